@@ -33,6 +33,9 @@
 
 #include "drivers/data_type.h"
 #include "infra/device.h"
+#ifdef CONFIG_SPI_FLASH_CACHE
+#include "util/flash_cache.h"
+#endif
 
 /**
  * @defgroup flash_spi_driver SPI Flash Driver
@@ -204,6 +207,48 @@ DRIVER_API_RC spi_flash_get_rdid(struct td_device *dev, uint32_t *rdid);
 DRIVER_API_RC spi_flash_ioctl(struct td_device *dev, uint32_t *result,
 			      uint8_t ioctl);
 
+/**
+ *  Start a session of SPI flash accesses
+ *
+ *  Each read, write or erase call wakes the flash up from deep power-down and
+ *  puts it back to sleep once done. Within a session, the flash and the
+ *  system are kept awake until spi_flash_session_end(), which saves two bus
+ *  transactions per call for a batch of small accesses.
+ *  Sessions can be nested, and accesses from other tasks remain allowed.
+ *
+ *  @param  dev      SPI flash device to use
+ *
+ *  @return  DRV_RC_OK on success else DRIVER_API_RC error code
+ */
+DRIVER_API_RC spi_flash_session_begin(struct td_device *dev);
+
+/**
+ *  End a session of SPI flash accesses
+ *
+ *  The flash is put back to deep power-down when the last session ends.
+ *
+ *  @param  dev      SPI flash device to use
+ *
+ *  @return  DRV_RC_OK on success else DRIVER_API_RC error code
+ */
+DRIVER_API_RC spi_flash_session_end(struct td_device *dev);
+
+#ifdef CONFIG_SPI_FLASH_CACHE
+/**
+ *  Get the statistics of the read cache of the SPI flash
+ *
+ *  Reads of at most CONFIG_SPI_FLASH_CACHE_LINE_SIZE bytes are served by a
+ *  cache of CONFIG_SPI_FLASH_CACHE_LINES lines, see @ref flash_cache.
+ *
+ *  @param  dev      SPI flash device to use
+ *  @param  stats    Pointer where to return the statistics
+ *
+ *  @return  DRV_RC_OK on success else DRIVER_API_RC error code
+ */
+DRIVER_API_RC spi_flash_get_cache_stats(struct td_device *		dev,
+					struct flash_cache_stats *	stats);
+#endif
+
 /*! Forward declaration for spi_flash drivers */
 struct spi_flash_driver;
 
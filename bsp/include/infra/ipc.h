@@ -172,6 +172,36 @@ void ipc_async_free_message(struct message *message);
  */
 void ipc_async_init(T_QUEUE queue);
 
+/** Statistics of the shared memory rings of the asynchronous messages */
+struct ipc_ring_stats {
+	uint32_t sent;          /*!< Messages pushed to the rings */
+	uint32_t frees;         /*!< Frees pushed to the rings */
+	uint32_t overflows;     /*!< Messages and frees which did not fit in
+	                         *   the rings, or sent without them */
+	uint32_t doorbells;     /*!< Requests notifying the other core */
+	uint32_t free_doorbells; /*!< Doorbells rung by a full batch of frees */
+	uint32_t free_timeouts; /*!< Doorbells rung by the frees waiting for
+	                         *   too long */
+	uint32_t received;      /*!< Messages and frees popped from the rings */
+	uint32_t rx_frees;      /*!< Frees popped from the rings */
+	uint32_t rx_doorbells;  /*!< Requests popping the rings */
+	uint32_t max_batch;     /*!< Maximum number popped for a request */
+};
+
+/**
+ * Get the statistics of the shared memory rings since boot.
+ *
+ * Messages sent by ipc_async_send_message() and frees requested by
+ * ipc_async_free_message() are pushed to rings in shared memory, the other
+ * core is notified by a synchronous request once per batch. The frees do not
+ * need to be handled at once: they wait for a batch of
+ * CONFIG_QUARK_SE_IPC_FREE_BATCH frees, for the next message to the other
+ * core, or at most CONFIG_QUARK_SE_IPC_FREE_DELAY_MS.
+ *
+ * @param stats Address where to return the statistics
+ */
+void ipc_ring_get_stats(struct ipc_ring_stats *stats);
+
 /**
  * Setup main queue and IPC for the application.
  *
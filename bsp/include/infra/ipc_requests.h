@@ -56,6 +56,10 @@
  * Set the MessageBox as synchronized.
  */
 #define IPC_MSG_TYPE_SYNC    0x3
+/**
+ * Messages and frees are pending in the shared memory rings.
+ */
+#define IPC_MSG_TYPE_RING    0x4
 
 /**
  * Allocate a port.
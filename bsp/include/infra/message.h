@@ -104,6 +104,7 @@ struct msg_flags {
 	uint16_t f_type : 2;            /*!< Type */
 	uint16_t f_queue_head : 1;      /*!< Insert at the queue head */
 	uint16_t f_is_job : 1;          /*!< Message is a job */
+	uint16_t f_shared : 1;          /*!< Shared message or reference to it */
 };
 
 /**
@@ -163,5 +164,66 @@ struct message *message_alloc(int size, OS_ERR_TYPE *err);
  */
 void message_free(struct message *message);
 
+/**
+ * Reference to a message shared by several destinations.
+ *
+ * A reference is a message header, with a null length, that is sent to one
+ * of the destinations instead of a copy of the shared message.
+ */
+struct message_ref {
+	/** Header of the reference, routed to one destination */
+	struct message m;
+	/** Shared message */
+	struct message *shared;
+};
+
+/**
+ * Share a copy of a message between several destinations.
+ *
+ * The message is copied once in a block also holding \c count references
+ * to the copy. The references are initialized with the header of the
+ * message: each one is sent with port_send_message() after setting its
+ * destination, and port_process_message() hands the shared copy to the
+ * destination handler.
+ *
+ * The shared copy is read-only, and its destination is the one of \c msg:
+ * a handler needing its own port must not read it from the message. It is
+ * freed when message_free() has been called once per reference, either on a
+ * reference which could not be delivered or on the copy by the handler which
+ * received it.
+ *
+ * Only destinations on the current CPU may be sent references.
+ *
+ * @param msg Message to share, left untouched.
+ * @param count Number of references to create.
+ * @param err Pointer where to return the return code.
+ *            If `err` is NULL, the function will panic in case of allocation
+ *            failure.
+ *
+ * @return Array of \c count references or
+ *         NULL if allocation failed and `err` != NULL
+ */
+struct message_ref *message_share(const struct message *msg, uint16_t count,
+				  OS_ERR_TYPE *err);
+
+/**
+ * Get the message to process for a received message.
+ *
+ * @param message Received message.
+ *
+ * @return The shared message if \c message is a reference to it,
+ *         \c message otherwise.
+ */
+struct message *message_deref(struct message *message);
+
+/**
+ * Release one reference to a shared message.
+ *
+ * The shared message is freed with its last reference.
+ *
+ * @param message Shared message or reference to it.
+ */
+void message_release(struct message *message);
+
 /** @} */
 #endif /* __INFRA_MESSAGE_H_ */
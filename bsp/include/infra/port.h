@@ -112,6 +112,11 @@ void port_process_message(struct message *msg);
 /**
  * Send a message to the destination port set in the message.
  *
+ * Messages are queued by decreasing MESSAGE_PRIO(). A CLASS_REPLACE or
+ * CLASS_NO_WAKE_REPLACE message replaces the pending message of the
+ * destination queue having the same class, identifier, source and
+ * destination; the replaced message is freed.
+ *
  * @param msg Message to send
  *
  * @return OS_ERR_TYPE error code
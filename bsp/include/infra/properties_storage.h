@@ -63,6 +63,8 @@ typedef enum {
 	PROPERTIES_STORAGE_IO_ERROR,            /*!< I/O error */
 	PROPERTIES_STORAGE_KEY_NOT_FOUND_ERROR, /*!< Key not found */
 	PROPERTIES_STORAGE_INVALID_ARG,         /*!< Invalid argument */
+	PROPERTIES_STORAGE_BUSY_ERROR,          /*!< Garbage collection in
+	                                         *   progress, retry */
 } properties_storage_status_t;
 
 /** Maximum size for the value of a property in byte */
@@ -102,6 +104,9 @@ void properties_storage_format_all(void);
  *  - PROPERTIES_STORAGE_BOUNDS_ERROR: Buffer length is larger than limit, or store
  *                                     is full
  *  - PROPERTIES_STORAGE_IO_ERROR:     Write failure, element is not stored
+ *  - PROPERTIES_STORAGE_BUSY_ERROR:   The garbage collection of obsolete
+ *                                     properties did not make room yet,
+ *                                     element is not stored
  *  - PROPERTIES_STORAGE_SUCCESS:      Store succeed
  */
 properties_storage_status_t properties_storage_set(
@@ -160,6 +165,92 @@ properties_storage_status_t properties_storage_get_info(
  */
 properties_storage_status_t properties_storage_delete(uint32_t key);
 
+/** Maximum size of the properties of a transaction in byte, counting an 8
+ * bytes header per property and the padding of its value to 4 bytes */
+#define PROPERTIES_STORAGE_MAX_TRANSACTION_LEN 256
+
+/**
+ * Start a transaction.
+ *
+ * The properties set by properties_storage_transaction_set() are written
+ * together by properties_storage_transaction_commit(): in case of power loss,
+ * either all of them or none are updated.
+ * Only one transaction can be in progress, any previous one is aborted.
+ *
+ * @param factory_reset_persistent Set to true to write the properties in the
+ * reset persistent partition, see properties_storage_set().
+ */
+void properties_storage_transaction_begin(bool factory_reset_persistent);
+
+/**
+ * Add a property to the transaction in progress.
+ *
+ * The value is copied, nothing is written until the commit.
+ *
+ * @param key Key of the property
+ * @param buf New value to store
+ * @param len Length of buf in bytes
+ *
+ * @return
+ *  - PROPERTIES_STORAGE_INVALID_ARG:  No transaction in progress, invalid len
+ *                                     or key already set in the transaction
+ *  - PROPERTIES_STORAGE_BOUNDS_ERROR: Transaction larger than
+ *                                     PROPERTIES_STORAGE_MAX_TRANSACTION_LEN
+ *  - PROPERTIES_STORAGE_SUCCESS:      Property added to the transaction
+ */
+properties_storage_status_t properties_storage_transaction_set(
+	uint32_t key, const uint8_t *buf, uint16_t len);
+
+/**
+ * Write the properties of the transaction in progress.
+ *
+ * The transaction is ended, whatever the result but
+ * PROPERTIES_STORAGE_BUSY_ERROR.
+ * This function blocks until completion.
+ *
+ * @return
+ *  - PROPERTIES_STORAGE_INVALID_ARG:  No transaction in progress
+ *  - PROPERTIES_STORAGE_BOUNDS_ERROR: Store is full, no property is updated
+ *  - PROPERTIES_STORAGE_BUSY_ERROR:   As for properties_storage_set(), no
+ *                                     property is updated, the transaction
+ *                                     can be committed again
+ *  - PROPERTIES_STORAGE_IO_ERROR:     Write failure
+ *  - PROPERTIES_STORAGE_SUCCESS:      All the properties are stored
+ */
+properties_storage_status_t properties_storage_transaction_commit(void);
+
+/**
+ * Drop the transaction in progress, if any.
+ */
+void properties_storage_transaction_abort(void);
+
+/** Garbage collection statistics */
+struct properties_storage_gc_stats {
+	uint32_t steps;            /*!< Steps of garbage collection run */
+	uint32_t erased_blocks;    /*!< Blocks reclaimed */
+	uint32_t sync_collections; /*!< Collections completed by a set, for
+	                            *   lack of spare blocks */
+};
+
+/**
+ * Run a step of the garbage collection of obsolete properties.
+ *
+ * A step copies at most one property, or the properties of one transaction,
+ * or erases one block. It is meant to be called when the storage is idle, so
+ * that properties_storage_set() finds erased blocks ready and does not need to
+ * reclaim obsolete properties itself, which bounds its latency.
+ *
+ * @return true if more garbage collection steps are pending
+ */
+bool properties_storage_gc_step(void);
+
+/**
+ * Get the garbage collection statistics since boot.
+ *
+ * @param stats Address where to return the statistics
+ */
+void properties_storage_get_gc_stats(struct properties_storage_gc_stats *stats);
+
 /** @} */
 
 #endif /* __PROPERTIES_STORAGE_H */
@@ -62,6 +62,8 @@
 typedef struct xloop {
 	T_QUEUE queue;
 	list_t delayed_items;
+	/** Handler of the messages, port_process_message() if NULL */
+	void (*process_message)(struct message *m);
 } xloop_t;
 
 /** A job that can be posted to a xloop */
@@ -85,6 +87,18 @@ typedef struct xloop_job {
  */
 void xloop_init_from_queue(xloop_t *l, T_QUEUE q);
 
+/**
+ * Set the handler of the messages received by an execution loop.
+ *
+ * By default the messages are passed to their port handler. A custom handler
+ * can defer or reorder them, it must eventually call port_process_message()
+ * for each of them.
+ * @param l Execution loop
+ * @param process_message Message handler, NULL to restore the default one
+ */
+void xloop_set_message_handler(xloop_t *l,
+			       void (*process_message)(struct message *m));
+
 /**
  * Start the execution loop.
  *
@@ -114,6 +128,20 @@ void xloop_post_message(xloop_t *l, struct message *m);
  */
 void xloop_post_job(xloop_t *l, xloop_job_t *j);
 
+/**
+ * Post a job on the xloop queue, failing instead of panicking when the queue
+ * is full.
+ *
+ * A job re-posting itself to the queue it is run from must use this function:
+ * the queue may have been filled by the messages received meanwhile.
+ *
+ * @param l xloop instance on which to post the job
+ * @param j Job to post on the xloop queue. It is not posted on error.
+ * @param err Set to E_OS_OK if the job is posted, to the error of the queue
+ * otherwise.
+ */
+void xloop_try_post_job(xloop_t *l, xloop_job_t *j, OS_ERR_TYPE *err);
+
 /**
  * Post a differed job on the xloop queue. The job is guaranteed to be run after
  * the passed time (but with an undetermined delay).
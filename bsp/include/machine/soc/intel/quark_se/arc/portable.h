@@ -78,4 +78,8 @@
 
 #define IRQ_ENABLED(flag) (flag & 0x10)
 
+/* The interrupt flags, as returned by irq_lock(), without locking */
+#define IRQ_FLAGS() \
+	((READ_ARC_REG(_ARC_V2_STATUS32) & _ARC_V2_STATUS32_IE) ? 0x10 : 0)
+
 #endif
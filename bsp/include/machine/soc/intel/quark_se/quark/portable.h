@@ -50,4 +50,11 @@
 
 #define IRQ_ENABLED(flag) (flag & 0x200)
 
+/* The interrupt flags, as returned by irq_lock(), without locking */
+#define IRQ_FLAGS() ({ \
+		uint32_t __flags; \
+		__asm__ volatile ("pushfl; popl %0" : "=g" (__flags)); \
+		__flags; \
+	})
+
 #endif
@@ -111,12 +111,19 @@ struct platform_shared_block_ {
 	 * checked it and decided to transition to deepsleep */
 	uint32_t soc_next_wakeup;
 
+	/** Inter-core message rings, allocated by QRK, NULL if not used */
+	void *ipc_rings;
+
 	/** reserved for user application */
 	uint8_t user_reverved;
 };
 
 #define RAM_START           0xA8000000
 
+/* Embedded flash, from where the code and constant data of both cores are read */
+#define ROM_START           0x40000000
+#define ROM_END             0x40060000
+
 static volatile struct platform_shared_block_ *const __unused shared_data =
 	(struct platform_shared_block_ *)RAM_START;
 static volatile uint32_t __unused *board_features =
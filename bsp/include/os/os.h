@@ -604,6 +604,11 @@ void enable_scheduling(void);
  * @ref queue_get_message       |     X     |     X     |           |
  * @ref queue_send_message      |     X     |     X     |     X     |
  * @ref queue_send_message_head |     X     |     X     |     X     |
+ * @ref queue_send_message_prio |     X     |     X     |     X     |
+ * @ref queue_replace_message   |     X     |     X     |     X     |
+ *
+ * Messages are dequeued by decreasing priority, and in sending order within
+ * a priority. @ref queue_send_message sends with the lowest priority (0).
  *
  * @{
  */
@@ -720,6 +725,73 @@ void queue_send_message(T_QUEUE queue, T_QUEUE_MESSAGE message,
 void queue_send_message_head(T_QUEUE queue, T_QUEUE_MESSAGE message,
 			     OS_ERR_TYPE *err);
 
+/**
+ * Send a message to a queue with a priority.
+ *
+ * Send/queue a message after all the pending messages of the same or higher
+ * priority, and before the ones of lower priority.
+ *
+ * @warning This service may panic if err parameter is NULL and:
+ * - queue parameter is invalid, or
+ * - the queue is already full.
+ *
+ * <b>Authorized execution levels:</b>  task, fiber, ISR.
+ *
+ * @param queue Handle of the queue (as returned by @ref queue_create).
+ *
+ * @param[in] message  Pointer to the message to send.
+ *
+ * @param prio Priority of the message, 0 being the lowest.
+ *
+ * @param[out] err   Execution status:
+ *          - E_OS_OK  The message was sent,
+ *          - E_OS_ERR_OVERFLOW The queue is full (message was not posted),
+ *          - E_OS_ERR Invalid parameter.
+ */
+void queue_send_message_prio(T_QUEUE queue, T_QUEUE_MESSAGE message,
+			     uint8_t prio, OS_ERR_TYPE *err);
+
+/**
+ * Message matching function used by @ref queue_replace_message.
+ *
+ * Called with interrupts locked, it must not block.
+ *
+ * @param pending Message pending in the queue.
+ * @param message Message being sent.
+ *
+ * @return true if \c message supersedes \c pending
+ */
+typedef bool (*T_QUEUE_MATCH)(T_QUEUE_MESSAGE pending,
+			      T_QUEUE_MESSAGE message);
+
+/**
+ * Send a message to a queue, replacing a pending one.
+ *
+ * If a pending message matches the new one, the new message takes its place
+ * in the queue and the pending one is returned to the caller, who owns it
+ * again. Otherwise the message is sent as with @ref queue_send_message_prio.
+ *
+ * <b>Authorized execution levels:</b>  task, fiber, ISR.
+ *
+ * @param queue Handle of the queue (as returned by @ref queue_create).
+ *
+ * @param[in] message  Pointer to the message to send.
+ *
+ * @param prio Priority of the message if it is not a replacement.
+ *
+ * @param match Function selecting the pending message to replace.
+ *
+ * @param[out] err   Execution status:
+ *          - E_OS_OK  The message was sent,
+ *          - E_OS_ERR_OVERFLOW The queue is full (message was not posted),
+ *          - E_OS_ERR Invalid parameter.
+ *
+ * @return The replaced message, NULL if none was replaced.
+ */
+T_QUEUE_MESSAGE queue_replace_message(T_QUEUE queue, T_QUEUE_MESSAGE message,
+				      uint8_t prio, T_QUEUE_MATCH match,
+				      OS_ERR_TYPE *err);
+
 /**
  * @}
  */
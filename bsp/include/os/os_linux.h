@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2016, Intel Corporation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __OS_LINUX_H__
+#define __OS_LINUX_H__
+
+#include "os/os.h"
+
+/**
+ * @defgroup os_linux_task Linux host tasks
+ * Extra services of the Linux OS abstraction layer.
+ *
+ * <table>
+ * <tr><th><b>Include file</b><td><tt> \#include "os/os_linux.h"</tt>
+ * <tr><th><b>Source path</b> <td><tt>bsp/src/os/linux</tt>
+ * </table>
+ *
+ * On a Linux host, the tasks of the framework are POSIX threads which may
+ * run concurrently on several cores. As there are no interrupts,
+ * irq_lock() takes a global recursive lock instead of masking interrupts,
+ * so that the code relying on it for mutual exclusion stays correct.
+ *
+ * @ingroup os
+ * @{
+ */
+
+/** Task handle */
+typedef void *T_TASK;
+
+/**
+ * Create and start a task.
+ *
+ * <b>Authorized execution levels:</b>  task.
+ *
+ * @param entry Entry point of the task.
+ * @param param Parameter passed to the entry point.
+ * @param[out] err Execution status:
+ *          - E_OS_OK  The task was started,
+ *          - E_OS_ERR_NO_MEMORY The task could not be created.
+ *
+ * @return Handle of the task, NULL on error.
+ */
+T_TASK task_create(T_ENTRY_POINT entry, void *param, OS_ERR_TYPE *err);
+
+/**
+ * Wait for the end of a task and release its resources.
+ *
+ * @param task Handle of the task (as returned by @ref task_create).
+ */
+void task_join(T_TASK task);
+
+/**
+ * Lock the global OS lock (interrupt lock emulation).
+ *
+ * Calls may be nested in the same task.
+ *
+ * @return key to pass to @ref irq_unlock
+ */
+unsigned int irq_lock(void);
+
+/**
+ * Unlock the global OS lock.
+ *
+ * @param key value returned by the matching @ref irq_lock
+ */
+void irq_unlock(unsigned int key);
+
+/** @} */
+
+#endif /* __OS_LINUX_H__ */
@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2016, Intel Corporation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BLOCK_ARENA_H__
+#define __BLOCK_ARENA_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "util/block_bitmap.h"
+
+/**
+ * @defgroup block_arena Fixed-block arena
+ * Allocator of fixed-size blocks carved from a single buffer, sorted in
+ * size tiers described by a table.
+ *
+ * <table>
+ * <tr><th><b>Include file</b><td><tt> \#include "util/block_arena.h"</tt>
+ * <tr><th><b>Source path</b> <td><tt>bsp/src/util</tt>
+ * </table>
+ *
+ * The tiers are laid out one after the other in the buffer, in the order of
+ * the table, which must be sorted by increasing block size. A request is
+ * served by the smallest tier which blocks are large enough, or by the next
+ * ones if that tier is full. Free blocks of a tier are found with the
+ * @ref block_bitmap shared with balloc, and the tier of a freed block is
+ * found from its address, so both operations are constant time for a given
+ * table.
+ *
+ * Each tier keeps usage statistics: current and maximum number of used
+ * blocks, number of allocations, number of requests it fitted best but that
+ * were served by a larger tier or failed because it was full, and the
+ * number of bytes of the used blocks left unused by the requests (internal
+ * fragmentation).
+ *
+ * None of these functions is reentrant, the caller must provide the locking.
+ *
+ * @ingroup util
+ * @{
+ */
+
+/** Statistics of an arena tier */
+struct block_arena_stats {
+	uint16_t used;           /* blocks in use */
+	uint16_t max_used;       /* high-water mark of used blocks */
+	uint32_t alloc_count;    /* blocks allocated from the tier */
+	uint32_t fallback_count; /* best fitting requests served by a larger tier */
+	uint32_t fail_count;     /* best fitting requests that failed */
+	uint32_t wasted;         /* unrequested bytes of the used blocks */
+};
+
+/** Tier of an arena, see @ref BLOCK_ARENA_TIER */
+struct block_arena_tier {
+	uint16_t block_size;
+	uint16_t count;
+	uint32_t *track;        /* block allocation tracker */
+	uint32_t *full;         /* full word tracker */
+	uint16_t *requested;    /* requested size of each used block */
+	uint8_t *start;         /* first block, set by block_arena_init() */
+	struct block_arena_stats stats;
+};
+
+/** Arena */
+struct block_arena {
+	uint8_t *buffer;
+	uint8_t tier_count;
+	struct block_arena_tier *tiers;
+};
+
+/**
+ * Initializer of an entry of a tier table, allocating the tracking arrays
+ * of the tier.
+ *
+ * @param size  size of the blocks of the tier, in bytes
+ * @param cnt   number of blocks of the tier
+ */
+#define BLOCK_ARENA_TIER(size, cnt) \
+	{ \
+		.block_size = (size), \
+		.count = (cnt), \
+		.track = (uint32_t[BLOCK_BITMAP_TRACK_WORDS(cnt)]){ 0 }, \
+		.full = (uint32_t[BLOCK_BITMAP_FULL_WORDS(cnt)]){ 0 }, \
+		.requested = (uint16_t[(cnt) + 1]){ 0 }, \
+	}
+
+/**
+ * Compute the size of the buffer of an arena.
+ *
+ * @param tiers      tier table
+ * @param tier_count number of tiers in the table
+ *
+ * @return size of the buffer, in bytes
+ */
+uint32_t block_arena_size(const struct block_arena_tier *tiers,
+			  uint8_t tier_count);
+
+/**
+ * Initialize an arena.
+ *
+ * All the blocks are released and the statistics are cleared.
+ *
+ * @param arena      arena to initialize
+ * @param buffer     buffer of at least @ref block_arena_size bytes
+ * @param tiers      tier table, sorted by increasing block size
+ * @param tier_count number of tiers in the table
+ */
+void block_arena_init(struct block_arena *arena, void *buffer,
+		      struct block_arena_tier *tiers, uint8_t tier_count);
+
+/**
+ * Allocate a block.
+ *
+ * @param arena arena to allocate from
+ * @param size  requested size, in bytes
+ *
+ * @return the block, NULL if no block of at least \c size bytes is free
+ */
+void *block_arena_alloc(struct block_arena *arena, uint32_t size);
+
+/**
+ * Release a block.
+ *
+ * @param arena arena the block was allocated from
+ * @param ptr   block to release
+ *
+ * @return 0 on success, -1 if \c ptr is not an allocated block of the arena
+ */
+int block_arena_free(struct block_arena *arena, void *ptr);
+
+/**
+ * Check if a pointer is a block of an arena.
+ *
+ * @param arena arena
+ * @param ptr   pointer to check
+ *
+ * @return true if \c ptr is the start of a block of the arena
+ */
+bool block_arena_owns(const struct block_arena *arena, const void *ptr);
+
+/**
+ * Clear the statistics of an arena.
+ *
+ * The number of used blocks and the wasted bytes are kept, the other
+ * counters are reset and the high-water marks set to the current usage.
+ *
+ * @param arena arena
+ */
+void block_arena_reset_stats(struct block_arena *arena);
+
+/** @} */
+
+#endif /* __BLOCK_ARENA_H__ */
@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2016, Intel Corporation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BLOCK_BITMAP_H__
+#define __BLOCK_BITMAP_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @defgroup block_bitmap Block allocation bitmap
+ * Two-level bitmap used to find a free block of a fixed-size pool in
+ * constant time.
+ *
+ * Each block of a pool is tracked by one bit of the \c track array, block 0
+ * being the most significant bit of the first word. A second \c full array
+ * holds one bit per \c track word, set when all 32 blocks of that word are
+ * reserved. Looking for a free block is then two count-leading-zeros
+ * operations instead of a walk over every block.
+ *
+ * Both arrays must be zero-initialized; no other setup is required. Padding
+ * bits past the last block are never reserved: a lookup landing on them means
+ * the pool is full.
+ *
+ * @ingroup util
+ * @{
+ */
+
+#define BLOCK_BITMAP_BITS 32U
+
+/** Number of words of the \c track array for a pool of \c count blocks */
+#define BLOCK_BITMAP_TRACK_WORDS(count) ((count) / BLOCK_BITMAP_BITS + 1)
+
+/** Number of words of the \c full array for a pool of \c count blocks */
+#define BLOCK_BITMAP_FULL_WORDS(count) \
+	(BLOCK_BITMAP_TRACK_WORDS(count) / BLOCK_BITMAP_BITS + 1)
+
+/** Mask of the bit tracking \c index within its word (MSB first) */
+#define BLOCK_BITMAP_MASK(index) \
+	(1U << (BLOCK_BITMAP_BITS - 1 - ((index) % BLOCK_BITMAP_BITS)))
+
+/**
+ * Reserve the first free block of a pool.
+ *
+ * This function is not reentrant, the caller must provide the locking.
+ *
+ * @param track block allocation tracker
+ * @param full  full word tracker
+ * @param count number of blocks in the pool
+ *
+ * @return index of the reserved block, or -1 if the pool is full
+ */
+static inline int32_t block_bitmap_alloc(uint32_t *track, uint32_t *full,
+					 uint16_t count)
+{
+	uint32_t word = 0;
+	uint32_t block;
+	uint32_t i;
+
+	/* first word having at least one free block */
+	for (i = 0; i < BLOCK_BITMAP_FULL_WORDS(count); i++) {
+		if (~full[i] != 0) {
+			word = i * BLOCK_BITMAP_BITS + __builtin_clz(~full[i]);
+			break;
+		}
+	}
+	if (i == BLOCK_BITMAP_FULL_WORDS(count) ||
+	    word >= BLOCK_BITMAP_TRACK_WORDS(count))
+		return -1;
+
+	block = word * BLOCK_BITMAP_BITS + __builtin_clz(~track[word]);
+	/* only padding bits are left */
+	if (block >= count)
+		return -1;
+
+	track[word] |= BLOCK_BITMAP_MASK(block);
+	if (track[word] == 0xFFFFFFFF)
+		full[word / BLOCK_BITMAP_BITS] |= BLOCK_BITMAP_MASK(word);
+
+	return block;
+}
+
+/**
+ * Release a block of a pool.
+ *
+ * This function is not reentrant, the caller must provide the locking.
+ *
+ * @param track block allocation tracker
+ * @param full  full word tracker
+ * @param block index of the block to release
+ */
+static inline void block_bitmap_free(uint32_t *track, uint32_t *full,
+				     uint16_t block)
+{
+	uint32_t word = block / BLOCK_BITMAP_BITS;
+
+	track[word] &= ~BLOCK_BITMAP_MASK(block);
+	full[word / BLOCK_BITMAP_BITS] &= ~BLOCK_BITMAP_MASK(word);
+}
+
+/**
+ * Test if a block of a pool is reserved.
+ *
+ * @param track block allocation tracker
+ * @param block index of the block to test
+ *
+ * @return true if the block is reserved
+ */
+static inline bool block_bitmap_used(const uint32_t *track, uint16_t block)
+{
+	return (track[block / BLOCK_BITMAP_BITS] & BLOCK_BITMAP_MASK(block)) !=
+	       0;
+}
+
+/** @} */
+
+#endif /* __BLOCK_BITMAP_H__ */
@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2016, Intel Corporation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __FLASH_CACHE_H__
+#define __FLASH_CACHE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @defgroup flash_cache Flash read cache
+ * Read-through cache of flash lines, for drivers of flashes that are slow
+ * to access.
+ *
+ * <table>
+ * <tr><th><b>Include file</b><td><tt> \#include "util/flash_cache.h"</tt>
+ * <tr><th><b>Source path</b> <td><tt>bsp/src/util</tt>
+ * </table>
+ *
+ * The cache keeps copies of aligned lines of the flash, replaced in least
+ * recently used order. A read that misses a line reads the whole line
+ * through the fill function of the driver, so that the next small reads of
+ * the same area (headers, status words) are served from RAM. Reads larger
+ * than a line bypass the cache, they are better done in one flash access.
+ *
+ * The cache is write-through: the driver writes the flash directly and
+ * invalidates the lines of the written or erased area, the cached lines are
+ * never more recent than the flash.
+ *
+ * None of these functions is reentrant, the caller must provide the locking.
+ *
+ * @ingroup util
+ * @{
+ */
+
+/** Statistics of a flash cache */
+struct flash_cache_stats {
+	uint32_t hits;          /* line lookups served from the cache */
+	uint32_t misses;        /* line lookups that filled a line */
+	uint32_t bypasses;      /* reads larger than a line */
+	uint32_t bytes_saved;   /* bytes read from the cache instead of the flash */
+	uint32_t bytes_filled;  /* bytes read from the flash to fill lines */
+	/* bytes_saved minus the bytes of the fills that were not requested,
+	 * negative when the cache reads more payload from the flash than it
+	 * saves. The command bytes of the saved transactions are not counted */
+	int32_t net_bytes_saved;
+	uint32_t invalidations; /* lines dropped by writes and erases */
+};
+
+/** Cached line */
+struct flash_cache_line {
+	uint32_t address;       /* flash address of the line */
+	uint32_t last_use;      /* date of the last access, for the LRU */
+	bool valid;
+};
+
+/** Flash cache */
+struct flash_cache {
+	struct flash_cache_line *lines;
+	uint8_t *data;          /* line_count * line_size bytes */
+	uint32_t line_count;
+	uint32_t line_size;     /* power of 2 */
+	uint32_t date;          /* access counter */
+	struct flash_cache_stats stats;
+};
+
+/**
+ * Read from the flash, called on a cache miss or bypass.
+ *
+ * @param priv    private data given to flash_cache_read()
+ * @param address flash address to read
+ * @param len     number of bytes to read
+ * @param buf     buffer where to store the read bytes
+ *
+ * @return 0 on success
+ */
+typedef int (*flash_cache_fill_t)(void *priv, uint32_t address, uint32_t len,
+				  uint8_t *buf);
+
+/**
+ * Initialize a flash cache, all lines are invalid.
+ *
+ * @param cache      cache to initialize
+ * @param lines      array of line_count lines
+ * @param data       buffer of line_count * line_size bytes
+ * @param line_count number of lines
+ * @param line_size  size of a line in bytes, must be a power of 2
+ */
+void flash_cache_init(struct flash_cache *cache, struct flash_cache_line *lines,
+		      uint8_t *data, uint32_t line_count, uint32_t line_size);
+
+/**
+ * Read from the flash through the cache.
+ *
+ * @param cache   flash cache
+ * @param address flash address to read
+ * @param len     number of bytes to read
+ * @param buf     buffer where to store the read bytes
+ * @param fill    function reading the flash
+ * @param priv    private data for fill
+ *
+ * @return 0 on success, else the error of fill
+ */
+int flash_cache_read(struct flash_cache *cache, uint32_t address, uint32_t len,
+		     uint8_t *buf, flash_cache_fill_t fill, void *priv);
+
+/**
+ * Invalidate the lines of a flash area, to be called when it is written or
+ * erased.
+ *
+ * @param cache   flash cache
+ * @param address first flash address of the area
+ * @param len     length of the area in bytes
+ */
+void flash_cache_invalidate(struct flash_cache *cache, uint32_t address,
+			    uint32_t len);
+
+/** @} */
+
+#endif /* __FLASH_CACHE_H__ */
@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2016, Intel Corporation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __MPSC_RING_H__
+#define __MPSC_RING_H__
+
+#include <stdint.h>
+#include <atomic.h>
+
+/**
+ * @defgroup mpsc_ring Multiple producers single consumer ring
+ * Lock-free ring of records written from any context of a core and read by
+ * a single consumer, the oldest records being overwritten when it is full.
+ *
+ * <table>
+ * <tr><th><b>Include file</b><td><tt> \#include "util/mpsc_ring.h"</tt>
+ * <tr><th><b>Source path</b> <td><tt>bsp/src/util</tt>
+ * </table>
+ *
+ * The ring is an array of slots of the same size. A writer reserves the
+ * slots of its record by advancing the head with a compare and swap, which
+ * also allocates a sequence number to the record. It then claims each slot
+ * by setting the position of the record and a writing flag in the sequence
+ * word of the slot, copies the record and commits it by clearing the flag.
+ * A slot still claimed by a writer lapped by the ring is not claimed again:
+ * the new record is dropped instead of being torn. The slots of a dropped
+ * record are committed without a record, by its writer or by the lapped
+ * writer, at the newest position reserved for them, so that the consumer
+ * skips them.
+ *
+ * The consumer reads a record if the sequence words of its slots hold its
+ * position, and checks them again after the copy: a record overwritten in
+ * the meantime is skipped. The gaps in the sequence numbers of the records
+ * give the number of records overwritten or dropped.
+ *
+ * A record not committed yet, or not claimed yet by its writer, blocks the
+ * consumer until its writer commits or drops it, or until the writers lap
+ * the ring.
+ *
+ * @ingroup util
+ * @{
+ */
+
+/** Number of bits of the positions of the slots */
+#define MPSC_RING_POS_BITS 16
+
+/** Header of a slot */
+struct mpsc_ring_slot {
+	atomic_t seq;           /* position << 1, bit 0 set while written */
+	uint8_t len;            /* length of the record, in its first slot */
+	uint8_t count;          /* slots of the record in its first slot, else 0 */
+	uint16_t record;        /* sequence number of the record */
+};
+
+/** Ring of records */
+struct mpsc_ring {
+	atomic_t head;          /* next position, and sequence number of the
+	                         * next record in the upper bits */
+	uint32_t tail;          /* next position to read, consumer only */
+	uint16_t next_record;   /* next record expected, consumer only */
+	uint16_t slot_size;     /* size of a slot, header included */
+	uint32_t count;         /* number of slots, power of 2 */
+	uint8_t *slots;
+};
+
+/**
+ * Initialize an empty ring.
+ *
+ * @param ring      ring to initialize
+ * @param buf       memory of the slots, 4 bytes aligned
+ * @param count     number of slots, must be a power of 2 lower than
+ *                  1 << (MPSC_RING_POS_BITS - 1)
+ * @param slot_size size of a slot, must be a multiple of 4 larger than
+ *                  struct mpsc_ring_slot
+ */
+void mpsc_ring_init(struct mpsc_ring *ring, uint8_t *buf, uint32_t count,
+		    uint16_t slot_size);
+
+/**
+ * Write a record, from any context.
+ *
+ * @param ring ring
+ * @param data record to write
+ * @param len  length of the record
+ *
+ * @return 0 if written, -1 if dropped because its slots are still written by
+ * lapped writers, or if it is larger than the ring
+ */
+int mpsc_ring_write(struct mpsc_ring *ring, const uint8_t *data, uint8_t len);
+
+/**
+ * Read the oldest record, called by the consumer.
+ *
+ * @param ring ring
+ * @param data buffer where to copy the record
+ * @param size size of data, a longer record is truncated
+ * @param lost address where to return the number of records overwritten or
+ *             dropped before this one, modulo 65536
+ *
+ * @return the length of the record copied, 0 if there is none to read
+ */
+int mpsc_ring_read(struct mpsc_ring *ring, uint8_t *data, uint8_t size,
+		   uint16_t *lost);
+
+/** @} */
+
+#endif /* __MPSC_RING_H__ */
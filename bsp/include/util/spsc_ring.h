@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2016, Intel Corporation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __SPSC_RING_H__
+#define __SPSC_RING_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @defgroup spsc_ring Single producer single consumer ring
+ * Lock-free ring of pointers between one producer and one consumer, which
+ * can run on different cores sharing the memory of the ring.
+ *
+ * <table>
+ * <tr><th><b>Include file</b><td><tt> \#include "util/spsc_ring.h"</tt>
+ * <tr><th><b>Source path</b> <td><tt>bsp/src/util</tt>
+ * </table>
+ *
+ * The head is only written by the producer and the tail only by the
+ * consumer, each one reading the index of the other to know the number of
+ * used slots. The indexes run freely and are masked by the size of the ring,
+ * a power of 2, so that all the slots are used.
+ *
+ * The ordering of the accesses relies on compiler barriers only: the shared
+ * memory must not be cached and the cores must not reorder their accesses
+ * to it, as on Quark SE.
+ *
+ * Pushing from several contexts of a core, or popping, needs the caller to
+ * serialize these contexts.
+ *
+ * @ingroup util
+ * @{
+ */
+
+/** Ring of pointers */
+struct spsc_ring {
+	volatile uint32_t head; /* next slot to push, written by the producer */
+	volatile uint32_t tail; /* next slot to pop, written by the consumer */
+	uint32_t size;          /* number of slots, power of 2 */
+	void **slots;
+};
+
+/**
+ * Initialize an empty ring.
+ *
+ * @param ring  ring to initialize
+ * @param slots array of size pointers
+ * @param size  number of slots, must be a power of 2
+ */
+void spsc_ring_init(struct spsc_ring *ring, void **slots, uint32_t size);
+
+/**
+ * Push a pointer, called by the producer.
+ *
+ * @param ring ring
+ * @param ptr  pointer to push
+ *
+ * @return false if the ring is full
+ */
+bool spsc_ring_push(struct spsc_ring *ring, void *ptr);
+
+/**
+ * Pop the oldest pointer, called by the consumer.
+ *
+ * @param ring ring
+ *
+ * @return the pointer, NULL if the ring is empty
+ */
+void *spsc_ring_pop(struct spsc_ring *ring);
+
+/**
+ * Get the number of used slots.
+ *
+ * The result is exact for the producer or the consumer, and a snapshot for
+ * any other context.
+ *
+ * @param ring ring
+ *
+ * @return the number of pointers in the ring
+ */
+static inline uint32_t spsc_ring_count(const struct spsc_ring *ring)
+{
+	return ring->head - ring->tail;
+}
+
+/** @} */
+
+#endif /* __SPSC_RING_H__ */
@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2016, Intel Corporation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __TIMER_WHEEL_H__
+#define __TIMER_WHEEL_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @defgroup timer_wheel Timer wheel
+ * Hierarchical timing wheel used by the OS abstraction timers.
+ *
+ * <table>
+ * <tr><th><b>Include file</b><td><tt> \#include "util/timer_wheel.h"</tt>
+ * <tr><th><b>Source path</b> <td><tt>bsp/src/util</tt>
+ * </table>
+ *
+ * Pending timers are hashed by expiration date (in ms) on
+ * @ref TIMER_WHEEL_LEVELS levels of @ref TIMER_WHEEL_SLOTS slots. A timer
+ * is stored on the level of the most significant digit in which its
+ * expiration differs from the wheel current time, so that starting or
+ * stopping a timer is done in constant time. When the wheel is advanced,
+ * the slots of the upper levels are cascaded to the lower ones and the due
+ * timers of level 0 are moved to an expired list, in expiration order.
+ *
+ * Expiration dates are compared to the current time by their signed
+ * difference, so that timers may expire after the 32 bits wrap of the uptime
+ * in ms; the sorted list it replaces compared them as absolute uptime values.
+ * A timer must expire less than 2^31 ms (about 24 days) ahead.
+ *
+ * None of these functions is reentrant, the caller must provide the locking.
+ *
+ * @ingroup infra
+ * @{
+ */
+
+/** Number of bits of the expiration date handled by a level */
+#define TIMER_WHEEL_BITS 4
+/** Number of slots of a level */
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+/** Number of levels required to cover 32 bits expiration dates */
+#define TIMER_WHEEL_LEVELS (32 / TIMER_WHEEL_BITS)
+
+/** Timer wheel element, to be embedded in the timer structure */
+struct timer_wheel_node {
+	struct timer_wheel_node *next;
+	struct timer_wheel_node *prev;
+	uint32_t expiration;    /* expiration date, in ms */
+	uint8_t level;          /* level, expired list or idle */
+	uint8_t slot;           /* slot within the level */
+};
+
+/** Timer wheel */
+struct timer_wheel {
+	uint32_t now;           /* date the wheel was last advanced to */
+	uint16_t occupied[TIMER_WHEEL_LEVELS]; /* one bit per non empty slot */
+	struct timer_wheel_node *slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+	struct timer_wheel_node *expired;
+};
+
+/**
+ * Initialize a timer wheel.
+ *
+ * @param wheel timer wheel to initialize
+ * @param now   current date, in ms
+ */
+void timer_wheel_init(struct timer_wheel *wheel, uint32_t now);
+
+/**
+ * Initialize a timer wheel element, as not pending.
+ *
+ * @param node element to initialize
+ */
+void timer_wheel_node_init(struct timer_wheel_node *node);
+
+/**
+ * Add a timer to the wheel.
+ *
+ * A timer which expiration date is already passed is due on the next
+ * call to @ref timer_wheel_advance.
+ *
+ * @param wheel      timer wheel
+ * @param node       element of the timer, must not be pending
+ * @param expiration expiration date, in ms
+ */
+void timer_wheel_add(struct timer_wheel *wheel, struct timer_wheel_node *node,
+		     uint32_t expiration);
+
+/**
+ * Remove a timer from the wheel or from its expired list.
+ *
+ * Nothing is done if the timer is not pending.
+ *
+ * @param wheel timer wheel
+ * @param node  element of the timer
+ */
+void timer_wheel_remove(struct timer_wheel *wheel,
+			struct timer_wheel_node *node);
+
+/**
+ * Check if a timer is in the wheel or in its expired list.
+ *
+ * @param node element of the timer
+ *
+ * @return true if the timer is pending
+ */
+bool timer_wheel_pending(const struct timer_wheel_node *node);
+
+/**
+ * Advance the wheel to the current date.
+ *
+ * All the timers which expiration date is before or equal to \c now are
+ * moved to the expired list.
+ *
+ * @param wheel timer wheel
+ * @param now   current date, in ms
+ */
+void timer_wheel_advance(struct timer_wheel *wheel, uint32_t now);
+
+/**
+ * Get the first timer of the expired list.
+ *
+ * The timer is removed from the list and is no longer pending.
+ *
+ * @param wheel timer wheel
+ *
+ * @return element of the timer, NULL if the list is empty
+ */
+struct timer_wheel_node *timer_wheel_get_expired(struct timer_wheel *wheel);
+
+/**
+ * Get the expiration date of the next timer to expire.
+ *
+ * @param wheel           timer wheel
+ * @param[out] expiration next expiration date, in ms, not before the date
+ *                        the wheel was last advanced to
+ *
+ * @return false if no timer is pending
+ */
+bool timer_wheel_next_expiration(struct timer_wheel *wheel,
+				 uint32_t *expiration);
+
+/** @} */
+
+#endif /* __TIMER_WHEEL_H__ */
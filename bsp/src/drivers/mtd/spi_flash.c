@@ -37,6 +37,10 @@
 #include "infra/log.h"  /* For logger */
 
 #include "drivers/serial_bus_access.h"
+#ifdef CONFIG_SPI_FLASH_CACHE
+#include "util/flash_cache.h"
+#include "util/misc.h"
+#endif
 
 #define GET_SPI_FLASH_INFO(_dev) \
 	(&(((const struct spi_flash_driver *)_dev->driver)->info))
@@ -55,9 +59,22 @@ struct driver_data {
 	T_SEMAPHORE spi_sync_sem;               /*!< Semaphore to wait for and spi transfer to complete */
 	T_MUTEX device_mtx;                     /*!< Device in use mutex */
 	struct pm_wakelock wakelock;            /*!< wakelock */
+	uint8_t sessions;                       /*!< Number of sessions keeping the flash awake */
+#ifdef CONFIG_SPI_FLASH_CACHE
+	struct flash_cache cache;               /*!< Cache of the small reads */
+	struct flash_cache_line cache_lines[CONFIG_SPI_FLASH_CACHE_LINES];
+	uint8_t cache_data[CONFIG_SPI_FLASH_CACHE_LINES *
+			   CONFIG_SPI_FLASH_CACHE_LINE_SIZE];
+#endif
 	uint8_t tx_buffer[];                    /*!< Buffer used to store tx data during write operation */
 };
 
+#ifdef CONFIG_SPI_FLASH_CACHE
+/* The cache finds the line of an address by masking it with the line size */
+STATIC_ASSERT((CONFIG_SPI_FLASH_CACHE_LINE_SIZE &
+	       (CONFIG_SPI_FLASH_CACHE_LINE_SIZE - 1)) == 0);
+#endif
+
 /*! Erase operations list */
 typedef enum {
 	ER_SECTOR,      /*!< Erase sector */
@@ -116,6 +133,12 @@ int spi_flash_init(struct td_device *device)
 	flash_dev->req.request_type = SBA_TRANSFER;
 	flash_dev->req.addr.cs = dev->addr.cs;
 	flash_dev->req.full_duplex = 0;
+	flash_dev->sessions = 0;
+#ifdef CONFIG_SPI_FLASH_CACHE
+	flash_cache_init(&flash_dev->cache, flash_dev->cache_lines,
+			 flash_dev->cache_data, CONFIG_SPI_FLASH_CACHE_LINES,
+			 CONFIG_SPI_FLASH_CACHE_LINE_SIZE);
+#endif
 
 	/* Link driver priv data to device */
 	device->priv = flash_dev;
@@ -213,26 +236,68 @@ static DRIVER_API_RC spi_flash_sleep(struct td_device *dev, bool on)
 #endif
 }
 
+/* Wake the flash up, unless a session keeps it awake */
+static DRIVER_API_RC spi_flash_wakeup(struct td_device *dev)
+{
+	DRIVER_API_RC ret;
+	struct driver_data *flash_dev = (struct driver_data *)dev->priv;
+
+	if (flash_dev->sessions)
+		return DRV_RC_OK;
+
+	pm_wakelock_acquire(&flash_dev->wakelock);
+	if ((ret = spi_flash_sleep(dev, true)) != DRV_RC_OK)
+		pm_wakelock_release(&flash_dev->wakelock);
+	return ret;
+}
+
+/* Put the flash to sleep, unless a session is in progress */
+static void spi_flash_idle(struct td_device *dev)
+{
+	struct driver_data *flash_dev = (struct driver_data *)dev->priv;
+
+	if (flash_dev->sessions)
+		return;
+
+	spi_flash_sleep(dev, false);
+	pm_wakelock_release(&flash_dev->wakelock);
+}
+
+/* Take the device and wake the flash up */
+static DRIVER_API_RC spi_flash_acquire(struct td_device *dev)
+{
+	DRIVER_API_RC ret;
+	struct driver_data *flash_dev = (struct driver_data *)dev->priv;
+
+	/* Take spi device mutex */
+	if (mutex_lock(flash_dev->device_mtx, DEVICE_MUTEX_DELAY) != E_OS_OK)
+		return DRV_RC_FAIL;
+	if ((ret = spi_flash_wakeup(dev)) != DRV_RC_OK)
+		mutex_unlock(flash_dev->device_mtx);
+	return ret;
+}
+
+/* Put the flash to sleep and give the device */
+static void spi_flash_release(struct td_device *dev)
+{
+	struct driver_data *flash_dev = (struct driver_data *)dev->priv;
+
+	spi_flash_idle(dev);
+	/* Give device mutex */
+	mutex_unlock(flash_dev->device_mtx);
+}
+
 DRIVER_API_RC spi_flash_get_rdid(struct td_device *dev, uint32_t *rdid)
 {
 	uint8_t command;
 	DRIVER_API_RC ret;
-	OS_ERR_TYPE ret_os;
 	struct driver_data *flash_dev = (struct driver_data *)dev->priv;
 	const struct spi_flash_info *info = GET_SPI_FLASH_INFO(dev);
 
 	if (!flash_dev->is_init)
 		return DRV_RC_INVALID_OPERATION;
-	/* Take spi device mutex */
-	if ((ret_os =
-		     mutex_lock(flash_dev->device_mtx,
-				DEVICE_MUTEX_DELAY)) != E_OS_OK) {
-		return DRV_RC_FAIL;
-	}
-	pm_wakelock_acquire(&flash_dev->wakelock);
-	/* wake up the flash */
-	if ((ret = spi_flash_sleep(dev, true)) != DRV_RC_OK)
-		goto exit_mutex;
+	if ((ret = spi_flash_acquire(dev)) != DRV_RC_OK)
+		return ret;
 
 	flash_dev->req.tx_len = 1;
 	flash_dev->req.tx_buff = &command;
@@ -243,12 +308,7 @@ DRIVER_API_RC spi_flash_get_rdid(struct td_device *dev, uint32_t *rdid)
 	*rdid = 0;
 	ret = spi_sync(dev, &flash_dev->req);
 
-	/* put the flash to sleep */
-	spi_flash_sleep(dev, false);
-exit_mutex:
-	/* Give device mutex */
-	pm_wakelock_release(&flash_dev->wakelock);
-	mutex_unlock(flash_dev->device_mtx);
+	spi_flash_release(dev);
 	return ret;
 }
 
@@ -315,15 +375,70 @@ static DRIVER_API_RC spi_flash_write_enable(struct td_device *dev)
 	return (status & info->status_wel_bit) ? DRV_RC_OK : DRV_RC_FAIL;
 }
 
+/* Read data, the device must be taken and the flash awake */
+static DRIVER_API_RC spi_flash_read_data(struct td_device *dev,
+					 uint32_t address, unsigned int len,
+					 uint8_t *data)
+{
+	struct driver_data *flash_dev = (struct driver_data *)dev->priv;
+	const struct spi_flash_info *info = GET_SPI_FLASH_INFO(dev);
+	/* Command, address and dummy bytes of the fast read */
+	uint8_t command[8];
+	uint32_t command_len = 4;
+
+#ifdef CONFIG_SPI_FLASH_FAST_READ
+	/* The flash outputs the data after the dummy bytes, whatever their
+	 * value */
+	command[0] = info->cmd_fast_read;
+	command_len += info->fast_read_dummy_bytes;
+#else
+	command[0] = info->cmd_read;
+#endif
+	command[1] = (uint8_t)(address >> 16);
+	command[2] = (uint8_t)(address >> 8);
+	command[3] = (uint8_t)address;
+
+	flash_dev->req.tx_len = command_len;
+	flash_dev->req.tx_buff = command;
+	flash_dev->req.rx_len = len;
+	flash_dev->req.rx_buff = data;
+
+	/* TODO: use DMA if transfer is too long */
+	return spi_sync(dev, &flash_dev->req);
+}
+
+#ifdef CONFIG_SPI_FLASH_CACHE
+/* Context of the cache fills of a read */
+struct spi_flash_fill {
+	struct td_device *dev;
+	bool awake;             /*!< Flash woken up by a fill */
+	DRIVER_API_RC ret;
+};
+
+/* Read from the flash on a cache miss, the flash is woken up on the first
+ * one only, the reads served by the cache do not access the bus */
+static int spi_flash_cache_fill(void *priv, uint32_t address, uint32_t len,
+				uint8_t *buf)
+{
+	struct spi_flash_fill *fill = priv;
+
+	if (!fill->awake) {
+		if ((fill->ret = spi_flash_wakeup(fill->dev)) != DRV_RC_OK)
+			return -1;
+		fill->awake = true;
+	}
+	fill->ret = spi_flash_read_data(fill->dev, address, len, buf);
+	return fill->ret == DRV_RC_OK ? 0 : -1;
+}
+#endif
+
 DRIVER_API_RC spi_flash_read_byte(struct td_device *dev, uint32_t address,
 				  unsigned int len, unsigned int *retlen,
 				  uint8_t *data)
 {
 	DRIVER_API_RC ret = DRV_RC_OK;
-	OS_ERR_TYPE ret_os;
 	struct driver_data *flash_dev = (struct driver_data *)dev->priv;
 	const struct spi_flash_info *info = GET_SPI_FLASH_INFO(dev);
-	uint8_t command[4];
 
 	*retlen = 0;
 
@@ -334,38 +449,30 @@ DRIVER_API_RC spi_flash_read_byte(struct td_device *dev, uint32_t address,
 		return DRV_RC_OUT_OF_MEM;
 
 	/* Take spi device mutex */
-	if ((ret_os =
-		     mutex_lock(flash_dev->device_mtx,
-				DEVICE_MUTEX_DELAY)) != E_OS_OK) {
+	if (mutex_lock(flash_dev->device_mtx, DEVICE_MUTEX_DELAY) != E_OS_OK)
 		return DRV_RC_FAIL;
-	}
-	pm_wakelock_acquire(&flash_dev->wakelock);
 
-	/* wake up the flash */
-	if ((ret = spi_flash_sleep(dev, true)) != DRV_RC_OK)
-		goto exit_mutex;
-
-	command[0] = info->cmd_read;
-	command[1] = (uint8_t)(address >> 16);
-	command[2] = (uint8_t)(address >> 8);
-	command[3] = (uint8_t)address;
+#ifdef CONFIG_SPI_FLASH_CACHE
+	struct spi_flash_fill fill = { .dev = dev, .awake = false,
+				       .ret = DRV_RC_OK };
 
-	flash_dev->req.tx_len = 4;
-	flash_dev->req.tx_buff = command;
-	flash_dev->req.rx_len = len;
-	flash_dev->req.rx_buff = data;
-
-	/* TODO: use DMA if transfer is too long */
-	if ((ret = spi_sync(dev, &flash_dev->req)) == DRV_RC_OK) {
-		/* TODO: sba does not provide a retlen data (could be done through request.rx_len) */
-		/*       so we set retlen to len if success else 0 */
-		*retlen = len;
+	flash_cache_read(&flash_dev->cache, address, len, data,
+			 spi_flash_cache_fill, &fill);
+	ret = fill.ret;
+	if (fill.awake)
+		spi_flash_idle(dev);
+#else
+	if ((ret = spi_flash_wakeup(dev)) == DRV_RC_OK) {
+		ret = spi_flash_read_data(dev, address, len, data);
+		spi_flash_idle(dev);
 	}
-	/* put the flash to sleep */
-	spi_flash_sleep(dev, false);
-exit_mutex:
+#endif
+	/* TODO: sba does not provide a retlen data (could be done through request.rx_len) */
+	/*       so we set retlen to len if success else 0 */
+	if (ret == DRV_RC_OK)
+		*retlen = len;
+
 	/* Give device mutex */
-	pm_wakelock_release(&flash_dev->wakelock);
 	mutex_unlock(flash_dev->device_mtx);
 	return ret;
 }
@@ -382,14 +489,24 @@ DRIVER_API_RC spi_flash_read(struct td_device *dev, uint32_t address,
 	return ret;
 }
 
+/* Fill the tx buffer with the address and data of a page program */
+static void spi_flash_set_page(struct driver_data *flash_dev, uint32_t address,
+			       const uint8_t *data, unsigned int count)
+{
+	flash_dev->tx_buffer[1] = (uint8_t)(address >> 16);
+	flash_dev->tx_buffer[2] = (uint8_t)(address >> 8);
+	flash_dev->tx_buffer[3] = (uint8_t)address;
+	memcpy((uint8_t *)(flash_dev->tx_buffer) + 4, data, count);
+}
+
 DRIVER_API_RC spi_flash_write_byte(struct td_device *dev, uint32_t address,
 				   unsigned int len, unsigned int *retlen,
 				   uint8_t *data)
 {
 	DRIVER_API_RC ret = DRV_RC_OK;
-	OS_ERR_TYPE ret_os;
 	struct driver_data *flash_dev = (struct driver_data *)dev->priv;
 	const struct spi_flash_info *info = GET_SPI_FLASH_INFO(dev);
+	unsigned int count, next_count;
 	uint8_t status;
 
 	*retlen = 0;
@@ -400,89 +517,68 @@ DRIVER_API_RC spi_flash_write_byte(struct td_device *dev, uint32_t address,
 	if ((len + address) > info->flash_size)
 		return DRV_RC_OUT_OF_MEM;
 
-	/* Take spi device mutex */
-	if ((ret_os =
-		     mutex_lock(flash_dev->device_mtx,
-				DEVICE_MUTEX_DELAY)) != E_OS_OK) {
-		return DRV_RC_FAIL;
-	}
-	pm_wakelock_acquire(&flash_dev->wakelock);
-
-	/* wake up the flash */
-	if ((ret = spi_flash_sleep(dev, true)) != DRV_RC_OK)
-		goto exit_mutex;
-
-	*retlen = len;
+	if ((ret = spi_flash_acquire(dev)) != DRV_RC_OK)
+		return ret;
+#ifdef CONFIG_SPI_FLASH_CACHE
+	flash_cache_invalidate(&flash_dev->cache, address, len);
+#endif
 
 	/* We can only program a page with PP command so we use several write operations */
-	unsigned int count; /* Byte count to write for next program operation */
 	count = info->page_size - (address & (info->page_size - 1));
 	if (count > len)
 		count = len;
 
 	flash_dev->tx_buffer[0] = info->cmd_page_program;
+	spi_flash_set_page(flash_dev, address, data, count);
 
 	/* Loop on pages to program */
-	for (;
-	     len;
-	     address += count,
-	     data += count, count =
-		     ((len -= count) >
-		      info->page_size ? info->page_size : len)) {
+	while (count) {
 		/* Enable write operation */
-		if ((ret = spi_flash_write_enable(dev)) != DRV_RC_OK) {
-			*retlen -= len;
-			goto exit_wakeup;
-		}
+		if ((ret = spi_flash_write_enable(dev)) != DRV_RC_OK)
+			goto exit_release;
 
-		/* Set data for write operation */
-		memcpy((uint8_t *)(flash_dev->tx_buffer) + 4, data, count);
 		flash_dev->req.tx_len = count + 4;
 		flash_dev->req.tx_buff = flash_dev->tx_buffer;
 		flash_dev->req.rx_len = 0;
 		flash_dev->req.rx_buff = NULL;
 
-		flash_dev->tx_buffer[1] = (uint8_t)(address >> 16);
-		flash_dev->tx_buffer[2] = (uint8_t)(address >> 8);
-		flash_dev->tx_buffer[3] = (uint8_t)address;
+		if ((ret = spi_sync(dev, &flash_dev->req)) != DRV_RC_OK)
+			goto exit_release;
 
-		if ((ret = spi_sync(dev, &flash_dev->req)) != DRV_RC_OK) {
-			*retlen -= len;
-			goto exit_wakeup;
-		}
+		/* The tx buffer is free once the page program command is sent:
+		 * prepare the next page while the flash programs this one */
+		address += count;
+		data += count;
+		len -= count;
+		next_count = len > info->page_size ? info->page_size : len;
+		if (next_count)
+			spi_flash_set_page(flash_dev, address, data, next_count);
 
 		/* loop until the write operation is complete */
 		do {
 			if ((ret =
 				     spi_flash_get_status(dev,
 							  &status)) !=
-			    DRV_RC_OK) {
+			    DRV_RC_OK)
 				/* Error detected */
-				*retlen -= len;
-				goto exit_wakeup;
-			}
+				goto exit_release;
 		} while (status & info->status_wip_bit);
 
 		/* Check for success */
-		if ((ret = spi_flash_get_rdscur(dev, &status)) != DRV_RC_OK) {
+		if ((ret = spi_flash_get_rdscur(dev, &status)) != DRV_RC_OK)
 			/* Error detected */
-			*retlen -= len;
-			goto exit_wakeup;
-		}
+			goto exit_release;
 		if (status & info->status_secr_pfail_bit) {
 			/* Write failed */
 			ret = DRV_RC_CHECK_FAIL;
-			*retlen -= len;
-			goto exit_wakeup;
+			goto exit_release;
 		}
+		*retlen += count;
+		count = next_count;
 	}
 
-exit_wakeup:
-	spi_flash_sleep(dev, false);
-exit_mutex:
-	/* Give device mutex */
-	pm_wakelock_release(&flash_dev->wakelock);
-	mutex_unlock(flash_dev->device_mtx);
+exit_release:
+	spi_flash_release(dev);
 	return ret;
 }
 
@@ -549,17 +645,12 @@ static DRIVER_API_RC spi_flash_erase(struct td_device *dev, ER_TYPE er_type,
 	if ((count + start) > er_count)
 		return DRV_RC_OUT_OF_MEM;
 
-	/* Take spi device mutex */
-	if ((ret_os =
-		     mutex_lock(flash_dev->device_mtx,
-				DEVICE_MUTEX_DELAY)) != E_OS_OK) {
-		return DRV_RC_FAIL;
-	}
-	pm_wakelock_acquire(&flash_dev->wakelock);
-
-	/* wake up the flash */
-	if ((ret = spi_flash_sleep(dev, true)) != DRV_RC_OK)
-		goto exit_mutex;
+	if ((ret = spi_flash_acquire(dev)) != DRV_RC_OK)
+		return ret;
+#ifdef CONFIG_SPI_FLASH_CACHE
+	flash_cache_invalidate(&flash_dev->cache, er_size * start,
+			       er_size * count);
+#endif
 	/* TODO: Check write protection */
 	for (count += start; start < count; start++) {
 		uint32_t address = er_size * start;
@@ -614,11 +705,7 @@ static DRIVER_API_RC spi_flash_erase(struct td_device *dev, ER_TYPE er_type,
 		}
 	}
 exit_wakeup:
-	spi_flash_sleep(dev, false);
-exit_mutex:
-	/* Give device mutex */
-	pm_wakelock_release(&flash_dev->wakelock);
-	mutex_unlock(flash_dev->device_mtx);
+	spi_flash_release(dev);
 	return ret;
 }
 
@@ -676,3 +763,51 @@ DRIVER_API_RC spi_flash_chip_erase(struct td_device *dev)
 {
 	return spi_flash_erase(dev, ER_CHIP, 0, 1);
 }
+
+DRIVER_API_RC spi_flash_session_begin(struct td_device *dev)
+{
+	DRIVER_API_RC ret;
+	struct driver_data *flash_dev = (struct driver_data *)dev->priv;
+
+	if (!flash_dev->is_init)
+		return DRV_RC_INVALID_OPERATION;
+	if ((ret = spi_flash_acquire(dev)) != DRV_RC_OK)
+		return ret;
+	/* Keep the flash awake until the last session ends */
+	flash_dev->sessions++;
+	mutex_unlock(flash_dev->device_mtx);
+	return DRV_RC_OK;
+}
+
+DRIVER_API_RC spi_flash_session_end(struct td_device *dev)
+{
+	struct driver_data *flash_dev = (struct driver_data *)dev->priv;
+
+	if (!flash_dev->is_init)
+		return DRV_RC_INVALID_OPERATION;
+	if (mutex_lock(flash_dev->device_mtx, DEVICE_MUTEX_DELAY) != E_OS_OK)
+		return DRV_RC_FAIL;
+	if (!flash_dev->sessions) {
+		mutex_unlock(flash_dev->device_mtx);
+		return DRV_RC_INVALID_OPERATION;
+	}
+	flash_dev->sessions--;
+	spi_flash_release(dev);
+	return DRV_RC_OK;
+}
+
+#ifdef CONFIG_SPI_FLASH_CACHE
+DRIVER_API_RC spi_flash_get_cache_stats(struct td_device *		dev,
+					struct flash_cache_stats *	stats)
+{
+	struct driver_data *flash_dev = (struct driver_data *)dev->priv;
+
+	if (!flash_dev->is_init)
+		return DRV_RC_INVALID_OPERATION;
+	if (mutex_lock(flash_dev->device_mtx, DEVICE_MUTEX_DELAY) != E_OS_OK)
+		return DRV_RC_FAIL;
+	*stats = flash_dev->cache.stats;
+	mutex_unlock(flash_dev->device_mtx);
+	return DRV_RC_OK;
+}
+#endif
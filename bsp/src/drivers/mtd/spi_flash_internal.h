@@ -57,6 +57,8 @@ struct spi_flash_info {
 	uint32_t cmd_write_en;
 	uint32_t cmd_page_program;
 	uint32_t cmd_read;
+	uint32_t cmd_fast_read;
+	uint32_t fast_read_dummy_bytes;
 	uint32_t cmd_sector_erase;
 	uint32_t cmd_block_erase;
 	uint32_t cmd_large_block_erase;
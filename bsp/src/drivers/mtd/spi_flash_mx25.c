@@ -54,6 +54,8 @@
 			.cmd_write_en = FLASH_CMD_WREN,	\
 			.cmd_page_program = FLASH_CMD_PP, \
 			.cmd_read = FLASH_CMD_READ, \
+			.cmd_fast_read = FLASH_CMD_FASTREAD, \
+			.fast_read_dummy_bytes = 1, \
 			.cmd_sector_erase = FLASH_CMD_SE, \
 			.cmd_block_erase = FLASH_CMD_BE32K, \
 			.cmd_large_block_erase = FLASH_CMD_BE, \
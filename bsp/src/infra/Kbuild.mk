@@ -1,6 +1,7 @@
 obj-$(CONFIG_IPC) += ipc_callback.o
 obj-y += panic.o
 obj-$(CONFIG_LOG_CBUFFER) += log_impl_cbuffer.o
+obj-$(CONFIG_LOG_CBUFFER_BINARY) += log_binary.o
 obj-$(CONFIG_LOG_PRINTK)  += log_impl_printk.o
 obj-$(CONFIG_LOG_PRINTF)  += log_impl_printf.o
 obj-$(CONFIG_TCMD) += tcmd/
@@ -13,6 +14,7 @@ obj-y += log.o
 obj-y += log_impl.o
 obj-$(CONFIG_VERSION) += version.o
 obj-y += port.o
+obj-y += message_shared.o
 obj-$(CONFIG_CONSOLE_MANAGER)  += console_manager.o
 obj-$(CONFIG_CONSOLE_BACKEND_UART)     += console_backend_uart.o
 obj-$(CONFIG_CONSOLE_BACKEND_USB_ACM)  += console_backend_usb_acm.o
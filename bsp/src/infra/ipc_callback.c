@@ -95,14 +95,15 @@ int ipc_sync_callback(uint8_t cpu_id, int request, int param1, int param2,
 #ifdef CONFIG_LOG_MASTER
 	case IPC_REQUEST_LOGGER:
 	{
-		log_incoming_msg_from_slave(cpu_id, (const log_message_t *)ptr);
+		log_incoming_msg_from_slave(cpu_id,
+					    (const struct log_frame *)ptr);
 		break;
 	}
 #endif
 #ifdef CONFIG_LOG_SLAVE
 	case IPC_REQUEST_LOGGER:
 	{
-		log_master_ready_for_new_msg(cpu_id, (log_message_t *)ptr);
+		log_master_ready_for_new_msg(cpu_id, (struct log_frame *)ptr);
 		break;
 	}
 #endif
@@ -0,0 +1,363 @@
+/*
+ * Copyright (c) 2016, Intel Corporation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "log_binary.h"
+
+/* Maximum length of a conversion specification */
+#define SPEC_LEN 24
+
+/* How an argument is stored in a record */
+enum arg_type {
+	ARG_NONE,       /* No argument, as for %% */
+	ARG_INT,        /* int, including the promoted char and short */
+	ARG_LONG,       /* long, size_t or ptrdiff_t */
+	ARG_LLONG,      /* long long or intmax_t */
+	ARG_PTR,        /* void * */
+	ARG_DOUBLE,     /* double, long double is stored as double */
+	ARG_STR,        /* copy of the string, up to its precision */
+	ARG_SKIP        /* pointer of %n, not stored */
+};
+
+/* Precision of a conversion given as an argument */
+#define PREC_STAR -2
+
+/* A conversion of the format string */
+struct conv {
+	const char *start;      /* the '%' */
+	const char *end;        /* the character after the conversion */
+	int prec;               /* precision, -1 if none, or PREC_STAR */
+	uint8_t stars;          /* number of width and precision arguments */
+	uint8_t type;           /* type of the argument, enum arg_type */
+	uint8_t long_double;    /* the 'L' length modifier is used */
+};
+
+/* Find the next conversion of a format string, return NULL if none */
+static const char *next_conv(const char *p, struct conv *c)
+{
+	int longs = 0;
+
+	p = strchr(p, '%');
+	if (!p)
+		return NULL;
+	c->start = p++;
+	c->prec = -1;
+	c->stars = 0;
+	c->long_double = 0;
+	while (*p && strchr("-+ #0", *p))
+		p++;
+	for (; *p == '*' || (*p >= '0' && *p <= '9'); p++)
+		if (*p == '*')
+			c->stars++;
+	if (*p == '.') {
+		p++;
+		if (*p == '*') {
+			c->prec = PREC_STAR;
+			c->stars++;
+			p++;
+		} else {
+			for (c->prec = 0; *p >= '0' && *p <= '9'; p++)
+				c->prec = c->prec * 10 + *p - '0';
+		}
+	}
+	for (; *p && strchr("hlLjzt", *p); p++) {
+		if (*p == 'l')
+			longs++;
+		else if (*p == 'j')
+			longs = 2;
+		else if (*p == 'z' || *p == 't')
+			longs = 1;
+		else if (*p == 'L')
+			c->long_double = 1;
+	}
+	switch (*p) {
+	case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': case 'c':
+		c->type = longs > 1 ? ARG_LLONG : longs ? ARG_LONG : ARG_INT;
+		break;
+	case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a':
+	case 'A':
+		c->type = ARG_DOUBLE;
+		break;
+	case 'p':
+		c->type = ARG_PTR;
+		break;
+	case 's':
+		c->type = ARG_STR;
+		break;
+	case 'n':
+		c->type = ARG_SKIP;
+		break;
+	default:
+		c->type = ARG_NONE;
+		break;
+	}
+	c->end = *p ? p + 1 : p;
+	return c->start;
+}
+
+static int put(uint8_t *buf, int size, int *len, const void *val, int n)
+{
+	if (*len + n > size)
+		return 0;
+	memcpy(buf + *len, val, n);
+	*len += n;
+	return 1;
+}
+
+int log_binary_pack(uint8_t *buf, int size, const char *format,
+		    va_list args)
+{
+	const char *p = format;
+	struct conv c;
+	int star = -1;
+	int len = 0;
+	int i;
+
+	if (!put(buf, size, &len, &format, sizeof(format)))
+		return 0;
+
+	while ((p = next_conv(p, &c)) != NULL) {
+		for (i = 0; i < c.stars; i++) {
+			star = va_arg(args, int);
+			if (!put(buf, size, &len, &star, sizeof(star)))
+				return len;
+		}
+		p = c.end;
+
+		switch (c.type) {
+		case ARG_INT: {
+			int val = va_arg(args, int);
+			if (!put(buf, size, &len, &val, sizeof(val)))
+				return len;
+			break;
+		}
+		case ARG_LONG: {
+			long val = va_arg(args, long);
+			if (!put(buf, size, &len, &val, sizeof(val)))
+				return len;
+			break;
+		}
+		case ARG_LLONG: {
+			long long val = va_arg(args, long long);
+			if (!put(buf, size, &len, &val, sizeof(val)))
+				return len;
+			break;
+		}
+		case ARG_PTR: {
+			void *val = va_arg(args, void *);
+			if (!put(buf, size, &len, &val, sizeof(val)))
+				return len;
+			break;
+		}
+		case ARG_DOUBLE: {
+			double val = c.long_double ?
+				     (double)va_arg(args, long double) :
+				     va_arg(args, double);
+			if (!put(buf, size, &len, &val, sizeof(val)))
+				return len;
+			break;
+		}
+		case ARG_STR: {
+			const char *str = va_arg(args, const char *);
+			/* The characters after the precision are not read, the
+			 * string may not be NULL-terminated */
+			int prec = c.prec == PREC_STAR ? star : c.prec;
+			int n;
+
+			if (!str)
+				str = "(null)";
+			if (len >= size)
+				return len;
+			for (n = 0; (prec < 0 || n < prec) && str[n]; n++) {
+				/* A truncated string is the last argument
+				 * stored */
+				if (len + n == size - 1) {
+					buf[len + n] = '\0';
+					return len + n + 1;
+				}
+				buf[len + n] = str[n];
+			}
+			buf[len + n] = '\0';
+			len += n + 1;
+			break;
+		}
+		case ARG_SKIP:
+			(void)va_arg(args, void *);
+			break;
+		}
+	}
+	return len;
+}
+
+/* Copy a conversion specification, replacing the stars by their value.
+ * Return 0 if the arguments are missing. */
+static int get_spec(char *spec, const struct conv *c, const uint8_t *buf,
+		    int len, int *pos)
+{
+	const char *p;
+	int n = 0;
+
+	for (p = c->start; p < c->end && n < SPEC_LEN - 12; p++) {
+		if (*p == '*') {
+			int star;
+			if (*pos + (int)sizeof(star) > len)
+				return 0;
+			memcpy(&star, buf + *pos, sizeof(star));
+			*pos += sizeof(star);
+			n += sprintf(spec + n, "%d", star);
+		} else if (*p != 'L') {
+			spec[n++] = *p;
+		}
+	}
+	spec[n] = '\0';
+	return 1;
+}
+
+/* Read an argument of the record, return 0 if it is missing */
+static int get(const uint8_t *buf, int len, int *pos, void *val, int n)
+{
+	if (*pos + n > len)
+		return 0;
+	memcpy(val, buf + *pos, n);
+	*pos += n;
+	return 1;
+}
+
+int log_binary_format(char *out, int size, const uint8_t *buf, int len)
+{
+	const char *format;
+	const char *p;
+	char spec[SPEC_LEN];
+	struct conv c;
+	int pos = 0;
+	int n = 0;
+	int ret;
+
+	if (size <= 0)
+		return 0;
+	if (!get(buf, len, &pos, &format, sizeof(format))) {
+		out[0] = '\0';
+		return 0;
+	}
+
+	for (p = format; n < size - 1; p = c.end) {
+		const char *literal_end = next_conv(p, &c);
+		int literal_len = literal_end ? literal_end - p : (int)strlen(p);
+
+		if (literal_len > size - 1 - n)
+			literal_len = size - 1 - n;
+		memcpy(out + n, p, literal_len);
+		n += literal_len;
+		if (!literal_end || !get_spec(spec, &c, buf, len, &pos))
+			break;
+
+		switch (c.type) {
+		case ARG_INT: {
+			int val;
+			if (!get(buf, len, &pos, &val, sizeof(val)))
+				goto end;
+			ret = snprintf(out + n, size - n, spec, val);
+			break;
+		}
+		case ARG_LONG: {
+			long val;
+			if (!get(buf, len, &pos, &val, sizeof(val)))
+				goto end;
+			ret = snprintf(out + n, size - n, spec, val);
+			break;
+		}
+		case ARG_LLONG: {
+			long long val;
+			if (!get(buf, len, &pos, &val, sizeof(val)))
+				goto end;
+			ret = snprintf(out + n, size - n, spec, val);
+			break;
+		}
+		case ARG_PTR: {
+			void *val;
+			if (!get(buf, len, &pos, &val, sizeof(val)))
+				goto end;
+			ret = snprintf(out + n, size - n, spec, val);
+			break;
+		}
+		case ARG_DOUBLE: {
+			double val;
+			if (!get(buf, len, &pos, &val, sizeof(val)))
+				goto end;
+			ret = snprintf(out + n, size - n, spec, val);
+			break;
+		}
+		case ARG_STR: {
+			const char *str = (const char *)buf + pos;
+			if (pos >= len || !memchr(str, '\0', len - pos))
+				goto end;
+			pos += strlen(str) + 1;
+			ret = snprintf(out + n, size - n, spec, str);
+			break;
+		}
+		case ARG_SKIP:
+			ret = 0;
+			break;
+		default:
+			/* %% or unknown conversion, output as is */
+			ret = snprintf(out + n, size - n, "%s",
+				       spec[1] == '%' ? "%" : spec);
+			break;
+		}
+		if (ret > 0)
+			n += ret;
+		if (n > size - 1)
+			n = size - 1;
+	}
+end:
+	out[n] = '\0';
+	return n;
+}
+
+int log_binary_hex(char *out, int size, const uint8_t *buf, int len)
+{
+	static const char digits[] = "0123456789abcdef";
+	int n = 0;
+	int i;
+
+	if (size <= 0)
+		return 0;
+	if (size > 1)
+		out[n++] = LOG_BINARY_HEX_PREFIX;
+	for (i = 0; i < len && n + 2 < size; i++) {
+		out[n++] = digits[buf[i] >> 4];
+		out[n++] = digits[buf[i] & 0xf];
+	}
+	out[n] = '\0';
+	return n;
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2016, Intel Corporation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * This private header provides the binary encoding of log messages.
+ *
+ * Instead of formatting a message when it is logged, the address of its
+ * format string and the raw values of its arguments are stored. The message
+ * is formatted later by the logger task, or by the host with
+ * tools/scripts/decode_log.py when the hexadecimal encoding of the record is
+ * output instead.
+ *
+ * The format string must remain valid, i.e. be a constant. The arguments
+ * are stored as they are passed, except strings which are copied, up to
+ * their precision if any.
+ */
+
+#ifndef LOG_BINARY_H
+#define LOG_BINARY_H
+
+#include <stdint.h>
+#include <stdarg.h>
+
+/** Prefix of the hexadecimal encoding of a record */
+#define LOG_BINARY_HEX_PREFIX '#'
+
+/**
+ * Encode a log message.
+ *
+ * The format string is parsed for the conversions only. An argument which
+ * does not fit in the record is dropped, along with the following ones.
+ *
+ * @param buf record to fill
+ * @param size size of buf
+ * @param format printf-like string format, must be a constant
+ * @param args arguments of the format
+ *
+ * @return the length of the record, 0 if not even the format fits
+ */
+int log_binary_pack(uint8_t *buf, int size, const char *format,
+		    va_list args);
+
+/**
+ * Format an encoded log message.
+ *
+ * The text is truncated at the first argument dropped by log_binary_pack().
+ *
+ * @param out buffer where to format the text, NULL-terminated and truncated
+ * to size - 1 characters
+ * @param size size of out
+ * @param buf record filled by log_binary_pack()
+ * @param len length of the record
+ *
+ * @return the length of the text
+ */
+int log_binary_format(char *out, int size, const uint8_t *buf, int len);
+
+/**
+ * Write the hexadecimal encoding of a log message, to be decoded by the host.
+ *
+ * The record is written as LOG_BINARY_HEX_PREFIX followed by two hexadecimal
+ * digits per byte.
+ *
+ * @param out buffer where to write, NULL-terminated and truncated to size - 1
+ * characters
+ * @param size size of out, should be at least 2 * len + 2
+ * @param buf record filled by log_binary_pack()
+ * @param len length of the record
+ *
+ * @return the length of the text
+ */
+int log_binary_hex(char *out, int size, const uint8_t *buf, int len);
+
+#endif /* LOG_BINARY_H */
@@ -81,6 +81,27 @@ typedef struct __packed log_message {
 	char buf[LOG_MAX_MSG_LEN];
 } log_message_t;
 
+/** Length of a message truncated to its text */
+#define LOG_MESSAGE_LEN(msg) \
+	(sizeof(log_message_t) - LOG_MAX_MSG_LEN + (msg)->buf_size)
+
+#ifdef CONFIG_LOG_MULTI_CPU_SUPPORT
+/**
+ * Describes a batch of log messages sent by a slave to the master.
+ *
+ * The frame is allocated by the master in shared memory and filled by the
+ * slave with the messages of its log buffer, each one truncated to
+ * LOG_MESSAGE_LEN().
+ */
+struct log_frame {
+	uint16_t size;                  /*!< size of data, set by the master */
+	uint16_t len;                   /*!< number of valid bytes in data */
+	/** The number of messages lost by the slave before this frame */
+	uint16_t lost_messages_count;
+	uint8_t data[];                 /*!< the messages */
+};
+#endif
+
 #if defined(CONFIG_LOG_MASTER) || !defined(CONFIG_LOG_MULTI_CPU_SUPPORT)
 /**
  * Output one message on the backend.
@@ -127,16 +148,17 @@ extern const struct log_core log_cores[LOG_CORE_NUM];
 uint8_t cpu_id_to_logcore_id(uint8_t cpu_id);
 
 /**
- * The log IPC callback called on the master when the slave has a new log
- * message.
+ * The log IPC callback called on the master when the slave has filled a
+ * frame of log messages.
  *
  * This function must be defined by all implementations of log master.
  *
  * @param cpu_id ID of the cpu from which the IPC comes from
- * @param msg the incoming log_message. On shared memory implementations, this
- * pointer is the same as the one passed in the XXX IPC callback on the slave.
+ * @param frame the incoming frame. On shared memory implementations, this
+ * pointer is the same as the one passed to log_master_ready_for_new_msg() on
+ * the slave.
  */
-void log_incoming_msg_from_slave(int cpu_id, const log_message_t *msg);
+void log_incoming_msg_from_slave(int cpu_id, const struct log_frame *frame);
 
 #endif
 
@@ -144,15 +166,15 @@ void log_incoming_msg_from_slave(int cpu_id, const log_message_t *msg);
 
 /**
  * The log IPC callback called on the slave when the master is ready to receive
- * a new log message.
+ * a new frame of log messages.
  *
  * This function must be defined by all implementations of log slave.
  *
  * @param cpu_id ID of the cpu from which the IPC comes from
- * @param msg pointer on the passed buffer in case of shared memory
- * implementations or NULL if the buffer is allocated by the IPC mechanism.
+ * @param frame pointer on the passed frame in case of shared memory
+ * implementations or NULL if the frame is allocated by the IPC mechanism.
  */
-void log_master_ready_for_new_msg(int cpu_id, log_message_t *msg);
+void log_master_ready_for_new_msg(int cpu_id, struct log_frame *frame);
 
 #endif
 
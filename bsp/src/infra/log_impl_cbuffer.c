@@ -33,7 +33,9 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdarg.h>
+#include <atomic.h>
 #include "util/assert.h"
+#include "util/misc.h"
 
 #include "util/cbuffer.h"
 #include "infra/log.h"
@@ -47,6 +49,52 @@
 #endif
 #include "infra/time.h"
 
+#ifdef CONFIG_LOG_CBUFFER_BINARY
+#include "machine.h"
+#include "log_binary.h"
+
+/* Flag set in the buf_size of the messages stored as binary records */
+#define LOG_MESSAGE_BINARY      0x80
+
+/* The hexadecimal encoding of a record must fit in a message */
+#ifdef CONFIG_LOG_CBUFFER_BINARY_HOST_DECODE
+#define LOG_BINARY_MAX_LEN      ((LOG_MAX_MSG_LEN - 2) / 2)
+#else
+#define LOG_BINARY_MAX_LEN      LOG_MAX_MSG_LEN
+#endif
+
+/* Only the constant strings can be referenced by a record */
+#define IS_CONST(str)           ((uint32_t)(str) >= ROM_START && \
+				 (uint32_t)(str) < ROM_END)
+
+/* The module and level word of a binary message header. The module is the
+ * offset of its name in the flash, the top byte the second magic number. */
+#define LOG_MODULE_BITS         19
+#define LOG_MODULE_MASK         ((1 << LOG_MODULE_BITS) - 1)
+#define LOG_LEVEL_MASK          0x7
+#define LOG_MODULE_LEVEL(module, level) \
+	(((uint32_t)(module) - ROM_START) | \
+	 ((uint32_t)(level) << LOG_MODULE_BITS) | \
+	 ((uint32_t)LOG_MESSAGE_MAGIC_B << 24))
+
+/* Header of a binary message, stored instead of the first members of
+ * log_message_t and followed by the record.
+ *
+ * The timestamp is the 16 low bits of the uptime: the reader dates the
+ * message by its age modulo 65536 ms. A message read more than 65 s after
+ * being logged is dated modulo 65536 ms. */
+struct __packed log_binary_header {
+	uint8_t magic;          /* LOG_MESSAGE_MAGIC_A, as has_saturated */
+	uint8_t buf_size;       /* length of the record | LOG_MESSAGE_BINARY */
+	uint16_t timestamp;     /* uptime in ms, 16 low bits */
+	uint32_t module_level;  /* LOG_MODULE_LEVEL() */
+};
+
+STATIC_ASSERT(LOG_MAX_MSG_LEN < LOG_MESSAGE_BINARY);
+STATIC_ASSERT(ROM_END - ROM_START <= (1 << LOG_MODULE_BITS));
+STATIC_ASSERT(LOG_LEVEL_NUM <= LOG_LEVEL_MASK + 1);
+#endif
+
 #define LOG_BUFFER_SIZE             CONFIG_LOG_CBUFFER_SIZE
 
 /* First message magic number; */
@@ -55,10 +103,23 @@
 /* Second message magic number; */
 #define LOG_MESSAGE_MAGIC_B     0xEE
 
+#ifdef CONFIG_LOG_CBUFFER_RING
+#include "util/mpsc_ring.h"
+
+#define LOG_SLOT_SIZE           CONFIG_LOG_CBUFFER_SLOT_SIZE
+
+/* The main ring where messages are transiently stored */
+static uint32_t logbuf[CONFIG_LOG_CBUFFER_SIZE / 4];
+static struct mpsc_ring log_ring;
+
+STATIC_ASSERT(IS_POWER_OF_TWO(LOG_SLOT_SIZE));
+STATIC_ASSERT(IS_POWER_OF_TWO(CONFIG_LOG_CBUFFER_SIZE / LOG_SLOT_SIZE));
+#else
 /* The main circular buffer where messages are transiently stored */
 static uint8_t logbuf[CONFIG_LOG_CBUFFER_SIZE];
 static cbuffer_t log_buffer =
 { .buf = logbuf, .buf_size = CONFIG_LOG_CBUFFER_SIZE };
+#endif
 
 /* Used when a new message comes either from local core, or other cores */
 static T_SEMAPHORE new_msg_notif = NULL;
@@ -66,6 +127,39 @@ static T_SEMAPHORE new_msg_notif = NULL;
 /* Fill the passed message by taking one from the cbuffer */
 static int32_t log_read_msg(log_message_t *p_msg);
 
+#ifdef CONFIG_LOG_CBUFFER_BINARY
+/* Replace the binary message read in p_msg by the message with its text */
+static void log_decode_msg(log_message_t *p_msg)
+{
+	struct log_binary_header header;
+	uint8_t record[LOG_BINARY_MAX_LEN];
+	uint32_t now = get_uptime_ms();
+	int len;
+
+	memcpy(&header, p_msg, sizeof(header));
+	len = MIN(header.buf_size & ~LOG_MESSAGE_BINARY, sizeof(record));
+	memcpy(record, (uint8_t *)p_msg + sizeof(header), len);
+
+	p_msg->level = (header.module_level >> LOG_MODULE_BITS) &
+		       LOG_LEVEL_MASK;
+	memcpy(p_msg->module, (const char *)ROM_START +
+	       (header.module_level & LOG_MODULE_MASK), 4);
+	p_msg->timestamp = now - (uint16_t)(now - header.timestamp);
+#ifdef CONFIG_LOG_MULTI_CPU_SUPPORT
+	p_msg->cpu_id = get_cpu_id();
+#else
+	p_msg->cpu_id = 0;
+#endif
+#ifdef CONFIG_LOG_CBUFFER_BINARY_HOST_DECODE
+	p_msg->buf_size = log_binary_hex(p_msg->buf, sizeof(p_msg->buf),
+					 record, len);
+#else
+	p_msg->buf_size = log_binary_format(p_msg->buf, sizeof(p_msg->buf),
+					    record, len);
+#endif
+}
+#endif
+
 /* Definition of the private task "TASK_LOGGER" */
 #if defined(CONFIG_MICROKERNEL)
 #include "microkernel/task.h"
@@ -102,12 +196,16 @@ extern bool is_console_backend_connected(void);
 #ifdef CONFIG_LOG_MASTER
 
 #define LOG_SLAVES_NUM (LOG_CORE_NUM - 1)
+#define LOG_FRAME_SIZE CONFIG_LOG_SLAVE_FRAME_SIZE
 struct log_slave_data {
-	log_message_t msg;
+	struct log_frame *frame;
 	bool state;
 	uint8_t cpu_id;
 };
 static struct log_slave_data slavesdata[LOG_SLAVES_NUM];
+static uint32_t slaveframes[LOG_SLAVES_NUM][LOG_FRAME_SIZE / 4];
+STATIC_ASSERT(LOG_FRAME_SIZE >= sizeof(struct log_frame) +
+	      sizeof(log_message_t));
 
 static uint8_t cpu_id_to_slave_index(uint8_t cpu_id)
 {
@@ -121,7 +219,28 @@ static uint8_t cpu_id_to_slave_index(uint8_t cpu_id)
 	return 0;
 }
 
-void log_incoming_msg_from_slave(int cpu_id, const log_message_t *msg)
+/* Output all the messages of a frame received from a slave */
+static void output_frame(struct log_frame *frame)
+{
+	uint16_t pos = 0;
+
+	while (pos + sizeof(log_message_t) - LOG_MAX_MSG_LEN <= frame->len) {
+		log_message_t *msg = (log_message_t *)&frame->data[pos];
+
+		if (pos + LOG_MESSAGE_LEN(msg) > frame->len)
+			break;
+		/* The lost messages are reported with the first message */
+		if (pos == 0)
+			msg->lost_messages_count =
+				MIN(msg->lost_messages_count +
+				    frame->lost_messages_count, UINT8_MAX);
+		output_one_message(msg);
+		pos += LOG_MESSAGE_LEN(msg);
+	}
+	frame->len = 0;
+}
+
+void log_incoming_msg_from_slave(int cpu_id, const struct log_frame *frame)
 {
 	slavesdata[cpu_id_to_slave_index(cpu_id)].state = 1;
 	semaphore_give(new_msg_notif, NULL);
@@ -158,14 +277,14 @@ void log_task()
 			for (i = 0; i < LOG_SLAVES_NUM; i++) {
 				if (slavesdata[i].state == 1) {
 					/* Call backend */
-					output_one_message(&slavesdata[i].msg);
+					output_frame(slavesdata[i].frame);
 					slavesdata[i].state = 0;
 					/* Send a flush request to the slaves */
 					log_cores[cpu_id_to_logcore_id(
 							  slavesdata[i].cpu_id)
 					].send_buffer(
 						IPC_REQUEST_LOGGER, 0, 0,
-						(void *)(&slavesdata[i].msg));
+						(void *)slavesdata[i].frame);
 				}
 			}
 		}
@@ -174,14 +293,16 @@ void log_task()
 #endif
 
 #ifdef CONFIG_LOG_SLAVE
-static volatile log_message_t *out_msg = NULL;
+static struct log_frame *volatile out_frame = NULL;
 static T_SEMAPHORE ipc_notif = NULL;
+#ifndef CONFIG_LOG_CBUFFER_RING
 /* Contains the number of messages put in the cbuffer. */
-static uint32_t msg_number;
+static atomic_t msg_number;
+#endif
 
-void log_master_ready_for_new_msg(int cpu_id, log_message_t *msg)
+void log_master_ready_for_new_msg(int cpu_id, struct log_frame *frame)
 {
-	out_msg = msg;
+	out_frame = frame;
 	semaphore_give(ipc_notif, NULL);
 }
 
@@ -190,41 +311,65 @@ void log_flush()
 	return;
 }
 
-/* Extract and send one message to the master
- * Updates lost_messages according */
-static void process_one_msg(uint8_t *lost_messages)
+/* Extract and send as many messages as the frame of the master can hold
+ * Updates lost_messages according
+ * Return false if there was no message to send */
+static bool process_msgs(uint16_t *lost_messages)
 {
-	/* Wait for a new valid buffer to be received from master */
+	/* Wait for a new valid frame to be received from master */
 	if (semaphore_take(ipc_notif, OS_WAIT_FOREVER) != E_OS_OK) {
 		panic(E_OS_ERR);
 	}
 
-	/* At this point we are guaranteed to have a master buffer available */
-	assert(out_msg);
+	/* At this point we are guaranteed to have a master frame available */
+	struct log_frame *frame = out_frame;
+	assert(frame);
+
+	frame->len = 0;
+#ifdef CONFIG_LOG_CBUFFER_RING
+	/* The ring reports the lost messages with the next message read. It
+	 * stops at a message not committed yet, whose writer gives
+	 * new_msg_notif again once it is. */
+	while (frame->len + sizeof(log_message_t) <= frame->size) {
+		log_message_t *p_msg = (log_message_t *)&frame->data[frame->len];
+		if (log_read_msg(p_msg) <= 0)
+			break;
+		frame->len += LOG_MESSAGE_LEN(p_msg);
+	}
+#else
+	while (atomic_get(&msg_number) &&
+	       frame->len + sizeof(log_message_t) <= frame->size) {
+		log_message_t *p_msg = (log_message_t *)&frame->data[frame->len];
+		if (log_read_msg(p_msg) <= 0) {
+			/* We were too late and the message has been overwritten
+			 * (saturation). Skip this message.. */
+			*lost_messages += 1;
+		} else {
+			frame->len += LOG_MESSAGE_LEN(p_msg);
+		}
+		atomic_dec(&msg_number);
+	}
+#endif
 
-	/* Process next message */
-	log_message_t *p_msg = (log_message_t *)out_msg;
-	if (log_read_msg(p_msg) <= 0) {
-		/* We were too late and the message has been overwritten (saturation)
-		 * Skip this message.. */
-		*lost_messages += 1;
-		/* As nothing is done with the buffer, give back semaphore so
+	if (frame->len == 0) {
+		/* As nothing is done with the frame, give back semaphore so
 		 * count is 1 */
 		semaphore_give(ipc_notif, NULL);
+		return false;
 	} else {
-		/* Use the message as a container to tell the master how many
-		 * messages we lost */
-		p_msg->lost_messages_count = *lost_messages;
+		/* Tell the master how many messages we lost */
+		frame->lost_messages_count = *lost_messages;
 		*lost_messages = 0;
-		out_msg = NULL;
+		out_frame = NULL;
 		ipc_request_sync_int(IPC_REQUEST_LOGGER, 0, 0, NULL);
+		return true;
 	}
 }
 
 /* Logger task. Should be lower prio than any other tasks that send messages. */
 static void log_task()
 {
-	uint8_t lost_messages = 0;
+	uint16_t lost_messages = 0;
 
 	/* Send an initial IPC request to tell the master that slave task
 	 * is ready. */
@@ -237,12 +382,13 @@ static void log_task()
 			panic(E_OS_ERR);
 		}
 
-		while (msg_number) {
-			process_one_msg(&lost_messages);
-			uint32_t it_flags = irq_lock();
-			msg_number--;
-			irq_unlock(it_flags);
-		}
+#ifdef CONFIG_LOG_CBUFFER_RING
+		while (process_msgs(&lost_messages))
+			;
+#else
+		while (atomic_get(&msg_number))
+			process_msgs(&lost_messages);
+#endif
 	}
 }
 #endif
@@ -296,12 +442,19 @@ void log_start(void)
 
 void log_impl_init(void)
 {
+#ifdef CONFIG_LOG_CBUFFER_RING
+	mpsc_ring_init(&log_ring, (uint8_t *)logbuf,
+		       CONFIG_LOG_CBUFFER_SIZE / LOG_SLOT_SIZE, LOG_SLOT_SIZE);
+#else
 	if (cb_init(&log_buffer) == -1)
 		panic(E_OS_ERR_UNKNOWN);
+#endif
 	new_msg_notif = semaphore_create(0);
 
 #ifdef CONFIG_LOG_SLAVE
-	msg_number = 0;
+#ifndef CONFIG_LOG_CBUFFER_RING
+	atomic_set(&msg_number, 0);
+#endif
 	ipc_notif = semaphore_create(0);
 #endif
 
@@ -313,6 +466,10 @@ void log_impl_init(void)
 			/* This the master CPU, skip from our slaves list */
 			j++;
 		}
+		slavesdata[i].frame = (struct log_frame *)slaveframes[i];
+		slavesdata[i].frame->size = sizeof(slaveframes[i]) -
+					    sizeof(struct log_frame);
+		slavesdata[i].frame->len = 0;
 		slavesdata[i].state = 0;
 		slavesdata[i].cpu_id = log_cores[j].cpu_id;
 		j++;
@@ -320,6 +477,51 @@ void log_impl_init(void)
 #endif
 }
 
+/* Push a message, or a binary message, into the logging queue */
+static void log_push_msg(const uint8_t *msg, uint32_t msg_len)
+{
+#ifdef CONFIG_LOG_CBUFFER_RING
+	/* The ring detects overwritten messages without the magic numbers,
+	 * and does not need the interrupts to be locked */
+	mpsc_ring_write(&log_ring, msg, msg_len);
+	uint32_t saved = IRQ_FLAGS();
+#else
+	uint32_t saved = irq_lock();
+	cb_push(&log_buffer, msg, msg_len);
+	irq_unlock(saved);
+#endif
+
+	/* Check if interrupts are enabled. If not, do not signal semaphore
+	 * as it would schedule. */
+	if (IRQ_ENABLED(saved)) {
+		semaphore_give(new_msg_notif, NULL);
+	}
+#if defined(CONFIG_LOG_SLAVE) && !defined(CONFIG_LOG_CBUFFER_RING)
+	atomic_inc(&msg_number);
+#endif
+}
+
+#ifdef CONFIG_LOG_CBUFFER_BINARY
+/* Push a message with a compact header and a binary record */
+static void log_write_binary(uint8_t level, const char *module,
+			     const char *format, va_list args)
+{
+	struct __packed {
+		struct log_binary_header header;
+		uint8_t record[LOG_BINARY_MAX_LEN];
+	} msg;
+	int len = log_binary_pack(msg.record, sizeof(msg.record), format, args);
+
+	if (len <= 0)
+		return;
+	msg.header.magic = LOG_MESSAGE_MAGIC_A;
+	msg.header.buf_size = len | LOG_MESSAGE_BINARY;
+	msg.header.timestamp = get_uptime_ms();
+	msg.header.module_level = LOG_MODULE_LEVEL(module, level);
+	log_push_msg((const uint8_t *)&msg, sizeof(msg.header) + len);
+}
+#endif
+
 /**
  * @brief Creates and pushes a user's log message into the logging queue.
  *
@@ -331,12 +533,20 @@ void log_write_msg(uint8_t level, const char *module, const char *format,
 {
 	log_message_t msg;
 
+#ifdef CONFIG_LOG_CBUFFER_BINARY
+	/* Formatting is deferred to the logger task, or to the host */
+	if (IS_CONST(format) && IS_CONST(module)) {
+		log_write_binary(level, module, format, args);
+		return;
+	}
+#endif
 	/* Contains the full text size not including the terminating \0 */
-	msg.buf_size = vsnprintf(msg.buf, sizeof(msg.buf), format, args);
-	if (msg.buf_size >= sizeof(msg.buf))
-		msg.buf_size = sizeof(msg.buf) - 1;
-	if (msg.buf_size <= 0)
+	int len = vsnprintf(msg.buf, sizeof(msg.buf), format, args);
+	if (len >= (int)sizeof(msg.buf))
+		len = sizeof(msg.buf) - 1;
+	if (len <= 0)
 		return;
+	msg.buf_size = len;
 
 	/* Fill up the message contents */
 	/* Note that we abuse the has_saturated and lost_messages_count members
@@ -355,24 +565,46 @@ void log_write_msg(uint8_t level, const char *module, const char *format,
 #else
 	msg.cpu_id = 0;
 #endif
-	uint32_t msg_len = sizeof(msg) - sizeof(msg.buf) + msg.buf_size;
+	log_push_msg((const uint8_t *)&msg,
+		     sizeof(msg) - sizeof(msg.buf) + msg.buf_size);
+}
 
-	uint32_t saved = irq_lock();
-	cb_push(&log_buffer, (const uint8_t *)&msg, msg_len);
-	irq_unlock(saved);
+#ifdef CONFIG_LOG_CBUFFER_RING
+/**
+ * @brief Read a message in the ring.
+ *
+ * @param p_msg  pointer on the message filled by the function:
+ *   - p_msg->has_saturated is set to 0
+ *   - p_msg->lost_messages_count is set to the number of messages
+ *     overwritten before this one
+ *
+ * @return  1  If no error,
+ * @return  0  If no message has been found
+ */
+static int32_t log_read_msg(log_message_t *p_msg)
+{
+	uint32_t it_flags;
+	uint16_t lost;
+	int len;
 
-	/* Check if interrupts are enabled. If not, do not signal semaphore
-	 * as it would schedule. */
-	if (IRQ_ENABLED(saved)) {
-		semaphore_give(new_msg_notif, NULL);
-	}
-#ifdef CONFIG_LOG_SLAVE
-	saved = irq_lock();
-	msg_number++;
-	irq_unlock(saved);
+	/* Serialize the log task and the callers of log_flush(), the only
+	 * readers of the ring */
+	it_flags = irq_lock();
+	len = mpsc_ring_read(&log_ring, (uint8_t *)p_msg, sizeof(*p_msg),
+			     &lost);
+	irq_unlock(it_flags);
+	if (len <= 0)
+		return 0;
+
+#ifdef CONFIG_LOG_CBUFFER_BINARY
+	if (p_msg->buf_size & LOG_MESSAGE_BINARY)
+		log_decode_msg(p_msg);
 #endif
+	p_msg->has_saturated = 0;
+	p_msg->lost_messages_count = MIN(lost, UINT8_MAX);
+	return 1;
 }
-
+#else
 /**
  * @brief Read a message in a circular buffer.
  *
@@ -391,6 +623,8 @@ static int32_t log_read_msg(log_message_t *p_msg)
 	int msg_len = 0;
 	int buf_len = 0;
 	int start_r = 0;        /* Start of the next message index */
+	int header_len = sizeof(*p_msg) - sizeof(p_msg->buf);
+	int magic_b_pos = offsetof(log_message_t, lost_messages_count);
 
 	it_flags = irq_lock();
 
@@ -421,10 +655,19 @@ static int32_t log_read_msg(log_message_t *p_msg)
 		return 0;
 	}
 
-	if (log_buffer.buf[(start_r +
-			    offsetof(log_message_t,
-				     lost_messages_count)) %
-			   LOG_BUFFER_SIZE] !=
+	buf_len = log_buffer.buf[((start_r + offsetof(log_message_t, buf_size))
+				  % LOG_BUFFER_SIZE)];
+#ifdef CONFIG_LOG_CBUFFER_BINARY
+	/* A binary message has a compact header, with the second magic number
+	 * in the top byte of its last word */
+	if (buf_len & LOG_MESSAGE_BINARY) {
+		magic_b_pos = sizeof(struct log_binary_header) - 1;
+		header_len = sizeof(struct log_binary_header);
+		buf_len &= ~LOG_MESSAGE_BINARY;
+	}
+#endif
+
+	if (log_buffer.buf[(start_r + magic_b_pos) % LOG_BUFFER_SIZE] !=
 	    LOG_MESSAGE_MAGIC_B) {
 		/* Something is not right, we can't match the second magic number; we'll advance r to speed up next search */
 		log_buffer.r = start_r;
@@ -432,9 +675,7 @@ static int32_t log_read_msg(log_message_t *p_msg)
 		return -1;
 	}
 
-	buf_len = log_buffer.buf[((start_r + offsetof(log_message_t, buf_size))
-				  % LOG_BUFFER_SIZE)];
-	msg_len = sizeof(*p_msg) - sizeof(p_msg->buf) + buf_len;
+	msg_len = header_len + buf_len;
 
 	if (buf_len < 0 || msg_len < 0) {
 		/* Start_r doesn't look good.. we'll wait. */
@@ -447,7 +688,12 @@ static int32_t log_read_msg(log_message_t *p_msg)
 
 	irq_unlock(it_flags);
 
+#ifdef CONFIG_LOG_CBUFFER_BINARY
+	if (ret > 0 && (p_msg->buf_size & LOG_MESSAGE_BINARY))
+		log_decode_msg(p_msg);
+#endif
 	p_msg->has_saturated = saturation;
 	p_msg->lost_messages_count = 0;
 	return ret;
 }
+#endif
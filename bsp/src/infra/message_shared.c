@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2016, Intel Corporation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include <atomic.h>
+#ifdef CONFIG_OS_LINUX
+#include "os/os_linux.h"
+#else
+#include <zephyr.h>
+#endif
+
+#include "os/os.h"
+#include "infra/message.h"
+#include "util/misc.h"
+
+/*
+ * A shared message is allocated in a single block:
+ *  - the reference counter,
+ *  - the copy of the message, padded to a word boundary,
+ *  - the references sent to the destinations.
+ */
+struct shared_block {
+	atomic_t ref_count;
+	struct message msg;
+};
+
+#define SHARED_MSG_SIZE(len) (((len) + 3) & ~3)
+
+static struct shared_block *get_block(struct message *msg)
+{
+	return container_of(msg, struct shared_block, msg);
+}
+
+struct message_ref *message_share(const struct message *msg, uint16_t count,
+				  OS_ERR_TYPE *err)
+{
+	uint16_t len = MESSAGE_LEN(msg);
+	struct shared_block *block;
+	struct message_ref *refs;
+	uint16_t i;
+
+	block = balloc(offsetof(struct shared_block, msg) +
+		       SHARED_MSG_SIZE(len) + count * sizeof(*refs), err);
+	if (block == NULL)
+		return NULL;
+
+	atomic_set(&block->ref_count, count);
+	memcpy(&block->msg, msg, len);
+	block->msg.flags.f_shared = 1;
+	block->msg.flags.f_queue_head = 0;
+
+	refs = (struct message_ref *)((uint8_t *)&block->msg +
+				      SHARED_MSG_SIZE(len));
+	for (i = 0; i < count; i++) {
+		refs[i].m = block->msg;
+		MESSAGE_LEN(&refs[i].m) = 0;
+		refs[i].shared = &block->msg;
+	}
+	return refs;
+}
+
+struct message *message_deref(struct message *message)
+{
+	if (message->flags.f_shared && MESSAGE_LEN(message) == 0)
+		return ((struct message_ref *)message)->shared;
+	return message;
+}
+
+void message_release(struct message *message)
+{
+	struct shared_block *block = get_block(message_deref(message));
+
+	/* The references may be released from several tasks, the last one
+	 * frees the block */
+	if (atomic_dec(&block->ref_count) == 1)
+		bfree(block);
+}
@@ -202,6 +202,8 @@ void port_process_message(struct message *msg)
 {
 	struct port *p = get_port(msg->dst_port_id);
 
+	/* the handler of a reference receives the shared message */
+	msg = message_deref(msg);
 	if (p->handle_message != NULL) {
 		p->handle_message(msg, p->handle_param);
 	}
@@ -228,6 +230,40 @@ uint8_t port_get_cpu_id(uint16_t port_id)
 	return p->cpu_id;
 }
 
+static bool message_is_replaced(T_QUEUE_MESSAGE pending, T_QUEUE_MESSAGE m)
+{
+	struct message *old = (struct message *)pending;
+	struct message *msg = (struct message *)m;
+
+	return MESSAGE_CLASS(old) == MESSAGE_CLASS(msg) &&
+	       MESSAGE_ID(old) == MESSAGE_ID(msg) &&
+	       MESSAGE_SRC(old) == MESSAGE_SRC(msg) &&
+	       MESSAGE_DST(old) == MESSAGE_DST(msg);
+}
+
+/* Queue a message on a local port according to its flags */
+static int port_queue_message(struct port *port, struct message *msg)
+{
+	OS_ERR_TYPE err = E_OS_OK;
+	struct message *replaced;
+
+	if (msg->flags.f_queue_head == true) {
+		queue_send_message_head(port->queue, msg, &err);
+	} else if (MESSAGE_CLASS(msg) == CLASS_REPLACE ||
+		   MESSAGE_CLASS(msg) == CLASS_NO_WAKE_REPLACE) {
+		/* a newer sample makes the pending one useless */
+		replaced = queue_replace_message(port->queue, msg,
+						 MESSAGE_PRIO(msg),
+						 message_is_replaced, &err);
+		if (replaced != NULL)
+			message_free(replaced);
+	} else {
+		queue_send_message_prio(port->queue, msg, MESSAGE_PRIO(msg),
+					&err);
+	}
+	return err;
+}
+
 #ifdef CONFIG_PORT_MULTI_CPU_SUPPORT
 #include "machine.h"
 
@@ -262,7 +298,6 @@ void set_cpu_free_handler(uint8_t cpu_id, void (*free_handler)(struct message *)
 
 int port_send_message(struct message *message)
 {
-	OS_ERR_TYPE err = 0;
 	struct port *port = get_port(MESSAGE_DST(message));
 
 	if (port == NULL) {
@@ -274,13 +309,11 @@ int port_send_message(struct message *message)
 	if (port->cpu_id == get_cpu_id()) {
 #ifdef PORT_DEBUG
 		pr_debug(LOG_MODULE_MAIN,
-			 "Sending message %p to port %p(q:%p) ret: %d", message,
+			 "Sending message %p to port %p(q:%p)", message,
 			 port,
-			 port->queue,
-			 err);
+			 port->queue);
 #endif
-		queue_send_message(port->queue, message, &err);
-		return err;
+		return port_queue_message(port, message);
 	} else {
 #ifdef PORT_DEBUG
 		pr_debug(LOG_MODULE_MAIN, "Remote port ! using: %p handler",
@@ -293,7 +326,13 @@ int port_send_message(struct message *message)
 
 void message_free(struct message *msg)
 {
-	struct port *port = get_port(MESSAGE_SRC(msg));
+	struct port *port;
+
+	if (msg->flags.f_shared) {
+		message_release(msg);
+		return;
+	}
+	port = get_port(MESSAGE_SRC(msg));
 
 	pr_debug(LOG_MODULE_MAIN, "free message %p: port %p[%d] this %d id %d",
 		 msg, port, port->cpu_id, get_cpu_id(), MESSAGE_SRC(msg));
@@ -309,18 +348,16 @@ void message_free(struct message *msg)
 int port_send_message(struct message *msg)
 {
 	struct port *port = get_port(MESSAGE_DST(msg));
-	OS_ERR_TYPE err;
 
-	if (msg->flags.f_queue_head == true)
-		queue_send_message_head(port->queue, msg, &err);
-	else
-		queue_send_message(port->queue, msg, &err);
-	return err;
+	return port_queue_message(port, msg);
 }
 
 void message_free(struct message *msg)
 {
-	bfree(msg);
+	if (msg->flags.f_shared)
+		message_release(msg);
+	else
+		bfree(msg);
 }
 #endif
 
@@ -67,6 +67,13 @@ void xloop_init_from_queue(xloop_t *l, T_QUEUE q)
 {
 	l->queue = q;
 	l->delayed_items.next = NULL;
+	l->process_message = NULL;
+}
+
+void xloop_set_message_handler(xloop_t *l,
+			       void (*process_message)(struct message *m))
+{
+	l->process_message = process_message;
 }
 
 __noreturn void xloop_run(xloop_t *l)
@@ -102,7 +109,10 @@ __noreturn void xloop_run(xloop_t *l)
 			job->run(job);
 		} else {
 			struct message *msg = (struct message *)m;
-			port_process_message(msg);
+			if (l->process_message)
+				l->process_message(msg);
+			else
+				port_process_message(msg);
 		}
 	}
 }
@@ -121,6 +131,14 @@ void xloop_post_job(xloop_t *l, xloop_job_t *j)
 	queue_send_message(l->queue, j, NULL);
 }
 
+void xloop_try_post_job(xloop_t *l, xloop_job_t *j, OS_ERR_TYPE *err)
+{
+	j->flags.f_is_job = 1;
+	j->flags.f_queue_head = 0;
+	j->loop = l;
+	queue_send_message(l->queue, j, err);
+}
+
 struct func_job {
 	xloop_job_t j;
 	void (*fn)(void *data);
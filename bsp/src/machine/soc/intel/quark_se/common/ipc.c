@@ -37,6 +37,8 @@
 #include "infra/time.h"
 #include "machine.h"
 #include "os/os.h"
+#include "util/misc.h"
+#include "util/spsc_ring.h"
 
 #include "quark_se_common.h"
 
@@ -57,6 +59,129 @@ static uint8_t remote_cpu = 0;
 
 static T_MUTEX ipc_mutex;
 
+/*****************************************************************************
+ * Shared memory rings:
+ * The asynchronous messages and frees to a core are pushed to a pair of rings
+ * in shared memory. The destination core is notified by an IPC_MSG_TYPE_RING
+ * request, sent only if none is already pending: a burst of messages costs
+ * one mailbox round-trip. The destination core pops the rings in its mailbox
+ * interrupt.
+ * The rings are allocated by QRK, ARC finds them in the shared data.
+ ****************************************************************************/
+
+#define IPC_RING_CPUS (CPU_ID_ARC + 1)
+
+/* Rings to a core */
+struct ipc_ring_pair {
+	struct spsc_ring messages;
+	struct spsc_ring frees;
+};
+
+/* Rings to each core, indexed by CPU id */
+struct ipc_rings {
+	struct ipc_ring_pair to[IPC_RING_CPUS];
+};
+
+#if defined(CONFIG_QUARK_SE_QUARK) && defined(CONFIG_QUARK_SE_IPC_RING)
+STATIC_ASSERT((CONFIG_QUARK_SE_IPC_RING_SIZE &
+	       (CONFIG_QUARK_SE_IPC_RING_SIZE - 1)) == 0);
+
+static struct ipc_rings rings;
+static void *ring_slots[IPC_RING_CPUS][2][CONFIG_QUARK_SE_IPC_RING_SIZE];
+#endif
+
+static struct ipc_ring_stats ring_stats;
+
+/* A doorbell message is in the queue of the ipc port */
+static volatile bool doorbell_pending;
+
+#ifdef CONFIG_QUARK_SE_IPC_RING
+#define FREE_BATCH CONFIG_QUARK_SE_IPC_FREE_BATCH
+#define FREE_DELAY_MS CONFIG_QUARK_SE_IPC_FREE_DELAY_MS
+#else
+#define FREE_BATCH 1
+#define FREE_DELAY_MS 0
+#endif
+
+/* Rings the doorbell for the frees waiting in the ring */
+static T_TIMER free_timer;
+static volatile bool free_timer_armed;
+
+/* Rings the doorbell again when its request could not be queued */
+static T_TIMER doorbell_timer;
+#define DOORBELL_RETRY_MS 1
+
+/* Messages in the queue of the ipc port, which did not fit in the ring: the
+ * next messages are queued behind them to keep the order */
+static volatile uint32_t pending_sends;
+
+#ifdef CONFIG_QUARK_SE_QUARK
+static void ipc_rings_init(void)
+{
+#ifdef CONFIG_QUARK_SE_IPC_RING
+	int cpu;
+
+	for (cpu = 0; cpu < IPC_RING_CPUS; cpu++) {
+		spsc_ring_init(&rings.to[cpu].messages, ring_slots[cpu][0],
+			       CONFIG_QUARK_SE_IPC_RING_SIZE);
+		spsc_ring_init(&rings.to[cpu].frees, ring_slots[cpu][1],
+			       CONFIG_QUARK_SE_IPC_RING_SIZE);
+	}
+	shared_data->ipc_rings = &rings;
+#else
+	shared_data->ipc_rings = NULL;
+#endif
+}
+#endif
+
+/* Rings to the other core, NULL if they are not used */
+static struct ipc_ring_pair *tx_rings(void)
+{
+#ifdef CONFIG_QUARK_SE_IPC_RING
+	struct ipc_rings *r = (struct ipc_rings *)shared_data->ipc_rings;
+
+	if (r)
+		return &r->to[remote_cpu];
+#endif
+	return NULL;
+}
+
+/* Pop the rings to this core, called in the mailbox interrupt. The rings are
+ * popped even if this core does not push to the other one */
+static int ipc_ring_receive(void)
+{
+	struct ipc_rings *r = (struct ipc_rings *)shared_data->ipc_rings;
+	struct ipc_ring_pair *rx;
+	uint32_t count = 0;
+	void *msg;
+
+	if (!r)
+		return -1;
+	rx = &r->to[get_cpu_id()];
+	/* The frees first, the new messages may need the memory */
+	while ((msg = spsc_ring_pop(&rx->frees))) {
+		message_free(msg);
+		count++;
+	}
+	ring_stats.rx_frees += count;
+	while ((msg = spsc_ring_pop(&rx->messages))) {
+		port_send_message(msg);
+		count++;
+	}
+	ring_stats.received += count;
+	ring_stats.max_batch = MAX(ring_stats.max_batch, count);
+	ring_stats.rx_doorbells++;
+	return 0;
+}
+
+void ipc_ring_get_stats(struct ipc_ring_stats *stats)
+{
+	uint32_t flags = irq_lock();
+
+	*stats = ring_stats;
+	irq_unlock(flags);
+}
+
 void ipc_init(int tx_channel, int rx_channel, int tx_ack_channel,
 	      int rx_ack_channel, uint8_t remote_cpu_id)
 {
@@ -66,6 +191,10 @@ void ipc_init(int tx_channel, int rx_channel, int tx_ack_channel,
 	rx_ack_chan = rx_ack_channel;
 	remote_cpu = remote_cpu_id;
 	ipc_mutex = mutex_create();
+#ifdef CONFIG_QUARK_SE_QUARK
+	/* Before ARC is started */
+	ipc_rings_init();
+#endif
 }
 
 void ipc_handle_message()
@@ -78,7 +207,11 @@ void ipc_handle_message()
 	int param2 = MBX_DAT2(rx_chan);
 	void *ptr = (void *)MBX_DAT3(rx_chan);
 
-	ret = ipc_sync_callback(remote_cpu, request, param1, param2, ptr);
+	if (request == IPC_MSG_TYPE_RING)
+		ret = ipc_ring_receive();
+	else
+		ret = ipc_sync_callback(remote_cpu, request, param1, param2,
+					ptr);
 
 	MBX_CTRL(rx_chan) = 0x80000000;
 
@@ -168,6 +301,7 @@ int ipc_request_sync_int(int request_id, int param1, int param2, void *ptr)
 
 #define IPC_MESSAGE_SEND 1
 #define IPC_MESSAGE_FREE 2
+#define IPC_MESSAGE_DOORBELL 3
 
 static uint16_t ipc_port;
 
@@ -176,6 +310,60 @@ struct ipc_async_msg {
 	void *data;
 };
 
+static int ipc_request_send(uint16_t msgid, void *message);
+
+/* Ring the doorbell of the other core for the pushed messages. If the
+ * request cannot be allocated, doorbell_pending stays set and the doorbell
+ * timer retries, whether or not anything else is pushed */
+static void ring_notify(void)
+{
+	OS_ERR_TYPE err;
+
+	if (ipc_request_send(IPC_MESSAGE_DOORBELL, NULL) == E_OS_OK)
+		return;
+	timer_start(doorbell_timer, DOORBELL_RETRY_MS, &err);
+	if (err != E_OS_OK)
+		/* No timer: the next push rings again */
+		doorbell_pending = false;
+}
+
+static void doorbell_timer_expired(void *data)
+{
+	ring_notify();
+}
+
+/* Send a message which did not fit in the ring, or when the rings are not
+ * used. The next messages are queued behind it to keep the order: once the
+ * other core is notified, it has popped the ring and the message fits */
+static void ring_send_overflow(struct message *message)
+{
+	struct ipc_ring_pair *rings = tx_rings();
+	bool pushed = false, notify = false;
+	uint32_t flags;
+
+	if (rings) {
+		/* No other context pushes messages while pending_sends is set */
+		pushed = spsc_ring_push(&rings->messages, message);
+		if (!pushed) {
+			ring_stats.doorbells++;
+			ipc_request_sync_int(IPC_MSG_TYPE_RING, 0, 0, NULL);
+			pushed = spsc_ring_push(&rings->messages, message);
+		}
+	}
+	if (!pushed)
+		ipc_request_sync_int(IPC_MSG_TYPE_MESSAGE, 0, 0, message);
+
+	flags = irq_lock();
+	pending_sends--;
+	if (pushed) {
+		notify = !doorbell_pending;
+		doorbell_pending = true;
+	}
+	irq_unlock(flags);
+	if (notify)
+		ring_notify();
+}
+
 /**
  * \brief this function is called in the context of the queue set by
  * ipc_async_init().
@@ -193,8 +381,14 @@ static void handle_ipc_request_port(struct message *m, void *data)
 	case IPC_MESSAGE_SEND:
 		pr_debug(LOG_MODULE_QUARK_SE, "Send message: %p",
 			 msg->data);
-		ipc_request_sync_int(IPC_MSG_TYPE_MESSAGE,
-				     0, 0, msg->data);
+		ring_send_overflow(msg->data);
+		break;
+	case IPC_MESSAGE_DOORBELL:
+		/* Cleared first, so that the messages pushed from now on ring
+		 * again if this request does not pop them */
+		doorbell_pending = false;
+		ring_stats.doorbells++;
+		ipc_request_sync_int(IPC_MSG_TYPE_RING, 0, 0, NULL);
 		break;
 	case IPC_MESSAGE_FREE:
 		pr_debug(LOG_MODULE_QUARK_SE, "Free message: %p",
@@ -209,8 +403,8 @@ static void handle_ipc_request_port(struct message *m, void *data)
 /**
  * \brief send a message to handle_ipc_request_port()
  *
- * \param msgid the message id to generate. can be \ref IPC_MESSAGE_FREE
- *              or \ref IPC_MESSAGE_SEND
+ * \param msgid the message id to generate. can be \ref IPC_MESSAGE_FREE,
+ *              \ref IPC_MESSAGE_SEND or \ref IPC_MESSAGE_DOORBELL
  * \param message the message data to send / free
  */
 static int ipc_request_send(uint16_t msgid, void *message)
@@ -229,19 +423,177 @@ static int ipc_request_send(uint16_t msgid, void *message)
 	return err;
 }
 
+/* Push to a ring to the other core, called with interrupts locked: the tasks
+ * and interrupts of this core are the single producer of the ring.
+ * notify is set if the doorbell must be rung */
+static bool ring_push_locked(struct spsc_ring *ring, void *ptr, bool *notify)
+{
+	if (!spsc_ring_push(ring, ptr))
+		return false;
+	*notify = !doorbell_pending;
+	doorbell_pending = true;
+	return true;
+}
+
 int ipc_async_send_message(struct message *message)
 {
-	return ipc_request_send(IPC_MESSAGE_SEND, message);
+	struct ipc_ring_pair *rings = tx_rings();
+	bool pushed = false, notify = false;
+	uint32_t flags;
+	int err;
+
+	flags = irq_lock();
+	if (rings && !pending_sends)
+		pushed = ring_push_locked(&rings->messages, message, &notify);
+	if (pushed) {
+		ring_stats.sent++;
+	} else {
+		ring_stats.overflows++;
+		pending_sends++;
+	}
+	irq_unlock(flags);
+
+	if (pushed) {
+		if (notify)
+			ring_notify();
+		return E_OS_OK;
+	}
+
+	err = ipc_request_send(IPC_MESSAGE_SEND, message);
+	if (err != E_OS_OK) {
+		flags = irq_lock();
+		pending_sends--;
+		irq_unlock(flags);
+	}
+	return err;
 }
 
+/*
+ * The frees are batched: they wait in the ring until
+ * CONFIG_QUARK_SE_IPC_FREE_BATCH of them are pushed, until a message is sent
+ * to the other core, which pops the frees as well, or until the free timer
+ * expires.
+ */
 void ipc_async_free_message(struct message *message)
 {
-	ipc_request_send(IPC_MESSAGE_FREE, message);
+	struct ipc_ring_pair *rings = tx_rings();
+	bool pushed = false, notify = false, arm = false;
+	OS_ERR_TYPE err;
+	uint32_t flags;
+
+	flags = irq_lock();
+	if (rings)
+		pushed = spsc_ring_push(&rings->frees, message);
+	if (!pushed) {
+		ring_stats.overflows++;
+		irq_unlock(flags);
+		ipc_request_send(IPC_MESSAGE_FREE, message);
+		return;
+	}
+	ring_stats.frees++;
+	if (doorbell_pending) {
+		/* Popped by the pending doorbell */
+	} else if (spsc_ring_count(&rings->frees) >= FREE_BATCH) {
+		notify = doorbell_pending = true;
+		ring_stats.free_doorbells++;
+	} else if (!free_timer_armed) {
+		arm = free_timer_armed = true;
+	}
+	irq_unlock(flags);
+
+	if (notify)
+		ring_notify();
+	if (arm) {
+		timer_start(free_timer, FREE_DELAY_MS, &err);
+		if (err != E_OS_OK)
+			/* The frees wait for the next doorbell */
+			free_timer_armed = false;
+	}
+}
+
+static void free_timer_expired(void *data)
+{
+	struct ipc_ring_pair *rings = tx_rings();
+	bool notify = false;
+	uint32_t flags;
+
+	flags = irq_lock();
+	free_timer_armed = false;
+	if (rings && spsc_ring_count(&rings->frees) && !doorbell_pending) {
+		notify = doorbell_pending = true;
+		ring_stats.free_timeouts++;
+	}
+	irq_unlock(flags);
+
+	if (notify)
+		ring_notify();
 }
 
 void ipc_async_init(T_QUEUE queue)
 {
 	ipc_port = port_alloc(queue);
 	port_set_handler(ipc_port, handle_ipc_request_port, NULL);
+	doorbell_timer = timer_create(doorbell_timer_expired, NULL,
+				      DOORBELL_RETRY_MS, false, false, NULL);
+	/* A single free rings the doorbell if the frees are not batched */
+	if (FREE_BATCH > 1)
+		free_timer = timer_create(free_timer_expired, NULL,
+					  FREE_DELAY_MS, false, false, NULL);
 	pr_debug(LOG_MODULE_QUARK_SE, "%s: done port: %d", __func__, ipc_port);
 }
+
+#ifdef CONFIG_TCMD
+
+#include <stdio.h>
+#include <string.h>
+#include "infra/tcmd/handler.h"
+
+/*
+ * Test command to display the statistics of the inter-core rings:
+ * ipc stats [reset]
+ *
+ * The frees per doorbell are the frees popped by a request of the other
+ * core, whatever the reason of the request.
+ *
+ * @param[in]   argc        Number of arguments in the Test Command (including group and name)
+ * @param[in]   argv        Table of null-terminated buffers containing the arguments
+ * @param[in]   ctx         The context to pass back to responses
+ */
+void ipc_stats_tcmd(int argc, char *argv[], struct tcmd_handler_ctx *ctx)
+{
+	struct ipc_ring_stats stats;
+	uint32_t flags, per_doorbell;
+	char buf[80];
+
+	if (argc == 3 && !strcmp(argv[2], "reset")) {
+		flags = irq_lock();
+		memset(&ring_stats, 0, sizeof(ring_stats));
+		irq_unlock(flags);
+		TCMD_RSP_FINAL(ctx, NULL);
+		return;
+	} else if (argc != 2) {
+		TCMD_RSP_ERROR(ctx, TCMD_ERROR_MSG_INV_ARG);
+		return;
+	}
+
+	ipc_ring_get_stats(&stats);
+	snprintf(buf, sizeof(buf),
+		 "tx: %u msgs, %u frees, %u overflows, %u doorbells",
+		 stats.sent, stats.frees, stats.overflows, stats.doorbells);
+	TCMD_RSP_PROVISIONAL(ctx, buf);
+	snprintf(buf, sizeof(buf),
+		 "tx free doorbells: %u full batch, %u timeout",
+		 stats.free_doorbells, stats.free_timeouts);
+	TCMD_RSP_PROVISIONAL(ctx, buf);
+	per_doorbell = stats.rx_doorbells ?
+		       stats.rx_frees * 100 / stats.rx_doorbells : 0;
+	snprintf(buf, sizeof(buf),
+		 "rx: %u popped, %u frees, %u doorbells, %u.%02u frees/doorbell,"
+		 " max %u", stats.received, stats.rx_frees, stats.rx_doorbells,
+		 per_doorbell / 100, per_doorbell % 100, stats.max_batch);
+	TCMD_RSP_FINAL(ctx, buf);
+}
+
+DECLARE_TEST_COMMAND_ENG(ipc, stats, ipc_stats_tcmd);
+
+#endif
@@ -33,6 +33,7 @@
 #include <stdbool.h>
 
 #include "util/compiler.h"
+#include "util/misc.h"
 #include "infra/properties_storage.h"
 #include "infra/panic.h"
 #include "infra/log.h"
@@ -66,6 +67,23 @@
  * value needs to be written, it must fit in the remaining space of the block.
  *
  * The last property in a block is followed by 8 bytes set at value zero.
+ *
+ * The properties of a transaction are written as regular entries within a
+ * single transaction entry, of key TRANSACTION_KEY, ending with a commit word:
+ * | 8 Bytes header | Entry | ... | Entry | Commit word |
+ * As the flash is programmed in order, the commit word is only found if the
+ * whole transaction was written. The entries of a transaction which was not
+ * committed are ignored.
+ *
+ * Obsolete entries are reclaimed by a garbage collection which copies the
+ * valid entries of the oldest block at the write offset, then erases it. It
+ * is run in steps of one entry copy or one block erase by
+ * properties_storage_gc_step(), as long as less than
+ * CONFIG_QUARK_SE_PROPERTIES_STORAGE_SPARE_BLOCKS erased blocks are left, in
+ * addition to the one reserved to the collection. When no spare block is
+ * left, properties_storage_set() runs at most
+ * CONFIG_QUARK_SE_PROPERTIES_STORAGE_SET_GC_STEPS steps itself, and fails
+ * with PROPERTIES_STORAGE_BUSY_ERROR if it could not make room yet.
  */
 
 #define NEXT_MULTIPLE_OF_4(x) (((x) + 3) & ~3)
@@ -74,8 +92,19 @@
 	((part)->start_block + (((block) - (part)->start_block) + 1) % \
 	 (part)->nb_blocks)
 #define OLDEST_BLOCK(part) BLOCK_FOR_OFFSET((part), (part)->current_read_offset)
-#define BLOCK_IS_LAST_FREE(part, block)	\
-	(NEXT_BLOCK((part), (block)) == OLDEST_BLOCK(part))
+#define WRITE_BLOCK(part) BLOCK_FOR_OFFSET((part), (part)->current_write_offset)
+/* Index of a block within its partition */
+#define BLOCK_RANK(part, block) ((block) - (part)->start_block)
+
+/* Maximum number of blocks of a partition */
+#define PARTITION_MAX_BLOCKS 8
+
+/* Garbage collection states of a partition */
+enum {
+	GC_IDLE,  /* no collection in progress */
+	GC_COPY,  /* copying the valid entries of the oldest block */
+	GC_ERASE, /* the oldest block only holds obsolete entries */
+};
 
 typedef struct {
 	/* Start block number */
@@ -92,8 +121,21 @@ typedef struct {
 	uint32_t previous_write_offset;
 	/* Incremented each time a new block is started */
 	uint32_t last_written_block_header;
+	/* Size in bytes of the obsolete entries of each block */
+	uint16_t obsolete_bytes[PARTITION_MAX_BLOCKS];
+	/* Garbage collection state */
+	uint8_t gc_state;
+	/* Offset of the next entry of the oldest block to collect */
+	uint32_t gc_offset;
+	/* Blocks collected while a set was lacking room */
+	uint8_t gc_collections;
 } flash_partition_t;
 
+STATIC_ASSERT(FACTORY_RESET_PERSISTENT_END_BLOCK -
+	      FACTORY_RESET_PERSISTENT_START_BLOCK < PARTITION_MAX_BLOCKS);
+STATIC_ASSERT(FACTORY_RESET_NON_PERSISTENT_END_BLOCK -
+	      FACTORY_RESET_NON_PERSISTENT_START_BLOCK < PARTITION_MAX_BLOCKS);
+
 static flash_partition_t reset_persistent_partition = {
 	.start_block = FACTORY_RESET_PERSISTENT_START_BLOCK,
 	.nb_blocks = FACTORY_RESET_PERSISTENT_END_BLOCK -
@@ -108,6 +150,8 @@ static flash_partition_t not_persistent_partition = {
 	.block_size = EMBEDDED_FLASH_BLOCK_SIZE,
 };
 
+static struct properties_storage_gc_stats gc_stats;
+
 #define PROPERTY_FLAG_NONE          0xFF /* 0b11111111 */
 #define PROPERTY_FLAG_OBSOLETE      0xFE /* 0b11111110 */
 
@@ -132,49 +176,166 @@ typedef struct {
 #define IS_ENTRY_OBSOLETE(prop_header) \
 	(((prop_header).pflags & ~PROPERTY_FLAG_OBSOLETE) == 0)
 
+/* Key of the entries holding a transaction, reserved */
+#define TRANSACTION_KEY 0xfffffffe
+/* Last word of a committed transaction entry */
+#define TRANSACTION_COMMITTED 0x434d4954
+/* Size of the commit word */
+#define TRANSACTION_COMMIT_SIZE 4
+
+/* Transaction in progress: its entry is built in record, the properties
+ * are copied after the header */
+static struct {
+	bool started;
+	bool factory_reset_persistent;
+	/* Size of the properties entries */
+	uint16_t len;
+	uint32_t record[(PROPERTY_HEADER_SIZE +
+			 PROPERTIES_STORAGE_MAX_TRANSACTION_LEN +
+			 TRANSACTION_COMMIT_SIZE) / 4];
+} transaction;
+
+STATIC_ASSERT((PROPERTIES_STORAGE_MAX_TRANSACTION_LEN & 3) == 0);
+/* A transaction entry must fit in a block, see properties_storage_set */
+STATIC_ASSERT(BLOCK_HEADER_SIZE + PROPERTY_HEADER_SIZE +
+	      PROPERTIES_STORAGE_MAX_TRANSACTION_LEN +
+	      TRANSACTION_COMMIT_SIZE + 8 <= EMBEDDED_FLASH_BLOCK_SIZE);
+
 /* This implementation maintains an index of all properties in RAM,
  * the index is re-generated at startup by scanning the content of the
- * blocks allocated to the properties storage */
+ * blocks allocated to the properties storage.
+ *
+ * The slots of the index are found by key through an open addressing hash
+ * table (linear probing), and the unused slots are chained in a free list,
+ * so that looking up, adding or removing a property does not walk the
+ * whole index. */
 typedef struct {
 	uint32_t key;
 	uint16_t len;
-	uint8_t used;    /* false if the element is unused */
-	uint8_t reserved;
+	uint8_t used;      /* false if the element is unused */
+	uint8_t next_free; /* next unused slot + 1, 0 for none */
 	uint32_t offset; /* in byte, from byte 0 of block 0 (possibly outside partition) */
+#ifdef CONFIG_QUARK_SE_PROPERTIES_STORAGE_VALUE_CACHE
+	/* Copy of the value of short properties, valid if value_cached is set */
+	uint8_t value_cached;
+	uint8_t value[CONFIG_QUARK_SE_PROPERTIES_STORAGE_VALUE_CACHE_LEN];
+#endif
 } property_info_t;
 
+/* Hash table size, a power of 2 at least twice the number of properties */
+#define PROPERTY_HASH_BITS 6
+#define PROPERTY_HASH_SIZE (1 << PROPERTY_HASH_BITS)
+#define PROPERTY_HASH_MASK (PROPERTY_HASH_SIZE - 1)
+/* Fibonacci hashing of the key */
+#define PROPERTY_HASH(key) \
+	(((uint32_t)(key) * 2654435761U) >> (32 - PROPERTY_HASH_BITS))
+
+STATIC_ASSERT(PROPERTY_HASH_SIZE >= 2 * PROPERTIES_STORAGE_MAX_NB_PROPERTIES);
+STATIC_ASSERT(PROPERTIES_STORAGE_MAX_NB_PROPERTIES < 0xff);
+
 static property_info_t ram_cache[PROPERTIES_STORAGE_MAX_NB_PROPERTIES];
+/* Index in ram_cache + 1 of the property hashed at this position, 0 if empty */
+static uint8_t ram_cache_hash[PROPERTY_HASH_SIZE];
+/* First unused slot of ram_cache + 1, 0 if the index is full */
+static uint8_t ram_cache_free;
+
+/* Position of key in the hash table, or of the empty entry ending its probe
+ * sequence if it is not indexed */
+static uint8_t find_hash_position(uint32_t key)
+{
+	uint8_t pos = PROPERTY_HASH(key);
+
+	while (ram_cache_hash[pos] != 0 &&
+	       ram_cache[ram_cache_hash[pos] - 1].key != key)
+		pos = (pos + 1) & PROPERTY_HASH_MASK;
+	return pos;
+}
 
 static property_info_t *get_property_info(uint32_t key)
 {
-	for (int i = 0; i < PROPERTIES_STORAGE_MAX_NB_PROPERTIES; ++i) {
-		if (ram_cache[i].key == key && ram_cache[i].used == true)
-			return &ram_cache[i];
-	}
-	return NULL;
+	uint8_t slot = ram_cache_hash[find_hash_position(key)];
+
+	return slot ? &ram_cache[slot - 1] : NULL;
 }
-static property_info_t *alloc_property_info()
+
+/* Allocate a property info and index it for key, which must not be indexed */
+static property_info_t *alloc_property_info(uint32_t key)
 {
-	for (int i = 0; i < PROPERTIES_STORAGE_MAX_NB_PROPERTIES; ++i) {
-		if (ram_cache[i].used == false) {
-			ram_cache[i].used = true;
-			return &ram_cache[i];
-		}
-	}
-	return NULL;
+	uint8_t slot = ram_cache_free;
+	property_info_t *p;
+
+	if (slot == 0)
+		return NULL;
+	p = &ram_cache[slot - 1];
+	ram_cache_free = p->next_free;
+	p->used = true;
+	p->key = key;
+#ifdef CONFIG_QUARK_SE_PROPERTIES_STORAGE_VALUE_CACHE
+	p->value_cached = false;
+#endif
+	ram_cache_hash[find_hash_position(key)] = slot;
+	return p;
 }
 
 static void free_property_info(property_info_t *p)
 {
+	uint8_t hole = find_hash_position(p->key);
+	uint8_t pos = hole;
+	uint8_t home;
+
 	assert(p->used == true);
+	assert(ram_cache_hash[hole] == p - ram_cache + 1);
+
+	/* Backward shift deletion: move up the following entries of the probe
+	 * sequence that would no longer be reachable through the hole */
+	while (1) {
+		pos = (pos + 1) & PROPERTY_HASH_MASK;
+		if (ram_cache_hash[pos] == 0)
+			break;
+		home = PROPERTY_HASH(ram_cache[ram_cache_hash[pos] - 1].key);
+		if (((pos - home) & PROPERTY_HASH_MASK) >=
+		    ((pos - hole) & PROPERTY_HASH_MASK)) {
+			ram_cache_hash[hole] = ram_cache_hash[pos];
+			hole = pos;
+		}
+	}
+	ram_cache_hash[hole] = 0;
+
 	p->used = false;
+	p->next_free = ram_cache_free;
+	ram_cache_free = p - ram_cache + 1;
 }
 
 static void clear_all_property_info()
 {
-	for (int i = 0; i < PROPERTIES_STORAGE_MAX_NB_PROPERTIES; ++i)
+	for (int i = 0; i < PROPERTIES_STORAGE_MAX_NB_PROPERTIES; ++i) {
 		ram_cache[i].used = false;
+		ram_cache[i].next_free =
+			i + 2 <= PROPERTIES_STORAGE_MAX_NB_PROPERTIES ? i + 2 : 0;
+	}
+	ram_cache_free = 1;
+	memset(ram_cache_hash, 0, sizeof(ram_cache_hash));
+}
+
+static uint8_t nb_free_property_info(void)
+{
+	uint8_t nb = 0;
+
+	for (uint8_t slot = ram_cache_free; slot != 0;
+	     slot = ram_cache[slot - 1].next_free)
+		nb++;
+	return nb;
+}
+
+#ifdef CONFIG_QUARK_SE_PROPERTIES_STORAGE_VALUE_CACHE
+/* Keep a copy of the value of a short property */
+static void cache_property_value(property_info_t *p, const uint8_t *buf)
+{
+	p->value_cached = p->len <= sizeof(p->value);
+	if (p->value_cached)
+		memcpy(p->value, buf, p->len);
 }
+#endif
 
 static bool is_entry_last_in_block(uint32_t				offset,
 				   const property_flash_header_t *	pfh)
@@ -203,12 +364,117 @@ static bool set_entry_last_in_block(uint32_t				offset,
 	return ret == DRV_RC_OK && ret_len == 2;
 }
 
-/* Find next free offset in block */
+/* Check if the commit word ending a transaction entry was written */
+static bool is_transaction_committed(uint32_t				offset,
+				     const property_flash_header_t *	pfh)
+{
+	uint32_t commit;
+	unsigned int ret_len;
+	DRIVER_API_RC __maybe_unused ret = soc_flash_read(
+		offset + PROPERTY_HEADER_SIZE + pfh->len -
+		TRANSACTION_COMMIT_SIZE, 1, &ret_len, &commit);
+
+	assert(ret == DRV_RC_OK && ret_len == 1);
+	return commit == TRANSACTION_COMMITTED;
+}
+
+/* Partition holding the entry at offset */
+static flash_partition_t *partition_for_offset(uint32_t offset)
+{
+	flash_partition_t *part = &reset_persistent_partition;
+
+	if (offset >= part->start_block * part->block_size &&
+	    offset < (part->start_block + part->nb_blocks) * part->block_size)
+		return part;
+	return &not_persistent_partition;
+}
+
+/* Number of erased blocks of a partition */
+static uint16_t free_blocks(const flash_partition_t *part)
+{
+	return part->nb_blocks - 1 -
+	       (WRITE_BLOCK(part) - OLDEST_BLOCK(part) + part->nb_blocks) %
+	       part->nb_blocks;
+}
+
+static uint32_t remaining_space_in_block(const flash_partition_t *part)
+{
+	return part->block_size -
+	       (part->current_write_offset % part->block_size);
+}
+
+/* Account an entry which became obsolete to its block */
+static void add_obsolete_bytes(flash_partition_t *part, uint32_t offset,
+			       uint16_t len)
+{
+	part->obsolete_bytes[BLOCK_RANK(part, BLOCK_FOR_OFFSET(part, offset))] +=
+		NEXT_MULTIPLE_OF_4(PROPERTY_HEADER_SIZE + len);
+}
+
+static properties_storage_status_t make_entry_obsolete_in_flash(uint32_t offset)
+{
+	/* The element was already present in the RAM index, make the previous
+	 * entry obsolete */
+	property_flash_header_t pfh = { 0 };
+	unsigned int ret_len;
+	DRIVER_API_RC ret = soc_flash_read(offset, 2, &ret_len,
+					   (uint32_t *)&pfh);
+
+	assert(ret == DRV_RC_OK && ret_len == 2);
+
+	assert(!IS_ENTRY_OBSOLETE(pfh));
+	pfh.pflags &= PROPERTY_FLAG_OBSOLETE;
+	ret = soc_flash_write(offset, 2, &ret_len, (uint32_t *)&pfh);
+	if (ret != DRV_RC_OK)
+		panic(67);
+	add_obsolete_bytes(partition_for_offset(offset), offset, pfh.len);
+	return ret;
+}
+
+/* Start writing in the next block, which must be free */
+static void start_next_block(flash_partition_t *part)
+{
+	/* Flag the last entry as last in its block */
+	property_flash_header_t pfh = { 0 };
+	unsigned int ret_len;
+	DRIVER_API_RC __maybe_unused ret;
+
+	assert(free_blocks(part) > 0);
+	if (part->previous_write_offset != part->current_write_offset) {
+		ret = soc_flash_read(part->previous_write_offset, 2, &ret_len,
+				     (uint32_t *)&pfh);
+		assert(ret == DRV_RC_OK && ret_len == 2);
+		set_entry_last_in_block(part->previous_write_offset, &pfh);
+	}
+
+	/* Init the next free block by writing its header */
+	uint16_t next_block = NEXT_BLOCK(part, WRITE_BLOCK(part));
+	part->last_written_block_header++;
+	if (part->last_written_block_header == UNUSED_BLOCK_HEADER)
+		part->last_written_block_header = 0;
+	ret = soc_flash_write(next_block * part->block_size, 1,
+			      &ret_len,
+			      (uint32_t *)&(part->last_written_block_header));
+	if (ret != DRV_RC_OK)
+		panic(67);
+	part->current_write_offset = next_block * part->block_size +
+				     BLOCK_HEADER_SIZE;
+	part->previous_write_offset = part->current_write_offset;
+}
+
+/* Find next free offset in block, and the offset of the last entry of the
+ * block (the free offset if the block is empty). If the last entry is
+ * already flagged as last in the block, return the offset of this flag and
+ * set full */
 static uint32_t find_next_free_offset(const flash_partition_t *part,
-				      uint16_t block, bool *status)
+				      uint16_t block, uint32_t *last_offset,
+				      bool *full, bool *status)
 {
+	static const uint32_t last_in_block[2] = { 0, 0 };
+
 	*status = true;
 	uint32_t offset = block * part->block_size + BLOCK_HEADER_SIZE; /* starts after header */
+	*last_offset = offset;
 	property_flash_header_t prop_header = { 0 };
 	while (1) {
 		unsigned int ret_len;
@@ -222,6 +488,11 @@ static uint32_t find_next_free_offset(const flash_partition_t *part,
 		}
 		if (prop_header.key == 0xffffffff)
 			break;
+		*full = memcmp(&prop_header, last_in_block, PROPERTY_HEADER_SIZE) ==
+			0;
+		if (*full)
+			break;
+		*last_offset = offset;
 		offset += NEXT_MULTIPLE_OF_4(
 			PROPERTY_HEADER_SIZE + prop_header.len);
 	}
@@ -240,6 +511,10 @@ static bool init_read_write_offset_from_flash(flash_partition_t *part)
 	uint32_t max_used_block_header = 0xffffffff;
 	uint32_t nb_unused_block = 0;
 
+	part->gc_state = GC_IDLE;
+	part->gc_collections = 0;
+	memset(part->obsolete_bytes, 0, sizeof(part->obsolete_bytes));
+
 	for (b = part->start_block;
 	     b < part->start_block + part->nb_blocks;
 	     ++b) {
@@ -265,11 +540,10 @@ static bool init_read_write_offset_from_flash(flash_partition_t *part)
 	}
 
 	/* The current implementation is designed so that at least one block
-	 * must be free at all time, i.e. it's header is equal to 0xffffffff.
-	 * If it's not the case at startup, this indicates a corrupted data and
-	 * the init fails, in turn causing a reformatting of the partition. */
-	if (nb_unused_block == 0)
-		return false;
+	 * must be free at all time, i.e. it's header is equal to 0xffffffff,
+	 * except while the garbage collection copies the oldest block in the
+	 * last free one. Its collection is then completed before any other
+	 * write, see properties_storage_set(). */
 
 	/* Case of the yet unused partition */
 	if (min_used_block_header == UNUSED_BLOCK_HEADER &&
@@ -308,9 +582,16 @@ static bool init_read_write_offset_from_flash(flash_partition_t *part)
 				    BLOCK_HEADER_SIZE;
 	part->last_written_block_header = max_used_block_header;
 	bool status;
-	part->current_write_offset = find_next_free_offset(part, max_used_block,
-							   &status);
-	part->previous_write_offset = part->current_write_offset;
+	bool full = false;
+	part->current_write_offset = find_next_free_offset(
+		part, max_used_block, &part->previous_write_offset, &full,
+		&status);
+	/* Complete a switch to the next block interrupted by a power loss */
+	if (status && full) {
+		if (nb_unused_block == 0)
+			return false;
+		start_next_block(part);
+	}
 	return status;
 }
 
@@ -333,10 +614,75 @@ static uint32_t get_next_property_offset(
 		       PROPERTY_HEADER_SIZE + prop_header->len);
 }
 
+/* Store the entry at offset in the RAM index if it is not obsolete */
+static void index_entry(flash_partition_t *part, uint32_t offset,
+			const property_flash_header_t *prop_header)
+{
+	if (IS_ENTRY_OBSOLETE(*prop_header)) {
+		add_obsolete_bytes(part, offset, prop_header->len);
+		return;
+	}
+
+	/* The entry is the most up-to-date one for this property, store it
+	 * in our RAM index */
+	property_info_t *p = get_property_info(prop_header->key);
+	if (p != NULL) {
+		/* Older copy left by an interrupted set or garbage
+		 * collection */
+		make_entry_obsolete_in_flash(p->offset);
+#ifdef CONFIG_QUARK_SE_PROPERTIES_STORAGE_VALUE_CACHE
+		p->value_cached = false;
+#endif
+	} else {
+		p = alloc_property_info(prop_header->key);
+	}
+	/* As we reload a previous valid storage, we can't overflow by
+	 * design */
+	assert(p);
+
+	p->len = prop_header->len;
+	p->offset = offset;
+}
+
+/* Store the entries of the transaction at offset in the RAM index, if it was
+ * committed. Return false if the transaction is corrupted */
+static bool index_transaction(flash_partition_t *part, uint32_t offset,
+			      const property_flash_header_t *prop_header)
+{
+	uint32_t end = offset + PROPERTY_HEADER_SIZE + prop_header->len -
+		       TRANSACTION_COMMIT_SIZE;
+	uint32_t entry = offset + PROPERTY_HEADER_SIZE;
+	property_flash_header_t entry_header;
+
+	if (prop_header->len < TRANSACTION_COMMIT_SIZE ||
+	    !is_transaction_committed(offset, prop_header)) {
+		/* Interrupted commit, the transaction is dropped */
+		add_obsolete_bytes(part, offset, prop_header->len);
+		return true;
+	}
+
+	while (entry < end) {
+		unsigned int ret_len;
+		DRIVER_API_RC ret = soc_flash_read(entry, 2, &ret_len,
+						   (uint32_t *)&entry_header);
+		if (ret != DRV_RC_OK || ret_len != 2 ||
+		    entry_header.key == TRANSACTION_KEY ||
+		    entry + NEXT_MULTIPLE_OF_4(PROPERTY_HEADER_SIZE +
+					       entry_header.len) > end)
+			return false;
+		index_entry(part, entry, &entry_header);
+		entry += NEXT_MULTIPLE_OF_4(PROPERTY_HEADER_SIZE +
+					    entry_header.len);
+	}
+	/* The transaction header and commit word are never valid */
+	add_obsolete_bytes(part, offset, TRANSACTION_COMMIT_SIZE);
+	return true;
+}
+
 /* Fill the global properties index in RAM
  * As we can't recover errors at this level, just return false if
  * an error occured */
-static bool fill_index_from_flash(const flash_partition_t *part)
+static bool fill_index_from_flash(flash_partition_t *part)
 {
 	/* Case of a completely empty store */
 	if (part->current_read_offset == part->current_write_offset)
@@ -355,18 +701,10 @@ static bool fill_index_from_flash(const flash_partition_t *part)
 	if (ret != DRV_RC_OK || ret_len != 2 || prop_header.key == 0xffffffff)
 		return false;
 	while (1) {
-		if (!IS_ENTRY_OBSOLETE(prop_header)) {
-			/* The entry is the most up-to-date one for this property, store it
-			 * in our RAM index */
-			property_info_t *p = alloc_property_info();
-			/* As we reload a previous valid storage, we can't overflow by
-			 * design */
-			assert(p);
-
-			p->key = prop_header.key;
-			p->len = prop_header.len;
-			p->offset = offset;
-		}
+		if (prop_header.key != TRANSACTION_KEY)
+			index_entry(part, offset, &prop_header);
+		else if (!index_transaction(part, offset, &prop_header))
+			return false;
 		offset = get_next_property_offset(part, offset, &prop_header);
 		ret = soc_flash_read(offset, 2, &ret_len,
 				     (uint32_t *)&prop_header);
@@ -432,153 +770,167 @@ void properties_storage_format_all(void)
 	properties_storage_init();
 }
 
-/* Copy the entry at src_offset to the current write offset */
-static void copy_entry_if_not_obsolete(flash_partition_t *	part,
-				       uint32_t *		src_offset,
-				       bool *			last_in_block)
+/* Copy the entry at src_offset to the current write offset if it is the
+ * valid one of its property */
+static void copy_entry_if_not_obsolete(
+	flash_partition_t *part, uint32_t src_offset,
+	const property_flash_header_t *src_header)
 {
 	uint8_t tmp[PROPERTY_HEADER_SIZE + PROPERTIES_STORAGE_MAX_VALUE_LEN];
 	property_flash_header_t *prop_header = (property_flash_header_t *)tmp;
-
+	const unsigned int value_size = NEXT_MULTIPLE_OF_4(src_header->len) / 4;
+	property_info_t *prop_info = get_property_info(src_header->key);
 	unsigned int ret_len;
-	DRIVER_API_RC ret =
-		soc_flash_read(*src_offset, 2, &ret_len, (uint32_t *)tmp);
-
-	assert(ret == DRV_RC_OK && ret_len == 2);
-	assert(prop_header->key != 0xffffffff);
+	DRIVER_API_RC ret;
 
-	*last_in_block = is_entry_last_in_block(*src_offset, prop_header);
+	/* Scraps obsolete content, and the older copies which were not flagged
+	 * obsolete because of a power loss */
+	if (prop_info == NULL || prop_info->offset != src_offset)
+		return;
 
-	const unsigned int value_size = NEXT_MULTIPLE_OF_4(prop_header->len) /
-					4;
+	*prop_header = *src_header;
+	ret = soc_flash_read(src_offset + PROPERTY_HEADER_SIZE, value_size,
+			     &ret_len, (uint32_t *)(tmp + PROPERTY_HEADER_SIZE));
+	assert(ret == DRV_RC_OK && ret_len == value_size);
 
-	/* Scraps obsolete content */
-	if (!IS_ENTRY_OBSOLETE(*prop_header)) {
-		ret =
-			soc_flash_read(*src_offset + PROPERTY_HEADER_SIZE,
-				       value_size,
-				       &ret_len,
-				       (uint32_t *)(tmp + PROPERTY_HEADER_SIZE));
-		assert(ret == DRV_RC_OK && ret_len == value_size);
-		/* Reset all flags */
-		prop_header->pflags = PROPERTY_FLAG_NONE;
-		ret =
-			soc_flash_write(part->current_write_offset, 2 +
-					value_size,
-					&ret_len,
-					(uint32_t *)tmp);
-		assert(ret == DRV_RC_OK && ret_len == 2 + value_size);
+	/* Same room as for a new entry, see properties_storage_set */
+	if (NEXT_MULTIPLE_OF_4(PROPERTY_HEADER_SIZE + prop_header->len + 8) >
+	    remaining_space_in_block(part))
+		start_next_block(part);
 
-		property_info_t *prop_info = get_property_info(prop_header->key);
-		/* Update RAM index for this entry */
-		assert(prop_info);
-		prop_info->offset = part->current_write_offset;
+	/* Reset all flags */
+	prop_header->pflags = PROPERTY_FLAG_NONE;
+	ret = soc_flash_write(part->current_write_offset, 2 + value_size,
+			      &ret_len, (uint32_t *)tmp);
+	assert(ret == DRV_RC_OK && ret_len == 2 + value_size);
 
-		part->previous_write_offset = part->current_write_offset;
-		part->current_write_offset += PROPERTY_HEADER_SIZE +
-					      value_size * 4;
-	}
+	/* Update RAM index for this entry. The source is made obsolete so
+	 * that it cannot come back if the property is changed before the
+	 * oldest block is erased */
+	make_entry_obsolete_in_flash(src_offset);
+	prop_info->offset = part->current_write_offset;
 
-	*src_offset += PROPERTY_HEADER_SIZE + value_size * 4;
+	part->previous_write_offset = part->current_write_offset;
+	part->current_write_offset += PROPERTY_HEADER_SIZE + value_size * 4;
 }
 
-static properties_storage_status_t make_entry_obsolete_in_flash(uint32_t offset)
+/* Copy the valid entries found at src_offset, a single entry or the ones of
+ * a committed transaction, then move src_offset to the next entry */
+static void collect_entry(flash_partition_t *part, uint32_t *src_offset,
+			  bool *last_in_block)
 {
-	/* The element was already present in the RAM index, make the previous
-	 * entry obsolete */
-	property_flash_header_t pfh = { 0 };
+	property_flash_header_t prop_header;
 	unsigned int ret_len;
-	DRIVER_API_RC ret = soc_flash_read(offset, 2, &ret_len,
-					   (uint32_t *)&pfh);
+	DRIVER_API_RC __maybe_unused ret =
+		soc_flash_read(*src_offset, 2, &ret_len,
+			       (uint32_t *)&prop_header);
 
 	assert(ret == DRV_RC_OK && ret_len == 2);
+	assert(prop_header.key != 0xffffffff);
+
+	*last_in_block = is_entry_last_in_block(*src_offset, &prop_header);
+
+	if (prop_header.key != TRANSACTION_KEY) {
+		copy_entry_if_not_obsolete(part, *src_offset, &prop_header);
+	} else if (is_transaction_committed(*src_offset, &prop_header)) {
+		/* The properties of a transaction are copied as single
+		 * entries: the transaction was already committed */
+		uint32_t end = *src_offset + PROPERTY_HEADER_SIZE +
+			       prop_header.len - TRANSACTION_COMMIT_SIZE;
+		uint32_t entry = *src_offset + PROPERTY_HEADER_SIZE;
+		property_flash_header_t entry_header;
+
+		while (entry < end) {
+			ret = soc_flash_read(entry, 2, &ret_len,
+					     (uint32_t *)&entry_header);
+			assert(ret == DRV_RC_OK && ret_len == 2);
+			copy_entry_if_not_obsolete(part, entry, &entry_header);
+			entry += NEXT_MULTIPLE_OF_4(PROPERTY_HEADER_SIZE +
+						    entry_header.len);
+		}
+	}
 
-	assert(!IS_ENTRY_OBSOLETE(pfh));
-	pfh.pflags &= PROPERTY_FLAG_OBSOLETE;
-	ret = soc_flash_write(offset, 2, &ret_len, (uint32_t *)&pfh);
-	if (ret != DRV_RC_OK)
-		panic(67);
-	return ret;
+	*src_offset += NEXT_MULTIPLE_OF_4(PROPERTY_HEADER_SIZE +
+					  prop_header.len);
 }
 
-/* Initialize the next block to prepare writting in it. This may involve
- * shifting the oldest blocks content into the new one to get rid of obsolete
- * properties to make space */
-static void prepare_next_block(flash_partition_t *part)
+/* Check if the oldest block of a partition needs to be collected: when the
+ * spare blocks are used up and it holds obsolete entries, or when forced to
+ * make space */
+static bool gc_wanted(const flash_partition_t *part, bool force)
 {
-	/* Flag the last entry as last in its block */
-	property_flash_header_t pfh = { 0 };
-	unsigned int ret_len;
-	DRIVER_API_RC __maybe_unused ret = soc_flash_read(
-		part->previous_write_offset, 2, &ret_len, (uint32_t *)&pfh);
+	uint16_t oldest_block = OLDEST_BLOCK(part);
 
-	assert(ret == DRV_RC_OK && ret_len == 2);
-	set_entry_last_in_block(part->previous_write_offset, &pfh);
+	if (part->gc_state != GC_IDLE)
+		return true;
+	if (oldest_block == WRITE_BLOCK(part))
+		return false;
+	return force ||
+	       (free_blocks(part) <=
+		CONFIG_QUARK_SE_PROPERTIES_STORAGE_SPARE_BLOCKS &&
+		part->obsolete_bytes[BLOCK_RANK(part, oldest_block)] != 0);
+}
 
-	/* Init the next free block by writing its header */
-	uint16_t next_block = NEXT_BLOCK(part, BLOCK_FOR_OFFSET(part,
-								part->
-								current_write_offset));
-	part->last_written_block_header++;
-	if (part->last_written_block_header == UNUSED_BLOCK_HEADER)
-		part->last_written_block_header = 0;
-	ret = soc_flash_write(next_block * part->block_size, 1,
-			      &ret_len,
-			      (uint32_t *)&(part->last_written_block_header));
-	if (ret != DRV_RC_OK)
-		panic(67);
-	part->current_write_offset = next_block * part->block_size +
-				     BLOCK_HEADER_SIZE;
+/* Copy one entry or erase the oldest block of a partition, return false if
+ * there was nothing to collect */
+static bool gc_partition_step(flash_partition_t *part, bool force)
+{
+	uint16_t oldest_block = OLDEST_BLOCK(part);
+	bool last_in_block;
 
-	if (BLOCK_IS_LAST_FREE(part, next_block)) {
-		/* We are starting to write on the last free block, but we always
-		 * need at least one completely free block so we need to free the
-		 * oldest used block. For this, we copy the oldest block's
-		 * content in the new one, and scrap all obsolete entries */
-		uint16_t oldest_block = OLDEST_BLOCK(part);
-		uint32_t src_offset = oldest_block * part->block_size +
-				      BLOCK_HEADER_SIZE;
-
-		bool last_in_block = false;
-		/* Copy oldest block in new one. Note that the write_offset of the
-		 * partition is updated within the copy_entry_if_not_obsolete
-		 * function */
-		while (!last_in_block)
-			copy_entry_if_not_obsolete(part, &src_offset,
-						   &last_in_block);
+	if (!gc_wanted(part, force))
+		return false;
 
+	switch (part->gc_state) {
+	case GC_IDLE:
+		part->gc_offset = oldest_block * part->block_size +
+				  BLOCK_HEADER_SIZE;
+		part->gc_state = GC_COPY;
+	/* Fall through */
+	case GC_COPY:
+		/* Note that the write offset of the partition is updated within
+		 * the copy_entry_if_not_obsolete function */
+		collect_entry(part, &part->gc_offset, &last_in_block);
+		if (last_in_block)
+			part->gc_state = GC_ERASE;
+		break;
+	case GC_ERASE:
+		/* We are done copying the oldest block, we can now clear it */
 		part->current_read_offset =
-			NEXT_BLOCK(part,
-				   oldest_block) * part->block_size +
+			NEXT_BLOCK(part, oldest_block) * part->block_size +
 			BLOCK_HEADER_SIZE;
-
-		/* We are done copying one block into the other, we can now clear
-		 * the oldest block */
-		DRIVER_API_RC ret = soc_flash_block_erase(oldest_block, 1);
-		if (ret != DRV_RC_OK)
+		part->obsolete_bytes[BLOCK_RANK(part, oldest_block)] = 0;
+		part->gc_state = GC_IDLE;
+		if (soc_flash_block_erase(oldest_block, 1) != DRV_RC_OK)
 			panic(67);
+		gc_stats.erased_blocks++;
+		break;
 	}
+	gc_stats.steps++;
+	return true;
 }
 
-properties_storage_status_t properties_storage_set(
-	uint32_t key,
-	const uint8_t *buf,
-	uint16_t len, bool factory_reset_persistent)
+bool properties_storage_gc_step(void)
 {
-	if (len > PROPERTIES_STORAGE_MAX_VALUE_LEN)
-		return PROPERTIES_STORAGE_INVALID_ARG;
+	if (!gc_partition_step(&reset_persistent_partition, false))
+		gc_partition_step(&not_persistent_partition, false);
 
-	unsigned int ret_len;
-	flash_partition_t *part = factory_reset_persistent ?
-				  &reset_persistent_partition : &
-				  not_persistent_partition;
+	return gc_wanted(&reset_persistent_partition, false) ||
+	       gc_wanted(&not_persistent_partition, false);
+}
 
-	uint16_t old_write_block = BLOCK_FOR_OFFSET(part,
-						    part->current_write_offset);
+void properties_storage_get_gc_stats(struct properties_storage_gc_stats *stats)
+{
+	*stats = gc_stats;
+}
 
-	uint32_t remaining_space_in_block = part->block_size -
-					    (part->current_write_offset %
-					     part->block_size);
+/* Make room for writing size bytes at the write offset of a partition,
+ * within its current block, running at most
+ * CONFIG_QUARK_SE_PROPERTIES_STORAGE_SET_GC_STEPS garbage collection steps */
+static properties_storage_status_t reserve_space(flash_partition_t *part,
+						 uint16_t size)
+{
+	uint16_t nb_steps = 0;
 
 	/* Ensure we have enough contiguous space in the currently written block */
 	/* The "+8" here is important: it ensures that after writing the new
@@ -588,22 +940,54 @@ properties_storage_status_t properties_storage_set(
 	 *   block
 	 * - we reserve 8 bytes for potentially flagging this entry as the last
 	 *   one in the block
+	 * The garbage collection uses the last free block to copy the oldest
+	 * one: it must be completed before writing anything else.
 	 */
-	while (NEXT_MULTIPLE_OF_4(PROPERTY_HEADER_SIZE + len + 8) >
-	       remaining_space_in_block) {
-		/* We don't have enough space in current block, prepare the next one */
-		prepare_next_block(part);
-
-		/* If we have wrapped around looking for a slot large enough, it
-		 * means that the store is completely filled with valid entries */
-		if (old_write_block ==
-		    BLOCK_FOR_OFFSET(part, part->current_write_offset))
-			return PROPERTIES_STORAGE_BOUNDS_ERROR;
+	while (free_blocks(part) == 0 ||
+	       NEXT_MULTIPLE_OF_4(size + 8) > remaining_space_in_block(part)) {
+		/* We don't have enough space in current block, use a spare one,
+		 * keeping the last free block for the garbage collection */
+		if (free_blocks(part) > 1) {
+			start_next_block(part);
+			continue;
+		}
 
-		remaining_space_in_block = part->block_size -
-					   (part->current_write_offset %
-					    part->block_size);
+		/* No spare block left: collect the oldest block. If we have
+		 * collected all the blocks without finding a slot large
+		 * enough, it means that the store is completely filled with
+		 * valid entries */
+		if (nb_steps++ == CONFIG_QUARK_SE_PROPERTIES_STORAGE_SET_GC_STEPS)
+			return PROPERTIES_STORAGE_BUSY_ERROR;
+		if (part->gc_collections == part->nb_blocks ||
+		    !gc_partition_step(part, true))
+			return PROPERTIES_STORAGE_BOUNDS_ERROR;
+		if (part->gc_state == GC_IDLE) {
+			part->gc_collections++;
+			gc_stats.sync_collections++;
+		}
 	}
+	part->gc_collections = 0;
+	return PROPERTIES_STORAGE_SUCCESS;
+}
+
+properties_storage_status_t properties_storage_set(
+	uint32_t key,
+	const uint8_t *buf,
+	uint16_t len, bool factory_reset_persistent)
+{
+	if (len > PROPERTIES_STORAGE_MAX_VALUE_LEN || key == TRANSACTION_KEY)
+		return PROPERTIES_STORAGE_INVALID_ARG;
+
+	unsigned int ret_len;
+	flash_partition_t *part = factory_reset_persistent ?
+				  &reset_persistent_partition : &
+				  not_persistent_partition;
+
+	properties_storage_status_t status =
+		reserve_space(part, PROPERTY_HEADER_SIZE + len);
+
+	if (status != PROPERTIES_STORAGE_SUCCESS)
+		return status;
 
 	/* From this point we know we have enough space available at
 	 * current_write_offset to write the new entry. */
@@ -633,13 +1017,15 @@ properties_storage_status_t properties_storage_set(
 			return PROPERTIES_STORAGE_IO_ERROR;
 	} else {
 		/* Allocate a new property info in our cache */
-		p = alloc_property_info();
+		p = alloc_property_info(key);
 		if (p == NULL)
 			return PROPERTIES_STORAGE_BOUNDS_ERROR;
-		p->key = key;
 	}
 	p->offset = part->previous_write_offset;
 	p->len = len;
+#ifdef CONFIG_QUARK_SE_PROPERTIES_STORAGE_VALUE_CACHE
+	cache_property_value(p, buf);
+#endif
 
 	return PROPERTIES_STORAGE_SUCCESS;
 }
@@ -656,15 +1042,8 @@ properties_storage_status_t properties_storage_get_info(
 		return PROPERTIES_STORAGE_KEY_NOT_FOUND_ERROR;
 
 	*len = pinfo->len;
-	*factory_reset_persistent = false;
-	if (pinfo->offset >= reset_persistent_partition.start_block *
-	    reset_persistent_partition.block_size &&
-	    pinfo->offset <
-	    (reset_persistent_partition.start_block +
-	     reset_persistent_partition.nb_blocks) *
-	    reset_persistent_partition.block_size) {
-		*factory_reset_persistent = true;
-	}
+	*factory_reset_persistent = partition_for_offset(pinfo->offset) ==
+				    &reset_persistent_partition;
 	return PROPERTIES_STORAGE_SUCCESS;
 }
 
@@ -684,11 +1063,18 @@ properties_storage_status_t properties_storage_get(uint32_t key, uint8_t *buf,
 	if (len < pinfo->len)
 		return PROPERTIES_STORAGE_BOUNDS_ERROR;
 
+#ifdef CONFIG_QUARK_SE_PROPERTIES_STORAGE_VALUE_CACHE
+	if (pinfo->value_cached) {
+		memcpy(buf, pinfo->value, pinfo->len);
+		return PROPERTIES_STORAGE_SUCCESS;
+	}
+#endif
+
 	/* Read the multiple of 4 part first directly in the output variable */
 	unsigned int ret_len;
 	DRIVER_API_RC ret;
 
-	if (pinfo->len > 4) {
+	if (pinfo->len >= 4) {
 		ret =
 			soc_flash_read(pinfo->offset + PROPERTY_HEADER_SIZE,
 				       (pinfo->len & ~3) / 4, &ret_len,
@@ -699,7 +1085,7 @@ properties_storage_status_t properties_storage_get(uint32_t key, uint8_t *buf,
 		}
 
 		if ((pinfo->len & 3) == 0)
-			return PROPERTIES_STORAGE_SUCCESS;
+			goto done;
 	}
 
 	/* Read the rest */
@@ -716,6 +1102,10 @@ properties_storage_status_t properties_storage_get(uint32_t key, uint8_t *buf,
 	for (int i = 0; i < (pinfo->len & 3); ++i)
 		buf[(pinfo->len & ~3) + i] = data[i];
 
+done:
+#ifdef CONFIG_QUARK_SE_PROPERTIES_STORAGE_VALUE_CACHE
+	cache_property_value(pinfo, buf);
+#endif
 	return PROPERTIES_STORAGE_SUCCESS;
 }
 
@@ -732,3 +1122,132 @@ properties_storage_status_t properties_storage_delete(uint32_t key)
 
 	return PROPERTIES_STORAGE_SUCCESS;
 }
+
+void properties_storage_transaction_begin(bool factory_reset_persistent)
+{
+	transaction.started = true;
+	transaction.factory_reset_persistent = factory_reset_persistent;
+	transaction.len = 0;
+}
+
+properties_storage_status_t properties_storage_transaction_set(
+	uint32_t key, const uint8_t *buf, uint16_t len)
+{
+	uint8_t *entries = (uint8_t *)transaction.record + PROPERTY_HEADER_SIZE;
+	property_flash_header_t *prop_header;
+	uint16_t offset;
+
+	if (!transaction.started || len > PROPERTIES_STORAGE_MAX_VALUE_LEN ||
+	    key == TRANSACTION_KEY)
+		return PROPERTIES_STORAGE_INVALID_ARG;
+
+	/* A property can only be set once in a transaction */
+	for (offset = 0; offset < transaction.len;
+	     offset += NEXT_MULTIPLE_OF_4(PROPERTY_HEADER_SIZE +
+					  prop_header->len)) {
+		prop_header = (property_flash_header_t *)(entries + offset);
+		if (prop_header->key == key)
+			return PROPERTIES_STORAGE_INVALID_ARG;
+	}
+
+	if (transaction.len + NEXT_MULTIPLE_OF_4(PROPERTY_HEADER_SIZE + len) >
+	    PROPERTIES_STORAGE_MAX_TRANSACTION_LEN)
+		return PROPERTIES_STORAGE_BOUNDS_ERROR;
+
+	prop_header = (property_flash_header_t *)(entries + transaction.len);
+	prop_header->pflags = PROPERTY_FLAG_NONE;
+	prop_header->key = key;
+	prop_header->len = len;
+	prop_header->reserved = 0xff;
+	memcpy(entries + transaction.len + PROPERTY_HEADER_SIZE, buf, len);
+	transaction.len += NEXT_MULTIPLE_OF_4(PROPERTY_HEADER_SIZE + len);
+
+	return PROPERTIES_STORAGE_SUCCESS;
+}
+
+properties_storage_status_t properties_storage_transaction_commit(void)
+{
+	uint8_t *entries = (uint8_t *)transaction.record + PROPERTY_HEADER_SIZE;
+	property_flash_header_t *prop_header;
+	uint16_t offset;
+	uint8_t nb_new = 0;
+
+	if (!transaction.started)
+		return PROPERTIES_STORAGE_INVALID_ARG;
+	transaction.started = false;
+	if (transaction.len == 0)
+		return PROPERTIES_STORAGE_SUCCESS;
+
+	flash_partition_t *part = transaction.factory_reset_persistent ?
+				  &reset_persistent_partition :
+				  &not_persistent_partition;
+
+	/* Check that the index can hold the new properties before writing
+	 * anything */
+	for (offset = 0; offset < transaction.len;
+	     offset += NEXT_MULTIPLE_OF_4(PROPERTY_HEADER_SIZE +
+					  prop_header->len)) {
+		prop_header = (property_flash_header_t *)(entries + offset);
+		if (get_property_info(prop_header->key) == NULL)
+			nb_new++;
+	}
+	if (nb_new > nb_free_property_info())
+		return PROPERTIES_STORAGE_BOUNDS_ERROR;
+
+	uint16_t wlen = PROPERTY_HEADER_SIZE + transaction.len +
+			TRANSACTION_COMMIT_SIZE;
+	properties_storage_status_t status = reserve_space(part, wlen);
+	if (status == PROPERTIES_STORAGE_BUSY_ERROR)
+		/* Kept for the next commit */
+		transaction.started = true;
+	if (status != PROPERTIES_STORAGE_SUCCESS)
+		return status;
+
+	/* Write the whole transaction at once, the commit word last */
+	prop_header = (property_flash_header_t *)transaction.record;
+	prop_header->pflags = PROPERTY_FLAG_NONE;
+	prop_header->key = TRANSACTION_KEY;
+	prop_header->len = transaction.len + TRANSACTION_COMMIT_SIZE;
+	prop_header->reserved = 0xff;
+	transaction.record[wlen / 4 - 1] = TRANSACTION_COMMITTED;
+
+	unsigned int ret_len;
+	DRIVER_API_RC ret = soc_flash_write(part->current_write_offset,
+					    wlen / 4, &ret_len,
+					    transaction.record);
+	if (ret != DRV_RC_OK || ret_len != wlen / 4)
+		panic(67);
+	part->previous_write_offset = part->current_write_offset;
+	part->current_write_offset += wlen;
+	/* The transaction header and commit word are never valid */
+	add_obsolete_bytes(part, part->previous_write_offset,
+			   TRANSACTION_COMMIT_SIZE);
+
+	/* Update the RAM index as for single sets */
+	for (offset = 0; offset < transaction.len;
+	     offset += NEXT_MULTIPLE_OF_4(PROPERTY_HEADER_SIZE +
+					  prop_header->len)) {
+		prop_header = (property_flash_header_t *)(entries + offset);
+		property_info_t *p = get_property_info(prop_header->key);
+		if (p != NULL) {
+			ret = make_entry_obsolete_in_flash(p->offset);
+			if (ret != DRV_RC_OK)
+				status = PROPERTIES_STORAGE_IO_ERROR;
+		} else {
+			p = alloc_property_info(prop_header->key);
+		}
+		p->offset = part->previous_write_offset + PROPERTY_HEADER_SIZE +
+			    offset;
+		p->len = prop_header->len;
+#ifdef CONFIG_QUARK_SE_PROPERTIES_STORAGE_VALUE_CACHE
+		cache_property_value(p, entries + offset + PROPERTY_HEADER_SIZE);
+#endif
+	}
+
+	return status;
+}
+
+void properties_storage_transaction_abort(void)
+{
+	transaction.started = false;
+}
@@ -28,14 +28,30 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <stdlib.h>
+#include <errno.h>
+/* The POSIX timer functions clash with the OS abstraction ones */
+#define timer_create posix_timer_create
+#define timer_delete posix_timer_delete
+#include <pthread.h>
+#include <time.h>
+#undef timer_create
+#undef timer_delete
+
 #include "os/os.h"
+#include "os/os_linux.h"
 #include "infra/log.h"
-#include <stdlib.h>
-#include "util/list.h"
+#include "util/misc.h"
+#include "util/timer_wheel.h"
 
 /**
  * @defgroup os_linux Linux OS Abstraction Layer
- * Implements the linux OS abstraction layer.
+ * Implements the linux OS abstraction layer on top of POSIX threads.
+ *
+ * Every blocking service waits on a condition variable, with timeouts
+ * computed on CLOCK_MONOTONIC. Timers are run by a dedicated thread
+ * started by os_init().
+ *
  * @ingroup os
  * @{
  */
@@ -45,10 +61,93 @@ DEFINE_LOG_MODULE(LOG_MODULE_OS, "  OS")
 #define reset_err_ptr(error_ptr) \
 	do { if (error_ptr != NULL) *error_ptr = E_OS_OK; } while (0)
 
-#define set_error_panic(err_ptr, errno)	\
+#define set_error_panic(err_ptr, error)	\
 	do { if (err_ptr == NULL) pr_error(LOG_MODULE_OS, "panic!"); \
-	     else *err_ptr = errno; } while (0)
+	     else *err_ptr = error; } while (0)
+
+/* The host clock is converted to 1 ms ticks */
+int sys_clock_us_per_tick = 1000;
+int sys_clock_ticks_per_sec = 1000;
+
+/*************************    LOCKS   *************************/
+
+static pthread_once_t irq_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t irq_mutex;
+
+static void irq_mutex_init(void)
+{
+	pthread_mutexattr_t attr;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&irq_mutex, &attr);
+	pthread_mutexattr_destroy(&attr);
+}
+
+unsigned int irq_lock(void)
+{
+	pthread_once(&irq_once, irq_mutex_init);
+	pthread_mutex_lock(&irq_mutex);
+	return 0;
+}
+
+void irq_unlock(unsigned int key)
+{
+	pthread_mutex_unlock(&irq_mutex);
+}
+
+void disable_scheduling(void)
+{
+	irq_lock();
+}
+
+void enable_scheduling(void)
+{
+	irq_unlock(0);
+}
+
+int8_t is_in_isr_context()
+{
+	return 0; /* linux runs only non-isr context */
+}
+
+/* Condition variables wait on CLOCK_MONOTONIC, immune to time changes */
+static void cond_init(pthread_cond_t *cond)
+{
+	pthread_condattr_t attr;
 
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(cond, &attr);
+	pthread_condattr_destroy(&attr);
+}
+
+/* Compute the absolute deadline of a timeout in ms */
+static void get_deadline(struct timespec *deadline, int timeout)
+{
+	clock_gettime(CLOCK_MONOTONIC, deadline);
+	deadline->tv_sec += timeout / 1000;
+	deadline->tv_nsec += (timeout % 1000) * 1000000L;
+	if (deadline->tv_nsec >= 1000000000L) {
+		deadline->tv_sec++;
+		deadline->tv_nsec -= 1000000000L;
+	}
+}
+
+/**
+ * Wait on a condition variable until a deadline.
+ *
+ * @param deadline absolute deadline, NULL to wait forever
+ *
+ * @return false if the deadline expired
+ */
+static bool cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex,
+		      const struct timespec *deadline)
+{
+	if (deadline == NULL)
+		return pthread_cond_wait(cond, mutex) == 0;
+	return pthread_cond_timedwait(cond, mutex, deadline) != ETIMEDOUT;
+}
 
 /*************************    MEMORY   *************************/
 
@@ -59,296 +158,372 @@ int alloc_count = 0;
 void *balloc(uint32_t size, OS_ERR_TYPE *err)
 {
 	void *ptr;
-	unsigned int flags = irq_lock();
 
-	ptr = malloc(size + sizeof(void *));
-	if (ptr) {
-		(*(int *)ptr) = size;
+	reset_err_ptr(err);
+	if (size == 0) {
+		set_error_panic(err, E_OS_ERR);
+		return NULL;
+	}
+	ptr = malloc(size);
+	if (ptr == NULL) {
+		set_error_panic(err, E_OS_ERR_NO_MEMORY);
+		return NULL;
+	}
 #ifdef TRACK_ALLOCS
-		alloc_count++;
+	__sync_fetch_and_add(&alloc_count, 1);
 #endif
-	}
-	irq_unlock(flags);
 	return ptr;
 }
 
 OS_ERR_TYPE bfree(void *ptr)
 {
-	int flags = irq_lock();
-
+	if (ptr == NULL)
+		return E_OS_ERR;
 #ifdef TRACK_ALLOCS
-	alloc_count--;
+	__sync_fetch_and_sub(&alloc_count, 1);
 #endif
 	free(ptr);
-	irq_unlock(flags);
 	return E_OS_OK;
 }
 
 
 /*************************    QUEUES   *************************/
 
+/* Bounded ring of message pointers, sorted by decreasing priority */
 typedef struct queue_ {
-	list_head_t lh;
-	int count;
-	int used;
+	pthread_mutex_t lock;
+	pthread_cond_t not_empty;
+	T_QUEUE_MESSAGE *msgs;
+	uint8_t *prios;
+	uint32_t size;
+	uint32_t head;
+	uint32_t count;
 } q_t;
 
-q_t q_pool[10] = { { 0 }, };
-
-void queue_put(void *queue, void *msg)
+T_QUEUE queue_create(uint32_t max_size)
 {
-	q_t *q = (q_t *)queue;
+	q_t *q;
 
-	list_add(&q->lh, (list_t *)msg);
-#ifdef DEBUG_OS
-	pr_debug(LOG_MODULE_OS, "queue_put: %p <- %p", queue, msg);
-#endif
+	if (max_size == 0)
+		return NULL;
+	q = malloc(sizeof(*q));
+	if (q == NULL)
+		return NULL;
+	q->msgs = malloc(max_size * sizeof(T_QUEUE_MESSAGE));
+	q->prios = malloc(max_size);
+	if (q->msgs == NULL || q->prios == NULL) {
+		free(q->msgs);
+		free(q->prios);
+		free(q);
+		return NULL;
+	}
+	pthread_mutex_init(&q->lock, NULL);
+	cond_init(&q->not_empty);
+	q->size = max_size;
+	q->head = 0;
+	q->count = 0;
+	return (T_QUEUE)q;
 }
-void queue_put_head(void *queue, void *msg)
+
+void queue_delete(T_QUEUE queue)
 {
 	q_t *q = (q_t *)queue;
 
-	list_add_head(&q->lh, (list_t *)msg);
-#ifdef DEBUG_OS
-	pr_debug(LOG_MODULE_OS, "queue_put: %p <- %p", queue, msg);
-#endif
+	if (q == NULL) {
+		pr_error(LOG_MODULE_OS, "panic!");
+		return;
+	}
+	pthread_cond_destroy(&q->not_empty);
+	pthread_mutex_destroy(&q->lock);
+	free(q->msgs);
+	free(q->prios);
+	free(q);
 }
 
-void *queue_wait(void *queue)
+#define QUEUE_INDEX(q, i) (((q)->head + (i)) % (q)->size)
+
+static void queue_put(T_QUEUE queue, T_QUEUE_MESSAGE message, uint8_t prio,
+		      bool head, OS_ERR_TYPE *err)
 {
 	q_t *q = (q_t *)queue;
-	void *elem = (void *)list_get(&q->lh);
+	uint32_t i;
 
+	reset_err_ptr(err);
+	if (q == NULL) {
+		set_error_panic(err, E_OS_ERR);
+		return;
+	}
+	pthread_mutex_lock(&q->lock);
+	if (q->count == q->size) {
+		pthread_mutex_unlock(&q->lock);
+		set_error_panic(err, E_OS_ERR_OVERFLOW);
+		return;
+	}
+	if (head) {
+		/* keep the ring sorted by priority */
+		if (q->count != 0 && q->prios[q->head] > prio)
+			prio = q->prios[q->head];
+		q->head = (q->head + q->size - 1) % q->size;
+		i = 0;
+	} else {
+		/* after the messages of the same or higher priority */
+		for (i = q->count;
+		     i > 0 && q->prios[QUEUE_INDEX(q, i - 1)] < prio; i--) {
+			q->msgs[QUEUE_INDEX(q, i)] = q->msgs[QUEUE_INDEX(q, i - 1)];
+			q->prios[QUEUE_INDEX(q, i)] =
+				q->prios[QUEUE_INDEX(q, i - 1)];
+		}
+	}
+	q->msgs[QUEUE_INDEX(q, i)] = message;
+	q->prios[QUEUE_INDEX(q, i)] = prio;
+	q->count++;
+	pthread_cond_signal(&q->not_empty);
+	pthread_mutex_unlock(&q->lock);
 #ifdef DEBUG_OS
-	pr_debug(LOG_MODULE_OS, "queue_wait: %p -> %p", queue, elem);
+	pr_debug(LOG_MODULE_OS, "queue_put: %p <- %p", queue, message);
 #endif
-	return elem;
 }
 
 void queue_get_message(T_QUEUE queue, T_QUEUE_MESSAGE *message, int timeout,
 		       OS_ERR_TYPE *err)
 {
-	*message = queue_wait(queue);
+	q_t *q = (q_t *)queue;
+	struct timespec deadline;
+	bool expired = false;
+
+	reset_err_ptr(err);
+	if (q == NULL || message == NULL) {
+		set_error_panic(err, E_OS_ERR);
+		return;
+	}
+	if (timeout != OS_NO_WAIT && timeout != OS_WAIT_FOREVER)
+		get_deadline(&deadline, timeout);
+
+	pthread_mutex_lock(&q->lock);
+	while (q->count == 0) {
+		if (timeout == OS_NO_WAIT || expired) {
+			pthread_mutex_unlock(&q->lock);
+			*message = NULL;
+			set_error_panic(err, timeout == OS_NO_WAIT ?
+					E_OS_ERR_EMPTY : E_OS_ERR_TIMEOUT);
+			return;
+		}
+		expired = !cond_wait(&q->not_empty, &q->lock,
+				     timeout == OS_WAIT_FOREVER ?
+				     NULL : &deadline);
+	}
+	*message = q->msgs[q->head];
+	q->head = (q->head + 1) % q->size;
+	q->count--;
+	pthread_mutex_unlock(&q->lock);
+#ifdef DEBUG_OS
+	pr_debug(LOG_MODULE_OS, "queue_wait: %p -> %p", queue, *message);
+#endif
 }
 
 void queue_send_message(T_QUEUE queue, T_QUEUE_MESSAGE message,
 			OS_ERR_TYPE *err)
 {
-	queue_put(queue, message);
+	queue_put(queue, message, 0, false, err);
 }
 
 void queue_send_message_head(T_QUEUE queue, T_QUEUE_MESSAGE message,
 			     OS_ERR_TYPE *err)
 {
-	queue_put_head(queue, message);
+	queue_put(queue, message, 0, true, err);
 }
 
-T_QUEUE queue_create(uint32_t max_size)
+void queue_send_message_prio(T_QUEUE queue, T_QUEUE_MESSAGE message,
+			     uint8_t prio, OS_ERR_TYPE *err)
 {
-	int i, found = 0;
-	q_t *q;
+	queue_put(queue, message, prio, false, err);
+}
+
+T_QUEUE_MESSAGE queue_replace_message(T_QUEUE queue, T_QUEUE_MESSAGE message,
+				      uint8_t prio, T_QUEUE_MATCH match,
+				      OS_ERR_TYPE *err)
+{
+	q_t *q = (q_t *)queue;
+	T_QUEUE_MESSAGE replaced = NULL;
+	uint32_t i;
 
-	for (i = 0; i < 10; i++) {
-		q = &q_pool[i];
-		if (q->used == 0) {
-			q->used = 1;
-			found = 1;
+	reset_err_ptr(err);
+	if (q == NULL || match == NULL) {
+		set_error_panic(err, E_OS_ERR);
+		return NULL;
+	}
+	pthread_mutex_lock(&q->lock);
+	for (i = 0; i < q->count; i++) {
+		if (match(q->msgs[QUEUE_INDEX(q, i)], message)) {
+			replaced = q->msgs[QUEUE_INDEX(q, i)];
+			q->msgs[QUEUE_INDEX(q, i)] = message;
 			break;
 		}
 	}
-	if (!found) return (T_QUEUE)NULL;
-	list_init(&q->lh);
-	q->count = 0;
-	return (T_QUEUE)q;
+	pthread_mutex_unlock(&q->lock);
+
+	if (replaced == NULL)
+		queue_put(queue, message, prio, false, err);
+	return replaced;
 }
 
-void queue_delete(T_QUEUE queue)
+
+/*************************    TIME   *************************/
+
+static uint64_t monotonic_us(void)
 {
-	void *element = NULL;
-	q_t *q = (q_t *)queue;
+	struct timespec ts;
 
-	while ((element = list_get(&q->lh)) != NULL)
-		list_remove(&q->lh, element);
-	bfree(q);
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
 }
 
+/* Date of os_init(), origin of the OS time */
+static uint64_t start_us;
 
-/*************************    TIMERS   *************************/
+uint64_t get_time_us(void)
+{
+	return monotonic_us() - start_us;
+}
 
-//timer HAL
-/**
- * this function is called by the os abstraction in order to initialize
- * the hardware timer.
- *
- * \param cb the callback function that hw timer implementation should call
- *           when it expires.
- * \param param the parameter passed to the callback function.
- */
-void timer_hal_init(void (*cb)(void *param), void *param);
-/**
- * this function should return the current time in ms of the hardware timer.
- *
- * \return the current hardware timer time in milliseconds
- */
-int timer_hal_get_ms();
+uint32_t get_time_ms(void)
+{
+	return (uint32_t)(get_time_us() / 1000);
+}
+
+void local_task_sleep_ms(int time)
+{
+	struct timespec ts = {
+		.tv_sec = time / 1000,
+		.tv_nsec = (time % 1000) * 1000000L
+	};
+
+	while (nanosleep(&ts, &ts) != 0 && errno == EINTR)
+		;
+}
+
+void local_task_sleep_ticks(int ticks)
+{
+	local_task_sleep_ms(ticks * sys_clock_us_per_tick / 1000);
+}
 
-/**
- * This function request the harware timer callback to be called after the
- * specified delay.
- *
- * \param delay the delay after which the timer callback is requested
- */
-void timer_hal_trigger(int delay);
+
+/*************************    TIMERS   *************************/
 
 /**
  * Timer internal structure.
  * This structure is allocated by timer_create()
  */
 struct timer {
-	/** timer list queueing element. */
-	list_t list;
+	/** timer wheel element, holding the expiration time */
+	struct timer_wheel_node node;
 	/** timer callback function. called when the timer expires */
 	T_ENTRY_POINT callback;
 	/** argument for the callback function */
 	void *arg;
 	/** flag to indicate that timer is periodic */
 	uint32_t repeat      : 1;
-	/** flag to indicate that the timer is active */
-	uint32_t pending     : 1;
-	/** flag to indicate that the timer was retriggered in the callback */
-	uint32_t retriggered : 1;
 	/** flag to indicate that we are in the context of the timer callback.
-	 * This is used by the timer_start(), timer_stop() and timer_delete()
-	 * functions.
+	 * This is used by the timer_delete() function.
 	 */
 	uint32_t in_callback : 1;
 	/** flag to indicate that the timer was deleted in the context of
 	 * the callback function.
 	 */
 	uint32_t deleted     : 1;
-	/** timer expiration time */
-	uint32_t expires;
 	/** period for periodic timer */
 	uint32_t period;
 };
 
-list_head_t timer_list = { NULL, NULL };
+/** Wheel of the pending timers, hashed by expiration time */
+static struct timer_wheel timer_wheel;
+/** Protects the wheel and the timers state */
+static pthread_mutex_t timer_lock = PTHREAD_MUTEX_INITIALIZER;
+/** Signaled when the next expiration may have changed */
+static pthread_cond_t timer_cond;
+static pthread_t timer_thread;
 
-/**
- * This structure is used to pass the current time to the timer list
- * traversal callback as well as returning the next expiration date
- * for the hardware timer at end of traversal.
- */
-struct timer_cb_arg {
-	uint32_t current_time;
-	uint32_t next_time;
-} timer_cb_arg;
+/* Add a timer and wake up the timer thread. Called with timer_lock held. */
+static void timer_add(struct timer *t, uint32_t delay)
+{
+	timer_wheel_remove(&timer_wheel, &t->node);
+	timer_wheel_add(&timer_wheel, &t->node, get_time_ms() + delay);
+	pthread_cond_signal(&timer_cond);
+}
 
 /**
- * Callback function for timer expiration callback timer list traversal.
+ * Timer thread: fires the callback of each expired timer, then sleeps
+ * until the next expiration or until a timer is started.
+ *
+ * Callbacks are called without holding timer_lock, so that they can start,
+ * stop or delete timers.
  */
-int timer_foreach_cb(void *elem, void *param)
+static void *timer_task(void *param)
 {
-	struct timer_cb_arg *arg = (struct timer_cb_arg *)param;
-	struct timer *t = (struct timer *)elem;
-
-	if (t->deleted) {
-		free(t);
-		return 1;
-	}
-	if (t->expires <= arg->current_time && t->pending) {
-		if (t->repeat) {
-			t->expires = arg->current_time + t->period;
-			if (t->expires < arg->next_time) {
-				arg->next_time = t->expires;
-			}
-			t->in_callback = 1;
-			t->callback(t->arg);
-			t->in_callback = 0;
-		} else {
-			t->retriggered = 0;
+	struct timer_wheel_node *node;
+	struct timer *t;
+	struct timespec deadline;
+	uint32_t now, next;
+
+	pthread_mutex_lock(&timer_lock);
+	for (;;) {
+		now = get_time_ms();
+		timer_wheel_advance(&timer_wheel, now);
+		while ((node = timer_wheel_get_expired(&timer_wheel)) != NULL) {
+			t = container_of(node, struct timer, node);
+			if (t->repeat)
+				timer_wheel_add(&timer_wheel, &t->node,
+						now + t->period);
 			t->in_callback = 1;
+			pthread_mutex_unlock(&timer_lock);
 			t->callback(t->arg);
+			pthread_mutex_lock(&timer_lock);
 			t->in_callback = 0;
-			if (!t->retriggered) {
-				t->pending = 0;
-				return 1;
-			}
+			if (t->deleted)
+				free(t);
 		}
-	} else if (t->pending && (t->expires < arg->next_time)) {
-		arg->next_time = t->expires;
-	}
-	return 0;
-}
-
-/**
- * This function will fire timer callback for each timer that has expired.
- * It is called by the hardware timer expiration callback.
- */
-void timer_callback(void *param)
-{
-	timer_cb_arg.current_time = timer_hal_get_ms();
-	timer_cb_arg.next_time = 0xffffffff;
-	list_foreach_del(&timer_list, timer_foreach_cb, (void *)&timer_cb_arg);
-	if (timer_cb_arg.next_time != 0xffffffff) {
-		timer_hal_trigger(
-			timer_cb_arg.next_time - timer_cb_arg.current_time);
-	}
-}
-
-/**
- * Callback function associated with timer list traversal of
- * timer_set_next_expiration()
- */
-void timer_set_next_expiration_cb(void *elem, void *param)
-{
-	struct timer_cb_arg *arg = (struct timer_cb_arg *)param;
-	struct timer *t = (struct timer *)elem;
 
-	if (t->pending && (t->expires < arg->next_time)) {
-		arg->next_time = t->expires;
-	}
-}
+		if (timer_wheel_next_expiration(&timer_wheel, &next)) {
+			int32_t delay = (int32_t)(next - get_time_ms());
 
-/**
- * This function will call timer_hal in order to set the next requested
- * timer expiration time.
- * This function is called each time a timer expires or a timer is started.
- */
-void timer_set_next_expiration()
-{
-	timer_cb_arg.current_time = timer_hal_get_ms();
-	timer_cb_arg.next_time = 0xffffffff;
-	list_foreach(&timer_list, timer_set_next_expiration_cb,
-		     (void *)&timer_cb_arg);
-	if (timer_cb_arg.next_time != 0xffffffff) {
-		timer_hal_trigger(
-			timer_cb_arg.next_time - timer_cb_arg.current_time);
+			if (delay <= 0)
+				continue;
+			get_deadline(&deadline, delay);
+			cond_wait(&timer_cond, &timer_lock, &deadline);
+		} else {
+			cond_wait(&timer_cond, &timer_lock, NULL);
+		}
 	}
+	return NULL;
 }
 
 T_TIMER timer_create(T_ENTRY_POINT callback, void *privData, uint32_t delay,
 		     bool repeat, bool startup,
 		     OS_ERR_TYPE *err)
 {
-	struct timer *t = (struct timer *)malloc(sizeof(*t));
+	struct timer *t;
 
-	if (!t)
-		return t;
+	reset_err_ptr(err);
+	if (callback == NULL) {
+		set_error_panic(err, E_OS_ERR);
+		return NULL;
+	}
+	t = (struct timer *)malloc(sizeof(*t));
+	if (t == NULL) {
+		set_error_panic(err, E_OS_ERR_NO_MEMORY);
+		return NULL;
+	}
 	t->callback = callback;
 	t->arg = privData;
 	t->period = delay;
 	t->repeat = repeat;
+	t->in_callback = 0;
 	t->deleted = 0;
+	timer_wheel_node_init(&t->node);
 	if (startup) {
-		int flags = irq_lock();
-		list_add(&timer_list, &t->list);
-		t->expires = timer_hal_get_ms() + delay;
-		t->pending = 1;
-		timer_set_next_expiration();
-		irq_unlock(flags);
-	} else {
-		t->pending = 0;
+		pthread_mutex_lock(&timer_lock);
+		timer_add(t, delay);
+		pthread_mutex_unlock(&timer_lock);
 	}
 	return t;
 }
@@ -356,53 +531,48 @@ T_TIMER timer_create(T_ENTRY_POINT callback, void *privData, uint32_t delay,
 void timer_start(T_TIMER tmr, uint32_t timeout, OS_ERR_TYPE *err)
 {
 	struct timer *t = (struct timer *)tmr;
-	int flags = irq_lock();
 
-	t->period = timeout;
-	t->expires = timer_hal_get_ms() + timeout;
-	if (!t->in_callback && !t->pending) {
-		list_add(&timer_list, &t->list);
-		t->pending = 1;
-	} else {
-		t->pending = 1;
-		t->retriggered = 1;
+	reset_err_ptr(err);
+	if (t == NULL) {
+		set_error_panic(err, E_OS_ERR);
+		return;
 	}
-	timer_set_next_expiration();
-	irq_unlock(flags);
+	pthread_mutex_lock(&timer_lock);
+	t->period = timeout;
+	timer_add(t, timeout);
+	pthread_mutex_unlock(&timer_lock);
 }
 
 
 void timer_stop(T_TIMER tmr)
 {
 	struct timer *t = (struct timer *)tmr;
-	int flags = irq_lock();
 
-	if (!t->in_callback) {
-		list_remove(&timer_list, &t->list);
-	}
-	t->pending = 0;
-	irq_unlock(flags);
+	pthread_mutex_lock(&timer_lock);
+	timer_wheel_remove(&timer_wheel, &t->node);
+	pthread_mutex_unlock(&timer_lock);
 }
 
 void timer_delete(T_TIMER tmr)
 {
 	struct timer *t = (struct timer *)tmr;
-	int flags = irq_lock();
 
-	t->deleted = 1;
+	pthread_mutex_lock(&timer_lock);
+	timer_wheel_remove(&timer_wheel, &t->node);
 	if (t->in_callback) {
-		irq_unlock(flags);
+		/* freed by timer_task() when the callback returns */
+		t->deleted = 1;
+		pthread_mutex_unlock(&timer_lock);
 		return;
 	}
-	if (t->pending) {
-		list_remove(&timer_list, &t->list);
-	}
-	irq_unlock(flags);
+	pthread_mutex_unlock(&timer_lock);
 	free(t);
 }
 
 /*************************    SEMAPHORES   *************************/
 typedef struct {
+	pthread_mutex_t lock;
+	pthread_cond_t given;
 	uint32_t available;
 	uint32_t waiting;
 } sem_t;
@@ -414,6 +584,8 @@ T_SEMAPHORE semaphore_create(uint32_t initialCount)
 	if (sem == NULL) {
 		pr_error(LOG_MODULE_OS, "panic!");
 	} else {
+		pthread_mutex_init(&sem->lock, NULL);
+		cond_init(&sem->given);
 		sem->available = initialCount;
 		sem->waiting = 0;
 	}
@@ -426,13 +598,14 @@ void semaphore_delete(T_SEMAPHORE semaphore)
 	sem_t *sema = (sem_t *)semaphore;
 
 	/* Make sure nobody is waiting on it otherwise report a failure */
-	int flags = irq_lock();
-
+	pthread_mutex_lock(&sema->lock);
 	if (sema->waiting != 0) {
 		pr_error(LOG_MODULE_OS, "panic!");
 	}
-	irq_unlock(flags);
+	pthread_mutex_unlock(&sema->lock);
 
+	pthread_cond_destroy(&sema->given);
+	pthread_mutex_destroy(&sema->lock);
 	bfree((void *)semaphore);
 }
 
@@ -441,79 +614,84 @@ void semaphore_give(T_SEMAPHORE semaphore, OS_ERR_TYPE *err)
 	sem_t *sema = (sem_t *)semaphore;
 
 	reset_err_ptr(err);
+	if (sema == NULL) {
+		set_error_panic(err, E_OS_ERR);
+		return;
+	}
 
-	int flags = irq_lock();
+	pthread_mutex_lock(&sema->lock);
 	sema->available++;
-	irq_unlock(flags);
+	pthread_cond_signal(&sema->given);
+	pthread_mutex_unlock(&sema->lock);
 }
 
 OS_ERR_TYPE semaphore_take(T_SEMAPHORE semaphore, int timeout)
 {
 	sem_t *sema = (sem_t *)semaphore;
-	OS_ERR_TYPE error = E_OS_ERR_TIMEOUT;
-	uint32_t time = timer_hal_get_ms();
-
-	int flags = irq_lock();
-
-	if (sema->available > 0) {
-		sema->available--;
-		error = E_OS_OK;
-	} else if (timeout != OS_NO_WAIT) {
-		sema->waiting++;
-
-		do {
-			/* Let a chance to an ISR to give us the semaphore */
-			irq_unlock(flags);
-			flags = irq_lock();
-
-			if (sema->available > 0) {
-				sema->available--;
-				sema->waiting--;
-				error = E_OS_OK;
-				break;
+	OS_ERR_TYPE error = E_OS_OK;
+	struct timespec deadline;
+
+	if (sema == NULL)
+		return E_OS_ERR;
+	if (timeout != OS_NO_WAIT && timeout != OS_WAIT_FOREVER)
+		get_deadline(&deadline, timeout);
+
+	pthread_mutex_lock(&sema->lock);
+	if (sema->available == 0) {
+		if (timeout == OS_NO_WAIT) {
+			error = E_OS_ERR_BUSY;
+		} else {
+			sema->waiting++;
+			while (sema->available == 0) {
+				if (!cond_wait(&sema->given, &sema->lock,
+					       timeout == OS_WAIT_FOREVER ?
+					       NULL : &deadline) &&
+				    sema->available == 0) {
+					error = E_OS_ERR_TIMEOUT;
+					break;
+				}
 			}
-		} while (((int)(timer_hal_get_ms() - time) < timeout) ||
-			 (timeout == OS_WAIT_FOREVER));
+			sema->waiting--;
+		}
 	}
+	if (error == E_OS_OK)
+		sema->available--;
+	pthread_mutex_unlock(&sema->lock);
 
-	irq_unlock(flags);
 	return error;
 }
 
 int32_t semaphore_get_count(T_SEMAPHORE semaphore, OS_ERR_TYPE *err)
 {
 	sem_t *sema = (sem_t *)semaphore;
+	int32_t count;
 
 	reset_err_ptr(err);
+	if (sema == NULL) {
+		set_error_panic(err, E_OS_ERR);
+		return 0;
+	}
 
-	int flags = irq_lock();
-	int32_t count = sema->available - sema->waiting;
-	irq_unlock(flags);
+	pthread_mutex_lock(&sema->lock);
+	count = sema->available - sema->waiting;
+	pthread_mutex_unlock(&sema->lock);
 
 	return count;
 }
 
 /*************************    MUTEXES   *************************/
-// Sema HAL
-int8_t is_in_isr_context()
-{
-	return 0; /* linux runs only non-isr context */
-}
-
-/* List containing all locked mutexes in the system */
-list_head_t mutex_list;
 
+/*
+ * Recursive mutex with timeout. Like the Zephyr implementation, it may be
+ * unlocked by another task than its owner, as done by the rwlocks.
+ */
 typedef struct {
-	list_t list;
-	uint32_t requestor;
+	pthread_mutex_t lock;
+	pthread_cond_t released;
+	pthread_t owner;
 	uint32_t count;
 } mutex_t;
 
-static bool list_finder_cb(list_t *plist, void *data)
-{
-	return plist == data;
-}
-
 T_MUTEX mutex_create(void)
 {
 	mutex_t *pmutex = (mutex_t *)balloc(sizeof(mutex_t), NULL);
@@ -521,7 +699,8 @@ T_MUTEX mutex_create(void)
 	if (pmutex == NULL) {
 		pr_error(LOG_MODULE_OS, "panic!");
 	} else {
-		pmutex->requestor = (uint32_t)__builtin_return_address(0);
+		pthread_mutex_init(&pmutex->lock, NULL);
+		cond_init(&pmutex->released);
 		pmutex->count = 0;
 	}
 
@@ -530,18 +709,19 @@ T_MUTEX mutex_create(void)
 
 void mutex_delete(T_MUTEX mutex)
 {
-	int flags = irq_lock();
+	mutex_t *pmutex = (mutex_t *)mutex;
 
 	if (mutex == NULL) {
 		pr_error(LOG_MODULE_OS, "panic!");
-	} else if (list_find_first(&mutex_list, list_finder_cb,
-				   mutex) != NULL) {
+		return;
+	}
+	if (pmutex->count != 0) {
 		pr_error(LOG_MODULE_OS, "panic!");
-	} else {
-		bfree((void *)mutex);
+		return;
 	}
-
-	irq_unlock(flags);
+	pthread_cond_destroy(&pmutex->released);
+	pthread_mutex_destroy(&pmutex->lock);
+	bfree((void *)mutex);
 }
 
 void mutex_unlock(T_MUTEX mutex)
@@ -550,52 +730,161 @@ void mutex_unlock(T_MUTEX mutex)
 
 	if ((is_in_isr_context() != 0) || (mutex == NULL)) {
 		pr_error(LOG_MODULE_OS, "panic!");
-	} else {
-		int flags = irq_lock();
-
-		if (list_find_first(&mutex_list, list_finder_cb,
-				    mutex) != NULL) {
-			pmutex->count--;
-
-			if (pmutex->count == 0)
-				list_remove(&mutex_list, &pmutex->list);
-		}
+		return;
+	}
 
-		irq_unlock(flags);
+	pthread_mutex_lock(&pmutex->lock);
+	/* Unlocking a free mutex is silently ignored, as on Zephyr */
+	if (pmutex->count > 0) {
+		pmutex->count--;
+		if (pmutex->count == 0)
+			pthread_cond_signal(&pmutex->released);
 	}
+	pthread_mutex_unlock(&pmutex->lock);
 }
 
 OS_ERR_TYPE mutex_lock(T_MUTEX mutex, int timeout)
 {
 	mutex_t *pmutex = (mutex_t *)mutex;
-	OS_ERR_TYPE error = E_OS_ERR_TIMEOUT;
+	OS_ERR_TYPE error = E_OS_OK;
+	struct timespec deadline;
+	pthread_t self = pthread_self();
+
+	if (is_in_isr_context() != 0)
+		return E_OS_ERR_NOT_ALLOWED;
+	if (mutex == NULL)
+		return E_OS_ERR;
+	if (timeout != OS_NO_WAIT && timeout != OS_WAIT_FOREVER)
+		get_deadline(&deadline, timeout);
+
+	pthread_mutex_lock(&pmutex->lock);
+	while (pmutex->count != 0 && !pthread_equal(pmutex->owner, self)) {
+		if (timeout == OS_NO_WAIT) {
+			error = E_OS_ERR_BUSY;
+			break;
+		}
+		if (!cond_wait(&pmutex->released, &pmutex->lock,
+			       timeout == OS_WAIT_FOREVER ? NULL : &deadline) &&
+		    pmutex->count != 0) {
+			error = E_OS_ERR_TIMEOUT;
+			break;
+		}
+	}
+	if (error == E_OS_OK) {
+		pmutex->owner = self;
+		pmutex->count++;
+	}
+	pthread_mutex_unlock(&pmutex->lock);
 
-	if ((is_in_isr_context() != 0) || (mutex == NULL)) {
-		error = E_OS_ERR_NOT_ALLOWED;
-	} else {
-		int flags = irq_lock();
+	return error;
+}
 
-		pmutex->count++;
+/*************************    RWLOCKS   *************************/
+
+void rwlock_init(struct rwlock_t *rwlock)
+{
+	rwlock->rwlock_rdmtx = mutex_create();
+	rwlock->rwlock_wrmtx = mutex_create();
+	rwlock->read_count = 0;
+}
+
+void rwlock_delete(struct rwlock_t *rwlock)
+{
+	mutex_delete(rwlock->rwlock_rdmtx);
+	mutex_delete(rwlock->rwlock_wrmtx);
+	rwlock->read_count = 0;
+}
+
+void rwlock_rdlock(struct rwlock_t *rwlock, int32_t timeout)
+{
+	if (mutex_lock(rwlock->rwlock_rdmtx, timeout) != E_OS_OK) {
+		return;
+	}
 
-		/* If mutex not already locked add it to the lock list */
-		if (list_find_first(&mutex_list, list_finder_cb,
-				    mutex) == NULL) {
-			list_add(&mutex_list, &pmutex->list);
+	rwlock->read_count++;
+
+	if (rwlock->read_count == 1) {
+		if (mutex_lock(rwlock->rwlock_wrmtx, timeout) != E_OS_OK) {
+			return;
 		}
-		error = E_OS_OK;
+	}
 
-		irq_unlock(flags);
+	mutex_unlock(rwlock->rwlock_rdmtx);
+}
+
+void rwlock_rdunlock(struct rwlock_t *rwlock)
+{
+	mutex_lock(rwlock->rwlock_rdmtx, OS_WAIT_FOREVER);
+	rwlock->read_count--;
+
+	if (!rwlock->read_count) {
+		mutex_unlock(rwlock->rwlock_wrmtx);
 	}
+	mutex_unlock(rwlock->rwlock_rdmtx);
+}
 
-	return error;
+void rwlock_wrlock(struct rwlock_t *rwlock, int32_t timeout)
+{
+	mutex_lock(rwlock->rwlock_wrmtx, timeout);
+}
+
+void rwlock_wrunlock(struct rwlock_t *rwlock)
+{
+	mutex_unlock(rwlock->rwlock_wrmtx);
+}
+
+/*************************    TASKS   *************************/
+
+struct task {
+	pthread_t thread;
+	T_ENTRY_POINT entry;
+	void *param;
+};
+
+static void *task_entry(void *arg)
+{
+	struct task *task = (struct task *)arg;
+
+	task->entry(task->param);
+	return NULL;
+}
+
+T_TASK task_create(T_ENTRY_POINT entry, void *param, OS_ERR_TYPE *err)
+{
+	struct task *task;
+
+	reset_err_ptr(err);
+	task = (struct task *)malloc(sizeof(*task));
+	if (task == NULL) {
+		set_error_panic(err, E_OS_ERR_NO_MEMORY);
+		return NULL;
+	}
+	task->entry = entry;
+	task->param = param;
+	if (pthread_create(&task->thread, NULL, task_entry, task) != 0) {
+		free(task);
+		set_error_panic(err, E_OS_ERR_NO_MEMORY);
+		return NULL;
+	}
+	return (T_TASK)task;
+}
+
+void task_join(T_TASK task)
+{
+	struct task *t = (struct task *)task;
+
+	pthread_join(t->thread, NULL);
+	free(t);
 }
 
 /*************************    INIT   *************************/
 void os_init()
 {
-	timer_hal_init(timer_callback, NULL);
-
-	list_init(&mutex_list);
+	start_us = monotonic_us();
+	timer_wheel_init(&timer_wheel, get_time_ms());
+	cond_init(&timer_cond);
+	if (pthread_create(&timer_thread, NULL, timer_task, NULL) != 0)
+		pr_error(LOG_MODULE_OS, "panic!");
 }
 
 /** @} */
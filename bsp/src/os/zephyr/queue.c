@@ -47,6 +47,7 @@ typedef struct                     // element for linked-list
 {
 	list_t *next;            //the next element in the list
 	void *data;                 //generic pointer to any data type
+	uint8_t prio;               //priority of the data
 }list_element;
 
 typedef struct                    // a linked-list of list_element
@@ -68,7 +69,7 @@ DECLARE_BLK_ALLOC(element, list_element, QUEUE_ELEMENT_POOL_SIZE)  /* see common
 
 static void lock_pool(void);
 static void unlock_pool(void);
-static OS_ERR_TYPE add_data(queue_impl_t *queue, void *data, bool head);           // Append data to the head or tail of the queue
+static OS_ERR_TYPE add_data(queue_impl_t *queue, void *data, uint8_t prio, bool head); // Insert data at the head or by priority
 static OS_ERR_TYPE remove_data(queue_impl_t *queue, void **data);                 // Remove data to the queue
 
 
@@ -244,6 +245,29 @@ void queue_get_message(T_QUEUE queue, T_QUEUE_MESSAGE *message, int timeout,
 }
 
 
+static void send_message(T_QUEUE queue, T_QUEUE_MESSAGE message, uint8_t prio,
+			 bool head, OS_ERR_TYPE *err)
+{
+	OS_ERR_TYPE _err;
+	queue_impl_t *q = (queue_impl_t *)queue;
+
+	/* check input parameters */
+	if (queue_used(q) && q->sema != NULL) {
+		uint32_t it_mask = irq_lock();
+		_err = add_data(q, message, prio, head);
+		irq_unlock(it_mask);
+
+		if (_err == E_OS_OK) {
+			semaphore_give(q->sema, &_err); // signal new message in the queue to the listener.
+			error_management(err, E_OS_OK);
+		} else {
+			error_management(err, _err);
+		}
+	} else { /* param invalid */
+		error_management(err, E_OS_ERR);
+	}
+}
+
 /**
  * Send a message on a queue.
  *
@@ -266,25 +290,7 @@ void queue_get_message(T_QUEUE queue, T_QUEUE_MESSAGE *message, int timeout,
 void queue_send_message(T_QUEUE queue, T_QUEUE_MESSAGE message,
 			OS_ERR_TYPE *err)
 {
-	OS_ERR_TYPE _err;
-	queue_impl_t *q = (queue_impl_t *)queue;
-
-	/* check input parameters */
-	if (queue_used(q) && q->sema != NULL) {
-		uint32_t it_mask = irq_lock();
-		_err = add_data(q, message, false);
-		irq_unlock(it_mask);
-
-		if (_err == E_OS_OK) {
-			semaphore_give(q->sema, &_err); // signal new message in the queue to the listener.
-			error_management(err, E_OS_OK);
-		} else {
-			error_management(err, _err);
-		}
-	} else { /* param invalid */
-		error_management(err, E_OS_ERR);
-	}
-	return;
+	send_message(queue, message, 0, false, err);
 }
 
 /**
@@ -309,25 +315,94 @@ void queue_send_message(T_QUEUE queue, T_QUEUE_MESSAGE message,
 void queue_send_message_head(T_QUEUE queue, T_QUEUE_MESSAGE message,
 			     OS_ERR_TYPE *err)
 {
-	OS_ERR_TYPE _err;
+	send_message(queue, message, 0, true, err);
+}
+
+/**
+ * Send a message on a queue with a priority.
+ *
+ *     Send / queue a message after the pending messages of the same or
+ *     higher priority.
+ *     This service may panic if err parameter is NULL and:
+ *      -# queue parameter is invalid, or
+ *      -# the queue is already full, or
+ *
+ *     Authorized execution levels:  task, fiber, ISR.
+ *
+ * @param queue: handler on the queue (value returned by queue_create).
+ *
+ * @param message (in): pointer to the message to send.
+ *
+ * @param prio: priority of the message, 0 being the lowest.
+ *
+ * @param err (out): execution status:
+ *          -# E_OS_OK : a message was read
+ *          -# E_OS_ERR_OVERFLOW: the queue is full (message was not posted)
+ *          -# E_OS_ERR: invalid parameter
+ */
+void queue_send_message_prio(T_QUEUE queue, T_QUEUE_MESSAGE message,
+			     uint8_t prio, OS_ERR_TYPE *err)
+{
+	send_message(queue, message, prio, false, err);
+}
+
+/**
+ * Send a message on a queue, replacing a matching pending message.
+ *
+ *     The new message takes the place of the first pending message for
+ *     which match returns true, that message is returned to the caller.
+ *     Otherwise the message is queued according to its priority.
+ *
+ *     Authorized execution levels:  task, fiber, ISR.
+ *
+ * @param queue: handler on the queue (value returned by queue_create).
+ *
+ * @param message (in): pointer to the message to send.
+ *
+ * @param prio: priority of the message if it is not a replacement.
+ *
+ * @param match: function selecting the message to replace.
+ *
+ * @param err (out): execution status:
+ *          -# E_OS_OK : a message was read
+ *          -# E_OS_ERR_OVERFLOW: the queue is full (message was not posted)
+ *          -# E_OS_ERR: invalid parameter
+ *
+ * @return the replaced message, NULL if none was replaced.
+ */
+T_QUEUE_MESSAGE queue_replace_message(T_QUEUE queue, T_QUEUE_MESSAGE message,
+				      uint8_t prio, T_QUEUE_MATCH match,
+				      OS_ERR_TYPE *err)
+{
 	queue_impl_t *q = (queue_impl_t *)queue;
+	list_element *element;
+	T_QUEUE_MESSAGE replaced = NULL;
+	uint32_t it_mask;
 
-	/* check input parameters */
-	if (queue_used(q) && q->sema != NULL) {
-		uint32_t it_mask = irq_lock();
-		_err = add_data(q, message, true);
-		irq_unlock(it_mask);
+	if (!queue_used(q) || q->sema == NULL || match == NULL) {
+		error_management(err, E_OS_ERR);
+		return NULL;
+	}
 
-		if (_err == E_OS_OK) {
-			semaphore_give(q->sema, &_err); // signal new message in the queue to the listener.
-			error_management(err, E_OS_OK);
-		} else {
-			error_management(err, _err);
+	it_mask = irq_lock();
+	for (element = (list_element *)q->_list.head; element != NULL;
+	     element = (list_element *)element->next) {
+		if (match(element->data, message)) {
+			replaced = element->data;
+			element->data = message;
+			break;
 		}
-	} else { /* param invalid */
-		error_management(err, E_OS_ERR);
 	}
-	return;
+	irq_unlock(it_mask);
+
+	if (replaced != NULL) {
+		/* the listener is already signaled for the replaced message */
+		error_management(err, E_OS_OK);
+		return replaced;
+	}
+
+	send_message(queue, message, prio, false, err);
+	return NULL;
 }
 
 
@@ -352,7 +427,34 @@ static void unlock_pool(void)
 }
 
 
-static OS_ERR_TYPE add_data(queue_impl_t *list, void *data, bool head)
+/* Insert an element after the elements of the same or higher priority */
+static void insert_by_prio(list_head_t *lh, list_element *element)
+{
+	list_element *tail = (list_element *)lh->tail;
+	list_t *prev = NULL;
+	list_t *cur;
+
+	/* most of the messages have the same priority: append them */
+	if (tail == NULL || tail->prio >= element->prio) {
+		list_add(lh, (list_t *)element);
+		return;
+	}
+
+	/* the tail has a lower priority, so the walk stops before the end */
+	for (cur = lh->head; ((list_element *)cur)->prio >= element->prio;
+	     cur = cur->next)
+		prev = cur;
+
+	if (prev == NULL) {
+		list_add_head(lh, (list_t *)element);
+	} else {
+		element->next = cur;
+		prev->next = (list_t *)element;
+	}
+}
+
+static OS_ERR_TYPE add_data(queue_impl_t *list, void *data, uint8_t prio,
+			    bool head)
 {
 	OS_ERR_TYPE err = E_OS_ERR_OVERFLOW;
 
@@ -360,11 +462,19 @@ static OS_ERR_TYPE add_data(queue_impl_t *list, void *data, bool head)
 	if (list->current_size < list->max_size) {
 		list_element *element = element_alloc();
 		if (element) {
+			list_element *first =
+				(list_element *)list->_list.head;
+
 			element->data = data;
-			if (head)
+			element->prio = prio;
+			if (head) {
+				/* keep the list sorted by priority */
+				if (first != NULL && first->prio > prio)
+					element->prio = first->prio;
 				list_add_head(&(list->_list), (list_t *)element);
-			else
-				list_add(&(list->_list), (list_t *)element);
+			} else {
+				insert_by_prio(&(list->_list), element);
+			}
 			list->current_size++;
 			err = E_OS_OK;
 		} else {
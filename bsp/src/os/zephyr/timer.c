@@ -37,6 +37,8 @@
 #include "infra/panic.h"
 #include "common.h"
 #include "infra/time.h"
+#include "util/misc.h"
+#include "util/timer_wheel.h"
 
 /*type for timer status */
 typedef enum {
@@ -54,12 +56,11 @@ typedef struct {
 	uint8_t status;      /* describe the timer state */
 } T_TIMER_DESC;
 
-/** Chained list of timers */
-typedef struct _timer_list {
+/** Timer element, hashed in the wheel of active timers */
+typedef struct {
 	T_TIMER_DESC desc;
-	struct _timer_list *prev;
-	struct _timer_list *next;
-}T_TIMER_LIST_ELT;
+	struct timer_wheel_node node;
+}T_TIMER_ELT;
 
 
 
@@ -116,19 +117,20 @@ void timer_task_port(void)
 #endif
 
 /** Pool of timers */
-DECLARE_BLK_ALLOC(g_TimerPool, T_TIMER_LIST_ELT, TIMER_POOL_SIZE) /* see common.h */
+DECLARE_BLK_ALLOC(g_TimerPool, T_TIMER_ELT, TIMER_POOL_SIZE) /* see common.h */
 
-/** Head of the chained list that sorts active timers according to their expiration date */
-T_TIMER_LIST_ELT * g_CurrentTimerHead;
+/** Wheel of active timers, hashed according to their expiration date */
+static struct timer_wheel g_TimerWheel;
 
 /**********************************************************
 ************** Forward declarations **********************
 **********************************************************/
 static void signal_timer_task(void);
-static bool is_after_expiration(uint32_t tick, T_TIMER_DESC *tmrDesc);
-static void add_timer(T_TIMER_LIST_ELT *newTimer);
-static void remove_timer(T_TIMER_LIST_ELT *timerToRemove);
-static void execute_callback(T_TIMER_LIST_ELT *expiredTimer);
+static bool is_next_to_expire(T_TIMER_ELT *timer);
+static void add_timer(T_TIMER_ELT *newTimer);
+static void remove_timer(T_TIMER_ELT *timerToRemove);
+static T_TIMER_ELT *get_expired_timer(void);
+static void execute_callback(T_TIMER_ELT *expiredTimer);
 
 void timer_task(int dummy1, int dummy2);
 
@@ -170,53 +172,42 @@ static void signal_timer_task(void)
 
 #ifdef __DEBUG_OS_ABSTRACTION_TIMER
 /**
- *  Print the list of active timers, from tail (first to expire) to head (last to expire).
+ *  Print the next expiration date of the active timers.
  */
 static void display_list(void)
 {
-	T_TIMER_LIST_ELT *tbv;
+	uint32_t next;
 
-	tbv = g_CurrentTimerHead;
-	if (NULL == tbv) {
-		_log(" list is empty");
+	if (!timer_wheel_next_expiration(&g_TimerWheel, &next)) {
+		_log(" wheel is empty");
 	} else {
-		_log(" Head = 0x%x", (uint32_t)tbv);
-		while (NULL != tbv) {
-			_log(" -> 0x%x", (uint32_t)tbv->next);
-			tbv = tbv->next;
-		}
+		_log(" next expiration = %u", next);
 	}
 }
 #endif
 
 /**
- * Returns whether the provided tick
- *     is before or after the expiration
- *     of a timer.
+ * Returns whether a timer is the next
+ *     active timer to expire.
  *
- * @param tick date to compare
- * @param tmrDesc timer descriptor
+ * @param timer timer to check
  *
- * @return true if tick parameter represents
- *     a date after the expiration of the
- *     timer
- *     or false if the timer descriptor is null
- *     or if tick represents a date before the
- *     expiration of the timer
+ * @return true if no other active timer
+ *     is due to expire before it
  *
  */
-static bool is_after_expiration(uint32_t tick, T_TIMER_DESC *tmrDesc)
+static bool is_next_to_expire(T_TIMER_ELT *timer)
 {
-	if (NULL != tmrDesc) {
-		/* timer will expire before the tick rolls over */
-		return tick >= tmrDesc->expiration;
-	}
-	return false;
+	uint32_t next;
+
+	if (!timer_wheel_next_expiration(&g_TimerWheel, &next))
+		return false;
+	return (int32_t)(timer->desc.expiration - next) <= 0;
 }
 
 
 /**
- * Insert a timer in the list of active timer,
+ * Insert a timer in the wheel of active timers,
  *    according to its expiration date.
  *
  * @param newTimer pointer on the timer to insert
@@ -224,12 +215,8 @@ static bool is_after_expiration(uint32_t tick, T_TIMER_DESC *tmrDesc)
  * WARNING: newTimer MUST NOT be null (rem: static function )
  *
  */
-static void add_timer(T_TIMER_LIST_ELT *newTimer)
+static void add_timer(T_TIMER_ELT *newTimer)
 {
-	T_TIMER_LIST_ELT *insertionPoint;
-	T_TIMER_LIST_ELT *listTail;
-	bool found;
-
 #ifdef __DEBUG_OS_ABSTRACTION_TIMER
 	_log(
 		"\nINFO : add_timer - start: adding 0x%x to expire at %d (now = %d - delay = %d - ticktime = %d)",
@@ -238,67 +225,26 @@ static void add_timer(T_TIMER_LIST_ELT *newTimer)
 	display_list();
 #endif
 
-
-	if (NULL == g_CurrentTimerHead) {
-		/* there is no active timer, make newTimer the head timer */
-		g_CurrentTimerHead = newTimer;
-		newTimer->prev = NULL;
-		newTimer->next = NULL;
-	} else {
-		/* find the next timer to expire after newTimer->desc.expiration */
-		insertionPoint = g_CurrentTimerHead;
-		listTail = g_CurrentTimerHead;
-		found = false;
-		while ((NULL != insertionPoint) && (false == found)) {
-			if (!is_after_expiration(newTimer->desc.expiration,
-						 &(insertionPoint->desc))) { /* newTimer is due to expire before insertionPoint */
-				if (g_CurrentTimerHead == insertionPoint) { /*  insert newTimer before the head timer  */
-					g_CurrentTimerHead->prev = newTimer;
-					newTimer->prev = NULL;
-					newTimer->next = g_CurrentTimerHead;
-					g_CurrentTimerHead = newTimer;
-				} else { /* insert newTimer between insertionPoint and insertionPoint->prev */
-					newTimer->prev = insertionPoint->prev;
-					newTimer->next = insertionPoint;
-					insertionPoint->prev = newTimer;
-					newTimer->prev->next = newTimer;
-				}
-				/* done */
-				found = true;
-			} else { /* newTimer is due to expire after insertionPoint, continue searching */
-				listTail = insertionPoint; /* update list head marker = last non null insertionPoint */
-				/* move downward */
-				insertionPoint = insertionPoint->next;
-			}
-		}
-
-		if ((false == found) && (NULL != listTail)) {
-			/* newTimer is due to expire after all others have expired */
-			listTail->next = newTimer;
-			newTimer->prev = listTail;
-		}
-	}
-
+	timer_wheel_add(&g_TimerWheel, &newTimer->node,
+			newTimer->desc.expiration);
 	newTimer->desc.status = E_TIMER_RUNNING;
 
 #ifdef __DEBUG_OS_ABSTRACTION_TIMER
-	_log("\nINFO : add_timer - end "); display_list();
+	_log("\nINFO : add_timer - end ");
 	display_list();
 #endif
 }
 
 /**
- * Remove a timer from the list of active timers.
+ * Remove a timer from the wheel of active timers.
  *
  * @param timerToRemove pointer on the timer to remove
  *
  * WARNING: timerToRemove MUST NOT be null (rem: static function )
  *
  */
-static void remove_timer(T_TIMER_LIST_ELT *timerToRemove)
+static void remove_timer(T_TIMER_ELT *timerToRemove)
 {
-	T_TIMER_LIST_ELT *removePoint;
-
 #ifdef __DEBUG_OS_ABSTRACTION_TIMER
 	_log(
 		"\nINFO : remove_timer - start: removing 0x%x to expire at %d (now = %d)",
@@ -307,41 +253,17 @@ static void remove_timer(T_TIMER_LIST_ELT *timerToRemove)
 	display_list();
 #endif
 
-	if (NULL != g_CurrentTimerHead) {
-		removePoint = g_CurrentTimerHead;
-		while (NULL != removePoint) {
-			if (timerToRemove == removePoint) {
-				if (NULL != timerToRemove->next) {
-					timerToRemove->next->prev =
-						timerToRemove->prev;
-				}
-				if (NULL != timerToRemove->prev) {
-					timerToRemove->prev->next =
-						timerToRemove->next;
-				}
-			}
-			removePoint = removePoint->next;
-		}
-
-		if (timerToRemove == g_CurrentTimerHead) {
-			g_CurrentTimerHead = g_CurrentTimerHead->next;
-			if (NULL != g_CurrentTimerHead) {
-				g_CurrentTimerHead->prev = NULL;
-			}
-		}
+	if (timer_wheel_pending(&timerToRemove->node)) {
+		timer_wheel_remove(&g_TimerWheel, &timerToRemove->node);
 	} else {
 #ifdef __DEBUG_OS_ABSTRACTION_TIMER
-		_log("\nERROR : remove_timer : list of active timer is empty ");
+		_log("\nERROR : remove_timer : timer is not active ");
 #endif
 		panic(E_OS_ERR);
 	}
 
-	/* clean-up links */
-	timerToRemove->prev = NULL;
-	timerToRemove->next = NULL;
 	timerToRemove->desc.status = E_TIMER_READY;
 
-
 #ifdef __DEBUG_OS_ABSTRACTION_TIMER
 	_log("\nINFO : remove_timer - end ");
 	display_list();
@@ -350,25 +272,22 @@ static void remove_timer(T_TIMER_LIST_ELT *timerToRemove)
 
 
 /**
- * Execute the callback of a timer.
- *
- * @param expiredTimer pointer on the timer
+ * Get the next expired timer, and restart it
+ *    if it is a repeating timer.
  *
- * WARNING: expiredTimer MUST NOT be null (rem: static function )
+ * @return pointer on the timer, NULL if no timer
+ *    is expired
  */
-static void execute_callback(T_TIMER_LIST_ELT *expiredTimer)
+static T_TIMER_ELT *get_expired_timer(void)
 {
-#ifdef __DEBUG_OS_ABSTRACTION_TIMER
-	_log(
-		"\nINFO : execute_callback : executing callback of timer 0x%x  (now = %u - expiration = %u)",
-		(uint32_t)expiredTimer,
-		get_uptime_ms(), expiredTimer->desc.expiration);
-#endif
+	struct timer_wheel_node *node;
+	T_TIMER_ELT *expiredTimer = NULL;
 	int flags = irq_lock();
 
-	/* if the timer was not stopped by its own callback */
-	if (E_TIMER_RUNNING == expiredTimer->desc.status) {
-		remove_timer(expiredTimer);
+	node = timer_wheel_get_expired(&g_TimerWheel);
+	if (NULL != node) {
+		expiredTimer = container_of(node, T_TIMER_ELT, node);
+		expiredTimer->desc.status = E_TIMER_READY;
 		/* add it again if repeat flag was on */
 		if (expiredTimer->desc.repeat) {
 			expiredTimer->desc.expiration = get_uptime_ms() +
@@ -379,6 +298,24 @@ static void execute_callback(T_TIMER_LIST_ELT *expiredTimer)
 	}
 	irq_unlock(flags);
 
+	return expiredTimer;
+}
+
+/**
+ * Execute the callback of a timer.
+ *
+ * @param expiredTimer pointer on the timer
+ *
+ * WARNING: expiredTimer MUST NOT be null (rem: static function )
+ */
+static void execute_callback(T_TIMER_ELT *expiredTimer)
+{
+#ifdef __DEBUG_OS_ABSTRACTION_TIMER
+	_log(
+		"\nINFO : execute_callback : executing callback of timer 0x%x  (now = %u - expiration = %u)",
+		(uint32_t)expiredTimer,
+		get_uptime_ms(), expiredTimer->desc.expiration);
+#endif
 	/* call callback back */
 	if (NULL != expiredTimer->desc.callback) {
 		expiredTimer->desc.callback(expiredTimer->desc.data);
@@ -414,8 +351,8 @@ void os_init_timer(void)
 	g_TimerSem = OS_TIMER_SEM;
 #endif
 
-	/* start with empty list of active timers: */
-	g_CurrentTimerHead = NULL;
+	/* start with empty wheel of active timers: */
+	timer_wheel_init(&g_TimerWheel, get_uptime_ms());
 
 	/* memset ( g_TimerPool_elements, 0 ):  */
 	for (idx = 0; idx < TIMER_POOL_SIZE; idx++) {
@@ -424,8 +361,7 @@ void os_init_timer(void)
 		g_TimerPool_elements[idx].desc.delay = 0;
 		g_TimerPool_elements[idx].desc.expiration = 0;
 		g_TimerPool_elements[idx].desc.repeat = false;
-		g_TimerPool_elements[idx].prev = NULL;
-		g_TimerPool_elements[idx].next = NULL;
+		timer_wheel_node_init(&g_TimerPool_elements[idx].node);
 		/* hopefully, the init function is performed before
 		 *  timer_create and timer_stop can be called,
 		 *  hence there is no need for a critical section
@@ -498,7 +434,7 @@ T_TIMER timer_create(T_ENTRY_POINT callback, void *privData, uint32_t delay,
 		     bool repeat, bool startup,
 		     OS_ERR_TYPE *err)
 {
-	T_TIMER_LIST_ELT *timer = NULL;
+	T_TIMER_ELT *timer = NULL;
 
 	/* check input parameters */
 	if ((NULL != callback) && (OS_WAIT_FOREVER != delay)) {
@@ -521,13 +457,15 @@ T_TIMER timer_create(T_ENTRY_POINT callback, void *privData, uint32_t delay,
 				/* insert timer in the list of active timers */
 				if (startup) {
 					int flags;
+					bool doSignal;
 					timer->desc.expiration =
 						get_uptime_ms() +
 						timer->desc.delay;
 					flags = irq_lock();
 					add_timer(timer);
+					doSignal = is_next_to_expire(timer);
 					irq_unlock(flags);
-					if (g_CurrentTimerHead == timer) {
+					if (doSignal) {
 						/* new timer is the next to expire, unblock timer_task to assess the change */
 						signal_timer_task();
 					}
@@ -565,8 +503,9 @@ T_TIMER timer_create(T_ENTRY_POINT callback, void *privData, uint32_t delay,
  */
 void timer_start(T_TIMER tmr, uint32_t delay, OS_ERR_TYPE *err)
 {
-	T_TIMER_LIST_ELT *timer = (T_TIMER_LIST_ELT *)tmr;
+	T_TIMER_ELT *timer = (T_TIMER_ELT *)tmr;
 	OS_ERR_TYPE localErr = E_OS_OK;
+	bool doSignal;
 
 	/* if timer is created */
 	if (NULL != timer) {
@@ -583,10 +522,11 @@ void timer_start(T_TIMER tmr, uint32_t delay, OS_ERR_TYPE *err)
 							 timer->desc.delay;
 				/* add the timer */
 				add_timer(timer);
+				doSignal = is_next_to_expire(timer);
 
 				irq_unlock(flags);
 				/* new timer is the next to expire, unblock timer_task to assess the change */
-				if (g_CurrentTimerHead == timer) {
+				if (doSignal) {
 					signal_timer_task();
 				}
 			} else {
@@ -619,7 +559,7 @@ void timer_start(T_TIMER tmr, uint32_t delay, OS_ERR_TYPE *err)
  */
 void timer_stop(T_TIMER tmr)
 {
-	T_TIMER_LIST_ELT *timer = (T_TIMER_LIST_ELT *)tmr;
+	T_TIMER_ELT *timer = (T_TIMER_ELT *)tmr;
 	bool doSignal = false;
 
 	if (NULL != timer) {
@@ -633,7 +573,7 @@ void timer_stop(T_TIMER tmr)
 #endif
 			/* remove the timer */
 
-			if (g_CurrentTimerHead == timer) {
+			if (is_next_to_expire(timer)) {
 				doSignal = true;
 			}
 
@@ -663,7 +603,7 @@ void timer_stop(T_TIMER tmr)
  */
 void timer_delete(T_TIMER tmr)
 {
-	T_TIMER_LIST_ELT *timer = (T_TIMER_LIST_ELT *)tmr;
+	T_TIMER_ELT *timer = (T_TIMER_ELT *)tmr;
 
 	if (NULL != timer) {
 		/* check if timer is running and stop it */
@@ -712,7 +652,10 @@ void __attribute__ ((weak)) publish_cpu_timeout(uint32_t timeout_ms)
 void timer_task(int dummy1, int dummy2)
 {
 	int64_t timeout = UINT32_MAX;
+	T_TIMER_ELT *expiredTimer;
+	uint32_t next;
 	uint32_t now;
+	int flags;
 
 	UNUSED(dummy1);
 	UNUSED(dummy2);
@@ -727,28 +670,36 @@ void timer_task(int dummy1, int dummy2)
 		nano_sem_take(&g_TimerSem, CONVERT_MS_TO_TICKS(timeout));
 #endif
 		now = get_uptime_ms();
-		/* task is unblocked: check for expired timers */
-		while (g_CurrentTimerHead &&
-		       is_after_expiration(now, &(g_CurrentTimerHead->desc))) {
-			execute_callback(g_CurrentTimerHead);
+		/* task is unblocked: move all expired timers out of the wheel */
+		flags = irq_lock();
+		timer_wheel_advance(&g_TimerWheel, now);
+		irq_unlock(flags);
+		/* then execute their callbacks in expiration order */
+		while ((expiredTimer = get_expired_timer()) != NULL) {
+			execute_callback(expiredTimer);
 		}
 		/* Compute timeout until the expiration of the next timer */
-		if (g_CurrentTimerHead != NULL) {
+		flags = irq_lock();
+		if (timer_wheel_next_expiration(&g_TimerWheel, &next)) {
+			irq_unlock(flags);
 			now = get_uptime_ms();
 			/* In micro kernel context, timeout = 0 or timeout < 0 works.
 			 * In nano kernel context timeout must be a positive value.
 			 */
-			timeout = g_CurrentTimerHead->desc.expiration - now;
+			timeout = (int32_t)(next - now);
+			if (timeout < 0)
+				timeout = 0;
 		} else {
+			irq_unlock(flags);
 			timeout = UINT32_MAX;
 		}
 
 #ifdef __DEBUG_OS_ABSTRACTION_TIMER
-		if (NULL != g_CurrentTimerHead)
+		if (UINT32_MAX != timeout)
 			_log(
 				"\nINFO : timer_task : now = %u, next timer expires at %u, timeout = %u",
 				get_uptime_ms(),
-				g_CurrentTimerHead->desc.expiration,
+				next,
 				timeout);
 		else
 			_log(
@@ -1,4 +1,9 @@
 obj-y += list.o
+obj-y += timer_wheel.o
+obj-y += block_arena.o
+obj-$(CONFIG_FLASH_CACHE) += flash_cache.o
+obj-$(CONFIG_SPSC_RING) += spsc_ring.o
+obj-$(CONFIG_MPSC_RING) += mpsc_ring.o
 obj-$(CONFIG_WORKQUEUE) += workqueue.o
 obj-$(CONFIG_CUNIT_TESTS) += cunit_test.o
 obj-$(CONFIG_LOG_CBUFFER) += cbuffer.o
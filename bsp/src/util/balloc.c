@@ -43,6 +43,11 @@
 #include "infra/tcmd/handler.h"
 #include "infra/time.h"
 #include "util/compiler.h"
+#include "util/block_bitmap.h"
+
+#ifdef CONFIG_MEMORY_POOLS_BALLOC_CACHE
+#include <atomic.h>
+#endif
 
 #ifdef CONFIG_MEMORY_POOLS_BALLOC_TRACK_OWNER
 #include "misc/printk.h"
@@ -52,14 +57,13 @@
 #endif
 #endif
 
-#define BITS_PER_U32 (sizeof(uint32_t) * 8)
-
 /** If defined, allow to use a block larger than required when all smaller blocks are already reserved */
 #define MALLOC_ALLOW_OUTCLASS
 
 /** Descriptor for a memory pool */
 typedef struct {
 	uint32_t *track;        /** block allocation tracker */
+	uint32_t *full;         /** full track word tracker */
 	uint32_t start;         /** start address of the pool */
 	uint32_t end;           /** end address of the pool */
 	uint16_t count;         /** total number of blocks within the pool */
@@ -85,13 +89,18 @@ typedef struct {
 #ifdef CONFIG_MEMORY_POOLS_BALLOC_TRACK_OWNER
 #define DECLARE_MEMORY_POOL(index, size, count)	\
 	uint8_t mblock_ ## index[count][size] __aligned(4);	\
-	uint32_t mblock_alloc_track_ ## index[count / BITS_PER_U32 + 1] = { 0 }; \
+	uint32_t mblock_alloc_track_ ## index[BLOCK_BITMAP_TRACK_WORDS(count)] = \
+	{ 0 }; \
+	uint32_t mblock_full_track_ ## index[BLOCK_BITMAP_FULL_WORDS(count)] = \
+	{ 0 }; \
 	uint32_t *mblock_owners_ ## index[count] = { 0 };
 #else
 #define DECLARE_MEMORY_POOL(index, size, count)	\
 	uint8_t mblock_ ## index[count][size] __aligned(4);	\
-	uint32_t mblock_alloc_track_ ## index[count / BITS_PER_U32 + \
-					      1] = { 0 };
+	uint32_t mblock_alloc_track_ ## index[BLOCK_BITMAP_TRACK_WORDS(count)] = \
+	{ 0 }; \
+	uint32_t mblock_full_track_ ## index[BLOCK_BITMAP_FULL_WORDS(count)] = \
+	{ 0 };
 #endif
 
 #include "memory_pool_list.def"
@@ -104,6 +113,7 @@ T_POOL_DESC mpool[] =
 #define DECLARE_MEMORY_POOL(index, size, count)	\
 	{ \
 /* T_POOL_DESC.track */ mblock_alloc_track_ ## index, \
+/* T_POOL_DESC.full */ mblock_full_track_ ## index, \
 /* T_POOL_DESC.start */ (uint32_t)mblock_ ## index,	\
 /* T_POOL_DESC.end */ (uint32_t)mblock_ ## index + count * size, \
 /* T_POOL_DESC.count */ count, \
@@ -118,6 +128,7 @@ T_POOL_DESC mpool[] =
 #define DECLARE_MEMORY_POOL(index, size, count)	\
 	{ \
 /* T_POOL_DESC.track */ mblock_alloc_track_ ## index, \
+/* T_POOL_DESC.full */ mblock_full_track_ ## index, \
 /* T_POOL_DESC.start */ (uint32_t)mblock_ ## index,	\
 /* T_POOL_DESC.end */ (uint32_t)mblock_ ## index + count * size, \
 /* T_POOL_DESC.count */ count, \
@@ -138,7 +149,10 @@ T_POOL_DESC mpool[] =
 /** Allocate the memory blocks and tracking variables for each pool */
 #define DECLARE_MEMORY_POOL(index, size, count)	\
 	uint8_t mblock_ ## index[count][size]; \
-	uint32_t mblock_alloc_track_ ## index[count / BITS_PER_U32 + 1] = { 0 };
+	uint32_t mblock_alloc_track_ ## index[BLOCK_BITMAP_TRACK_WORDS(count)] = \
+	{ 0 }; \
+	uint32_t mblock_full_track_ ## index[BLOCK_BITMAP_FULL_WORDS(count)] = \
+	{ 0 };
 
 #include "memory_pool_list.def"
 
@@ -150,6 +164,7 @@ T_POOL_DESC mpool [] =
 #define DECLARE_MEMORY_POOL(index, size, count)	\
 	{ \
 /* T_POOL_DESC.track */ mblock_alloc_track_ ## index, \
+/* T_POOL_DESC.full */ mblock_full_track_ ## index, \
 /* T_POOL_DESC.start */ (uint32_t)mblock_ ## index,	\
 /* T_POOL_DESC.end */ (uint32_t)mblock_ ## index + count * size, \
 /* T_POOL_DESC.count */ count, \
@@ -167,14 +182,132 @@ T_POOL_DESC mpool [] =
 /** Number of memory pools */
 #define NB_MEMORY_POOLS   (sizeof(mpool) / sizeof(T_POOL_DESC))
 
+#ifdef CONFIG_MEMORY_POOLS_BALLOC_CACHE
+
+/**
+ * Cache of recently freed blocks of a pool.
+ *
+ * Freed blocks are pushed on a lock-free stack instead of being released in
+ * the pool bitmap, where they stay marked as reserved. The stack head packs
+ * a modification tag (16 MSB) with the link to the top block (16 LSB) so
+ * that a compare-and-swap detects a push/pop sequence done meanwhile by an
+ * interrupt (ABA). A link is the block index + 1, 0 meaning end of stack.
+ */
+typedef struct {
+	atomic_t head;          /** tagged link to the top block */
+	atomic_t depth;         /** number of cached blocks */
+	atomic_t *cached;       /** one bit per block, set if cached */
+	uint16_t *next;         /** link to the next cached block */
+#ifdef CONFIG_MEMORY_POOLS_BALLOC_STATISTICS
+	uint32_t hits;          /** allocations served by the cache */
+	uint32_t misses;        /** allocations served by the bitmap */
+#endif
+}T_POOL_CACHE;
+
+#define CACHE_LINK(head) ((uint32_t)(head) & 0xFFFF)
+#define CACHE_HEAD(head, link) \
+	((atomic_val_t)((((uint32_t)(head) & 0xFFFF0000) + 0x10000) | (link)))
+
+#define DECLARE_MEMORY_POOL(index, size, count)	\
+	atomic_t mblock_cached_ ## index[BLOCK_BITMAP_TRACK_WORDS(count)] = \
+	{ 0 }; \
+	uint16_t mblock_cache_next_ ## index[count];
+
+#include "memory_pool_list.def"
+
+/** Cache descriptor definition */
+T_POOL_CACHE mpool_cache[] =
+{
+#define DECLARE_MEMORY_POOL(index, size, count)	\
+	{ \
+		.cached = mblock_cached_ ## index, \
+		.next = mblock_cache_next_ ## index, \
+	},
+
+#include "memory_pool_list.def"
+};
+
+#endif
+
 /**********************************************************
 ************** Private functions  ************************
 **********************************************************/
 
+#ifdef CONFIG_MEMORY_POOLS_BALLOC_CACHE
+/**
+ * Pop a block from the cache of a pool.
+ *
+ * @param pool index of the pool in mpool
+ *
+ * @return index of the block or -1 if the cache is empty
+ */
+static int32_t memblock_cache_pop(uint32_t pool)
+{
+	T_POOL_CACHE *cache = &mpool_cache[pool];
+	atomic_val_t head;
+	uint16_t block;
+
+	do {
+		head = atomic_get(&cache->head);
+		if (CACHE_LINK(head) == 0)
+			return -1;
+		block = CACHE_LINK(head) - 1;
+	} while (!atomic_cas(&cache->head, head,
+			     CACHE_HEAD(head, cache->next[block])));
+
+	atomic_dec(&cache->depth);
+	atomic_clear_bit(cache->cached, block);
+	return block;
+}
+
+/**
+ * Push a reserved block on the cache of a pool.
+ *
+ * @param pool index of the pool in mpool
+ *
+ * @param block index of the block to cache
+ *
+ * @return execution status:
+ *    E_OS_OK : block was cached
+ *    E_OS_ERR : block is already cached
+ *    E_OS_ERR_BUSY : cache is full
+ */
+static OS_ERR_TYPE memblock_cache_push(uint32_t pool, uint16_t block)
+{
+	T_POOL_CACHE *cache = &mpool_cache[pool];
+	atomic_val_t head;
+
+	if (atomic_test_and_set_bit(cache->cached, block))
+		return E_OS_ERR;
+
+	if (atomic_inc(&cache->depth) >=
+	    CONFIG_MEMORY_POOLS_BALLOC_CACHE_DEPTH) {
+		atomic_dec(&cache->depth);
+		atomic_clear_bit(cache->cached, block);
+		return E_OS_ERR_BUSY;
+	}
+
+	do {
+		head = atomic_get(&cache->head);
+		cache->next[block] = CACHE_LINK(head);
+	} while (!atomic_cas(&cache->head, head, CACHE_HEAD(head, block + 1)));
+
+#ifdef CONFIG_MEMORY_POOLS_BALLOC_STATISTICS
+	mpool[pool].cur = mpool[pool].cur - 1;
+#endif
+	return E_OS_OK;
+}
+#endif
+
 /**
  * Return the next free block of a pool and
  *   mark it as reserved/allocated.
  *
+ * Recently freed blocks are first taken from the pool cache, if enabled,
+ *   without locking interrupts. Otherwise the lookup relies on the pool
+ *   bitmap summary so that the time spent with interrupts locked does not
+ *   depend on the number of blocks.
+ *
  * @param pool index of the pool in mpool
  *
  * @return allocated buffer or NULL if none is
@@ -182,34 +315,46 @@ T_POOL_DESC mpool [] =
  */
 static void *memblock_alloc(uint32_t pool)
 {
-	uint16_t block;
-	uint32_t flags = irq_lock();
-
-	for (block = 0; block < mpool[pool].count; block++) {
-		if (((mpool[pool].track)[block / BITS_PER_U32] & 1 <<
-		     (BITS_PER_U32 - 1 - (block % BITS_PER_U32))) == 0) {
-			(mpool[pool].track)[block / BITS_PER_U32] =
-				(mpool[pool].track)[block / BITS_PER_U32] |
-				(1 << (BITS_PER_U32 - 1 - (block % BITS_PER_U32)));
+	int32_t block = -1;
+	uint32_t flags;
+
+#ifdef CONFIG_MEMORY_POOLS_BALLOC_CACHE
+	block = memblock_cache_pop(pool);
+#ifndef CONFIG_MEMORY_POOLS_BALLOC_STATISTICS
+	if (block >= 0)
+		return (void *)(mpool[pool].start + mpool[pool].size * block);
+#endif
+#endif
+	flags = irq_lock();
+#ifdef CONFIG_MEMORY_POOLS_BALLOC_CACHE
 #ifdef CONFIG_MEMORY_POOLS_BALLOC_STATISTICS
-			mpool[pool].cur = mpool[pool].cur + 1;
-#ifdef CONFIG_MEMORY_POOLS_BALLOC_TRACK_OWNER
-			/* get return address */
-			uint32_t ret_a = (uint32_t)__builtin_return_address(0);
-			mpool[pool].owners[block] =
-				(uint32_t *)(((ret_a & 0xFFFF0U) >> 4) |
-					     ((get_uptime_ms() & 0xFFFF0) << 12));
+	if (block >= 0)
+		mpool_cache[pool].hits++;
+	else
+		mpool_cache[pool].misses++;
 #endif
-			if (mpool[pool].cur > mpool[pool].max)
-				mpool[pool].max = mpool[pool].cur;
 #endif
-			irq_unlock(flags);
-			return (void *)(mpool[pool].start +
-					mpool[pool].size * block);
-		}
+	if (block < 0)
+		block = block_bitmap_alloc(mpool[pool].track, mpool[pool].full,
+					   mpool[pool].count);
+	if (block < 0) {
+		irq_unlock(flags);
+		return NULL;
 	}
+#ifdef CONFIG_MEMORY_POOLS_BALLOC_STATISTICS
+	mpool[pool].cur = mpool[pool].cur + 1;
+#ifdef CONFIG_MEMORY_POOLS_BALLOC_TRACK_OWNER
+	/* get return address */
+	uint32_t ret_a = (uint32_t)__builtin_return_address(0);
+	mpool[pool].owners[block] =
+		(uint32_t *)(((ret_a & 0xFFFF0U) >> 4) |
+			     ((get_uptime_ms() & 0xFFFF0) << 12));
+#endif
+	if (mpool[pool].cur > mpool[pool].max)
+		mpool[pool].max = mpool[pool].cur;
+#endif
 	irq_unlock(flags);
-	return NULL;
+	return (void *)(mpool[pool].start + mpool[pool].size * block);
 }
 
 
@@ -231,8 +376,7 @@ static void memblock_free(uint32_t pool, void *ptr)
 	block = ((uint32_t)ptr - mpool[pool].start) / mpool[pool].size;
 	if (block < mpool[pool].count) {
 		flags = irq_lock();
-		(mpool[pool].track)[block / BITS_PER_U32] &=
-			~(1 << (BITS_PER_U32 - 1 - (block % BITS_PER_U32)));
+		block_bitmap_free(mpool[pool].track, mpool[pool].full, block);
 		irq_unlock(flags);
 #ifdef CONFIG_MEMORY_POOLS_BALLOC_STATISTICS
 		mpool[pool].cur = mpool[pool].cur - 1;
@@ -264,11 +408,8 @@ static bool memblock_used(uint32_t pool, void *ptr)
 	uint16_t block;
 
 	block = ((uint32_t)ptr - mpool[pool].start) / mpool[pool].size;
-	if (block < mpool[pool].count) {
-		if (((mpool[pool].track)[block / BITS_PER_U32] &
-		     (1 << (BITS_PER_U32 - 1 - (block % BITS_PER_U32)))) != 0)
-			return true;
-	}
+	if (block < mpool[pool].count)
+		return block_bitmap_used(mpool[pool].track, block);
 	return false;
 }
 
@@ -314,14 +455,19 @@ static void print_pool(int method, void *ctx)
 			mpool[pool].max,
 			average);
 		PRINT_POOL(method, tmp, ctx);
+#ifdef CONFIG_MEMORY_POOLS_BALLOC_CACHE
+		snprintf(tmp, sizeof(tmp), " cache depth:%-2d hit:%-6d miss:%-6d",
+			 atomic_get(&mpool_cache[pool].depth),
+			 mpool_cache[pool].hits,
+			 mpool_cache[pool].misses);
+		PRINT_POOL(method, tmp, ctx);
+#endif
 
 		memset(tmp, 0, sizeof(tmp));
 		str_count = 0;
 
 		for (block = 0; block < mpool[pool].count; block++) {
-			if (((mpool[pool].track)[block / BITS_PER_U32] & 1 <<
-			     (BITS_PER_U32 - 1 -
-			      (block % BITS_PER_U32)))) {
+			if (block_bitmap_used(mpool[pool].track, block)) {
 				if (str_count == 0) {
 					cur = tmp;
 					PRINT_POOL(method, " owners:", ctx);
@@ -505,6 +651,23 @@ OS_ERR_TYPE bfree(void *buffer)
 		/* check if buffer is within mpool[poolIdx] */
 		if (((uint32_t)buffer >= mpool[poolIdx].start) &&
 		    ((uint32_t)buffer < mpool[poolIdx].end)) {
+#ifdef CONFIG_MEMORY_POOLS_BALLOC_CACHE
+			/* keep the block reserved in the cache if not full */
+			if (false != memblock_used(poolIdx, buffer)) {
+				err = memblock_cache_push(poolIdx,
+							  ((uint32_t)buffer -
+							   mpool[poolIdx].start)
+							  / mpool[poolIdx].size);
+				if (err == E_OS_ERR)
+					pr_debug(
+						LOG_MODULE_UTIL,
+						"ERR: memory_free: buffer %p is already free\n",
+						buffer);
+				if (err != E_OS_ERR_BUSY)
+					break;
+				err = E_OS_ERR;
+			}
+#endif
 			imask = irq_lock();
 			if (false != memblock_used(poolIdx, buffer)) {
 				memblock_free(poolIdx, buffer);
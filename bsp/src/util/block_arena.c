@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2016, Intel Corporation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stddef.h>
+
+#include "util/block_arena.h"
+
+uint32_t block_arena_size(const struct block_arena_tier *tiers,
+			  uint8_t tier_count)
+{
+	uint32_t size = 0;
+	uint8_t i;
+
+	for (i = 0; i < tier_count; i++)
+		size += (uint32_t)tiers[i].block_size * tiers[i].count;
+	return size;
+}
+
+void block_arena_init(struct block_arena *arena, void *buffer,
+		      struct block_arena_tier *tiers, uint8_t tier_count)
+{
+	uint8_t *start = buffer;
+	uint8_t i;
+
+	arena->buffer = buffer;
+	arena->tiers = tiers;
+	arena->tier_count = tier_count;
+
+	for (i = 0; i < tier_count; i++) {
+		struct block_arena_tier *tier = &tiers[i];
+		uint16_t j;
+
+		tier->start = start;
+		start += (uint32_t)tier->block_size * tier->count;
+		for (j = 0; j < BLOCK_BITMAP_TRACK_WORDS(tier->count); j++)
+			tier->track[j] = 0;
+		for (j = 0; j < BLOCK_BITMAP_FULL_WORDS(tier->count); j++)
+			tier->full[j] = 0;
+		tier->stats = (struct block_arena_stats){ 0 };
+	}
+}
+
+void *block_arena_alloc(struct block_arena *arena, uint32_t size)
+{
+	struct block_arena_tier *best = NULL;
+	uint8_t i;
+
+	for (i = 0; i < arena->tier_count; i++) {
+		struct block_arena_tier *tier = &arena->tiers[i];
+		int32_t block;
+
+		if (tier->block_size < size)
+			continue;
+		if (best == NULL)
+			best = tier;
+
+		block = block_bitmap_alloc(tier->track, tier->full,
+					   tier->count);
+		if (block < 0)
+			continue;
+
+		if (tier != best)
+			best->stats.fallback_count++;
+		tier->requested[block] = size;
+		tier->stats.alloc_count++;
+		tier->stats.wasted += tier->block_size - size;
+		if (++tier->stats.used > tier->stats.max_used)
+			tier->stats.max_used = tier->stats.used;
+		return tier->start + (uint32_t)block * tier->block_size;
+	}
+
+	if (best != NULL)
+		best->stats.fail_count++;
+	return NULL;
+}
+
+/* Find the tier and the index of a block, return NULL if not a block */
+static struct block_arena_tier *find_block(const struct block_arena *arena,
+					   const void *ptr, uint16_t *index)
+{
+	const uint8_t *p = ptr;
+	uint8_t i;
+
+	for (i = 0; i < arena->tier_count; i++) {
+		struct block_arena_tier *tier = &arena->tiers[i];
+		uint32_t offset;
+
+		if (p < tier->start ||
+		    p >= tier->start + (uint32_t)tier->block_size * tier->count)
+			continue;
+		offset = p - tier->start;
+		if (offset % tier->block_size != 0)
+			return NULL;
+		*index = offset / tier->block_size;
+		return tier;
+	}
+	return NULL;
+}
+
+int block_arena_free(struct block_arena *arena, void *ptr)
+{
+	uint16_t index;
+	struct block_arena_tier *tier = find_block(arena, ptr, &index);
+
+	if (tier == NULL || !block_bitmap_used(tier->track, index))
+		return -1;
+
+	block_bitmap_free(tier->track, tier->full, index);
+	tier->stats.used--;
+	tier->stats.wasted -= tier->block_size - tier->requested[index];
+	return 0;
+}
+
+bool block_arena_owns(const struct block_arena *arena, const void *ptr)
+{
+	uint16_t index;
+
+	return find_block(arena, ptr, &index) != NULL;
+}
+
+void block_arena_reset_stats(struct block_arena *arena)
+{
+	uint8_t i;
+
+	for (i = 0; i < arena->tier_count; i++) {
+		struct block_arena_stats *stats = &arena->tiers[i].stats;
+
+		stats->max_used = stats->used;
+		stats->alloc_count = 0;
+		stats->fallback_count = 0;
+		stats->fail_count = 0;
+	}
+}
@@ -147,6 +147,8 @@ static void spi_flash_0_lock(cir_storage_flash_t *storage)
 		(cir_storage_flash_spi_t *)storage;
 
 	mutex_lock(spi_storage->mutex, OS_WAIT_FOREVER);
+	/* Keep the flash awake for the accesses of the operation */
+	spi_flash_session_begin(&pf_sba_device_flash_spi0.dev);
 }
 
 static void spi_flash_0_unlock(cir_storage_flash_t *storage)
@@ -154,5 +156,6 @@ static void spi_flash_0_unlock(cir_storage_flash_t *storage)
 	cir_storage_flash_spi_t *spi_storage =
 		(cir_storage_flash_spi_t *)storage;
 
+	spi_flash_session_end(&pf_sba_device_flash_spi0.dev);
 	mutex_unlock(spi_storage->mutex);
 }
@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2016, Intel Corporation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+
+#include "util/flash_cache.h"
+
+void flash_cache_init(struct flash_cache *cache, struct flash_cache_line *lines,
+		      uint8_t *data, uint32_t line_count, uint32_t line_size)
+{
+	uint32_t i;
+
+	memset(cache, 0, sizeof(*cache));
+	cache->lines = lines;
+	cache->data = data;
+	cache->line_count = line_count;
+	cache->line_size = line_size;
+	for (i = 0; i < line_count; i++)
+		lines[i].valid = false;
+}
+
+static uint8_t *line_data(struct flash_cache *cache,
+			  struct flash_cache_line *line)
+{
+	return &cache->data[(line - cache->lines) * cache->line_size];
+}
+
+/* Returns the line caching address, or the line to replace if none */
+static struct flash_cache_line *lookup(struct flash_cache *cache,
+				       uint32_t address, bool *hit)
+{
+	struct flash_cache_line *line, *victim = NULL;
+
+	for (line = cache->lines; line < &cache->lines[cache->line_count];
+	     line++) {
+		if (!line->valid) {
+			if (!victim || victim->valid)
+				victim = line;
+		} else if (line->address == address) {
+			*hit = true;
+			return line;
+		} else if (!victim ||
+			   (victim->valid && line->last_use < victim->last_use)) {
+			victim = line;
+		}
+	}
+	*hit = false;
+	return victim;
+}
+
+int flash_cache_read(struct flash_cache *cache, uint32_t address, uint32_t len,
+		     uint8_t *buf, flash_cache_fill_t fill, void *priv)
+{
+	struct flash_cache_line *line;
+	uint32_t offset, count;
+	bool hit;
+	int ret;
+
+	if (len > cache->line_size) {
+		cache->stats.bypasses++;
+		return fill(priv, address, len, buf);
+	}
+
+	while (len) {
+		offset = address & (cache->line_size - 1);
+		count = cache->line_size - offset;
+		if (count > len)
+			count = len;
+
+		line = lookup(cache, address - offset, &hit);
+		if (hit) {
+			cache->stats.hits++;
+			cache->stats.bytes_saved += count;
+			cache->stats.net_bytes_saved += count;
+		} else {
+			line->valid = false;
+			ret = fill(priv, address - offset, cache->line_size,
+				   line_data(cache, line));
+			if (ret != 0)
+				return ret;
+			line->address = address - offset;
+			line->valid = true;
+			cache->stats.misses++;
+			cache->stats.bytes_filled += cache->line_size;
+			cache->stats.net_bytes_saved -= cache->line_size - count;
+		}
+		line->last_use = ++cache->date;
+		memcpy(buf, line_data(cache, line) + offset, count);
+
+		address += count;
+		buf += count;
+		len -= count;
+	}
+	return 0;
+}
+
+void flash_cache_invalidate(struct flash_cache *cache, uint32_t address,
+			    uint32_t len)
+{
+	struct flash_cache_line *line;
+
+	for (line = cache->lines; line < &cache->lines[cache->line_count];
+	     line++) {
+		if (line->valid && line->address < address + len &&
+		    line->address + cache->line_size > address) {
+			line->valid = false;
+			cache->stats.invalidations++;
+		}
+	}
+}
@@ -0,0 +1,253 @@
+/*
+ * Copyright (c) 2016, Intel Corporation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+
+#include "util/compiler.h"
+#include "util/misc.h"
+#include "util/mpsc_ring.h"
+
+#define POS_MASK ((1 << MPSC_RING_POS_BITS) - 1)
+#define WRITING 1
+
+/* Sequence word of a slot holding a committed record at a position */
+#define SEQ(pos) ((atomic_val_t)(((pos) & POS_MASK) << 1))
+
+#define SLOT(ring, pos) ((struct mpsc_ring_slot *)((ring)->slots + \
+						   ((pos) & ((ring)->count - 1)) \
+						   * (ring)->slot_size))
+
+/* Signed distance between two positions */
+static int32_t pos_diff(uint32_t a, uint32_t b)
+{
+	return (int32_t)((a - b) << (32 - MPSC_RING_POS_BITS)) >>
+	       (32 - MPSC_RING_POS_BITS);
+}
+
+void mpsc_ring_init(struct mpsc_ring *ring, uint8_t *buf, uint32_t count,
+		    uint16_t slot_size)
+{
+	uint32_t pos;
+
+	ring->slots = buf;
+	ring->count = count;
+	ring->slot_size = slot_size;
+	ring->tail = 0;
+	ring->next_record = 0;
+	atomic_set(&ring->head, 0);
+	/* Slots committed at the previous lap, not starting a record */
+	for (pos = 0; pos < count; pos++) {
+		struct mpsc_ring_slot *slot = SLOT(ring, pos);
+		slot->count = 0;
+		atomic_set(&slot->seq, SEQ(pos - count));
+	}
+}
+
+/* Newest position of the slot of a position reserved by the writers */
+static uint32_t newest_pos(struct mpsc_ring *ring, uint32_t pos)
+{
+	uint32_t last = (uint32_t)atomic_get(&ring->head) - 1;
+
+	return (last - ((last - pos) & (ring->count - 1))) & POS_MASK;
+}
+
+/* Commit a slot claimed at a position. If the writers lapped it meanwhile,
+ * the writer of the newest position found it claimed and dropped its record:
+ * the slot is committed at this position without a record instead, so that
+ * the consumer skips it. The head is checked again after each commit, as a
+ * writer may lap the slot before it. */
+static void commit_slot(struct mpsc_ring *ring, uint32_t pos)
+{
+	struct mpsc_ring_slot *slot = SLOT(ring, pos);
+	atomic_val_t seq = SEQ(pos) | WRITING;
+	uint32_t newest;
+
+	while (1) {
+		newest = newest_pos(ring, pos);
+		if (newest == (pos & POS_MASK)) {
+			if (!(seq & WRITING))
+				return;
+			BARRIER();
+			seq = SEQ(pos);
+			atomic_set(&slot->seq, seq);
+			continue;
+		}
+		/* Claimed again by a newer writer, which commits it */
+		if (!(seq & WRITING) &&
+		    !atomic_cas(&slot->seq, seq, SEQ(newest) | WRITING))
+			return;
+		pos = newest;
+		seq = SEQ(pos) | WRITING;
+		atomic_set(&slot->seq, seq);
+		slot->count = 0;
+	}
+}
+
+/* Commit the slot of a position reserved by a dropped record without a
+ * record, unless it is written or already at a newer position */
+static void drop_slot(struct mpsc_ring *ring, uint32_t pos)
+{
+	struct mpsc_ring_slot *slot = SLOT(ring, pos);
+	atomic_val_t seq;
+
+	do {
+		seq = atomic_get(&slot->seq);
+		/* A lapped writer holding the slot commits it at this
+		 * position */
+		if ((seq & WRITING) || pos_diff((uint32_t)seq >> 1, pos) >= 0)
+			return;
+	} while (!atomic_cas(&slot->seq, seq, SEQ(pos) | WRITING));
+	slot->count = 0;
+	commit_slot(ring, pos);
+}
+
+int mpsc_ring_write(struct mpsc_ring *ring, const uint8_t *data, uint8_t len)
+{
+	uint32_t data_size = ring->slot_size - sizeof(struct mpsc_ring_slot);
+	uint32_t n = len ? (len + data_size - 1) / data_size : 1;
+	uint32_t head, pos, claimed, i;
+	struct mpsc_ring_slot *slot;
+
+	if (n > ring->count)
+		return -1;
+
+	/* Reserve the slots and a sequence number */
+	do {
+		head = atomic_get(&ring->head);
+		pos = head & POS_MASK;
+	} while (!atomic_cas(&ring->head, head,
+			     ((head + (1 << MPSC_RING_POS_BITS)) & ~POS_MASK) |
+			     ((pos + n) & POS_MASK)));
+
+	for (claimed = 0; claimed < n; claimed++) {
+		atomic_val_t seq;
+
+		slot = SLOT(ring, pos + claimed);
+		seq = atomic_get(&slot->seq);
+		/* Still written by a lapped writer, or already reserved by a
+		 * writer which lapped this one */
+		if ((seq & WRITING) ||
+		    pos_diff((uint32_t)seq >> 1, pos + claimed) >= 0 ||
+		    !atomic_cas(&slot->seq, seq, SEQ(pos + claimed) | WRITING))
+			break;
+	}
+
+	for (i = 0; i < claimed; i++) {
+		slot = SLOT(ring, pos + i);
+		slot->count = 0;
+		if (claimed == n)
+			memcpy(slot + 1, data + i * data_size,
+			       MIN(len - i * data_size, data_size));
+	}
+	if (claimed == n) {
+		slot = SLOT(ring, pos);
+		slot->len = len;
+		slot->record = head >> MPSC_RING_POS_BITS;
+		slot->count = n;
+	}
+
+	/* The slots of a dropped record must not stall the consumer */
+	for (i = claimed; i < n; i++)
+		drop_slot(ring, pos + i);
+
+	/* The first slot is committed last, the record is complete when the
+	 * consumer sees it */
+	for (i = claimed; i-- > 0; )
+		commit_slot(ring, pos + i);
+	return claimed == n ? 0 : -1;
+}
+
+/* Check that the slots of a record still hold it */
+static int record_valid(struct mpsc_ring *ring, uint32_t pos, uint32_t n)
+{
+	uint32_t i;
+
+	for (i = 0; i < n; i++)
+		if (atomic_get(&SLOT(ring, pos + i)->seq) != SEQ(pos + i))
+			return 0;
+	return 1;
+}
+
+int mpsc_ring_read(struct mpsc_ring *ring, uint8_t *data, uint8_t size,
+		   uint16_t *lost)
+{
+	uint32_t data_size = ring->slot_size - sizeof(struct mpsc_ring_slot);
+
+	while (1) {
+		uint32_t head = (uint32_t)atomic_get(&ring->head) & POS_MASK;
+		int32_t used = pos_diff(head, ring->tail);
+		struct mpsc_ring_slot *slot;
+		atomic_val_t seq;
+		uint32_t n, i;
+		uint8_t len;
+		uint16_t record;
+
+		if (used <= 0)
+			return 0;
+		/* Skip the slots lapped by the writers */
+		if (used > (int32_t)ring->count)
+			ring->tail = (head - ring->count) & POS_MASK;
+
+		slot = SLOT(ring, ring->tail);
+		seq = atomic_get(&slot->seq);
+		if (seq == (SEQ(ring->tail) | WRITING) ||
+		    (pos_diff((uint32_t)seq >> 1, ring->tail) < 0 &&
+		     !(seq & WRITING)))
+			/* Not committed, or not claimed yet */
+			return 0;
+
+		n = slot->count;
+		len = slot->len;
+		record = slot->record;
+		BARRIER();
+		if (seq != SEQ(ring->tail) || n == 0 ||
+		    !record_valid(ring, ring->tail, n)) {
+			/* Overwritten, dropped because a lapped writer still
+			 * holds the slot, or not the start of a record */
+			ring->tail = (ring->tail + 1) & POS_MASK;
+			continue;
+		}
+
+		for (i = 0; i < n && i * data_size < size; i++)
+			memcpy(data + i * data_size, SLOT(ring, ring->tail + i) + 1,
+			       MIN(MIN(len, size) - i * data_size, data_size));
+		/* The record is copied before checking it was not overwritten */
+		BARRIER();
+		if (!record_valid(ring, ring->tail, n)) {
+			ring->tail = (ring->tail + 1) & POS_MASK;
+			continue;
+		}
+
+		ring->tail = (ring->tail + n) & POS_MASK;
+		*lost = (uint16_t)(record - ring->next_record);
+		ring->next_record = record + 1;
+		return MIN(len, size);
+	}
+}
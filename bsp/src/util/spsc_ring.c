@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2016, Intel Corporation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stddef.h>
+
+#include "util/compiler.h"
+#include "util/spsc_ring.h"
+
+void spsc_ring_init(struct spsc_ring *ring, void **slots, uint32_t size)
+{
+	ring->head = 0;
+	ring->tail = 0;
+	ring->size = size;
+	ring->slots = slots;
+}
+
+bool spsc_ring_push(struct spsc_ring *ring, void *ptr)
+{
+	uint32_t head = ring->head;
+
+	if (head - ring->tail >= ring->size)
+		return false;
+	ring->slots[head & (ring->size - 1)] = ptr;
+	/* The slot is written before it is published */
+	BARRIER();
+	ring->head = head + 1;
+	return true;
+}
+
+void *spsc_ring_pop(struct spsc_ring *ring)
+{
+	uint32_t tail = ring->tail;
+	void *ptr;
+
+	if (tail == ring->head)
+		return NULL;
+	BARRIER();
+	ptr = ring->slots[tail & (ring->size - 1)];
+	/* The slot is read before it is given back to the producer */
+	BARRIER();
+	ring->tail = tail + 1;
+	return ptr;
+}
@@ -0,0 +1,250 @@
+/*
+ * Copyright (c) 2016, Intel Corporation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stddef.h>
+
+#include "util/timer_wheel.h"
+
+/** Level value of a timer in the expired list */
+#define LEVEL_EXPIRED TIMER_WHEEL_LEVELS
+/** Level value of a timer which is not pending */
+#define LEVEL_IDLE 0xFF
+
+/** Digit of a date handled by a level */
+#define DIGIT(date, level) \
+	(((date) >> ((level) * TIMER_WHEEL_BITS)) & (TIMER_WHEEL_SLOTS - 1))
+
+/** Mask of the digits of a date above a level */
+#define HIGH_MASK(level) \
+	((level) + 1 < TIMER_WHEEL_LEVELS ? \
+	 ~0U << (((level) + 1) * TIMER_WHEEL_BITS) : 0)
+
+/* Slot lists are circular, the head prev pointer being the tail */
+static void list_append(struct timer_wheel_node **head,
+			struct timer_wheel_node *node)
+{
+	if (*head == NULL) {
+		node->next = node;
+		node->prev = node;
+		*head = node;
+	} else {
+		node->next = *head;
+		node->prev = (*head)->prev;
+		(*head)->prev->next = node;
+		(*head)->prev = node;
+	}
+}
+
+static void list_unlink(struct timer_wheel_node **head,
+			struct timer_wheel_node *node)
+{
+	if (node->next == node) {
+		*head = NULL;
+	} else {
+		node->prev->next = node->next;
+		node->next->prev = node->prev;
+		if (*head == node)
+			*head = node->next;
+	}
+	node->next = node->prev = NULL;
+}
+
+/*
+ * Store a timer on the level of the highest digit that differs from now.
+ * A date after the 32 bits wrap differs on the top level, in a slot below
+ * the one of now.
+ */
+static void place(struct timer_wheel *wheel, struct timer_wheel_node *node)
+{
+	uint32_t date = node->expiration;
+	uint32_t diff;
+	uint8_t level = 0;
+
+	if ((int32_t)(date - wheel->now) < 0)
+		date = wheel->now;
+
+	diff = date ^ wheel->now;
+	if (diff != 0)
+		level = (31 - __builtin_clz(diff)) / TIMER_WHEEL_BITS;
+
+	node->level = level;
+	node->slot = DIGIT(date, level);
+	wheel->occupied[level] |= 1 << node->slot;
+	list_append(&wheel->slots[level][node->slot], node);
+}
+
+/*
+ * Find the next slot to process: the first non empty slot of level 0, or
+ * the first slot to cascade of the upper levels. Timers of a level all
+ * expire before the ones of the upper levels, so the first level having a
+ * non empty slot holds the next event.
+ *
+ * The top level is circular: the slots below the digit of now hold the
+ * timers expiring after the 32 bits wrap, which come after all the others.
+ */
+static bool next_event(struct timer_wheel *wheel, uint32_t *date,
+		       uint8_t *level, uint8_t *slot)
+{
+	uint32_t pending;
+	uint8_t l;
+
+	for (l = 0; l < TIMER_WHEEL_LEVELS; l++) {
+		pending = wheel->occupied[l] &
+			  (~0U << DIGIT(wheel->now, l));
+		if (!pending && l == TIMER_WHEEL_LEVELS - 1)
+			pending = wheel->occupied[l];
+		if (pending) {
+			*level = l;
+			*slot = __builtin_ctz(pending);
+			*date = (wheel->now & HIGH_MASK(l)) |
+				((uint32_t)*slot << (l * TIMER_WHEEL_BITS));
+			if ((int32_t)(*date - wheel->now) < 0)
+				*date = wheel->now;
+			return true;
+		}
+	}
+	return false;
+}
+
+void timer_wheel_init(struct timer_wheel *wheel, uint32_t now)
+{
+	uint8_t level, slot;
+
+	wheel->now = now;
+	wheel->expired = NULL;
+	for (level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+		wheel->occupied[level] = 0;
+		for (slot = 0; slot < TIMER_WHEEL_SLOTS; slot++)
+			wheel->slots[level][slot] = NULL;
+	}
+}
+
+void timer_wheel_node_init(struct timer_wheel_node *node)
+{
+	node->next = node->prev = NULL;
+	node->level = LEVEL_IDLE;
+}
+
+void timer_wheel_add(struct timer_wheel *wheel, struct timer_wheel_node *node,
+		     uint32_t expiration)
+{
+	node->expiration = expiration;
+	place(wheel, node);
+}
+
+void timer_wheel_remove(struct timer_wheel *wheel,
+			struct timer_wheel_node *node)
+{
+	if (node->level == LEVEL_IDLE)
+		return;
+
+	if (node->level == LEVEL_EXPIRED) {
+		list_unlink(&wheel->expired, node);
+	} else {
+		list_unlink(&wheel->slots[node->level][node->slot], node);
+		if (wheel->slots[node->level][node->slot] == NULL)
+			wheel->occupied[node->level] &= ~(1 << node->slot);
+	}
+	node->level = LEVEL_IDLE;
+}
+
+bool timer_wheel_pending(const struct timer_wheel_node *node)
+{
+	return node->level != LEVEL_IDLE;
+}
+
+void timer_wheel_advance(struct timer_wheel *wheel, uint32_t now)
+{
+	struct timer_wheel_node *list;
+	struct timer_wheel_node *node;
+	uint32_t date;
+	uint8_t level, slot;
+
+	while (next_event(wheel, &date, &level, &slot) &&
+	       (int32_t)(date - now) <= 0) {
+		wheel->now = date;
+
+		/* detach the slot, then expire or cascade its timers */
+		list = wheel->slots[level][slot];
+		wheel->slots[level][slot] = NULL;
+		wheel->occupied[level] &= ~(1 << slot);
+		while (list != NULL) {
+			node = list;
+			list_unlink(&list, node);
+			if (level == 0) {
+				node->level = LEVEL_EXPIRED;
+				list_append(&wheel->expired, node);
+			} else {
+				place(wheel, node);
+			}
+		}
+	}
+
+	if ((int32_t)(now - wheel->now) > 0)
+		wheel->now = now;
+}
+
+struct timer_wheel_node *timer_wheel_get_expired(struct timer_wheel *wheel)
+{
+	struct timer_wheel_node *node = wheel->expired;
+
+	if (node != NULL) {
+		list_unlink(&wheel->expired, node);
+		node->level = LEVEL_IDLE;
+	}
+	return node;
+}
+
+bool timer_wheel_next_expiration(struct timer_wheel *wheel,
+				 uint32_t *expiration)
+{
+	struct timer_wheel_node *node;
+	uint8_t level, slot;
+
+	if (wheel->expired != NULL) {
+		*expiration = wheel->now;
+		return true;
+	}
+	if (!next_event(wheel, expiration, &level, &slot))
+		return false;
+
+	/* timers of an upper level slot have different expiration dates */
+	if (level > 0) {
+		node = wheel->slots[level][slot];
+		*expiration = node->expiration;
+		while ((node = node->next) != wheel->slots[level][slot]) {
+			if ((int32_t)(node->expiration - *expiration) < 0)
+				*expiration = node->expiration;
+		}
+		if ((int32_t)(*expiration - wheel->now) < 0)
+			*expiration = wheel->now;
+	}
+	return true;
+}
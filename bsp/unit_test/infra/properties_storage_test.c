@@ -31,6 +31,334 @@
 #include <string.h>
 #include "util/cunit_test.h"
 #include "infra/properties_storage.h"
+#include "infra/time.h"
+#include "project_mapping.h"
+#include "drivers/soc_flash.h"
+
+#define BENCH_LOOPS 1000
+
+/* Set a property, retrying while the garbage collection makes room */
+static properties_storage_status_t set_property(uint32_t key,
+						const uint8_t *buf,
+						uint16_t len,
+						bool factory_reset_persistent)
+{
+	properties_storage_status_t ret;
+
+	do {
+		ret = properties_storage_set(key, buf, len,
+					     factory_reset_persistent);
+	} while (ret == PROPERTIES_STORAGE_BUSY_ERROR);
+	return ret;
+}
+
+/* Average duration in ns of a lookup of key with properties_storage_get_info,
+ * or with properties_storage_get if buf is not NULL */
+static uint32_t bench_lookup(uint32_t key, uint8_t *buf, uint16_t len)
+{
+	uint16_t readlen;
+	bool persistent;
+	uint32_t start = get_uptime_32k();
+
+	for (int i = 0; i < BENCH_LOOPS; ++i) {
+		if (buf)
+			properties_storage_get(key, buf, len, &readlen);
+		else
+			properties_storage_get_info(key, &readlen, &persistent);
+	}
+	return (uint64_t)(get_uptime_32k() - start) * 1000000000 / 32768 /
+	       BENCH_LOOPS;
+}
+
+/* Compare the lookup cost of the first and last stored properties and of a
+ * missing one, which used to require a walk over the whole RAM index, and
+ * the read cost of a short and a long property */
+static void properties_storage_bench(void)
+{
+	const uint8_t *data = "Random Test Data";
+	uint8_t rdata[16];
+	uint16_t readlen;
+	properties_storage_status_t ret;
+
+	properties_storage_format_all();
+	for (int i = 0; i < PROPERTIES_STORAGE_MAX_NB_PROPERTIES; ++i) {
+		ret = properties_storage_set(i * 1000, data, i & 1 ? 13 : 4,
+					     false);
+		CU_ASSERT("Write OK", ret == PROPERTIES_STORAGE_SUCCESS);
+	}
+
+	cu_print("get_info first %d ns, last %d ns, missing %d ns\n",
+		 bench_lookup(0, NULL, 0),
+		 bench_lookup((PROPERTIES_STORAGE_MAX_NB_PROPERTIES - 1) * 1000,
+			      NULL, 0),
+		 bench_lookup(999999, NULL, 0));
+	cu_print("get 4 bytes %d ns, 13 bytes %d ns\n",
+		 bench_lookup(0, rdata, sizeof(rdata)),
+		 bench_lookup(1000, rdata, sizeof(rdata)));
+
+	for (int i = 0; i < PROPERTIES_STORAGE_MAX_NB_PROPERTIES; ++i) {
+		ret = properties_storage_get(i * 1000, rdata, sizeof(rdata),
+					     &readlen);
+		CU_ASSERT("Read OK", ret == PROPERTIES_STORAGE_SUCCESS);
+		CU_ASSERT("Read Length OK", readlen == (i & 1 ? 13 : 4));
+		CU_ASSERT("Read content correct",
+			  strncmp(data, rdata, readlen) == 0);
+	}
+}
+
+#define LATENCY_BUCKETS 10
+
+/* Record a duration, in 32 kHz ticks, in a power of 2 bucket: 0, 1, 2-3,
+ * 4-7... */
+static void latency_record(uint32_t *hist, uint32_t ticks)
+{
+	int bucket = 0;
+
+	while (ticks != 0 && bucket < LATENCY_BUCKETS - 1) {
+		ticks >>= 1;
+		bucket++;
+	}
+	hist[bucket]++;
+}
+
+/* Highest non empty bucket */
+static int latency_max_bucket(const uint32_t *hist)
+{
+	int bucket = LATENCY_BUCKETS - 1;
+
+	while (bucket > 0 && hist[bucket] == 0)
+		bucket--;
+	return bucket;
+}
+
+static void latency_print(const char *name, const uint32_t *hist)
+{
+	cu_print("%s set latency histogram (x30us, power of 2 buckets):", name);
+	for (int i = 0; i < LATENCY_BUCKETS; ++i)
+		cu_print(" %d", hist[i]);
+	cu_print("\n");
+}
+
+/* Rewrite a few properties so that blocks have to be reclaimed, running the
+ * garbage collection in the idle time between the sets if idle_gc is set,
+ * and record the latency of the sets. Return the number of sets which had to
+ * be retried for lack of room */
+static uint32_t gc_latency_run(bool idle_gc, uint32_t *hist)
+{
+	const uint8_t *data = "Random Test Data";
+	uint8_t rdata[16];
+	uint16_t readlen;
+	uint32_t start, busy = 0;
+	properties_storage_status_t ret;
+
+	properties_storage_format_all();
+	for (int i = 0; i < 6 * 2048 / 24; ++i) {
+		do {
+			start = get_uptime_32k();
+			ret = properties_storage_set(i % 8, data, 13, false);
+			latency_record(hist, get_uptime_32k() - start);
+			if (ret == PROPERTIES_STORAGE_BUSY_ERROR)
+				busy++;
+		} while (ret == PROPERTIES_STORAGE_BUSY_ERROR);
+		CU_ASSERT("Write OK", ret == PROPERTIES_STORAGE_SUCCESS);
+		while (idle_gc && properties_storage_gc_step())
+			;
+	}
+	for (int i = 0; i < 8; ++i) {
+		ret = properties_storage_get(i, rdata, sizeof(rdata), &readlen);
+		CU_ASSERT("Read OK", ret == PROPERTIES_STORAGE_SUCCESS);
+		CU_ASSERT("Read content correct",
+			  readlen == 13 && strncmp(data, rdata, 13) == 0);
+	}
+	return busy;
+}
+
+/* Longest set with the garbage collection run when idle: it only writes
+ * its entry, under 32 ticks (1 ms), well below a block erase */
+#define IDLE_GC_MAX_BUCKET 5
+
+/* With the garbage collection run when idle, no set should have to reclaim
+ * a block itself, and all of them are short. Without it, sets run a bounded
+ * number of collection steps and have to be retried */
+static void properties_storage_gc_test(void)
+{
+	struct properties_storage_gc_stats before, after;
+	uint32_t hist[LATENCY_BUCKETS] = { 0 };
+	uint32_t busy;
+
+	properties_storage_get_gc_stats(&before);
+	busy = gc_latency_run(true, hist);
+	properties_storage_get_gc_stats(&after);
+	latency_print("idle gc", hist);
+	CU_ASSERT("No block reclaimed",
+		  after.erased_blocks > before.erased_blocks);
+	CU_ASSERT("Set reclaimed a block",
+		  after.sync_collections == before.sync_collections);
+	CU_ASSERT("Set retried", busy == 0);
+	CU_ASSERT("Set too long",
+		  latency_max_bucket(hist) <= IDLE_GC_MAX_BUCKET);
+
+	memset(hist, 0, sizeof(hist));
+	before = after;
+	busy = gc_latency_run(false, hist);
+	properties_storage_get_gc_stats(&after);
+	latency_print("no idle gc", hist);
+	CU_ASSERT("Set did not reclaim blocks",
+		  after.sync_collections > before.sync_collections);
+	CU_ASSERT("Set not retried", busy > 0);
+}
+
+static void check_property(uint32_t key, const uint8_t *data, uint16_t len)
+{
+	uint8_t rdata[PROPERTIES_STORAGE_MAX_VALUE_LEN];
+	uint16_t readlen;
+	properties_storage_status_t ret;
+
+	ret = properties_storage_get(key, rdata, sizeof(rdata), &readlen);
+	CU_ASSERT("Read OK", ret == PROPERTIES_STORAGE_SUCCESS);
+	CU_ASSERT("Read Length OK", readlen == len);
+	CU_ASSERT("Read content correct", strncmp(data, rdata, len) == 0);
+}
+
+/* Layout of the entries of the embedded flash storage, see
+ * properties_storage_soc_flash.c */
+#define TEST_BLOCK_HEADER_SIZE 4
+#define TEST_TRANSACTION_KEY 0xfffffffe
+
+/* A transaction entry left without its commit word by a power loss must be
+ * dropped by the index rebuilt at init, with all its inner properties */
+static void properties_storage_uncommitted_transaction_test(void)
+{
+	const uint8_t *data = "Random Test Data";
+	const uint8_t *data2 = "132456789";
+	/* Transaction header, then entries of keys 1 and 5, 4 bytes each.
+	 * The length counts the commit word, which is not written */
+	uint32_t record[] = {
+		TEST_TRANSACTION_KEY, 0xffff0000 | (2 * 12 + 4),
+		1, 0xffff0004, 0x64636261,
+		5, 0xffff0004, 0x68676665,
+	};
+	uint8_t rdata[16];
+	uint16_t readlen;
+	unsigned int ret_len;
+	properties_storage_status_t ret;
+	DRIVER_API_RC rc;
+
+	/* The partition then only holds property 1, of 20 bytes */
+	properties_storage_format_all();
+	ret = properties_storage_set(1, data2, 9, false);
+	CU_ASSERT("Write OK", ret == PROPERTIES_STORAGE_SUCCESS);
+
+	rc = soc_flash_write(FACTORY_RESET_NON_PERSISTENT_START_BLOCK *
+			     EMBEDDED_FLASH_BLOCK_SIZE +
+			     TEST_BLOCK_HEADER_SIZE + 20,
+			     sizeof(record) / 4, &ret_len, record);
+	CU_ASSERT("Flash write OK",
+		  rc == DRV_RC_OK && ret_len == sizeof(record) / 4);
+
+	properties_storage_init();
+	check_property(1, data2, 9);
+	ret = properties_storage_get(5, rdata, sizeof(rdata), &readlen);
+	CU_ASSERT("Get NOK", ret == PROPERTIES_STORAGE_KEY_NOT_FOUND_ERROR);
+
+	/* The storage is still writable after the dropped entry */
+	ret = properties_storage_set(5, data, 13, false);
+	CU_ASSERT("Write OK", ret == PROPERTIES_STORAGE_SUCCESS);
+	properties_storage_init();
+	check_property(1, data2, 9);
+	check_property(5, data, 13);
+}
+
+static void properties_storage_transaction_test(void)
+{
+	const uint8_t *data = "Random Test Data";
+	const uint8_t *data2 = "132456789";
+	uint8_t large_buf[PROPERTIES_STORAGE_MAX_TRANSACTION_LEN] = { 0 };
+	uint8_t rdata[16];
+	uint16_t readlen;
+	properties_storage_status_t ret;
+
+	properties_storage_format_all();
+	ret = properties_storage_set(1, data, 13, false);
+	CU_ASSERT("Write OK", ret == PROPERTIES_STORAGE_SUCCESS);
+
+	/* No transaction in progress */
+	ret = properties_storage_transaction_set(1, data2, 9);
+	CU_ASSERT("Transaction set NOK", ret == PROPERTIES_STORAGE_INVALID_ARG);
+	ret = properties_storage_transaction_commit();
+	CU_ASSERT("Commit NOK", ret == PROPERTIES_STORAGE_INVALID_ARG);
+
+	/* Update a property and create two in a transaction */
+	properties_storage_transaction_begin(false);
+	ret = properties_storage_transaction_set(1, data2, 9);
+	CU_ASSERT("Transaction set OK", ret == PROPERTIES_STORAGE_SUCCESS);
+	ret = properties_storage_transaction_set(2, data, 16);
+	CU_ASSERT("Transaction set OK", ret == PROPERTIES_STORAGE_SUCCESS);
+	ret = properties_storage_transaction_set(3, data, 5);
+	CU_ASSERT("Transaction set OK", ret == PROPERTIES_STORAGE_SUCCESS);
+	ret = properties_storage_transaction_set(2, data2, 3);
+	CU_ASSERT("Transaction set NOK", ret == PROPERTIES_STORAGE_INVALID_ARG);
+	ret = properties_storage_get(2, rdata, sizeof(rdata), &readlen);
+	CU_ASSERT("Get NOK", ret == PROPERTIES_STORAGE_KEY_NOT_FOUND_ERROR);
+	ret = properties_storage_transaction_commit();
+	CU_ASSERT("Commit OK", ret == PROPERTIES_STORAGE_SUCCESS);
+	check_property(1, data2, 9);
+	check_property(2, data, 16);
+	check_property(3, data, 5);
+
+	/* Aborted transaction */
+	properties_storage_transaction_begin(false);
+	ret = properties_storage_transaction_set(1, data, 13);
+	CU_ASSERT("Transaction set OK", ret == PROPERTIES_STORAGE_SUCCESS);
+	properties_storage_transaction_abort();
+	ret = properties_storage_transaction_commit();
+	CU_ASSERT("Commit NOK", ret == PROPERTIES_STORAGE_INVALID_ARG);
+	check_property(1, data2, 9);
+
+	/* Transaction too large */
+	properties_storage_transaction_begin(false);
+	ret = properties_storage_transaction_set(4, large_buf,
+						 sizeof(large_buf));
+	CU_ASSERT("Transaction set NOK", ret == PROPERTIES_STORAGE_BOUNDS_ERROR);
+	properties_storage_transaction_abort();
+
+	/* Rewrite the transaction so that blocks are switched and reclaimed,
+	 * its properties then being copied by the garbage collection */
+	for (int i = 0; i < 4 * 2048 / 64; ++i) {
+		properties_storage_transaction_begin(false);
+		properties_storage_transaction_set(2, data, 16);
+		properties_storage_transaction_set(3, data2, i % 9);
+		ret = properties_storage_transaction_commit();
+		CU_ASSERT("Commit OK", ret == PROPERTIES_STORAGE_SUCCESS);
+		while (properties_storage_gc_step())
+			;
+	}
+	properties_storage_transaction_begin(false);
+	properties_storage_transaction_set(2, data2, 8);
+	properties_storage_transaction_set(3, data2, 9);
+	ret = properties_storage_transaction_commit();
+	CU_ASSERT("Commit OK", ret == PROPERTIES_STORAGE_SUCCESS);
+
+	/* Reinit the storage to validate that the transactions are found */
+	properties_storage_init();
+	check_property(1, data2, 9);
+	check_property(2, data2, 8);
+	check_property(3, data2, 9);
+
+	/* Nothing is written if the transaction cannot be fully indexed */
+	for (int i = 4; i <= PROPERTIES_STORAGE_MAX_NB_PROPERTIES; ++i) {
+		ret = properties_storage_set(i, data, 13, false);
+		CU_ASSERT("Write OK", ret == PROPERTIES_STORAGE_SUCCESS);
+	}
+	properties_storage_transaction_begin(false);
+	properties_storage_transaction_set(1, data, 13);
+	properties_storage_transaction_set(999999, data, 13);
+	ret = properties_storage_transaction_commit();
+	CU_ASSERT("Commit NOK", ret == PROPERTIES_STORAGE_BOUNDS_ERROR);
+	check_property(1, data2, 9);
+	ret = properties_storage_get(999999, rdata, sizeof(rdata), &readlen);
+	CU_ASSERT("Get NOK", ret == PROPERTIES_STORAGE_KEY_NOT_FOUND_ERROR);
+}
 
 void properties_storage_test(void)
 {
@@ -85,7 +413,7 @@ void properties_storage_test(void)
 
 	/* Fill the partition with a lot of values so that we switch to a new block */
 	for (int i = 0; i < 2048 / 13 + 15; ++i) {
-		ret = properties_storage_set(42, data, 13, false);
+		ret = set_property(42, data, 13, false);
 		CU_ASSERT("Write OK", ret == PROPERTIES_STORAGE_SUCCESS);
 	}
 	ret = properties_storage_get(42, rdata, sizeof(rdata), &readlen);
@@ -95,7 +423,7 @@ void properties_storage_test(void)
 
 	/* Fill the partition even more so that we need to clear a previous block */
 	for (int i = 0; i < 3 * 2048 / 13 + 15; ++i) {
-		ret = properties_storage_set(42, data, 13, false);
+		ret = set_property(42, data, 13, false);
 		CU_ASSERT("Write OK", ret == PROPERTIES_STORAGE_SUCCESS);
 	}
 	ret = properties_storage_get(42, rdata, sizeof(rdata), &readlen);
@@ -166,7 +494,7 @@ void properties_storage_test(void)
 
 	/* Then make sure the partition is fully written causing block shifts */
 	for (int i = 0; i < 3 * 2048 / 13 + 15; ++i) {
-		ret = properties_storage_set(999999, data, 13, false);
+		ret = set_property(999999, data, 13, false);
 		CU_ASSERT("Write OK", ret == PROPERTIES_STORAGE_SUCCESS);
 	}
 
@@ -199,10 +527,8 @@ void properties_storage_test(void)
 	}
 
 	/* Re-write a property after deleting many */
-	ret =
-		properties_storage_set(42, large_buf,
-				       PROPERTIES_STORAGE_MAX_VALUE_LEN,
-				       false);
+	ret = set_property(42, large_buf, PROPERTIES_STORAGE_MAX_VALUE_LEN,
+			   false);
 	CU_ASSERT("Write OK", ret == PROPERTIES_STORAGE_SUCCESS);
 	ret = properties_storage_get(42, rdata, sizeof(rdata), &readlen);
 	CU_ASSERT("Read OK", ret == PROPERTIES_STORAGE_SUCCESS);
@@ -251,6 +577,16 @@ void properties_storage_test(void)
 	ret = properties_storage_set(999999, data, 13, false);
 	CU_ASSERT("Write NOK", ret == PROPERTIES_STORAGE_BOUNDS_ERROR);
 
+	/* Lookups at full capacity */
+	properties_storage_bench();
+
+	/* Latency of the sets with and without background garbage collection */
+	properties_storage_gc_test();
+
+	/* Properties written together */
+	properties_storage_transaction_test();
+	properties_storage_uncommitted_transaction_test();
+
 	/* Format the partition: later unit tests rely on it being not full.. */
 	properties_storage_format_all();
 }
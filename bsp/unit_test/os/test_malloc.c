@@ -35,6 +35,7 @@
 #include "os/os.h"
 #include "utility.h"
 #include "util/cunit_test.h"
+#include "util/block_arena.h"
 
 struct mem_pool {
 	uint32_t nb_elem;
@@ -282,3 +283,174 @@ void test_malloc_and_free_outclass(void)
 		CU_ASSERT("free not successful.", err == E_OS_OK);
 	}
 }
+
+/* check that the lowest freed block is always returned first, including
+ * across bitmap words and when the pool is exhausted */
+void test_malloc_reuse_freed_block(void)
+{
+	OS_ERR_TYPE err = E_OS_OK;
+	uint8_t *tab[50] = { NULL };
+	uint8_t *p;
+	int8_t i;
+
+	CU_ASSERT("test not valid if:", all_pools[0].nb_elem < DIM(tab));
+
+	for (i = 0; i < all_pools[0].nb_elem; i++) {
+		tab[i] = balloc(all_pools[0].size, &err);
+		CU_ASSERT("balloc not successful.", err == E_OS_OK);
+	}
+
+	/* free the blocks from the last one, each allocation must then
+	 * return the lowest free block */
+	for (i = all_pools[0].nb_elem - 1; i >= 0; i--) {
+		err = bfree(tab[i]);
+		CU_ASSERT("free not successful.", err == E_OS_OK);
+	}
+	for (i = 0; i < all_pools[0].nb_elem; i++) {
+		p = balloc(all_pools[0].size, &err);
+		CU_ASSERT("balloc not successful.", err == E_OS_OK);
+#ifndef CONFIG_MEMORY_POOLS_BALLOC_CACHE
+		CU_ASSERT("lowest block not returned", p == tab[i]);
+#endif
+	}
+
+	/* near-full pool: only the last block is free */
+	err = bfree(tab[all_pools[0].nb_elem - 1]);
+	CU_ASSERT("free not successful.", err == E_OS_OK);
+	p = balloc(all_pools[0].size, &err);
+	CU_ASSERT("last block not returned", p == tab[all_pools[0].nb_elem - 1]);
+
+	for (i = 0; i < all_pools[0].nb_elem; i++) {
+		err = bfree(tab[i]);
+		CU_ASSERT("free not successful.", err == E_OS_OK);
+	}
+}
+
+#ifdef CONFIG_MEMORY_POOLS_BALLOC_CACHE
+/* check that cached blocks are reused last freed first and that a double
+ * free of a cached block is detected */
+void test_malloc_cache(void)
+{
+	OS_ERR_TYPE err = E_OS_OK;
+	uint8_t *p1 = balloc(all_pools[0].size, &err);
+	uint8_t *p2 = balloc(all_pools[0].size, &err);
+
+	CU_ASSERT("balloc not successful.", p1 != NULL && p2 != NULL);
+
+	err = bfree(p1);
+	CU_ASSERT("free not successful.", err == E_OS_OK);
+	err = bfree(p1);
+	CU_ASSERT("double free not detected", err == E_OS_ERR);
+	err = bfree(p2);
+	CU_ASSERT("free not successful.", err == E_OS_OK);
+
+	CU_ASSERT("last freed block not returned",
+		  balloc(all_pools[0].size, &err) == p2);
+	CU_ASSERT("cached block not returned",
+		  balloc(all_pools[0].size, &err) == p1);
+
+	bfree(p1);
+	bfree(p2);
+}
+#endif
+
+/* Sensor core raw data tiers: 12 x 64, 2 x 128, 2 x 512, 1 x 1024 */
+static struct block_arena_tier arena_tiers[] = {
+	BLOCK_ARENA_TIER(64, 12),
+	BLOCK_ARENA_TIER(128, 2),
+	BLOCK_ARENA_TIER(512, 2),
+	BLOCK_ARENA_TIER(1024, 1),
+};
+static uint8_t arena_buffer[64 * 12 + 128 * 2 + 512 * 2 + 1024];
+
+/* Allocation trace step: allocate size bytes in slot, or free slot if
+ * size is 0. expected is true if the allocation must succeed. */
+struct arena_op {
+	uint16_t size;
+	uint8_t slot;
+	bool expected;
+};
+
+/* Trace recorded from the sensor core: hardware FIFO buffer and feed demand
+ * array at configuration, then raw data nodes and their data buffers polled
+ * and released by the algorithm engine, then a burst of large reads. */
+static const struct arena_op arena_trace[] = {
+	{ 1024, 0, true }, { 48, 1, true },
+	{ 16, 2, true }, { 240, 3, true }, { 16, 4, true }, { 120, 5, true },
+	{ 0, 2 }, { 0, 3 }, { 0, 4 }, { 0, 5 },
+	{ 16, 2, true }, { 240, 3, true }, { 16, 4, true }, { 120, 5, true },
+	{ 0, 2 }, { 0, 3 }, { 0, 4 }, { 0, 5 },
+	{ 16, 2, true }, { 240, 3, true }, { 16, 4, true }, { 120, 5, true },
+	{ 0, 2 }, { 0, 3 }, { 0, 4 }, { 0, 5 },
+	{ 1024, 6, false },
+	{ 100, 6, true }, { 100, 7, true }, { 100, 8, true },
+	{ 2000, 9, false },
+};
+
+void test_block_arena_trace(void)
+{
+	struct block_arena arena;
+	void *slots[10] = { NULL };
+	uint8_t i;
+
+	CU_ASSERT("arena size", block_arena_size(arena_tiers, DIM(arena_tiers))
+		  == sizeof(arena_buffer));
+	block_arena_init(&arena, arena_buffer, arena_tiers, DIM(arena_tiers));
+
+	for (i = 0; i < DIM(arena_trace); i++) {
+		const struct arena_op *op = &arena_trace[i];
+
+		if (op->size == 0) {
+			CU_ASSERT("free failed",
+				  block_arena_free(&arena, slots[op->slot]) == 0);
+			slots[op->slot] = NULL;
+			continue;
+		}
+		slots[op->slot] = block_arena_alloc(&arena, op->size);
+		CU_ASSERT("unexpected alloc result",
+			  (slots[op->slot] != NULL) == op->expected);
+		if (slots[op->slot] != NULL)
+			CU_ASSERT("block outside of the arena",
+				  block_arena_owns(&arena, slots[op->slot]));
+	}
+
+	/* third 100 bytes request fell back to the 512 bytes tier */
+	CU_ASSERT("128 fallback", arena_tiers[1].stats.fallback_count == 1);
+	CU_ASSERT("128 wasted", arena_tiers[1].stats.wasted == 2 * 28);
+	CU_ASSERT("512 wasted", arena_tiers[2].stats.wasted == 412);
+	CU_ASSERT("64 wasted", arena_tiers[0].stats.wasted == 16);
+	CU_ASSERT("1024 fail", arena_tiers[3].stats.fail_count == 1);
+
+	/* double free and pointers which are not blocks are rejected */
+	CU_ASSERT("free failed", block_arena_free(&arena, slots[1]) == 0);
+	CU_ASSERT("double free not detected",
+		  block_arena_free(&arena, slots[1]) == -1);
+	CU_ASSERT("unaligned free not detected",
+		  block_arena_free(&arena, (uint8_t *)slots[0] + 1) == -1);
+	CU_ASSERT("foreign free not detected",
+		  block_arena_free(&arena, &arena) == -1);
+	CU_ASSERT("free failed", block_arena_free(&arena, slots[0]) == 0);
+	for (i = 6; i <= 8; i++)
+		CU_ASSERT("free failed",
+			  block_arena_free(&arena, slots[i]) == 0);
+
+	CU_ASSERT("64 stats", arena_tiers[0].stats.alloc_count == 7 &&
+		  arena_tiers[0].stats.max_used == 3 &&
+		  arena_tiers[0].stats.used == 0 &&
+		  arena_tiers[0].stats.wasted == 0);
+	CU_ASSERT("128 stats", arena_tiers[1].stats.alloc_count == 5 &&
+		  arena_tiers[1].stats.max_used == 2 &&
+		  arena_tiers[1].stats.used == 0 &&
+		  arena_tiers[1].stats.wasted == 0);
+	CU_ASSERT("512 stats", arena_tiers[2].stats.alloc_count == 4 &&
+		  arena_tiers[2].stats.max_used == 1 &&
+		  arena_tiers[2].stats.used == 0);
+	CU_ASSERT("1024 stats", arena_tiers[3].stats.alloc_count == 1 &&
+		  arena_tiers[3].stats.max_used == 1 &&
+		  arena_tiers[3].stats.used == 0);
+
+	block_arena_reset_stats(&arena);
+	CU_ASSERT("stats not reset", arena_tiers[0].stats.max_used == 0 &&
+		  arena_tiers[0].stats.alloc_count == 0 &&
+		  arena_tiers[3].stats.fail_count == 0);
+}
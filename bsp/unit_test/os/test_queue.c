@@ -500,6 +500,71 @@ void test_queue_functional_testing_message_order(void)
 	queue_delete(g_Q[FUNCTIONAL_TEST_QID_MAIN_TASK]); /* nominal call */
 }
 
+/* Replace the pending message holding the same text as the new one */
+static bool match_message(T_QUEUE_MESSAGE pending, T_QUEUE_MESSAGE message)
+{
+	return compare_messages(*(T_TEST_MESSAGE *)pending,
+				*(T_TEST_MESSAGE *)message);
+}
+
+/**
+ * \brief Check the order of messages sent with priorities and replacements
+ */
+void test_queue_functional_testing_priority(void)
+{
+	/* index of the sent messages, in the expected reception order */
+	static const uint8_t expected[] = { 3, 1, 4, 0 };
+	T_QUEUE_MESSAGE replaced;
+	T_QUEUE q;
+	uint32_t msgCtr;
+	OS_ERR_TYPE osErr;
+
+	for (msgCtr = 0; msgCtr < 5; msgCtr++) {
+		set_message(g_TxBuffer[msgCtr], _T("msg_"), msgCtr);
+		g_RxBuffer[msgCtr] = NULL;
+	}
+	/* message 4 supersedes message 2 */
+	set_message(g_TxBuffer[4], _T("msg_"), 2);
+
+	q = queue_create(NOMINAL_QUEUE_SIZE);
+	CU_ASSERT("Functional Test - priority : queue_create", q != NULL);
+	if (q == NULL)
+		return;
+
+	queue_send_message(q, (T_QUEUE_MESSAGE)g_TxBuffer[0], &osErr);
+	CU_ASSERT("Functional Test - priority : queue_send_message",
+		  osErr == E_OS_OK);
+	queue_send_message_prio(q, (T_QUEUE_MESSAGE)g_TxBuffer[1], 2, &osErr);
+	CU_ASSERT("Functional Test - priority : queue_send_message_prio",
+		  osErr == E_OS_OK);
+	queue_send_message_prio(q, (T_QUEUE_MESSAGE)g_TxBuffer[2], 1, &osErr);
+	CU_ASSERT("Functional Test - priority : queue_send_message_prio",
+		  osErr == E_OS_OK);
+	queue_send_message_head(q, (T_QUEUE_MESSAGE)g_TxBuffer[3], &osErr);
+	CU_ASSERT("Functional Test - priority : queue_send_message_head",
+		  osErr == E_OS_OK);
+	replaced = queue_replace_message(q, (T_QUEUE_MESSAGE)g_TxBuffer[4], 0,
+					 match_message, &osErr);
+	CU_ASSERT("Functional Test - priority : queue_replace_message",
+		  osErr == E_OS_OK &&
+		  replaced == (T_QUEUE_MESSAGE)g_TxBuffer[2]);
+
+	for (msgCtr = 0; msgCtr < DIM(expected); msgCtr++) {
+		queue_get_message(q, (T_QUEUE_MESSAGE *)&g_RxBuffer[msgCtr],
+				  OS_NO_WAIT, &osErr);
+		CU_ASSERT("Functional Test - priority : message order",
+			  osErr == E_OS_OK &&
+			  g_RxBuffer[msgCtr] ==
+			  (T_TEST_MESSAGE *)g_TxBuffer[expected[msgCtr]]);
+	}
+	queue_get_message(q, (T_QUEUE_MESSAGE *)&g_RxBuffer[msgCtr],
+			  OS_NO_WAIT, &osErr);
+	CU_ASSERT("Functional Test - priority : replaced message not queued",
+		  osErr == E_OS_ERR_EMPTY);
+
+	queue_delete(q);
+}
+
 /**
  * \brief Check behavior on overflow on one queue
  */
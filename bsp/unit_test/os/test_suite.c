@@ -100,6 +100,7 @@ static void test_queue(void)
 	CU_RUN_TEST(test_queue_unit_testing); /* important: must be run before other queue tests */
 	CU_RUN_TEST(test_queue_functional_testing_overflow_one_queue); /* important: must be run before test_queue_functional_testing_message_order */
 	CU_RUN_TEST(test_queue_functional_testing_message_order); /* important: must be run after test_queue_functional_testing_overflow */
+	CU_RUN_TEST(test_queue_functional_testing_priority);
 	CU_RUN_TEST(test_queue_functional_testing_overflow_all_queues);
 	CU_RUN_TEST(test_queue_functional_testing_different_tasks);
 #ifndef CONFIG_ARC
@@ -117,6 +118,8 @@ static void test_timer(void)
 	CU_RUN_TEST(test_timer_callback_with_timer_stop);
 	CU_RUN_TEST(test_timer_restart);
 	CU_RUN_TEST(test_timer_stat);
+	CU_RUN_TEST(test_timer_wheel_bench);
+	CU_RUN_TEST(test_timer_wheel_wrap);
 	CU_RUN_TEST(test_counter_millisecond_incrementation);
 	CU_RUN_TEST(test_counter_microsecond_incrementation);
 	cu_print("======================\n");
@@ -139,6 +142,11 @@ static void test_malloc(void)
 	CU_RUN_TEST(test_malloc_and_free_1);
 	CU_TEST_DISABLED(test_malloc_and_free_2);
 	CU_RUN_TEST(test_malloc_and_free_outclass);
+	CU_RUN_TEST(test_malloc_reuse_freed_block);
+	CU_RUN_TEST(test_block_arena_trace);
+#ifdef CONFIG_MEMORY_POOLS_BALLOC_CACHE
+	CU_RUN_TEST(test_malloc_cache);
+#endif
 #ifndef CONFIG_ARC
 	CU_RUN_TEST(test_malloc_in_interruption_ctx);
 #endif
@@ -31,6 +31,8 @@
 #include <stdbool.h>
 
 #include "os/os.h"
+#include "infra/time.h"
+#include "util/timer_wheel.h"
 #include "utility.h"
 #include "util/cunit_test.h"
 #include "test_stub.h"
@@ -44,6 +46,15 @@
 /* This values can be changed/tweaked if the tests are a bit too aggressive and fail */
 #define CALLBACK_DELAY (10)
 
+/* Largest number of timers of the timer wheel benchmark */
+#ifdef CONFIG_ARC
+#define TIMER_BENCH_MAX (100)
+#else
+#define TIMER_BENCH_MAX (1000)
+#endif
+/* Number of start/stop operations measured for each number of timers */
+#define TIMER_BENCH_LOOPS (1000)
+
 typedef enum {
 	E_CALLBACK_RESET_COUNTER = 0,
 	E_CALLBACK_INCREMENT_COUNTER,
@@ -78,6 +89,9 @@ typedef struct {
 static T_TIMER timer_pool[TIMER_POOL_SIZE - 2] = { 0 };
 static T_TIMER timer = NULL;
 
+static struct timer_wheel bench_wheel;
+static struct timer_wheel_node bench_nodes[TIMER_BENCH_MAX];
+
 
 /* -------------- local function -------------- */
 static void timer_callback_stat(void *data);
@@ -591,6 +605,89 @@ void test_timer_stat(void)
 }
 
 
+/* measure the cost of timer start/stop with 10, 100 and 1000 active timers */
+void test_timer_wheel_bench(void)
+{
+	static const uint16_t nb_timers[] = { 10, 100, 1000 };
+	struct timer_wheel_node *node;
+	uint32_t now = get_uptime_ms();
+	uint32_t start, elapsed, last;
+	uint16_t i, n;
+	uint8_t k;
+
+	for (k = 0; k < DIM(nb_timers) && nb_timers[k] <= TIMER_BENCH_MAX;
+	     k++) {
+		n = nb_timers[k];
+		timer_wheel_init(&bench_wheel, now);
+		/* spread expiration dates from a few ms to a few minutes */
+		for (i = 0; i < n; i++) {
+			timer_wheel_node_init(&bench_nodes[i]);
+			timer_wheel_add(&bench_wheel, &bench_nodes[i],
+					now + 1 + (i * 7919) % 300000);
+		}
+
+		start = get_uptime_32k();
+		for (i = 0; i < TIMER_BENCH_LOOPS; i++) {
+			node = &bench_nodes[(i * 31) % n];
+			timer_wheel_remove(&bench_wheel, node);
+			timer_wheel_add(&bench_wheel, node,
+					now + 1 + (i * 104729) % 300000);
+		}
+		elapsed = get_uptime_32k() - start;
+
+		cu_print("%4d timers: %d ns per stop/start\n", n,
+			 (uint32_t)((uint64_t)elapsed * 1000000000 /
+				    32768 / TIMER_BENCH_LOOPS));
+
+		/* all timers must still be pending, in expiration order */
+		timer_wheel_advance(&bench_wheel, now + 300000);
+		last = now;
+		for (i = 0; i < n; i++) {
+			node = timer_wheel_get_expired(&bench_wheel);
+			CU_ASSERT("timer lost", node != NULL);
+			if (node == NULL)
+				break;
+			CU_ASSERT("timer out of order",
+				  (int32_t)(node->expiration - last) >= 0);
+			last = node->expiration;
+		}
+		CU_ASSERT("unexpected timer",
+			  timer_wheel_get_expired(&bench_wheel) == NULL);
+	}
+}
+
+/* timers expiring after the 32 bits wrap of the uptime in ms */
+void test_timer_wheel_wrap(void)
+{
+	static const uint32_t delays[] = { 5, 20, 300, 5000, 70000, 1000000 };
+	struct timer_wheel_node *node;
+	uint32_t now = 0xFFFFFFFF - 1000;
+	uint32_t expiration;
+	uint8_t i;
+
+	timer_wheel_init(&bench_wheel, now);
+	for (i = 0; i < DIM(delays); i++) {
+		timer_wheel_node_init(&bench_nodes[i]);
+		timer_wheel_add(&bench_wheel, &bench_nodes[i], now + delays[i]);
+	}
+
+	/* each timer is the next event, and expires on its date */
+	for (i = 0; i < DIM(delays); i++) {
+		CU_ASSERT("timer lost",
+			  timer_wheel_next_expiration(&bench_wheel,
+						      &expiration));
+		CU_ASSERT("wrong next expiration",
+			  expiration == now + delays[i]);
+		timer_wheel_advance(&bench_wheel, expiration);
+		node = timer_wheel_get_expired(&bench_wheel);
+		CU_ASSERT("timer not expired", node == &bench_nodes[i]);
+		CU_ASSERT("unexpected timer",
+			  timer_wheel_get_expired(&bench_wheel) == NULL);
+	}
+	CU_ASSERT("unexpected pending timer",
+		  !timer_wheel_next_expiration(&bench_wheel, &expiration));
+}
+
 /******************* LOCAL FUNCTION *******************************/
 static void timer_callback_stat(void *data)
 {
@@ -312,6 +312,12 @@ int cfw_unregister_service(service_t *service);
 /**
  * Send an indication message to the registered clients.
  *
+ * The message is not consumed. When many clients are registered, the
+ * clients of the current CPU receive the same read-only copy of the message
+ * (see message_share()), each client still frees it with cfw_msg_free().
+ * The destination of that copy is the one of \c msg, e.g. 0 for an event
+ * allocated with cfw_alloc_evt_msg(), not the port of the client.
+ *
  * @param msg indication message to send.
  */
 void cfw_send_event(struct cfw_message *msg);
@@ -103,6 +103,13 @@ typedef struct {
 	uint16_t put_idx;
 	uint16_t get_idx;
 	int16_t raw_data_offset;
+	/* resampling plan, computed by the open core when the demands or the
+	 * ODRs change, not to be set by the algorithms */
+	uint16_t si;            /* sampling interval, in ms */
+	uint16_t gap;           /* raw frames between two samples */
+	uint16_t target_count;  /* samples per common period of all demands */
+	uint16_t match_count;   /* samples per common period of matched demands */
+	uint8_t scale;          /* vernier steps between two samples */
 }sensor_data_demand_t;
 
 /**
@@ -110,7 +117,22 @@ typedef struct {
  **/
 struct feed_general_t;
 typedef struct {
+	/**
+	 * Process one sample per demand. Sensor data is read only, and only
+	 * valid during the call: it points into the raw data, which is freed or,
+	 * for a hardware FIFO, read again after the pass. An algorithm keeping
+	 * samples must copy them.
+	 */
 	int (*exec)(void **, struct feed_general_t *);
+	/**
+	 * Optional, process a block of samples of a feed fed directly from the
+	 * raw data: \c count samples, \c stride bytes apart, starting at the
+	 * pointer of the demand. Only used for more than one sample. Sensor
+	 * data is read only and only valid during the call, as for exec. Reports
+	 * made ready are only committed at the end of the block.
+	 */
+	int (*exec_block)(void **, uint16_t count, uint16_t stride,
+			  struct feed_general_t *);
 	int (*init)(struct feed_general_t *);
 	int (*deinit)(struct feed_general_t *);
 	int (*reset)(struct feed_general_t *);
@@ -143,6 +165,7 @@ typedef struct feed_general_t {
 	uint8_t no_idle_flag : 1;
 	uint8_t wake_up_clear_fifo_flag : 1;
 	uint8_t motion_sensor_flag : 1;
+	uint16_t vernier_length; /* vernier steps per match, set by the open core */
 }feed_general_t;
 
 /** @} */
@@ -58,6 +58,10 @@
  * - read the first element with \ref circular_storage_service_peek
  * - clear several or all the elements with \ref circular_storage_service_clear
  *
+ * Runs of elements can be transferred in a single request, with
+ * \ref circular_storage_service_push_n, \ref circular_storage_service_pop_n
+ * and \ref circular_storage_service_peek_at.
+ *
  * @ingroup services
  * @{
  */
@@ -77,6 +81,15 @@
 #define MSG_ID_CIRCULAR_STORAGE_SERVICE_GET_RSP      ((	\
 							      MSG_ID_CIRCULAR_STORAGE_SERVICE_BASE \
 							      + 9) | 0x40)
+#define MSG_ID_CIRCULAR_STORAGE_SERVICE_PUSH_N_RSP    (( \
+							       MSG_ID_CIRCULAR_STORAGE_SERVICE_BASE \
+							       + 10) | 0x40)
+#define MSG_ID_CIRCULAR_STORAGE_SERVICE_POP_N_RSP     (( \
+							       MSG_ID_CIRCULAR_STORAGE_SERVICE_BASE \
+							       + 11) | 0x40)
+#define MSG_ID_CIRCULAR_STORAGE_SERVICE_PEEK_AT_RSP   (( \
+							       MSG_ID_CIRCULAR_STORAGE_SERVICE_BASE \
+							       + 12) | 0x40)
 
 /**
  * Circular storage structure
@@ -151,6 +164,28 @@ typedef struct circular_storage_service_clear_rsp_msg {
 	int status;                     /*!< Response status code.*/
 } circular_storage_service_clear_rsp_msg_t;
 
+/**
+ * Structure containing the response to:
+ *  - @ref circular_storage_service_push_n
+ */
+typedef struct circular_storage_service_push_n_rsp_msg {
+	struct cfw_message header;      /*!< Message header */
+	uint32_t elt_count;             /*!< Number of elements pushed, all of them unless status is DRV_RC_FAIL */
+	int status;                     /*!< Response status code.*/
+} circular_storage_service_push_n_rsp_msg_t;
+
+/**
+ * Structure containing the response to:
+ *  - @ref circular_storage_service_pop_n
+ *  - @ref circular_storage_service_peek_at
+ */
+typedef struct circular_storage_service_read_n_rsp_msg {
+	struct cfw_message header;      /*!< Message header */
+	uint8_t *buffer;                /*!< Buffer containing the elements, to be freed by the client */
+	uint32_t elt_count;             /*!< Number of elements in the buffer */
+	int status;                     /*!< Response status code.*/
+} circular_storage_service_read_n_rsp_msg_t;
+
 /**
  * Flash storage get
  * Request to retreive the storage configuration by giving the configuration key.
@@ -216,6 +251,57 @@ void circular_storage_service_clear(cfw_service_conn_t *conn, void *storage,
 				    uint32_t elt_count,
 				    void *priv);
 
+/**
+ * Flash storage push of several elements.
+ *
+ * @param conn Service client connection pointer.
+ * @param buffer Buffer containing the elements to be written, back to back
+ * @param elt_count Number of elements in the buffer
+ * @param storage  Pointer on the storage struct as returned by get
+ * @param priv Private data pointer that will be passed back in the response
+ *
+ * @b Response: _MSG_ID_CIRCULAR_STORAGE_SERVICE_PUSH_N_RSP_ with attached \ref circular_storage_service_push_n_rsp_msg_t
+ */
+void circular_storage_service_push_n(cfw_service_conn_t *conn, uint8_t *buffer,
+				     uint32_t elt_count, void *storage,
+				     void *priv);
+
+/**
+ * Flash storage pop of several elements.
+ *
+ * The response holds up to elt_count of the oldest elements, or DRV_RC_FAIL
+ * status if the storage is empty, as @ref circular_storage_service_pop. The
+ * elements returned must also fit in the largest memory pool block.
+ *
+ * @param conn Service client connection pointer.
+ * @param storage  Pointer on the storage struct as returned by get
+ * @param elt_count Maximum number of elements to pop
+ * @param priv Private data pointer that will be passed back in the response
+ *
+ * @b Response: _MSG_ID_CIRCULAR_STORAGE_SERVICE_POP_N_RSP_ with attached \ref circular_storage_service_read_n_rsp_msg_t
+ */
+void circular_storage_service_pop_n(cfw_service_conn_t *conn, void *storage,
+				    uint32_t elt_count, void *priv);
+
+/**
+ * Flash storage peek of several elements, at an offset from the oldest one.
+ *
+ * The response holds up to elt_count elements, or DRV_RC_OUT_OF_MEM status if
+ * no element is stored at offset, as @ref circular_storage_service_peek. The
+ * elements returned must also fit in the largest memory pool block.
+ *
+ * @param conn Service client connection pointer.
+ * @param storage  Pointer on the storage struct as returned by get
+ * @param offset Rank of the first element to read, 0 being the oldest
+ * @param elt_count Maximum number of elements to read
+ * @param priv Private data pointer that will be passed back in the response
+ *
+ * @b Response: _MSG_ID_CIRCULAR_STORAGE_SERVICE_PEEK_AT_RSP_ with attached \ref circular_storage_service_read_n_rsp_msg_t
+ */
+void circular_storage_service_peek_at(cfw_service_conn_t *conn, void *storage,
+				      uint32_t offset, uint32_t elt_count,
+				      void *priv);
+
 /** @} */
 
 #endif /* __CIRCULAR_STORAGE_SERVICE_H__ */
@@ -64,6 +64,14 @@
 						    ( \
 							    MSG_ID_LL_STORAGE_SERVICE_BASE \
 							    + 4))
+#define MSG_ID_LL_STORAGE_SERVICE_READ_CHUNK_RSP   (0x40 | \
+						    ( \
+							    MSG_ID_LL_STORAGE_SERVICE_BASE \
+							    + 5))
+#define MSG_ID_LL_STORAGE_SERVICE_WRITE_CHUNK_RSP  (0x40 | \
+						    ( \
+							    MSG_ID_LL_STORAGE_SERVICE_BASE \
+							    + 6))
 
 /**
  * Structure containing the response to:
@@ -97,10 +105,30 @@ typedef struct ll_storage_service_read_rsp_msg {
 	int status;             /*!< Response status code.*/
 } ll_storage_service_read_rsp_msg_t;
 
+/**
+ * Structure containing the responses to:
+ *  - \ref ll_storage_service_read_stream
+ *  - \ref ll_storage_service_write_stream
+ *
+ * One response is sent per chunk transferred, the last one has the last flag
+ * set. A failure ends the transfer.
+ */
+typedef struct ll_storage_service_chunk_rsp_msg {
+	struct cfw_message header; /*!< Message header */
+	void *buffer;           /*!< Buffer of the request */
+	uint32_t offset;        /*!< Offset of the chunk in the buffer */
+	uint32_t size;          /*!< Number of bytes transferred for this chunk */
+	uint8_t last;           /*!< Set on the last response of the request */
+	int status;             /*!< Response status code.*/
+} ll_storage_service_chunk_rsp_msg_t;
+
 
 /**
  * Low level partition erase.
  *
+ * The blocks are erased one at a time, other requests can be handled in
+ * between: the partition must not be accessed before the response.
+ *
  * @msc
  *  Client,"Low Level Storage Service","Flash memory driver";
  *
@@ -123,6 +151,9 @@ void ll_storage_service_erase_partition(cfw_service_conn_t *	conn,
 /**
  * Low level erase block(s).
  *
+ * The blocks are erased one at a time, other requests can be handled in
+ * between: the blocks must not be accessed before the response.
+ *
  * @msc
  *  Client,"Low Level Storage Service","Flash memory driver";
  *
@@ -195,6 +226,59 @@ void ll_storage_service_write(cfw_service_conn_t *conn, uint16_t partition_id,
 			      uint32_t size,
 			      void *priv);
 
+/**
+ * Low level data read, by chunks.
+ *
+ * The data is read directly in the buffer of the caller, in chunks of
+ * CONFIG_SERVICES_QUARK_SE_LL_STORAGE_CHUNK_SIZE bytes. The other requests
+ * of the storage services are handled between the chunks.
+ *
+ * @msc
+ *  Client,"Low Level Storage Service","Flash memory driver";
+ *
+ *  Client->"Low Level Storage Service" [label="read stream request"];
+ *  "Low Level Storage Service"=>"Flash memory driver" [label="read chunk \n function call"];
+ *  "Low Level Storage Service"<<"Flash memory driver" [label="read return status"];
+ *  Client<-"Low Level Storage Service" [label="chunk response \n message w/ status", URL="\ref ll_storage_service_chunk_rsp_msg_t"];
+ *  ...;
+ *  Client<-"Low Level Storage Service" [label="last chunk response \n message w/ status", URL="\ref ll_storage_service_chunk_rsp_msg_t"];
+ * @endmsc
+ *
+ * @param conn Service client connection pointer.
+ * @param partition_id ID of the partition
+ * @param start_offset First data address to be read (offset from the beginning of the partition); \n must be 4bytes aligned
+ * @param buffer Buffer where to read the data, 4bytes aligned. It must be kept until the last response.
+ * @param size  Number of bytes to be read
+ * @param priv Private data pointer that will be passed in the response messages
+ *
+ * @b Response: _MSG_ID_LL_STORAGE_SERVICE_READ_CHUNK_RSP_ messages
+ */
+void ll_storage_service_read_stream(cfw_service_conn_t *conn,
+				    uint16_t partition_id,
+				    uint32_t start_offset, void *buffer,
+				    uint32_t size, void *priv);
+
+/**
+ * Low level data write, by chunks.
+ *
+ * The data is written from the buffer of the caller, in chunks of
+ * CONFIG_SERVICES_QUARK_SE_LL_STORAGE_CHUNK_SIZE bytes. The other requests
+ * of the storage services are handled between the chunks.
+ *
+ * @param conn Service client connection pointer.
+ * @param partition_id ID of the partition
+ * @param start_offset First address to be written (offset from the beginning of the partition); \n must be 4bytes aligned
+ * @param buffer Buffer containing data to be written, 4bytes aligned. It must be kept until the last response.
+ * @param size  Number of bytes to be written
+ * @param priv Private data pointer that will be passed in the response messages
+ *
+ * @b Response: _MSG_ID_LL_STORAGE_SERVICE_WRITE_CHUNK_RSP_ messages
+ */
+void ll_storage_service_write_stream(cfw_service_conn_t *conn,
+				     uint16_t partition_id,
+				     uint32_t start_offset, void *buffer,
+				     uint32_t size, void *priv);
+
 /** @} */
 
 #endif /* __LL_STORAGE_SERVICE_H__ */
@@ -56,6 +56,11 @@
  *   Client will receive _MSG_ID_SS_SENSOR_SUBSCRIBE_DATA_EVT_ messages
  *   with attached \ref sensor_service_subscribe_data_event_t.\n
  *   Data depends on the sensor type (see sensor_data_format.h for details).
+ * - \ref sensor_service_subscribe_data_batched to subscribe to a sensor with
+ *   batching\n
+ *   Client will receive _MSG_ID_SENSOR_SERVICE_SUBSCRIBE_BATCH_EVT_ messages
+ *   with attached \ref sensor_service_subscribe_data_event_t holding
+ *   several \ref sensor_service_batch_sample_t.
  *
  * @ingroup services
  * @{
@@ -111,6 +116,8 @@
 		MSG_ID_SENSOR_SERVICE_EVT | 0x06)
 #define MSG_ID_SENSOR_SERVICE_GET_PROPERTY_EVT           ( \
 		MSG_ID_SENSOR_SERVICE_EVT | 0x07)
+#define MSG_ID_SENSOR_SERVICE_SUBSCRIBE_BATCH_EVT        ( \
+		MSG_ID_SENSOR_SERVICE_EVT | 0x08)
 
 
 #define GET_SENSOR_TYPE(sensor_handle)  ((((uint32_t)(sensor_handle)) >> \
@@ -174,6 +181,58 @@ typedef struct {
 	sensor_service_sensor_data_header_t sensor_data_header;
 } sensor_service_subscribe_data_event_t;
 
+/**
+ * Sample of a batched subscribe data event
+ *
+ * The samples of a _MSG_ID_SENSOR_SERVICE_SUBSCRIBE_BATCH_EVT_ are packed
+ * one after the other in the \c data field of the event
+ * \ref sensor_service_sensor_data_header_t. For such an event, the header
+ * \c timestamp is the one of the first sample and \c data_length is the size
+ * of the data of a single sample.
+ */
+typedef struct {
+	uint32_t timestamp;     /*!< Timestamp of the sample */
+	uint8_t data[0];        /*!< Sample data, data_length bytes */
+} __packed sensor_service_batch_sample_t;
+
+/** Size of a batched sample carrying \c data_length bytes of data */
+#define SS_BATCH_SAMPLE_SIZE(data_length) \
+	(sizeof(sensor_service_batch_sample_t) + (data_length))
+
+/**
+ * Get the number of samples of a batched subscribe data event.
+ *
+ * @param  p_evt  _MSG_ID_SENSOR_SERVICE_SUBSCRIBE_BATCH_EVT_ message
+ *
+ * @return number of samples in the event
+ */
+static inline uint16_t sensor_service_batch_sample_nr(
+	sensor_service_subscribe_data_event_t *p_evt)
+{
+	return (CFW_MESSAGE_LEN(&p_evt->head) -
+		sizeof(sensor_service_subscribe_data_event_t)) /
+	       SS_BATCH_SAMPLE_SIZE(p_evt->sensor_data_header.data_length);
+}
+
+/**
+ * Get a sample of a batched subscribe data event.
+ *
+ * @param  p_evt  _MSG_ID_SENSOR_SERVICE_SUBSCRIBE_BATCH_EVT_ message
+ * @param  index  Index of the sample, lower than
+ *                \ref sensor_service_batch_sample_nr
+ *
+ * @return pointer on the sample
+ */
+static inline sensor_service_batch_sample_t *sensor_service_batch_sample(
+	sensor_service_subscribe_data_event_t *p_evt, uint16_t index)
+{
+	return (sensor_service_batch_sample_t *)
+	       &p_evt->sensor_data_header.data[
+		       index *
+		       SS_BATCH_SAMPLE_SIZE(p_evt->sensor_data_header.
+					    data_length)];
+}
+
 /**
  * Start the sensor scanning.
  *
@@ -222,6 +281,46 @@ void sensor_service_subscribe_data(cfw_service_conn_t *p_service_conn,
 				   uint16_t sampling_interval,
 				   uint16_t reporting_interval);
 
+/**
+ * Subscribe to sensor data, with samples delivered in batches
+ *
+ * Same as \ref sensor_service_subscribe_data, except that the samples are
+ * accumulated by the service and sent in a single
+ * _MSG_ID_SENSOR_SERVICE_SUBSCRIBE_BATCH_EVT_ message once \c batch_size
+ * samples are collected, or \c max_latency ms after the first one was
+ * received. Samples of a different data type or size, as well as
+ * unsubscribing, flush the pending batch.
+ *
+ * The batch is allocated from the message pool when its first sample is
+ * received. It holds at most as many samples as fit in the largest memory
+ * block, \c batch_size is reduced accordingly. If the allocation fails, the
+ * sample is delivered alone in a _MSG_ID_SENSOR_SERVICE_SUBSCRIBE_DATA_EVT_
+ * message.
+ *
+ * @param  p_service_conn      Service connection
+ * @param  p_priv              Pointer to private data that will be passed back in response
+ * @param  sensor              Sensor handle as received on \ref MSG_ID_SENSOR_SERVICE_START_SCANNING_EVT
+ * @param  data_type           Specific to sensor type.
+ * @param  data_type_nr        Size of data type
+ * @param  sampling_interval   Fequency of sensor data sampling,unit[HZ].
+ * @param  reporting_interval  Frequency of sensor data reporting,unit[ms].
+ * @param  max_latency         Maximum age of the first sample of a batch,unit[ms],
+ *                             0 to only flush full batches.
+ * @param  batch_size          Maximum number of samples in a batch, 0 or 1
+ *                             to disable batching.
+ *
+ * @b Response: _MSG_ID_SENSOR_SERVICE_SUBSCRIBE_DATA_RSP_ with attached \ref sensor_service_message_general_rsp_t
+ */
+void sensor_service_subscribe_data_batched(cfw_service_conn_t *p_service_conn,
+					   void *p_priv,
+					   sensor_service_t sensor,
+					   uint8_t *data_type,
+					   uint8_t data_type_nr,
+					   uint16_t sampling_interval,
+					   uint16_t reporting_interval,
+					   uint16_t max_latency,
+					   uint16_t batch_size);
+
 /**
  * Unsubscribe from sensor data
  *
@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2016, Intel Corporation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "os/os.h"
+#include "util/list.h"
+#include "infra/log.h"
+#include "infra/port.h"
+#include "cfw/cfw.h"
+#include "cfw/cfw_service.h"
+#include "cfw_internal.h"
+
+/**
+ * \file cfw_events.c registry of the events registered by the clients and
+ * event broadcasting, common to the service manager and its proxy.
+ */
+
+/**
+ * Indication list
+ * Holds a list of receivers.
+ */
+typedef struct {
+	list_t list;
+	conn_handle_t *conn_handle;
+} indication_list_t;
+
+/**
+ * \struct registered_int_list_t holds a list of registered clients to an indication
+ *
+ * Holds a list of registered receiver for each indication.
+ */
+typedef struct registered_evt_list_ {
+	list_t list; /*! Linking stucture */
+	list_head_t lh; /*! List of client */
+	int ind; /*! Indication message id */
+	uint16_t count; /*! Number of clients */
+} registered_evt_list_t;
+
+/** Minimum number of clients of an event to share a single copy of it.
+ * Below, cloning the event for each client is faster, see
+ * tools/tests/cfw_event_bench.c */
+#define EVT_SHARE_MIN_CLIENTS 8
+
+/** Number of buckets of the event registry, must be a power of 2 */
+#define EVT_HASH_SIZE 16
+
+/* Registered events, hashed by message id */
+static list_head_t registered_evt_table[EVT_HASH_SIZE];
+
+static list_head_t *get_event_bucket(int msg_id)
+{
+	/* message ids are a service base plus an index */
+	return &registered_evt_table[(msg_id ^ (msg_id >> 8)) &
+				     (EVT_HASH_SIZE - 1)];
+}
+
+static registered_evt_list_t *get_event_registered_list(int msg_id)
+{
+	registered_evt_list_t *l =
+		(registered_evt_list_t *)get_event_bucket(msg_id)->head;
+
+	while (l) {
+		if (l->ind == msg_id) {
+			return l;
+		}
+		l = (registered_evt_list_t *)l->list.next;
+	}
+	return NULL;
+}
+
+/* Send a copy of the event to one client */
+static void send_event_copy(struct cfw_message *msg, uint16_t port)
+{
+	struct cfw_message *m = cfw_clone_message(msg);
+
+	if (m != NULL) {
+		CFW_MESSAGE_DST(m) = port;
+		if (cfw_send_message(m) != E_OS_OK)
+			cfw_msg_free(m);
+	}
+}
+
+void cfw_send_event(struct cfw_message *msg)
+{
+	registered_evt_list_t *l;
+	indication_list_t *e;
+	struct message_ref *refs = NULL;
+	OS_ERR_TYPE err;
+	uint16_t used = 0;
+	uint16_t port;
+
+#ifdef SVC_MANAGER_DEBUG
+	pr_debug(LOG_MODULE_CFW, "%s : msg:%d", __func__, CFW_MESSAGE_ID(msg));
+#endif
+	l = get_event_registered_list(CFW_MESSAGE_ID(msg));
+	if (l == NULL || l->count == 0)
+		return;
+
+	/* Local clients share a single copy of the event, they are copied
+	 * one by one if it cannot be allocated */
+	if (l->count >= EVT_SHARE_MIN_CLIENTS)
+		refs = message_share(CFW_MESSAGE_HEADER(msg), l->count, &err);
+
+	for (e = (indication_list_t *)l->lh.head; e != NULL;
+	     e = (indication_list_t *)e->list.next) {
+		port = e->conn_handle->client_port;
+		if (refs != NULL && port_get_cpu_id(port) == get_cpu_id()) {
+			MESSAGE_DST(&refs[used].m) = port;
+			if (port_send_message(&refs[used].m) != E_OS_OK)
+				message_release(&refs[used].m);
+			used++;
+		} else {
+			send_event_copy(msg, port);
+		}
+	}
+
+	/* Release the references of the remote clients */
+	while (refs != NULL && used < l->count)
+		message_release(&refs[used++].m);
+}
+
+struct unregister_event_arg {
+	conn_handle_t *h;
+	registered_evt_list_t *l;
+};
+
+static int unregister_events_cb(void *element, void *param)
+{
+	indication_list_t *e = (indication_list_t *)element;
+	struct unregister_event_arg *arg = param;
+
+	if (e->conn_handle == arg->h) {
+		bfree(e);
+		arg->l->count--;
+		return 1;
+	}
+	return 0;
+}
+
+void _cfw_unregister_event(conn_handle_t *h)
+{
+	struct unregister_event_arg arg = { .h = h };
+	int i;
+
+	for (i = 0; i < EVT_HASH_SIZE; i++) {
+		arg.l = (registered_evt_list_t *)registered_evt_table[i].head;
+		while (arg.l) {
+			list_foreach_del(&arg.l->lh, unregister_events_cb,
+					 &arg);
+			arg.l = (registered_evt_list_t *)arg.l->list.next;
+		}
+	}
+}
+
+static bool check_duplicate_handle_cb(list_t *element, void *param)
+{
+	if (param == ((indication_list_t *)element)->conn_handle) {
+		return true;
+	}
+	return false;
+}
+
+void _cfw_register_event(conn_handle_t *h, int msg_id)
+{
+#ifdef SVC_MANAGER_DEBUG
+	pr_debug(LOG_MODULE_CFW, "%s : msg:%d port %d h:%p", __func__, msg_id,
+		 h->client_port,
+		 h);
+#endif
+	registered_evt_list_t *ind = get_event_registered_list(msg_id);
+
+	if (ind == NULL) {
+		ind = (registered_evt_list_t *)balloc(sizeof(*ind), NULL);
+		ind->ind = msg_id;
+		ind->count = 0;
+		list_init(&ind->lh);
+		list_add(get_event_bucket(msg_id), &ind->list);
+	}
+
+	if (!list_find_first(&ind->lh, check_duplicate_handle_cb, h)) {
+		indication_list_t *e = (indication_list_t *)balloc(sizeof(*e),
+								   NULL);
+		e->conn_handle = h;
+		list_add(&ind->lh, (list_t *)e);
+		ind->count++;
+	}
+}
@@ -205,131 +205,6 @@ uint16_t cfw_port_alloc(void *queue)
 	return port_alloc(queue);
 }
 
-
-/**
- * Indication list
- * Holds a list of receivers.
- */
-typedef struct {
-	list_t list;
-	conn_handle_t *conn_handle;
-} indication_list_t;
-
-/**
- * \struct registered_int_list_t holds a list of registered clients to an indication
- *
- * Holds a list of registered receiver for each indication.
- */
-typedef struct registered_evt_list_ {
-	list_t list; /*! Linking stucture */
-	list_head_t lh; /*! List of client */
-	int ind;     /*! Indication message id */
-} registered_evt_list_t;
-
-list_head_t registered_evt_list;
-
-
-
-registered_evt_list_t *get_event_registered_list(int msg_id)
-{
-	registered_evt_list_t *l =
-		(registered_evt_list_t *)registered_evt_list.head;
-
-	while (l) {
-		if (l->ind == msg_id) {
-			return l;
-		}
-		l = (registered_evt_list_t *)l->list.next;
-	}
-	return NULL;
-}
-
-list_head_t *get_event_list(int msg_id)
-{
-	registered_evt_list_t *l = get_event_registered_list(msg_id);
-
-	if (l)
-		return &l->lh;
-	return NULL;
-}
-
-static void send_event_callback(void *item, void *param)
-{
-	struct cfw_message *msg = (struct cfw_message *)param;
-	indication_list_t *ind = (indication_list_t *)item;
-	struct cfw_message *m = cfw_clone_message(msg);
-
-	if (m != NULL) {
-		CFW_MESSAGE_DST(m) = ind->conn_handle->client_port;
-		cfw_send_message(m);
-	}
-}
-
-void cfw_send_event(struct cfw_message *msg)
-{
-#ifdef SVC_MANAGER_DEBUG
-	pr_debug(LOG_MODULE_CFW, "%s : msg:%d", __func__, CFW_MESSAGE_ID(msg));
-#endif
-	list_head_t *list = get_event_list(CFW_MESSAGE_ID(msg));
-	if (list != NULL) {
-		list_foreach(list, send_event_callback, msg);
-	}
-}
-
-static int unregister_events_cb(void *element, void *param)
-{
-	indication_list_t *e = (indication_list_t *)element;
-
-	if (e->conn_handle == param) {
-		return 1;
-	}
-	return 0;
-}
-
-void _cfw_unregister_event(conn_handle_t *h)
-{
-	registered_evt_list_t *l =
-		(registered_evt_list_t *)registered_evt_list.head;
-
-	while (l) {
-		list_foreach_del(&l->lh, unregister_events_cb, h);
-		l = (registered_evt_list_t *)l->list.next;
-	}
-}
-
-static bool check_duplicate_handle_cb(list_t *element, void *param)
-{
-	if (param == ((indication_list_t *)element)->conn_handle) {
-		return true;
-	}
-	return false;
-}
-
-void _cfw_register_event(conn_handle_t *h, int msg_id)
-{
-#ifdef SVC_MANAGER_DEBUG
-	pr_debug(LOG_MODULE_CFW, "%s : msg:%d port %d h:%p", __func__, msg_id,
-		 h->client_port,
-		 h);
-#endif
-	registered_evt_list_t *ind =
-		(registered_evt_list_t *)get_event_registered_list(msg_id);
-
-	if (ind == NULL) {
-		ind = (registered_evt_list_t *)balloc(sizeof(*ind), NULL);
-		ind->ind = msg_id;
-		list_init(&ind->lh);
-		list_add(&registered_evt_list, &ind->list);
-	}
-
-	if (!list_find_first(&ind->lh, check_duplicate_handle_cb, h)) {
-		indication_list_t *e = (indication_list_t *)balloc(sizeof(*e),
-								   NULL);
-		e->conn_handle = h;
-		list_add(&ind->lh, (list_t *)e);
-	}
-}
-
 struct get_service_cb_arg {
 	service_t *svc;
 	int service_id;
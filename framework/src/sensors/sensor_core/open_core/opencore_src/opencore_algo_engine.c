@@ -63,9 +63,8 @@ void OpencoreCommitSensData(uint8_t type, uint8_t id, void* data_ptr, int data_l
 	}
 }
 
-static void HandleAlgo(feed_general_t* feed, void** data_ptr)
+static void CommitReadyReports(int ret)
 {
-	int ret = feed->ctl_api.exec(data_ptr, feed);
 	if(ret != 0){
 		for(list_t* next = exposed_sensor_list.head; next != NULL; next = next->next){
 			exposed_sensor_t* exposed_sensor = (exposed_sensor_t*)next;
@@ -78,22 +77,49 @@ static void HandleAlgo(feed_general_t* feed, void** data_ptr)
 	}
 }
 
-static void AddCaliData(uint8_t phy_type, sensor_handle_t* phy_sensor, void* ptr_from)
+static void HandleAlgo(feed_general_t* feed, void** data_ptr)
+{
+	CommitReadyReports(feed->ctl_api.exec(data_ptr, feed));
+}
+
+static void HandleAlgoBlock(feed_general_t* feed, void** data_ptr,
+				uint16_t count, uint16_t stride)
 {
-	switch(phy_type){
+	CommitReadyReports(feed->ctl_api.exec_block(data_ptr, count, stride, feed));
+}
+
+//add the calibration offset to count consecutive frames
+static void AddCaliData(sensor_handle_t* phy_sensor, void* buffer, uint16_t count)
+{
+	int frame_size = phy_sensor->sensor_data_frame_size;
+	switch(phy_sensor->type){
 		case SENSOR_ACCELEROMETER:
 			{
 				short* cali_ptr = (short*)phy_sensor->clb_data_buffer;
-				for(int k = 0; k < 3; k++)
-					((short*)ptr_from)[k] += cali_ptr[k];
+				short cx = cali_ptr[0], cy = cali_ptr[1], cz = cali_ptr[2];
+				if(cx == 0 && cy == 0 && cz == 0)
+					break;
+				for(uint16_t n = 0; n < count; n++, buffer += frame_size){
+					short* frame = (short*)buffer;
+					frame[0] += cx;
+					frame[1] += cy;
+					frame[2] += cz;
+				}
 			}
 			break;
 		case SENSOR_GYROSCOPE:
 		case SENSOR_MAGNETOMETER:
 			{
 				int* cali_ptr = (int*)phy_sensor->clb_data_buffer;
-				for(int k = 0; k < 3; k++)
-					((int*)ptr_from)[k] += cali_ptr[k];
+				int cx = cali_ptr[0], cy = cali_ptr[1], cz = cali_ptr[2];
+				if(cx == 0 && cy == 0 && cz == 0)
+					break;
+				for(uint16_t n = 0; n < count; n++, buffer += frame_size){
+					int* frame = (int*)buffer;
+					frame[0] += cx;
+					frame[1] += cy;
+					frame[2] += cz;
+				}
 			}
 			break;
 		default:
@@ -101,12 +127,23 @@ static void AddCaliData(uint8_t phy_type, sensor_handle_t* phy_sensor, void* ptr
 	}
 }
 
+//calibrate the raw data nodes once, before any feed reads them
+static void CalibrateRawData(sensor_handle_t* phy_sensor)
+{
+	if(phy_sensor->clb_data_buffer == NULL)
+		return;
+	for(list_t* node = phy_sensor->raw_data_head[phy_sensor->head_for_algo].head;
+		node != NULL; node = node->next){
+		raw_data_node_t* raw_data = (raw_data_node_t*)((void*)node
+			- offsetof(raw_data_node_t, raw_data_node));
+		AddCaliData(phy_sensor, raw_data->buffer, raw_data->raw_data_count);
+	}
+}
+
 static void HandleMatchBufferData(feed_general_t* feed)
 {
 	sensor_data_demand_t* demand = feed->demand;
 	uint8_t demand_length = feed->demand_length;
-	uint8_t data_match_not_ready_flag = 0;
-	uint16_t cm_time_consume = 1;
 	uint8_t match_times = 0;
 
 	for(int i = 0; i < demand_length; i++){
@@ -114,71 +151,48 @@ static void HandleMatchBufferData(feed_general_t* feed)
 			continue;
 		if((demand[i].flag & IGNORE) != 0)
 			continue;
-		cm_time_consume = GetCommonMultiple(cm_time_consume, ValueRound((float)1000 / demand[i].freq));
+		if(demand[i].match_data_count < demand[i].match_count)
+			return;
+		int temp = demand[i].match_data_count / demand[i].match_count;
+		if(match_times == 0 || temp < match_times)
+			match_times = temp;
 	}
 
+	int vernier_length = match_times * feed->vernier_length;
+	sensor_handle_t* phy_sensor[demand_length];
+	uint8_t tick[demand_length];
 	for(int i = 0; i < demand_length; i++){
-		if(demand[i].freq == 0)
-			continue;
-		if((demand[i].flag & IGNORE) != 0)
-			continue;
-		if(demand[i].match_data_count < cm_time_consume / ValueRound((float)1000 / demand[i].freq)){
-			data_match_not_ready_flag++;
-		}else{
-			int temp = demand[i].match_data_count / (cm_time_consume / ValueRound((float)1000 / demand[i].freq));
-			if(match_times == 0 || temp < match_times)
-				match_times = temp;
-		}
+		phy_sensor[i] = NULL;
+		tick[i] = 0;
+		if(demand[i].freq != 0 && demand[i].scale != 0 && demand[i].match_buffer != NULL)
+			phy_sensor[i] = GetActivePollSensStruct(demand[i].type, demand[i].id);
 	}
 
-	if(data_match_not_ready_flag == 0){
-		int vernier_length = 0;
-		uint16_t cm_multi_freq = 1;
-		int8_t scale[demand_length];
-		memset(scale, 0, sizeof(scale));
-		for(int i = 0; i < demand_length; i++){
-			if(demand[i].freq == 0)
-				continue;
-			cm_multi_freq = GetCommonMultiple(cm_multi_freq, demand[i].freq);
-		}
-
+	for(int v = 0; v < vernier_length; v++){
+		void* ptr[demand_length];
+		memset(ptr, 0, sizeof(ptr));
+		int act = 0;
 		for(int i = 0; i < demand_length; i++){
-			int count;
-			if(demand[i].freq == 0)
+			if(phy_sensor[i] == NULL)
 				continue;
-			scale[i] = cm_multi_freq / demand[i].freq;
-			count  = match_times * (cm_time_consume / ValueRound((float)1000 / demand[i].freq));
-			if(vernier_length == 0 || vernier_length < count * scale[i])
-				vernier_length = count * scale[i];
-		}
-
-		for(int v = 0; v < vernier_length; v++){
-			void* ptr[demand_length];
-			memset(ptr, 0, sizeof(ptr));
-			int act = 0;
-			for(int i = 0; i < demand_length; i++){
-				if(demand[i].freq == 0)
-					continue;
-				sensor_handle_t* phy_sensor = GetActivePollSensStruct(demand[i].type, demand[i].id);
-				if(phy_sensor != NULL && scale[i] != 0 && demand[i].match_buffer != NULL){
-					if(v % scale[i] == 0 && demand[i].get_idx != demand[i].put_idx){
-						void* ptr_from = demand[i].match_buffer
-							+ phy_sensor->sensor_data_frame_size * demand[i].get_idx;
-						//add the calibration offset value
-						AddCaliData(demand[i].type, phy_sensor, ptr_from);
-						ptr[i] = ptr_from;
-						demand[i].get_idx++;
-						demand[i].match_data_count--;
-						if(demand[i].get_idx >= demand[i].match_buffer_repo)
-							demand[i].get_idx = 0;
-						act++;
-					}
+			//one sample every scale vernier steps
+			if(tick[i] == 0){
+				tick[i] = demand[i].scale;
+				if(demand[i].get_idx != demand[i].put_idx){
+					ptr[i] = demand[i].match_buffer
+						+ phy_sensor[i]->sensor_data_frame_size * demand[i].get_idx;
+					demand[i].get_idx++;
+					demand[i].match_data_count--;
+					if(demand[i].get_idx >= demand[i].match_buffer_repo)
+						demand[i].get_idx = 0;
+					act++;
 				}
 			}
-
-			if(act != 0 && feed->ctl_api.exec != NULL)
-				HandleAlgo(feed, ptr);
+			tick[i]--;
 		}
+
+		if(act != 0 && feed->ctl_api.exec != NULL)
+			HandleAlgo(feed, ptr);
 	}
 }
 
@@ -187,35 +201,37 @@ static void FeedSensDataDirectly(feed_general_t* feed)
 	sensor_data_demand_t* demand = feed->demand;
 	uint8_t demand_length = feed->demand_length;
 	for(int i = 0; i < demand_length; i++){
-		if(demand[i].freq == 0)
+		if(demand[i].freq == 0 || demand[i].gap == 0)
 			continue;
 		sensor_handle_t* phy_sensor = GetActivePollSensStruct(demand[i].type, demand[i].id);
 		if(phy_sensor != NULL){
 			list_t* node = phy_sensor->raw_data_head[phy_sensor->head_for_algo].head;
+			int gap = demand[i].gap;
+			int frame_size = phy_sensor->sensor_data_frame_size;
 			while(node != NULL){
 				//get raw data node
 				raw_data_node_t* raw_data = (raw_data_node_t*)((void*)node
 					- offsetof(raw_data_node_t, raw_data_node));
 				uint16_t raw_sensor_data_count = raw_data->raw_data_count;
-				void* buffer = raw_data->buffer;
-				int gap = ValueRound((float)phy_sensor->freq / (demand[i].freq * 10));
-				int frame_size = phy_sensor->sensor_data_frame_size;
-				int count;
+				void* buffer = raw_data->buffer + demand[i].raw_data_offset * frame_size;
+				int count = 0;
 				void* ptr[demand_length];
 				memset(ptr, 0, sizeof(ptr));
 
-				for(count = 0; gap * count + demand[i].raw_data_offset < raw_sensor_data_count; count++){
-					int idx = gap * count + demand[i].raw_data_offset;
-					void* ptr_from = phy_sensor->feed_data_buffer;
-					memcpy(ptr_from, buffer + idx * frame_size, frame_size);
-					//add cali offset
-					AddCaliData(demand[i].type, phy_sensor, ptr_from);
-					ptr[i] = ptr_from;
-					if(feed->ctl_api.exec != NULL)
+				//frames are handed over in place, every gap frames
+				if(demand[i].raw_data_offset < raw_sensor_data_count)
+					count = (raw_sensor_data_count - demand[i].raw_data_offset + gap - 1) / gap;
+				//a single frame gains nothing from the block call
+				if(count > 1 && feed->ctl_api.exec_block != NULL){
+					ptr[i] = buffer;
+					HandleAlgoBlock(feed, ptr, count, gap * frame_size);
+				}else if(feed->ctl_api.exec != NULL){
+					for(int n = 0; n < count; n++, buffer += gap * frame_size){
+						ptr[i] = buffer;
 						HandleAlgo(feed, ptr);
+					}
 				}
-				demand[i].raw_data_offset = gap - (raw_sensor_data_count
-					- (gap * (count - 1) + demand[i].raw_data_offset));
+				demand[i].raw_data_offset += gap * count - raw_sensor_data_count;
 				node = node->next;
 			}
 		}
@@ -247,26 +263,20 @@ static void FeedSensDataAfterMatch(feed_general_t* feed, match_t type)
 	sensor_data_demand_t* demand = feed->demand;
 	uint8_t demand_length = feed->demand_length;
 	list_t* node[demand_length];
+	sensor_handle_t* phy_sensor[demand_length];
 	memset(node, 0, sizeof(node));
+	memset(phy_sensor, 0, sizeof(phy_sensor));
 	int d_valid_cnt = 0;
-	uint32_t cm_time_consume = 1;
 	int count[demand_length];
 	memset(count, 0, sizeof(count));
 
 	for(int i = 0; i < demand_length; i++){
 		if(demand[i].freq == 0)
 			continue;
-		cm_time_consume = GetCommonMultiple(cm_time_consume,
-			ValueRound((float)1000 / demand[i].freq));
-	}
-
-	for(int i = 0; i < demand_length; i++){
-		if(demand[i].freq == 0)
-			continue;
-		sensor_handle_t* phy_sensor = GetActivePollSensStruct(demand[i].type, demand[i].id);
-		if(phy_sensor != NULL)
+		phy_sensor[i] = GetActivePollSensStruct(demand[i].type, demand[i].id);
+		if(phy_sensor[i] != NULL)
 			//get raw data node
-			node[i] = phy_sensor->raw_data_head[phy_sensor->head_for_algo].head;
+			node[i] = phy_sensor[i]->raw_data_head[phy_sensor[i]->head_for_algo].head;
 		d_valid_cnt++;
 	}
 
@@ -275,18 +285,18 @@ static void FeedSensDataAfterMatch(feed_general_t* feed, match_t type)
 		for(int i = 0; i < demand_length; i++){
 			if(demand[i].freq == 0)
 				continue;
-			sensor_handle_t* phy_sensor = GetActivePollSensStruct(demand[i].type, demand[i].id);
-			if ((phy_sensor != NULL) && (node[i] != NULL)) {
+			if ((phy_sensor[i] != NULL) && (node[i] != NULL)) {
 				raw_data_node_t* raw_data = (raw_data_node_t*)((void*)node[i] - offsetof(raw_data_node_t, raw_data_node));
 				uint16_t raw_sensor_data_count = raw_data->raw_data_count;
 				void* buffer = raw_data->buffer;
-				int gap = ValueRound((float)phy_sensor->freq / (demand[i].freq * 10));
+				int gap = demand[i].gap;
+				int frame_size = phy_sensor[i]->sensor_data_frame_size;
 
 				if(type == SYNC){
-					int	target_count = cm_time_consume / ValueRound((float)1000 / demand[i].freq);
+					int	target_count = demand[i].target_count;
 					for(; gap * count[i] + demand[i].raw_data_offset < raw_sensor_data_count
 							&& demand[i].match_data_count < target_count; count[i]++){
-						CopySensorData2DelayBuf(&demand[i], buffer, gap, count[i], phy_sensor->sensor_data_frame_size);
+						CopySensorData2DelayBuf(&demand[i], buffer, gap, count[i], frame_size);
 					}
 					if(gap * count[i] + demand[i].raw_data_offset >= raw_sensor_data_count){
 						demand[i].raw_data_offset = gap - (raw_sensor_data_count
@@ -298,7 +308,7 @@ static void FeedSensDataAfterMatch(feed_general_t* feed, match_t type)
 					int count;
 					for(count = 0; gap * count + demand[i].raw_data_offset
 						< raw_sensor_data_count; count++){
-						CopySensorData2DelayBuf(&demand[i], buffer, gap, count, phy_sensor->sensor_data_frame_size);
+						CopySensorData2DelayBuf(&demand[i], buffer, gap, count, frame_size);
 					}
 
 					demand[i].raw_data_offset = gap - (raw_sensor_data_count
@@ -327,6 +337,7 @@ static void FeedSensData2Algo(void)
 		uint32_t key = irq_lock();
 		phy_sensor->head_for_algo = no;
 		irq_unlock(key);
+		CalibrateRawData(phy_sensor);
 	}
 
 	for(list_t* next = feed_list.head; next != NULL; next = next->next){
@@ -137,7 +137,6 @@ typedef struct {
 
 	int16_t buffer_length;
 	void *clb_data_buffer;
-	void *feed_data_buffer;
 	void *buffer;
 	T_MUTEX mutex;
 
@@ -153,6 +152,7 @@ typedef struct {
 
 void *AllocFromDss(uint32_t size);
 int FreeInDss(void *buf);
+void DumpDssStats(void);
 
 DEFINE_LOG_MODULE(LOG_MODULE_OPEN_CORE, "OCOR")
 
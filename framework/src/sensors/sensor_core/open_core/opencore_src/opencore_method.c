@@ -206,6 +206,12 @@ int ValueRound(float value)
 	return rslt;
 }
 
+/* Integer equivalent of ValueRound((float)num / den) */
+uint16_t IntDivRound(uint32_t num, uint32_t den)
+{
+	return (2 * num + den) / (2 * den);
+}
+
 int SendCmd2OpenCore(int cmd_id)
 {
 	int length = sizeof(struct ia_cmd);
@@ -56,4 +56,6 @@ uint16_t GetCommonMultiple(uint16_t next_freq, uint16_t prev_multiple);
 
 int ValueRound(float value);
 
+uint16_t IntDivRound(uint32_t num, uint32_t den);
+
 #endif
@@ -142,6 +142,59 @@ static int sensor_rawdata_prepare_exec(void** sensor_data, feed_general_t* feed)
 	return ret;
 }
 
+//copy the frames of a block to the report buffer, a report is committed as
+//soon as it is full since the block may hold several reports
+static int sensor_rawdata_prepare_exec_block(void** sensor_data, uint16_t count,
+						uint16_t stride, feed_general_t* feed)
+{
+	for(int i = 0; i < feed->demand_length; i++){
+		uint8_t* data = sensor_data[i];
+		if(data == NULL)
+			continue;
+		exposed_sensor_t* exposed_sensor =
+			GetExposedStruct(feed->demand[i].type, feed->demand[i].id);
+		sensor_handle_t* phy_sensor = GetActivePollSensStruct(feed->demand[i].type, feed->demand[i].id);
+		if(exposed_sensor == NULL || phy_sensor == NULL || exposed_sensor->rpt_data_buf == NULL)
+			continue;
+		int frame_size = phy_sensor->sensor_data_frame_size;
+		int frames = exposed_sensor->rpt_data_buf_len / frame_size;
+		if(frames == 0)
+			continue;
+		for(int n = 0; n < count;){
+			//the calibration process takes the frames one by one, and
+			//there is nothing to batch with one frame per report
+			if(raw_data_calibration_flag == 1 || frames == 1){
+				void* ptr[feed->demand_length];
+				memset(ptr, 0, sizeof(ptr));
+				ptr[i] = data;
+				if(sensor_rawdata_prepare_exec(ptr, feed) != 0)
+					ReportSensDataDirectly(exposed_sensor);
+				data += stride;
+				n++;
+				continue;
+			}
+			int run = frames - exposed_sensor->data_frame_count;
+			if(run > count - n)
+				run = count - n;
+			uint8_t* dst = exposed_sensor->rpt_data_buf + exposed_sensor->data_frame_count * frame_size;
+			if(stride == frame_size){
+				memcpy(dst, data, run * frame_size);
+			}else{
+				for(int k = 0; k < run; k++)
+					memcpy(dst + k * frame_size, data + k * stride, frame_size);
+			}
+			data += run * stride;
+			n += run;
+			exposed_sensor->data_frame_count += run;
+			if(exposed_sensor->data_frame_count == frames){
+				exposed_sensor->data_frame_count = 0;
+				ReportSensDataDirectly(exposed_sensor);
+			}
+		}
+	}
+	return 0;
+}
+
 static int sensor_rawdata_prepare_reset(feed_general_t* feed)
 {
 	int act = 0;
@@ -216,6 +269,7 @@ feed_general_t atlsp_algoC={
 		.type = BASIC_ALGO_RAWDATA,
 		.ctl_api = {
 					.exec = &sensor_rawdata_prepare_exec,
+					.exec_block = &sensor_rawdata_prepare_exec_block,
 					.reset = &sensor_rawdata_prepare_reset,
 					.goto_idle = &sensor_rawdata_prepare_goto_idle,
 					.get_property = &sensor_rawdata_get_property,
@@ -33,6 +33,7 @@
  ***************************************************************************************/
 /* *INDENT-OFF* */
 #include "opencore_support.h"
+#include "util/block_arena.h"
 list_head_t feed_list;
 list_head_t exposed_sensor_list;
 
@@ -59,98 +60,60 @@ static uint8_t buffer_for_raw_sensor_data[64*BUF_CNT_64
 	+ 128*BUF_CNT_128
 	+ 512*BUF_CNT_512
 	+ 1024*BUF_CNT_1024] __attribute__((section(".dccm")));
-static volatile uint32_t buf_mask_64;
-static volatile uint8_t buf_mask_128;
-static volatile uint8_t buf_mask_256;
-static volatile uint8_t buf_mask_512;
-static volatile uint8_t buf_mask_1024;
+
+/* block tiers of buffer_for_raw_sensor_data, by increasing block size */
+static struct block_arena_tier dss_tiers[] = {
+	BLOCK_ARENA_TIER(64, BUF_CNT_64),
+	BLOCK_ARENA_TIER(128, BUF_CNT_128),
+	BLOCK_ARENA_TIER(512, BUF_CNT_512),
+	BLOCK_ARENA_TIER(1024, BUF_CNT_1024),
+};
+static struct block_arena dss_arena;
+
+static void InitDss(void)
+{
+	if(dss_arena.tiers == NULL)
+		block_arena_init(&dss_arena, buffer_for_raw_sensor_data,
+				dss_tiers, sizeof(dss_tiers) / sizeof(dss_tiers[0]));
+}
 
 void* AllocFromDss(uint32_t size)
 {
-	void* ptr = NULL;
-	void* start = (void*)&buffer_for_raw_sensor_data[0];
+	void* ptr;
 	uint32_t key = irq_lock();
-	if(size <= 64 && buf_mask_64 != (1 << BUF_CNT_64) - 1){
-		for(int i = 0; i < BUF_CNT_64; i++){
-			if((buf_mask_64 & (1 << i)) == 0){
-				ptr = start + 64*i;
-				buf_mask_64 |= 1 << i;
-				break;
-			}
-		}
-	}else if(size <= 128 && buf_mask_128 != (1 << BUF_CNT_128) - 1){
-		for(int i = 0; i < BUF_CNT_128; i++){
-			if((buf_mask_128 & (1 << i)) == 0){
-				ptr = start + 64*BUF_CNT_64 + 128*i;
-				buf_mask_128 |= 1 << i;
-				break;
-			}
-		}
-	}else if(size <= 512 && buf_mask_512 != (1 << BUF_CNT_512) - 1){
-		for(int i = 0; i < BUF_CNT_512; i++){
-			if((buf_mask_512 & (1 << i)) == 0){
-				ptr = start + 64*BUF_CNT_64 + 128*BUF_CNT_128 + 512*i;
-				buf_mask_512 |= 1 << i;
-				break;
-			}
-		}
-	}else if(size <= 1024 && buf_mask_1024 != (1 << BUF_CNT_1024) - 1){
-		for(int i = 0; i < BUF_CNT_1024; i++){
-			if((buf_mask_1024 & (1 << i)) == 0){
-				ptr = start + 64*BUF_CNT_64 + 128*BUF_CNT_128 + 512*BUF_CNT_512 + 1024*i;
-				buf_mask_1024 |= 1 << i;
-				break;
-			}
-		}
-	}
-
+	InitDss();
+	ptr = block_arena_alloc(&dss_arena, size);
 	irq_unlock(key);
+	if(ptr == NULL)
+		pr_warning(LOG_MODULE_OPEN_CORE, "dss alloc %d failed", size);
 	return ptr;
 }
 
 int FreeInDss(void* buf)
 {
-	int ret = -1;
-	void* start = (void*)&buffer_for_raw_sensor_data[0];
+	int ret;
 	uint32_t key = irq_lock();
-	if(buf < start + 64*BUF_CNT_64){
-		for(int i = 0; i < BUF_CNT_64; i++){
-			if(buf == start + 64*i){
-				buf_mask_64 &= ~(1<<i);
-				ret = 0;
-				break;
-			}
-		}
-	}else if(buf < start + 64*BUF_CNT_64 + 128*BUF_CNT_128){
-		for(int i = 0; i < BUF_CNT_128; i++){
-			if(buf == start + 64*BUF_CNT_64 + 128*i){
-				buf_mask_128 &= ~(1<<i);
-				ret = 0;
-				break;
-			}
-		}
-	}else if(buf < start + 64*BUF_CNT_64 + 128*BUF_CNT_128 + 512*BUF_CNT_512){
-		for(int i = 0; i < BUF_CNT_512; i++){
-			if(buf == start + 64*BUF_CNT_64 + 128*BUF_CNT_128 + 512*i){
-				buf_mask_512 &= ~(1<<i);
-				ret = 0;
-				break;
-			}
-		}
-	}else if(buf < start + 64*BUF_CNT_64 + 128*BUF_CNT_128 + 512*BUF_CNT_512 + 1024*BUF_CNT_1024){
-		for(int i = 0; i < BUF_CNT_1024; i++){
-			if(buf == start + 64*BUF_CNT_64 + 128*BUF_CNT_128 + 512*BUF_CNT_512 + 1024*i){
-				buf_mask_1024 &= ~(1<<i);
-				ret = 0;
-				break;
-			}
-		}
-	}
-
+	InitDss();
+	ret = block_arena_free(&dss_arena, buf);
 	irq_unlock(key);
 	return ret;
 }
 
+void DumpDssStats(void)
+{
+	struct block_arena_stats stats;
+	uint8_t i;
+
+	for(i = 0; i < sizeof(dss_tiers) / sizeof(dss_tiers[0]); i++){
+		uint32_t key = irq_lock();
+		stats = dss_tiers[i].stats;
+		irq_unlock(key);
+		pr_debug(LOG_MODULE_OPEN_CORE, "dss %d: used=%d/%d max=%d alloc=%d fallback=%d fail=%d wasted=%d",
+			dss_tiers[i].block_size, stats.used, dss_tiers[i].count, stats.max_used,
+			stats.alloc_count, stats.fallback_count, stats.fail_count, stats.wasted);
+	}
+}
+
 static uint16_t MatchFreq(sensor_handle_t* phy_sensor, uint16_t freq)
 {
 	uint16_t final_freq = 1;
@@ -333,6 +296,44 @@ static int CheckFeedIfDirect(feed_general_t* feed)
 	return 0;
 }
 
+/*
+ * Work out the resampling plan of a feed from its demands and the ODR of
+ * their physical sensors, so that the feed loop of the algo engine only
+ * does integer index arithmetic. Must be called again whenever the demand
+ * frequencies, the IGNORE flags or the physical sensor ODRs change.
+ */
+static void CompileFeedPlan(feed_general_t* feed)
+{
+	sensor_data_demand_t* demand = feed->demand;
+	uint8_t demand_length = feed->demand_length;
+	uint32_t cm_time_consume = 1;
+	uint16_t match_cm_time_consume = 1;
+	uint16_t cm_multi_freq = 1;
+
+	for(int i = 0; i < demand_length; i++){
+		if(demand[i].freq == 0)
+			continue;
+		demand[i].si = IntDivRound(1000, demand[i].freq);
+		cm_time_consume = GetCommonMultiple(cm_time_consume, demand[i].si);
+		if((demand[i].flag & IGNORE) == 0)
+			match_cm_time_consume = GetCommonMultiple(match_cm_time_consume, demand[i].si);
+		cm_multi_freq = GetCommonMultiple(cm_multi_freq, demand[i].freq);
+	}
+
+	feed->vernier_length = 0;
+	for(int i = 0; i < demand_length; i++){
+		if(demand[i].freq == 0)
+			continue;
+		sensor_handle_t* phy_sensor = GetActivePollSensStruct(demand[i].type, demand[i].id);
+		demand[i].gap = phy_sensor != NULL ?
+			IntDivRound(phy_sensor->freq, demand[i].freq * 10) : 0;
+		demand[i].target_count = cm_time_consume / demand[i].si;
+		demand[i].match_count = match_cm_time_consume / demand[i].si;
+		demand[i].scale = cm_multi_freq / demand[i].freq;
+		if(feed->vernier_length < demand[i].match_count * demand[i].scale)
+			feed->vernier_length = demand[i].match_count * demand[i].scale;
+	}
+}
 
 void RefleshSensorCore(void)
 {
@@ -607,6 +608,10 @@ void RefleshSensorCore(void)
 		}
 	}
 
+	//compile the resampling plan of every feed, now that ODRs are known
+	for(list_t* node = feed_list.head; node != NULL; node = node->next)
+		CompileFeedPlan((feed_general_t*)node);
+
 	//work out pi_used_balloc for each physical sensor
 	for(list_t* next = phy_sensor_poll_active_list.head; next != NULL; next = next->next){
 		sensor_handle_t* phy_sensor = (sensor_handle_t*)((void*)next - offsetof(sensor_handle_t, links.poll.poll_active_link));
@@ -757,6 +762,7 @@ void RefleshSensorCore(void)
 		}
 		phy_sensor->dirty = 0;
 	}
+	DumpDssStats();
 }
 
 #ifdef SUPPORT_INTERRUPT_MODE
@@ -887,12 +893,6 @@ out:
 					continue;
 
 				memset(phy_sensor->clb_data_buffer, 0, phy_sensor->sensor_data_frame_size);
-
-				phy_sensor->feed_data_buffer = balloc(phy_sensor->sensor_data_frame_size, NULL);
-				if(phy_sensor->feed_data_buffer == NULL)
-					continue;
-
-				memset(phy_sensor->feed_data_buffer, 0, phy_sensor->sensor_data_frame_size);
 				list_add(&phy_sensor_list_poll, &phy_sensor->links.poll.poll_link);
 				count++;
 			}else{
@@ -48,6 +48,8 @@
 
 #define BATT_S_SOC_MAX          100
 #define BATT_GRANULARITY        5
+/* Queue priority of the shutdown events, above the default 0 */
+#define BS_SHUTDOWN_EVT_PRIO    1
 
 /**********************************************************
 ************** Local definitions  ************************
@@ -381,6 +383,14 @@ static void bs_send_evt_msg(
 		       battery_service_evt_content_rsp_msg,
 		       sizeof(battery_service_evt_content_rsp_msg_t));
 	}
+	/* A newer level makes a pending level update useless, and the
+	 * shutdown events are dispatched before the pending messages */
+	if (id == MSG_ID_BATTERY_SERVICE_LEVEL_UPDATED_EVT)
+		MESSAGE_CLASS(CFW_MESSAGE_HEADER(&evt->header)) = CLASS_REPLACE;
+	else if (id == MSG_ID_BATTERY_SERVICE_LEVEL_SHUTDOWN_EVT ||
+		 id == MSG_ID_BATTERY_SERVICE_TEMPERATURE_SHUTDOWN_EVT)
+		MESSAGE_PRIO(CFW_MESSAGE_HEADER(&evt->header)) =
+			BS_SHUTDOWN_EVT_PRIO;
 	cfw_send_event(&evt->header);
 	bfree(evt); /* message has been cloned by cfw_send_event */
 }
@@ -29,6 +29,7 @@
  */
 
 #include "util/assert.h"
+#include "util/misc.h"
 
 #include "infra/log.h"
 
@@ -248,6 +249,112 @@ void handle_clear(struct cfw_message *msg)
 	cfw_send_message(resp);
 }
 
+static void handle_push_n(struct cfw_message *msg)
+{
+	circular_storage_push_n_req_msg_t *req =
+		(circular_storage_push_n_req_msg_t *)msg;
+	circular_storage_service_push_n_rsp_msg_t *resp =
+		(circular_storage_service_push_n_rsp_msg_t *)cfw_alloc_rsp_msg(
+			msg,
+			MSG_ID_CIRCULAR_STORAGE_SERVICE_PUSH_N_RSP,
+			sizeof(*resp));
+	DRIVER_API_RC ret = DRV_RC_FAIL;
+
+	if (cir_storage_push_n((cir_storage_t *)req->storage, req->buffer,
+			       req->elt_count,
+			       &resp->elt_count) == CBUFFER_STORAGE_SUCCESS) {
+		ret = DRV_RC_OK;
+	}
+
+	resp->status = ret;
+	cfw_send_message(resp);
+}
+
+/* Block sizes of the memory pools, the elements read must fit in one block */
+#define DECLARE_MEMORY_POOL(index, size, count) size,
+static const uint32_t pool_block_sizes[] = {
+#include "memory_pool_list.def"
+};
+#undef DECLARE_MEMORY_POOL
+
+/* Pop or peek a run of elements in a single buffer */
+static void handle_read_n(struct cfw_message *msg, void *storage,
+			  uint32_t offset, uint32_t elt_count, bool pop)
+{
+	circular_storage_service_read_n_rsp_msg_t *resp =
+		(circular_storage_service_read_n_rsp_msg_t *)cfw_alloc_rsp_msg(
+			msg,
+			pop ? MSG_ID_CIRCULAR_STORAGE_SERVICE_POP_N_RSP :
+			MSG_ID_CIRCULAR_STORAGE_SERVICE_PEEK_AT_RSP,
+			sizeof(*resp));
+	uint32_t elt_size = ((cir_storage_t *)storage)->elt_size;
+	DRIVER_API_RC ret = DRV_RC_FAIL;
+	uint32_t stored, block = 0;
+	OS_ERR_TYPE alloc_err;
+	uint8_t i;
+
+	resp->elt_count = 0;
+	resp->buffer = NULL;
+
+	/* Same status as pop and peek when there is nothing to read */
+	stored = cir_storage_get_count((cir_storage_t *)storage);
+	if (offset >= stored) {
+		ret = pop ? DRV_RC_FAIL : DRV_RC_OUT_OF_MEM;
+		goto out;
+	}
+
+	/* Bound the buffer by the stored elements and the largest block */
+	for (i = 0; i < sizeof(pool_block_sizes) / sizeof(uint32_t); i++) {
+		block = MAX(block, pool_block_sizes[i]);
+	}
+	elt_count = MIN(elt_count, stored - offset);
+	elt_count = MIN(elt_count, block / elt_size);
+	if (elt_count == 0) {
+		goto out;
+	}
+
+	resp->buffer = balloc(elt_count * elt_size, &alloc_err);
+	if (alloc_err != E_OS_OK) {
+		resp->buffer = NULL;
+		goto out;
+	}
+
+	if (pop) {
+		if (cir_storage_pop_n((cir_storage_t *)storage, resp->buffer,
+				      elt_count, &resp->elt_count) ==
+		    CBUFFER_STORAGE_SUCCESS) {
+			ret = DRV_RC_OK;
+		}
+	} else {
+		if (cir_storage_peek_at((cir_storage_t *)storage, offset,
+					resp->buffer, elt_count,
+					&resp->elt_count) ==
+		    CBUFFER_STORAGE_SUCCESS) {
+			ret = DRV_RC_OK;
+		}
+	}
+
+out:
+	resp->status = ret;
+	cfw_send_message(resp);
+}
+
+static void handle_pop_n(struct cfw_message *msg)
+{
+	circular_storage_pop_n_req_msg_t *req =
+		(circular_storage_pop_n_req_msg_t *)msg;
+
+	handle_read_n(msg, req->storage, 0, req->elt_count, true);
+}
+
+static void handle_peek_at(struct cfw_message *msg)
+{
+	circular_storage_peek_at_req_msg_t *req =
+		(circular_storage_peek_at_req_msg_t *)msg;
+
+	handle_read_n(msg, req->storage, req->offset, req->elt_count, false);
+}
+
 static void handle_message(struct cfw_message *msg, void *param)
 {
 	switch (CFW_MESSAGE_ID(msg)) {
@@ -263,6 +370,15 @@ static void handle_message(struct cfw_message *msg, void *param)
 	case MSG_ID_CIRCULAR_STORAGE_CLEAR_REQ:
 		handle_clear(msg);
 		break;
+	case MSG_ID_CIRCULAR_STORAGE_PUSH_N_REQ:
+		handle_push_n(msg);
+		break;
+	case MSG_ID_CIRCULAR_STORAGE_POP_N_REQ:
+		handle_pop_n(msg);
+		break;
+	case MSG_ID_CIRCULAR_STORAGE_PEEK_AT_REQ:
+		handle_peek_at(msg);
+		break;
 	case MSG_ID_LL_CIRCULAR_STORAGE_SHUTDOWN_REQ:
 		cfw_send_message(CFW_MESSAGE_PRIV(msg));
 		break;
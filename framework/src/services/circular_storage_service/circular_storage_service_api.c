@@ -113,3 +113,58 @@ void circular_storage_service_clear(cfw_service_conn_t *conn,
 	req->storage = storage;
 	cfw_send_message(msg);
 }
+
+void circular_storage_service_push_n(cfw_service_conn_t *	conn,
+				     uint8_t *			buffer,
+				     uint32_t			elt_count,
+				     void *			storage,
+				     void *			priv)
+{
+	struct cfw_message *msg = cfw_alloc_message_for_service(
+		conn, MSG_ID_CIRCULAR_STORAGE_PUSH_N_REQ,
+		sizeof(
+			circular_storage_push_n_req_msg_t), priv);
+	circular_storage_push_n_req_msg_t *req =
+		(circular_storage_push_n_req_msg_t *)msg;
+
+	req->buffer = buffer;
+	req->elt_count = elt_count;
+	req->storage = storage;
+	cfw_send_message(msg);
+}
+
+void circular_storage_service_pop_n(cfw_service_conn_t *	conn,
+				    void *			storage,
+				    uint32_t			elt_count,
+				    void *			priv)
+{
+	struct cfw_message *msg = cfw_alloc_message_for_service(
+		conn, MSG_ID_CIRCULAR_STORAGE_POP_N_REQ,
+		sizeof(
+			circular_storage_pop_n_req_msg_t), priv);
+	circular_storage_pop_n_req_msg_t *req =
+		(circular_storage_pop_n_req_msg_t *)msg;
+
+	req->elt_count = elt_count;
+	req->storage = storage;
+	cfw_send_message(msg);
+}
+
+void circular_storage_service_peek_at(cfw_service_conn_t *	conn,
+				      void *			storage,
+				      uint32_t			offset,
+				      uint32_t			elt_count,
+				      void *			priv)
+{
+	struct cfw_message *msg = cfw_alloc_message_for_service(
+		conn, MSG_ID_CIRCULAR_STORAGE_PEEK_AT_REQ,
+		sizeof(
+			circular_storage_peek_at_req_msg_t), priv);
+	circular_storage_peek_at_req_msg_t *req =
+		(circular_storage_peek_at_req_msg_t *)msg;
+
+	req->offset = offset;
+	req->elt_count = elt_count;
+	req->storage = storage;
+	cfw_send_message(msg);
+}
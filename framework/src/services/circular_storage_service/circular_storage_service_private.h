@@ -46,6 +46,12 @@
 		MSG_ID_CIRCULAR_STORAGE_SERVICE_BASE + 8)
 #define MSG_ID_CIRCULAR_STORAGE_GET_REQ                ( \
 		MSG_ID_CIRCULAR_STORAGE_SERVICE_BASE + 9)
+#define MSG_ID_CIRCULAR_STORAGE_PUSH_N_REQ             ( \
+		MSG_ID_CIRCULAR_STORAGE_SERVICE_BASE + 10)
+#define MSG_ID_CIRCULAR_STORAGE_POP_N_REQ              ( \
+		MSG_ID_CIRCULAR_STORAGE_SERVICE_BASE + 11)
+#define MSG_ID_CIRCULAR_STORAGE_PEEK_AT_REQ            ( \
+		MSG_ID_CIRCULAR_STORAGE_SERVICE_BASE + 12)
 
 typedef struct circular_storage_get_req_msg {
 	struct cfw_message header;
@@ -68,6 +74,26 @@ typedef struct circular_storage_peek_req_msg {
 	void *storage;
 } circular_storage_peek_req_msg_t;
 
+typedef struct circular_storage_push_n_req_msg {
+	struct cfw_message header;
+	void *storage;
+	uint8_t *buffer;
+	uint32_t elt_count;
+} circular_storage_push_n_req_msg_t;
+
+typedef struct circular_storage_pop_n_req_msg {
+	struct cfw_message header;
+	void *storage;
+	uint32_t elt_count;
+} circular_storage_pop_n_req_msg_t;
+
+typedef struct circular_storage_peek_at_req_msg {
+	struct cfw_message header;
+	void *storage;
+	uint32_t offset;
+	uint32_t elt_count;
+} circular_storage_peek_at_req_msg_t;
+
 typedef struct circular_storage_clear_req_msg {
 	struct cfw_message header;
 	uint32_t elt_count;
@@ -28,7 +28,11 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <string.h>
+
 #include "infra/log.h"
+#include "infra/xloop.h"
+#include "util/misc.h"
 
 #include "cfw/cfw.h"
 #include "cfw/cfw_service.h"
@@ -65,6 +69,11 @@ static struct {
 	uint8_t no_part;
 } ll_storage_config;
 
+/* Loop of the storage task, running the chunks of the streamed requests */
+static xloop_t ll_storage_loop;
+
+STATIC_ASSERT(CONFIG_SERVICES_QUARK_SE_LL_STORAGE_CHUNK_SIZE % 4 == 0);
+
 DEFINE_LOG_MODULE(LOG_MODULE_LL_STORAGE_SERVICE, "LLST")
 
 /* Init and Configure partitions seen by the Storage Service. */
@@ -77,6 +86,8 @@ static void ll_storage_service_init(int service_id, void *queue)
 
 	ll_storage_config.partitions = storage_configuration;
 	ll_storage_config.no_part = NUMBER_OF_PARTITIONS;
+
+	xloop_init_from_queue(&ll_storage_loop, queue);
 }
 
 CFW_DECLARE_SERVICE(ll_storage, LL_STOR_SERVICE_ID, ll_storage_service_init);
@@ -95,17 +106,18 @@ static void ll_storage_client_disconnected(conn_handle_t *instance)
 	pr_debug(LOG_MODULE_LL_STORAGE_SERVICE, "%s: ", __func__);
 }
 
-void handle_erase_block(struct cfw_message *msg)
+static void start_erase(struct cfw_message *msg, struct ll_storage_erase_run *run,
+			uint16_t flash_id, uint32_t first_blk,
+			uint32_t last_blk);
+
+/* Start a block erase, return false if the request was rejected and can be
+ * freed */
+static bool handle_erase_block(struct cfw_message *msg)
 {
 	ll_storage_erase_block_req_msg_t *req =
 		(ll_storage_erase_block_req_msg_t *)msg;
-	ll_storage_service_erase_block_rsp_msg_t *resp =
-		(ll_storage_service_erase_block_rsp_msg_t *)cfw_alloc_rsp_msg(
-			msg,
-			MSG_ID_LL_STORAGE_SERVICE_ERASE_BLOCK_RSP,
-			sizeof(*resp));
+	ll_storage_service_erase_block_rsp_msg_t *resp;
 
-	flash_device_t flash;
 	uint16_t flash_id = 0;
 	int16_t partition_index = -1;
 	uint32_t i = 0;
@@ -146,40 +158,28 @@ void handle_erase_block(struct cfw_message *msg)
 		goto send;
 	}
 
-	flash = flash_devices[flash_id];
-
-	if (flash.flash_location == EMBEDDED_FLASH) {
-		ret =
-			soc_flash_block_erase(
-				ll_storage_config.partitions[partition_index].
-				start_block +
-				req->st_blk, req->no_blks);
-	}
-#ifdef CONFIG_SPI_FLASH
-	else {
-		// SERIAL_FLASH
-		ret = spi_flash_sector_erase(
-			(struct td_device *)&pf_sba_device_flash_spi0,
-			ll_storage_config.partitions[
-				partition_index].start_block + req->st_blk,
-			req->no_blks);
-	}
-#endif
+	start_erase(msg, &req->erase, flash_id,
+		    ll_storage_config.partitions[partition_index].start_block +
+		    req->st_blk, last_block);
+	return true;
 
 send:
+	resp = (ll_storage_service_erase_block_rsp_msg_t *)cfw_alloc_rsp_msg(
+		msg,
+		MSG_ID_LL_STORAGE_SERVICE_ERASE_BLOCK_RSP,
+		sizeof(*resp));
 	resp->status = ret;
 	cfw_send_message(resp);
+	return false;
 }
 
-void handle_write_partition(struct cfw_message *msg)
+/* Write or erase a partition, return true if the request is kept until the
+ * end of the erase */
+static bool handle_write_partition(struct cfw_message *msg)
 {
 	ll_storage_write_partition_req_msg_t *req =
 		(ll_storage_write_partition_req_msg_t *)msg;
-	ll_storage_service_write_rsp_msg_t *resp =
-		(ll_storage_service_write_rsp_msg_t *)cfw_alloc_rsp_msg(
-			msg,
-			MSG_ID_LL_STORAGE_SERVICE_WRITE_RSP,
-			sizeof(*resp));
+	ll_storage_service_write_rsp_msg_t *resp;
 
 	flash_device_t flash;
 	uint16_t flash_id = 0;
@@ -236,30 +236,12 @@ void handle_write_partition(struct cfw_message *msg)
 	size = req->size / sizeof(uint32_t) + !!(req->size % sizeof(uint32_t));
 
 	if (req->write_type == ERASE_REQ) {
-		if (flash.flash_location == EMBEDDED_FLASH) {
-			ret = soc_flash_block_erase(
-				ll_storage_config.partitions[partition_index].
-				start_block,
-				(ll_storage_config.
-				 partitions[partition_index
-				 ].end_block -
-				 ll_storage_config.
-				 partitions[partition_index].
-				 start_block) + 1);
-#ifdef CONFIG_SPI_FLASH
-		} else { // SERIAL_FLASH
-			ret = spi_flash_sector_erase(
-				(struct td_device *)&pf_sba_device_flash_spi0,
-				ll_storage_config.
-				partitions[partition_index].start_block,
-				(ll_storage_config.
-				 partitions[
-					 partition_index].end_block -
-				 ll_storage_config.
-				 partitions[partition_index].
-				 start_block) + 1);
-#endif
-		}
+		start_erase(msg, &req->erase, flash_id,
+			    ll_storage_config.partitions[partition_index].
+			    start_block,
+			    ll_storage_config.partitions[partition_index].
+			    end_block);
+		return true;
 	} else {
 		uint32_t address =
 			((ll_storage_config.partitions[partition_index].
@@ -277,7 +259,15 @@ void handle_write_partition(struct cfw_message *msg)
 				req->buffer);
 #endif
 		}
+	}
 
+send:
+	resp = (ll_storage_service_write_rsp_msg_t *)cfw_alloc_rsp_msg(
+		msg,
+		MSG_ID_LL_STORAGE_SERVICE_WRITE_RSP,
+		sizeof(*resp));
+	resp->actual_size = 0;
+	if (retlen)
 		resp->actual_size =
 			(retlen *
 			 sizeof(uint32_t)) - (((req->size % sizeof(uint32_t)))
@@ -285,12 +275,10 @@ void handle_write_partition(struct cfw_message *msg)
 						 (req->size %
 						  sizeof(uint32_t))) :
 					      0);
-	}
-
-send:
 	resp->status = ret;
 	resp->write_type = req->write_type;
 	cfw_send_message(resp);
+	return false;
 }
 
 void handle_read_partition(struct cfw_message *msg)
@@ -373,17 +361,300 @@ send:
 	cfw_send_message(resp);
 }
 
+/* Find a partition and the flash holding it, return NULL if unknown */
+static flash_partition_t *find_partition(uint16_t		partition_id,
+					 const flash_device_t **	flash)
+{
+	for (uint32_t i = 0; i < ll_storage_config.no_part; i++)
+		if (ll_storage_config.partitions[i].partition_id ==
+		    partition_id) {
+			*flash = &flash_devices[ll_storage_config.partitions[i].
+						flash_id];
+			return &ll_storage_config.partitions[i];
+		}
+	return NULL;
+}
+
+static DRIVER_API_RC flash_read_words(const flash_device_t *flash,
+				      uint32_t address, unsigned int len,
+				      uint32_t *data)
+{
+	unsigned int retlen = 0;
+	DRIVER_API_RC ret = DRV_RC_FAIL;
+
+	if (flash->flash_location == EMBEDDED_FLASH) {
+		ret = soc_flash_read(address, len, &retlen, data);
+#ifdef CONFIG_SPI_FLASH
+	} else { // SERIAL_FLASH
+		ret = spi_flash_read(
+			(struct td_device *)&pf_sba_device_flash_spi0,
+			address, len, &retlen, data);
+#endif
+	}
+	return (ret == DRV_RC_OK && retlen != len) ? DRV_RC_FAIL : ret;
+}
+
+static DRIVER_API_RC flash_write_words(const flash_device_t *flash,
+				       uint32_t address, unsigned int len,
+				       uint32_t *data)
+{
+	unsigned int retlen = 0;
+	DRIVER_API_RC ret = DRV_RC_FAIL;
+
+	if (flash->flash_location == EMBEDDED_FLASH) {
+		ret = soc_flash_write(address, len, &retlen, data);
+#ifdef CONFIG_SPI_FLASH
+	} else { // SERIAL_FLASH
+		ret = spi_flash_write(
+			(struct td_device *)&pf_sba_device_flash_spi0,
+			address, len, &retlen, data);
+#endif
+	}
+	return (ret == DRV_RC_OK && retlen != len) ? DRV_RC_FAIL : ret;
+}
+
+/* Transfer a chunk between the flash and a buffer. The bytes of the last
+ * word beyond the end of the buffer are not accessed: they are left erased
+ * when writing */
+static DRIVER_API_RC transfer_chunk(const flash_device_t *flash, bool write,
+				    uint32_t address, uint8_t *data,
+				    uint32_t size)
+{
+	unsigned int words = size / sizeof(uint32_t);
+	uint32_t tail = 0xffffffff;
+	DRIVER_API_RC ret = DRV_RC_OK;
+
+	if (words > 0) {
+		ret = write ?
+		      flash_write_words(flash, address, words,
+					(uint32_t *)data) :
+		      flash_read_words(flash, address, words,
+				       (uint32_t *)data);
+		if (ret != DRV_RC_OK || size % sizeof(uint32_t) == 0)
+			return ret;
+	}
+
+	address += words * sizeof(uint32_t);
+	data += words * sizeof(uint32_t);
+	if (write) {
+		memcpy(&tail, data, size % sizeof(uint32_t));
+		ret = flash_write_words(flash, address, 1, &tail);
+	} else {
+		ret = flash_read_words(flash, address, 1, &tail);
+		memcpy(data, &tail, size % sizeof(uint32_t));
+	}
+	return ret;
+}
+
+/* Transfer the next chunk of a streamed request, and send its response. The
+ * job is posted again until the last chunk, so that the requests queued in
+ * the meantime are handled between the chunks. When the queue is full, the
+ * next chunk is transferred right away, as an unchunked request would be */
+static void stream_chunk_run(xloop_job_t *job)
+{
+	ll_storage_stream_req_msg_t *req = job->data;
+	bool write = CFW_MESSAGE_ID(&req->header) == MSG_ID_LL_WRITE_STREAM_REQ;
+	const flash_device_t *flash;
+	flash_partition_t *partition = find_partition(req->partition_id,
+						      &flash);
+	ll_storage_service_chunk_rsp_msg_t *resp;
+	OS_ERR_TYPE err;
+	DRIVER_API_RC ret;
+	uint32_t size;
+	bool last;
+
+	do {
+		resp = (ll_storage_service_chunk_rsp_msg_t *)cfw_alloc_rsp_msg(
+			&req->header,
+			write ? MSG_ID_LL_STORAGE_SERVICE_WRITE_CHUNK_RSP :
+			MSG_ID_LL_STORAGE_SERVICE_READ_CHUNK_RSP,
+			sizeof(*resp));
+		size = MIN(req->size - req->done,
+			   CONFIG_SERVICES_QUARK_SE_LL_STORAGE_CHUNK_SIZE);
+		ret = transfer_chunk(
+			flash, write,
+			partition->start_block * flash->block_size +
+			req->st_offset + req->done,
+			(uint8_t *)req->buffer + req->done, size);
+
+		resp->buffer = req->buffer;
+		resp->offset = req->done;
+		resp->size = ret == DRV_RC_OK ? size : 0;
+		resp->status = ret;
+		req->done += size;
+		last = ret != DRV_RC_OK || req->done == req->size;
+		resp->last = last;
+		cfw_send_message(resp);
+
+		if (last) {
+			cfw_msg_free(&req->header);
+			return;
+		}
+		xloop_try_post_job(&ll_storage_loop, job, &err);
+	} while (err != E_OS_OK);
+}
+
+/* Start a streamed read or write, return false if the request was rejected
+ * and can be freed */
+static bool handle_stream(struct cfw_message *msg)
+{
+	ll_storage_stream_req_msg_t *req = (ll_storage_stream_req_msg_t *)msg;
+	const flash_device_t *flash;
+	flash_partition_t *partition;
+	ll_storage_service_chunk_rsp_msg_t *resp;
+	uint32_t partition_size;
+	OS_ERR_TYPE err;
+	DRIVER_API_RC ret;
+
+	if (req->size == 0 || req->buffer == NULL ||
+	    (req->st_offset % sizeof(uint32_t)) != 0) {
+		pr_debug(LOG_MODULE_LL_STORAGE_SERVICE,
+			 "LL Storage Service - Stream: Invalid request");
+		ret = DRV_RC_INVALID_OPERATION;
+		goto error;
+	}
+
+	partition = find_partition(req->partition_id, &flash);
+	if (partition == NULL) {
+		pr_debug(LOG_MODULE_LL_STORAGE_SERVICE,
+			 "LL Storage Service - Stream: Invalid partition ID");
+		ret = DRV_RC_FAIL;
+		goto error;
+	}
+
+	partition_size = (partition->end_block - partition->start_block + 1) *
+			 flash->block_size;
+	if (req->st_offset > partition_size ||
+	    req->size > partition_size - req->st_offset) {
+		pr_debug(LOG_MODULE_LL_STORAGE_SERVICE,
+			 "LL Storage Service - Stream: Partition overflow");
+		ret = DRV_RC_OUT_OF_MEM;
+		goto error;
+	}
+
+	req->done = 0;
+	req->job.run = stream_chunk_run;
+	req->job.data = req;
+	xloop_try_post_job(&ll_storage_loop, &req->job, &err);
+	if (err != E_OS_OK)
+		stream_chunk_run(&req->job);
+	return true;
+
+error:
+	resp = (ll_storage_service_chunk_rsp_msg_t *)cfw_alloc_rsp_msg(
+		msg,
+		CFW_MESSAGE_ID(msg) == MSG_ID_LL_WRITE_STREAM_REQ ?
+		MSG_ID_LL_STORAGE_SERVICE_WRITE_CHUNK_RSP :
+		MSG_ID_LL_STORAGE_SERVICE_READ_CHUNK_RSP,
+		sizeof(*resp));
+	resp->buffer = req->buffer;
+	resp->offset = 0;
+	resp->size = 0;
+	resp->last = true;
+	resp->status = ret;
+	cfw_send_message(resp);
+	return false;
+}
+
+static DRIVER_API_RC flash_erase_block(const flash_device_t *flash,
+				       uint32_t block)
+{
+	DRIVER_API_RC ret = DRV_RC_FAIL;
+
+	if (flash->flash_location == EMBEDDED_FLASH) {
+		ret = soc_flash_block_erase(block, 1);
+#ifdef CONFIG_SPI_FLASH
+	} else { // SERIAL_FLASH
+		ret = spi_flash_sector_erase(
+			(struct td_device *)&pf_sba_device_flash_spi0,
+			block, 1);
+#endif
+	}
+	return ret;
+}
+
+/* Erase the next block of an erase request, and send its response after the
+ * last one. The job is posted again between the blocks, so that the requests
+ * queued in the meantime are handled during a long erase. When the queue is
+ * full, the next block is erased right away */
+static void erase_block_run(xloop_job_t *job)
+{
+	struct cfw_message *msg = job->data;
+	struct ll_storage_erase_run *run =
+		container_of(job, struct ll_storage_erase_run, job);
+	OS_ERR_TYPE err;
+	DRIVER_API_RC ret;
+
+	do {
+		ret = flash_erase_block(&flash_devices[run->flash_id],
+					run->next_blk);
+		if (ret != DRV_RC_OK || run->next_blk++ >= run->last_blk)
+			break;
+		xloop_try_post_job(&ll_storage_loop, job, &err);
+		if (err == E_OS_OK)
+			return;
+	} while (1);
+
+	if (CFW_MESSAGE_ID(msg) == MSG_ID_LL_ERASE_BLOCK_REQ) {
+		ll_storage_service_erase_block_rsp_msg_t *resp =
+			(ll_storage_service_erase_block_rsp_msg_t *)
+			cfw_alloc_rsp_msg(
+				msg,
+				MSG_ID_LL_STORAGE_SERVICE_ERASE_BLOCK_RSP,
+				sizeof(*resp));
+		resp->status = ret;
+		cfw_send_message(resp);
+	} else {
+		ll_storage_service_write_rsp_msg_t *resp =
+			(ll_storage_service_write_rsp_msg_t *)
+			cfw_alloc_rsp_msg(
+				msg,
+				MSG_ID_LL_STORAGE_SERVICE_WRITE_RSP,
+				sizeof(*resp));
+		resp->write_type = ERASE_REQ;
+		resp->actual_size = 0;
+		resp->status = ret;
+		cfw_send_message(resp);
+	}
+	cfw_msg_free(msg);
+}
+
+static void start_erase(struct cfw_message *msg, struct ll_storage_erase_run *run,
+			uint16_t flash_id, uint32_t first_blk,
+			uint32_t last_blk)
+{
+	OS_ERR_TYPE err;
+
+	run->flash_id = flash_id;
+	run->next_blk = first_blk;
+	run->last_blk = last_blk;
+	run->job.run = erase_block_run;
+	run->job.data = msg;
+	xloop_try_post_job(&ll_storage_loop, &run->job, &err);
+	if (err != E_OS_OK)
+		erase_block_run(&run->job);
+}
+
 static void handle_message(struct cfw_message *msg, void *param)
 {
 	switch (CFW_MESSAGE_ID(msg)) {
 	case MSG_ID_LL_ERASE_BLOCK_REQ:
-		handle_erase_block(msg);
+		/* The request is freed after its last block is erased */
+		if (handle_erase_block(msg))
+			return;
 		break;
 	case MSG_ID_LL_READ_PARTITION_REQ:
 		handle_read_partition(msg);
 		break;
 	case MSG_ID_LL_WRITE_PARTITION_REQ:
-		handle_write_partition(msg);
+		if (handle_write_partition(msg))
+			return;
+		break;
+	case MSG_ID_LL_READ_STREAM_REQ:
+	case MSG_ID_LL_WRITE_STREAM_REQ:
+		/* The request is freed after its last chunk */
+		if (handle_stream(msg))
+			return;
 		break;
 	default:
 		cfw_print_default_handle_error_msg(
@@ -113,3 +113,41 @@ void ll_storage_service_write(cfw_service_conn_t *conn, uint16_t partition_id,
 	req->buffer = buffer;
 	cfw_send_message(msg);
 }
+
+static void ll_storage_service_stream(cfw_service_conn_t *conn, int msg_id,
+				      uint16_t partition_id,
+				      uint32_t start_offset, void *buffer,
+				      uint32_t size, void *priv)
+{
+	struct cfw_message *msg = cfw_alloc_message_for_service(
+		conn, msg_id,
+		sizeof(
+			ll_storage_stream_req_msg_t), priv);
+	ll_storage_stream_req_msg_t *req = (ll_storage_stream_req_msg_t *)msg;
+
+	req->partition_id = partition_id;
+	req->st_offset = start_offset;
+	req->size = size;
+	req->buffer = buffer;
+	cfw_send_message(msg);
+}
+
+void ll_storage_service_read_stream(cfw_service_conn_t *conn,
+				    uint16_t partition_id,
+				    uint32_t start_offset, void *buffer,
+				    uint32_t size, void *priv)
+{
+	ll_storage_service_stream(conn, MSG_ID_LL_READ_STREAM_REQ,
+				  partition_id, start_offset, buffer, size,
+				  priv);
+}
+
+void ll_storage_service_write_stream(cfw_service_conn_t *conn,
+				     uint16_t partition_id,
+				     uint32_t start_offset, void *buffer,
+				     uint32_t size, void *priv)
+{
+	ll_storage_service_stream(conn, MSG_ID_LL_WRITE_STREAM_REQ,
+				  partition_id, start_offset, buffer, size,
+				  priv);
+}
@@ -34,6 +34,7 @@
 #include <stdint.h>
 
 #include "cfw/cfw.h"
+#include "infra/xloop.h"
 #include "services/services_ids.h"
 #include "services/ll_storage_service/ll_storage_service.h"
 
@@ -44,6 +45,10 @@
 					MSG_ID_LL_STORAGE_SERVICE_READ_RSP)
 #define MSG_ID_LL_WRITE_PARTITION_REQ  (~0x40 &	\
 					MSG_ID_LL_STORAGE_SERVICE_WRITE_RSP)
+#define MSG_ID_LL_READ_STREAM_REQ      (~0x40 &	\
+					MSG_ID_LL_STORAGE_SERVICE_READ_CHUNK_RSP)
+#define MSG_ID_LL_WRITE_STREAM_REQ     (~0x40 &	\
+					MSG_ID_LL_STORAGE_SERVICE_WRITE_CHUNK_RSP)
 
 /*MX25U12835F is 128Mb bits serial Flash memory,
  *
@@ -61,6 +66,18 @@
 #define WRITE_REQ                                       1
 
 
+/**
+ * Progress of an erase, run one block at a time by the service.
+ */
+struct ll_storage_erase_run {
+	uint16_t flash_id;
+	/* Next and last blocks to erase, from the start of the flash */
+	uint32_t next_blk;
+	uint32_t last_blk;
+	/* Job erasing the next block */
+	xloop_job_t job;
+};
+
 /**
  * Structure containing the request to erase a block.
  */
@@ -69,6 +86,8 @@ typedef struct ll_storage_erase_block_req_msg {
 	uint16_t partition_id;
 	uint32_t st_blk;
 	uint32_t no_blks;
+	/* Set by the service */
+	struct ll_storage_erase_run erase;
 } ll_storage_erase_block_req_msg_t;
 
 /**
@@ -81,6 +100,8 @@ typedef struct ll_storage_write_partition_req_msg {
 	uint32_t size;
 	uint8_t write_type;
 	void *buffer;
+	/* Set by the service for an ERASE_REQ */
+	struct ll_storage_erase_run erase;
 } ll_storage_write_partition_req_msg_t;
 
 /**
@@ -93,5 +114,22 @@ typedef struct ll_storage_read_partition_req_msg {
 	uint32_t size;
 } ll_storage_read_partition_req_msg_t;
 
+/**
+ * Structure containing the request to read or write a partition by chunks.
+ *
+ * The request is kept by the service until the last chunk is transferred.
+ */
+typedef struct ll_storage_stream_req_msg {
+	struct cfw_message header;
+	uint16_t partition_id;
+	uint32_t st_offset;
+	uint32_t size;
+	void *buffer;
+	/* Number of bytes already transferred, set by the service */
+	uint32_t done;
+	/* Job transferring the next chunk, set by the service */
+	xloop_job_t job;
+} ll_storage_stream_req_msg_t;
+
 
 #endif /* __LL_STORAGE_SERVICE_PRIVATE_H__ */
@@ -32,6 +32,7 @@
 
 #include "infra/log.h"
 #include "infra/properties_storage.h"
+#include "infra/xloop.h"
 
 #include "cfw/cfw_service.h"
 
@@ -41,6 +42,56 @@
 #define SERVICE_ID_PROPERTY_ID_TO_KEY(svc_id, prop_id) (((uint32_t)(svc_id)) <<	\
 							16 | ((uint32_t)prop_id))
 
+/* The garbage collection of the properties storage is run in steps, by a job
+ * posted on the service queue, so that it only delays the pending requests
+ * by one step. When the queue is full, the job is posted again after the next
+ * request. */
+static xloop_t gc_loop;
+static void gc_job_run(xloop_job_t *job);
+static xloop_job_t gc_job = {
+	.run = gc_job_run,
+};
+static bool gc_job_posted;
+
+static void post_gc_job(void)
+{
+	OS_ERR_TYPE err;
+
+	xloop_try_post_job(&gc_loop, &gc_job, &err);
+	gc_job_posted = (err == E_OS_OK);
+}
+
+static void gc_job_run(xloop_job_t *job)
+{
+	if (properties_storage_gc_step())
+		post_gc_job();
+	else
+		gc_job_posted = false;
+}
+
+static void schedule_gc(void)
+{
+	if (!gc_job_posted)
+		post_gc_job();
+}
+
+/* A set fails with PROPERTIES_STORAGE_BUSY_ERROR when the garbage collection
+ * run in the background did not keep up. Each attempt runs a bounded number
+ * of collection steps: the request is retried until room is made. */
+static properties_storage_status_t set_property(uint32_t key,
+						const uint8_t *buf,
+						uint16_t len,
+						bool factory_reset_persistent)
+{
+	properties_storage_status_t ret;
+
+	do {
+		ret = properties_storage_set(key, buf, len,
+					     factory_reset_persistent);
+	} while (ret == PROPERTIES_STORAGE_BUSY_ERROR);
+	return ret;
+}
+
 /* Handle for a Read Property request message */
 static void handle_read_property(struct cfw_message *msg)
 {
@@ -95,8 +146,8 @@ static void handle_add_property(struct cfw_message *msg)
 					    &dummy2);
 
 	if (ret == PROPERTIES_STORAGE_KEY_NOT_FOUND_ERROR)
-		ret = properties_storage_set(key, req->value, req->size,
-					     req->factory_reset_persistent);
+		ret = set_property(key, req->value, req->size,
+				   req->factory_reset_persistent);
 
 	properties_service_add_rsp_msg_t *rsp =
 		(properties_service_add_rsp_msg_t *)cfw_alloc_rsp_msg(
@@ -133,7 +184,7 @@ static void handle_write_property(struct cfw_message *msg)
 					    &dummy2);
 
 	if (ret == PROPERTIES_STORAGE_SUCCESS)
-		ret = properties_storage_set(key, req->value, req->size, false);
+		ret = set_property(key, req->value, req->size, false);
 
 	properties_service_write_rsp_msg_t *rsp =
 		(properties_service_write_rsp_msg_t *)cfw_alloc_rsp_msg(
@@ -207,6 +258,7 @@ static void handle_request(struct cfw_message *msg, void *param)
 							   msg));
 		break;
 	}
+	schedule_gc();
 }
 
 static void properties_client_connected(conn_handle_t *instance)
@@ -227,6 +279,9 @@ static void property_service_init(int id, void *queue)
 {
 	properties_storage_init();
 	cfw_register_service(queue, &properties_service, handle_request, NULL);
+	/* Also completes a collection interrupted by a power loss */
+	xloop_init_from_queue(&gc_loop, queue);
+	schedule_gc();
 }
 
 CFW_DECLARE_SERVICE(properties, PROPERTIES_SERVICE_ID, property_service_init);
@@ -31,6 +31,9 @@
 #include "os/os.h"
 #include "cfw/cfw_service.h"
 #include "infra/message.h"
+#include "infra/port.h"
+#include "infra/time.h"
+#include "util/misc.h"
 
 #include "sensors/sensor_core/open_core/sc_exposed.h"
 #include "sensor_svc.h"
@@ -511,13 +514,232 @@ void ss_send_subscribing_rsp_msg_to_clients(
 	}
 }
 
+/**
+ * @brief  Allocate a subscribe data event message
+ * @param  sensor_handle: Sensor identification
+ *         data_type: Subscription type of the data
+ *         timestamp: Timestamp of the (first) sample
+ *         len: Size of the data of one sample
+ *         size: Size of the data part of the message
+ * @retval The event message, NULL if allocation failed
+ */
+static sensor_service_subscribe_data_event_t *ss_alloc_data_evt_msg(
+	sensor_service_t	sensor_handle,
+	uint8_t			data_type,
+	uint32_t		timestamp,
+	uint16_t		len,
+	uint32_t		size)
+{
+	OS_ERR_TYPE err;
+	sensor_service_subscribe_data_event_t *p_msg =
+		(sensor_service_subscribe_data_event_t *)
+		message_alloc(
+			sizeof(sensor_service_subscribe_data_event_t) + size,
+			&err);
+
+	if (p_msg == NULL) {
+		return NULL;
+	}
+	p_msg->handle = sensor_handle;
+	CFW_MESSAGE_LEN(&p_msg->head) =
+		sizeof(sensor_service_subscribe_data_event_t) + size;
+	p_msg->sensor_data_header.data_length = len;
+	p_msg->sensor_data_header.sensor_type = GET_SENSOR_TYPE(sensor_handle);
+	p_msg->sensor_data_header.subscription_type = data_type;
+	p_msg->sensor_data_header.timestamp = timestamp;
+	return p_msg;
+}
+
+/* Block sizes of the memory pools, a batch must fit in the largest one */
+#define DECLARE_MEMORY_POOL(index, size, count) size,
+static const uint32_t ss_pool_block_sizes[] = {
+#include "memory_pool_list.def"
+};
+#undef DECLARE_MEMORY_POOL
+
+/**
+ * @brief  Get the largest number of samples of a batch event
+ * @param  len: Size of the data of one sample
+ * @retval Number of samples fitting in the largest memory block
+ */
+static uint16_t ss_batch_max_sample_nr(uint16_t len)
+{
+	uint32_t block = 0;
+	uint8_t i;
+
+	for (i = 0; i < sizeof(ss_pool_block_sizes) / sizeof(uint32_t); i++) {
+		block = MAX(block, ss_pool_block_sizes[i]);
+	}
+	if (block <= sizeof(sensor_service_subscribe_data_event_t)) {
+		return 0;
+	}
+	return MIN((block - sizeof(sensor_service_subscribe_data_event_t)) /
+		   SS_BATCH_SAMPLE_SIZE(len), UINT16_MAX);
+}
+
+/**
+ * @brief  Max latency timer of the batch of a client
+ *
+ * Runs in the timer context: the service checks the pending batches on
+ * the message posted.
+ */
+static void ss_batch_timer_handler(void *data)
+{
+	OS_ERR_TYPE err;
+	struct cfw_message *p_msg =
+		(struct cfw_message *)message_alloc(sizeof(*p_msg), &err);
+
+	/* The batch is still flushed by the next sample, or when full */
+	if (p_msg == NULL) {
+		return;
+	}
+	CFW_MESSAGE_ID(p_msg) = MSG_ID_SS_BATCH_LATENCY_MSG;
+	CFW_MESSAGE_LEN(p_msg) = sizeof(*p_msg);
+	CFW_MESSAGE_SRC(p_msg) = ss_svc_port_id;
+	CFW_MESSAGE_DST(p_msg) = ss_svc_port_id;
+	CFW_MESSAGE_TYPE(p_msg) = TYPE_REQ;
+	if (port_send_message(CFW_MESSAGE_HEADER(p_msg)) != E_OS_OK) {
+		message_free(CFW_MESSAGE_HEADER(p_msg));
+	}
+}
+
+/**
+ * @brief  Send the pending batch of samples of a client, if any
+ * @param  l: Client connection info
+ */
+static void ss_flush_client_batch(client_arbit_info_list_t *l)
+{
+	if (l->p_batch == NULL) {
+		return;
+	}
+	if (l->batch_timer != NULL) {
+		timer_stop(l->batch_timer);
+	}
+	send_evt_msg_to_client((struct cfw_message *)l->p_batch, l->p_handle,
+			       MSG_ID_SENSOR_SERVICE_SUBSCRIBE_BATCH_EVT,
+			       l->priv_from_client);
+	l->p_batch = NULL;
+}
+
+/**
+ * @brief  Append a sample to the pending batch of a client
+ *
+ * The batch is sent once it holds batch_size samples, at most as many as
+ * fit in the largest memory block, or max_latency ms after its first
+ * sample.
+ *
+ * @param  l: Client connection info
+ *         sensor_handle: Sensor identification
+ *         data_type: Subscription type of the sample
+ *         timestamp: Timestamp of the sample
+ *         p_data: Data of the sample
+ *         len: Size of the data of the sample
+ * @retval false if the client does not batch or the batch allocation failed
+ */
+static bool ss_batch_client_sample(client_arbit_info_list_t *	l,
+				   sensor_service_t		sensor_handle,
+				   uint8_t			data_type,
+				   uint32_t			timestamp,
+				   void *			p_data,
+				   uint16_t			len)
+{
+	subscribe_batch_param_t *p_param = &l->arbit_info.batch_param;
+	sensor_service_subscribe_data_event_t *p_batch = l->p_batch;
+	sensor_service_batch_sample_t *p_sample;
+	uint16_t sample_nr;
+	uint16_t max_sample_nr;
+	OS_ERR_TYPE err;
+
+	if (p_param->batch_size <= 1 || len > UINT8_MAX) {
+		return false;
+	}
+	max_sample_nr = MIN(p_param->batch_size, ss_batch_max_sample_nr(len));
+	if (max_sample_nr <= 1) {
+		return false;
+	}
+	/* A batch only holds samples of the same type and size */
+	if (p_batch != NULL &&
+	    (p_batch->sensor_data_header.subscription_type != data_type ||
+	     p_batch->sensor_data_header.data_length != len)) {
+		ss_flush_client_batch(l);
+		p_batch = NULL;
+	}
+	if (p_batch == NULL) {
+		p_batch = ss_alloc_data_evt_msg(
+			sensor_handle, data_type, timestamp, len,
+			(uint32_t)SS_BATCH_SAMPLE_SIZE(len) * max_sample_nr);
+		if (p_batch == NULL) {
+			return false;
+		}
+		/* The message grows with the samples appended */
+		CFW_MESSAGE_LEN(&p_batch->head) =
+			sizeof(sensor_service_subscribe_data_event_t);
+		l->p_batch = p_batch;
+		l->batch_start = get_uptime_ms();
+		if (p_param->max_latency != 0) {
+			if (l->batch_timer == NULL) {
+				l->batch_timer = timer_create(
+					ss_batch_timer_handler, NULL,
+					p_param->max_latency, false, true,
+					&err);
+			} else {
+				timer_start(l->batch_timer,
+					    p_param->max_latency, &err);
+			}
+			if (err != E_OS_OK) {
+				SS_PRINT_ERR("Batch timer failed, flushed"
+					     " on sample arrival only");
+			}
+		}
+	}
+	sample_nr = sensor_service_batch_sample_nr(p_batch);
+	p_sample = sensor_service_batch_sample(p_batch, sample_nr);
+	p_sample->timestamp = timestamp;
+	data_cpy(p_sample->data, p_data, len);
+	CFW_MESSAGE_LEN(&p_batch->head) += SS_BATCH_SAMPLE_SIZE(len);
+	sample_nr++;
+
+	if (sample_nr >= max_sample_nr ||
+	    (p_param->max_latency != 0 &&
+	     timestamp - p_batch->sensor_data_header.timestamp >=
+	     p_param->max_latency)) {
+		ss_flush_client_batch(l);
+	}
+	return true;
+}
+
+/**
+ * @brief  Send the batches of all clients pending for max_latency ms
+ */
+static void ss_batch_latency_handler(void)
+{
+	list_head_t sensor_list = get_sensor_list_head();
+	ss_sensor_dev_list_t *p_list = (ss_sensor_dev_list_t *)sensor_list.head;
+	client_arbit_info_list_t *l;
+	uint32_t now = get_uptime_ms();
+
+	while (p_list) {
+		l = (client_arbit_info_list_t *)
+		    p_list->arbit_info_list_header.head;
+		while (l) {
+			if (l->p_batch != NULL &&
+			    l->arbit_info.batch_param.max_latency != 0 &&
+			    now - l->batch_start >=
+			    l->arbit_info.batch_param.max_latency) {
+				ss_flush_client_batch(l);
+			}
+			l = (client_arbit_info_list_t *)l->list.next;
+		}
+		p_list = (ss_sensor_dev_list_t *)p_list->list.next;
+	}
+}
+
 void ss_send_subscribing_evt_msg_to_clients(sensor_service_t sensor_handle,
 					    uint8_t data_type,
 					    uint32_t timestamp, void *p_data,
 					    uint16_t len)
 {
 	ss_sensor_dev_list_t *p_list = ss_get_sensor_dev_list(sensor_handle);
-	uint8_t sensor_type = GET_SENSOR_TYPE(sensor_handle);
 
 	if (p_list == NULL) {
 #if defined(SENSOR_SERVICE_DEBUG) && (SENSOR_SERVICE_DEBUG == 1)
@@ -537,30 +759,25 @@ void ss_send_subscribing_evt_msg_to_clients(sensor_service_t sensor_handle,
 		if (l->arbit_info.conn_status == SUBSCRIBED ||
 		    l->arbit_info.conn_status == SUBSCRIBE_EVENT) {
 			l->arbit_info.conn_status = SUBSCRIBE_EVENT; /* Update client's connection status */
+			err = 0;
+			if (ss_batch_client_sample(l, sensor_handle, data_type,
+						   timestamp, p_data, len)) {
+				l = (client_arbit_info_list_t *)l->list.next;
+				continue;
+			}
 			sensor_service_subscribe_data_event_t *p_msg =
-				(sensor_service_subscribe_data_event_t *)
-				cfw_alloc_message(
-					sizeof(
-						sensor_service_subscribe_data_event_t)
-					+ len);
+				ss_alloc_data_evt_msg(sensor_handle,
+						      data_type, timestamp,
+						      len, len);
 			if (p_msg == NULL) {
 				SS_PRINT_ERR("Allocing mem failed");
 				return;
 			}
-			p_msg->handle = sensor_handle;
-			CFW_MESSAGE_LEN(&p_msg->head) =
-				sizeof(sensor_service_subscribe_data_event_t) +
-				len;
-			p_msg->sensor_data_header.data_length = len;
-			p_msg->sensor_data_header.sensor_type = sensor_type;
-			p_msg->sensor_data_header.subscription_type = data_type;
-			p_msg->sensor_data_header.timestamp = timestamp;
 			data_cpy(p_msg->sensor_data_header.data, p_data, len);
 			send_evt_msg_to_client(
 				(struct cfw_message *)p_msg, l->p_handle,
 				MSG_ID_SENSOR_SERVICE_SUBSCRIBE_DATA_EVT,
 				l->priv_from_client);
-			err = 0;
 		}
 		l = (client_arbit_info_list_t *)l->list.next;
 	}
@@ -1086,6 +1303,11 @@ static void ss_svc_subscribe_handler(ss_sensor_subscribe_data_req_t *	p_req,
 #endif
 		goto EXIT;
 	}
+	/* Save client batching parameters, the size of the samples is only
+	 * known on their arrival: bound the batch with the smallest ones */
+	l->arbit_info.batch_param.max_latency = p_req->max_latency;
+	l->arbit_info.batch_param.batch_size =
+		MIN(p_req->batch_size, ss_batch_max_sample_nr(0));
 	uint8_t arbitrating_is_ok = ss_sensor_new_status_arbit(p_list,
 							       SUBSCRIBING);
 	switch (arbitrating_is_ok) {
@@ -1219,6 +1441,8 @@ static void ss_svc_unsubscribe_handler(
 #endif
 		goto EXIT;
 	}
+	/* Deliver the samples batched so far */
+	ss_flush_client_batch(l);
 	uint8_t arbitrating_is_ok = ss_sensor_new_status_arbit(p_list,
 							       UNSUBSCRIBING);
 	client_arbit_info_list_t *p_client_arbit_list =
@@ -1964,6 +2188,9 @@ static void ss_svc_msg_handler(struct cfw_message *p_msg, void *p_param)
 		ss_svc_get_property_handle(
 			(ss_sensor_get_property_req_t *)p_msg, p_param);
 		break;
+	case MSG_ID_SS_BATCH_LATENCY_MSG:
+		ss_batch_latency_handler();
+		break;
 #if defined(BLE_SERVICE) && (BLE_SERVICE == 1)
 	case MSG_ID_SS_BLE_RSP_MSG:
 		ss_ble_resp_msg_handler((ble_status_msg_t *)p_msg);
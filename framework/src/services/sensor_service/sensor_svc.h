@@ -97,6 +97,9 @@ typedef struct {
 #define MSG_ID_SS_SENSOR_SET_PROPERTY_REQ            (MSG_ID_SS_BASE | 0x08)
 #define MSG_ID_SS_SENSOR_GET_PROPERTY_REQ            (MSG_ID_SS_BASE | 0x09)
 
+/* Posted by the batch timers, to send the batches pending for too long */
+#define MSG_ID_SS_BATCH_LATENCY_MSG                 (MSG_ID_SS_BASE | 0x0A)
+
 
 #define SENSOR_DEVICE_ID_REQ_MASK           (1 << SENSOR_DEVICE_ID)
 #define SENSOR_PRODUCT_ID_REQ_MASK          (1 << SENSOR_PRODUCT_ID)
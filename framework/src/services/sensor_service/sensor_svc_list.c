@@ -253,12 +253,26 @@ int ss_delete_client_list(void *p_handle)
 	return _delete_list(&ss_client_list_head, (list_t *)p_client_list);
 }
 
+/* Drop the batch the client will never receive, and its timer */
+static void ss_arbit_info_release(client_arbit_info_list_t *l)
+{
+	if (l->p_batch != NULL) {
+		cfw_msg_free((struct cfw_message *)l->p_batch);
+		l->p_batch = NULL;
+	}
+	if (l->batch_timer != NULL) {
+		timer_delete(l->batch_timer);
+		l->batch_timer = NULL;
+	}
+}
+
 int  ss_arbit_info_list_delete(list_head_t *	p_arbit_info_list,
 			       list_t *		p_element)
 {
 	if (p_arbit_info_list == NULL) {
 		return SS_LIST_ERROR;
 	}
+	ss_arbit_info_release((client_arbit_info_list_t *)p_element);
 	return _delete_list(p_arbit_info_list, p_element);
 }
 
@@ -316,12 +330,18 @@ ss_sensor_dev_list_t *ss_sensor_list_add(uint8_t type, uint32_t id)
 int ss_sensor_list_delete(void *p_handle)
 {
 	ss_sensor_dev_list_t *p_list = ss_get_sensor_dev_list(p_handle);
+	client_arbit_info_list_t *l;
 	int err;
 
 	if (p_list == NULL) {
 		//SS_PRINT_ERR("Sensor device handle is NULL");
 		return SS_LIST_ERROR;
 	}
+	l = (client_arbit_info_list_t *)p_list->arbit_info_list_header.head;
+	while (l) {
+		ss_arbit_info_release(l);
+		l = (client_arbit_info_list_t *)l->list.next;
+	}
 	if (ss_list_delete_ext(&p_list->arbit_info_list_header) ==
 	    SS_LIST_ERROR) {
 		//SS_PRINT_ERR("Arbitration list deletion failed");
@@ -372,6 +392,10 @@ client_arbit_info_list_t *ss_arbit_info_list_add(
 	if (priv_data_from_client != NULL)
 		p_arbit_info_list->priv_from_client = priv_data_from_client;
 	p_arbit_info_list->arbit_info.flag = 0;
+	p_arbit_info_list->arbit_info.batch_param.max_latency = 0;
+	p_arbit_info_list->arbit_info.batch_param.batch_size = 0;
+	p_arbit_info_list->p_batch = NULL;
+	p_arbit_info_list->batch_timer = NULL;
 	list_add(&p_list->arbit_info_list_header,
 		 (list_t *)p_arbit_info_list);
 	return p_arbit_info_list;
@@ -31,6 +31,8 @@
 #ifndef __SENSOR_SVC_LIST_H__
 #define __SENSOR_SVC_LIST_H__
 
+#include "services/sensor_service/sensor_service.h"
+
 #define SCAN_RSP_FLAG       (0x1 << 0)
 
 typedef enum {
@@ -81,12 +83,18 @@ typedef struct {
 	uint16_t reporting_interval;
 } subscribe_data_param_t;
 
+typedef struct {
+	uint16_t max_latency; /* Max age of the first sample of a batch, in ms */
+	uint16_t batch_size; /* Max number of samples of a batch, 0 if not batched */
+} subscribe_batch_param_t;
+
 typedef struct {
 	uint8_t conn_status;
 	uint32_t flag; /* Flag the client if waiting for some describe or alarm info */
 	union {
 		subscribe_data_param_t subscribe_data_param;
 	};
+	subscribe_batch_param_t batch_param;
 } client_arbit_info_t;
 
 typedef struct {
@@ -94,6 +102,10 @@ typedef struct {
 	void *p_handle;
 	void *priv_from_client;
 	client_arbit_info_t arbit_info;
+	/* Batch being filled for the client, see batch_param */
+	sensor_service_subscribe_data_event_t *p_batch;
+	uint32_t batch_start; /* Uptime of the first sample of the batch, in ms */
+	T_TIMER batch_timer; /* Max latency timer of the batch, NULL if none */
 } client_arbit_info_list_t;
 
 typedef struct {
@@ -73,6 +73,8 @@ typedef struct {
 	struct cfw_message header;
 	uint16_t sampling_interval; /*!< Sensor data sample frequence, unit: HZ*/
 	uint16_t reporting_interval; /*!< sensor data reporting interval, unit: ms*/
+	uint16_t max_latency; /*!< Batching max latency, unit: ms*/
+	uint16_t batch_size; /*!< Batching size, 0 if not batched*/
 	sensor_service_t sensor;
 	uint8_t data_type_nr;
 	uint8_t data_type[1];
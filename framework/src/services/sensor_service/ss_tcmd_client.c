@@ -146,6 +146,18 @@ static void sensor_test_handle_message(struct cfw_message *p_msg, void *p_param)
 	case MSG_ID_SENSOR_SERVICE_SUBSCRIBE_DATA_RSP:
 		SS_TCMD_LOG("Sbc Rsp");
 		break;
+	case MSG_ID_SENSOR_SERVICE_SUBSCRIBE_BATCH_EVT:
+	{
+		sensor_service_subscribe_data_event_t *p_evt =
+			(sensor_service_subscribe_data_event_t *)p_msg;
+		uint16_t sample_nr = sensor_service_batch_sample_nr(p_evt);
+		if (sample_nr == 0)
+			break;
+		SS_TCMD_LOG("Batch:%d samples,T(ms):%d-%d", sample_nr,
+			    sensor_service_batch_sample(p_evt, 0)->timestamp,
+			    sensor_service_batch_sample(p_evt,
+							sample_nr - 1)->timestamp);
+	} break;
 	case MSG_ID_SENSOR_SERVICE_SUBSCRIBE_DATA_EVT:
 	{
 		sensor_service_subscribe_data_event_t *p_evt =
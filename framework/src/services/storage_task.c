@@ -31,12 +31,19 @@
 #include <zephyr.h>
 
 #include "util/assert.h"
+#include "util/list.h"
+#include "util/misc.h"
 
 #include "os/os.h"
 #include "infra/xloop.h"
+#include "infra/port.h"
+#include "infra/time.h"
 #include "infra/system_events.h"
 #include "cfw/cfw.h"
 #include "services/services_ids.h"
+#include "services/ll_storage_service/ll_storage_service.h"
+#include "services/circular_storage_service/circular_storage_service.h"
+#include "services/properties_service/properties_service.h"
 
 /* Definition of the private task "TASK_STORAGE" */
 DEFINE_TASK(TASK_STORAGE, 7, storage_task, 2048, 0);
@@ -44,6 +51,232 @@ DEFINE_TASK(TASK_STORAGE, 7, storage_task, 2048, 0);
 static T_QUEUE storage_queue;
 xloop_t loop;
 
+/*
+ * Scheduling of the storage requests
+ *
+ * The requests are sorted in classes by decreasing priority. Reads and the
+ * other short requests are handled as soon as the task takes them from its
+ * queue, writes and erases are deferred in a list per class and handled one
+ * at a time, writes first. As the long operations of the services are run by
+ * chunks, each chunk being a job posted on the queue, the queue is drained
+ * between the chunks: a read waits at most for the chunk in progress.
+ *
+ * The requests of a client are handled in order: a request from a port
+ * which has deferred requests is deferred in the same list.
+ *
+ * The messages which are not known storage requests, such as the shutdown
+ * messages the services send to themselves, are barriers: the deferred
+ * requests are all handled before them.
+ *
+ * At most STORAGE_MAX_PENDING requests are deferred: above, the oldest
+ * deferred request of the highest priority is handled before the next
+ * message is taken, so that a flood of writes fills the queue and blocks its
+ * senders as it would without deferral.
+ */
+enum storage_class {
+	STORAGE_CLASS_READ,
+	STORAGE_CLASS_WRITE,
+	STORAGE_CLASS_ERASE,
+	STORAGE_CLASS_COUNT
+};
+
+/* Pseudo class of the barrier messages */
+#define STORAGE_BARRIER STORAGE_CLASS_COUNT
+
+#define STORAGE_MAX_PENDING 8
+
+/* Class of the storage requests, identified by their response id: a request
+ * id is its response id without the 0x40 bit */
+static const struct {
+	uint16_t rsp_id;
+	uint8_t class;
+} request_classes[] = {
+	{ MSG_ID_LL_STORAGE_SERVICE_ERASE_BLOCK_RSP, STORAGE_CLASS_ERASE },
+	{ MSG_ID_LL_STORAGE_SERVICE_WRITE_RSP, STORAGE_CLASS_WRITE },
+	{ MSG_ID_LL_STORAGE_SERVICE_WRITE_CHUNK_RSP, STORAGE_CLASS_WRITE },
+	{ MSG_ID_CIRCULAR_STORAGE_SERVICE_CLEAR_RSP, STORAGE_CLASS_ERASE },
+	{ MSG_ID_CIRCULAR_STORAGE_SERVICE_PUSH_RSP, STORAGE_CLASS_WRITE },
+	{ MSG_ID_CIRCULAR_STORAGE_SERVICE_PUSH_N_RSP, STORAGE_CLASS_WRITE },
+	/* Popping clears the elements in flash */
+	{ MSG_ID_CIRCULAR_STORAGE_SERVICE_POP_RSP, STORAGE_CLASS_WRITE },
+	{ MSG_ID_CIRCULAR_STORAGE_SERVICE_POP_N_RSP, STORAGE_CLASS_WRITE },
+	{ MSG_ID_PROP_SERVICE_ADD_RSP, STORAGE_CLASS_WRITE },
+	{ MSG_ID_PROP_SERVICE_WRITE_RSP, STORAGE_CLASS_WRITE },
+	{ MSG_ID_PROP_SERVICE_REMOVE_RSP, STORAGE_CLASS_WRITE },
+	{ MSG_ID_LL_STORAGE_SERVICE_READ_RSP, STORAGE_CLASS_READ },
+	{ MSG_ID_LL_STORAGE_SERVICE_READ_CHUNK_RSP, STORAGE_CLASS_READ },
+	{ MSG_ID_CIRCULAR_STORAGE_SERVICE_GET_RSP, STORAGE_CLASS_READ },
+	{ MSG_ID_CIRCULAR_STORAGE_SERVICE_PEEK_RSP, STORAGE_CLASS_READ },
+	{ MSG_ID_CIRCULAR_STORAGE_SERVICE_PEEK_AT_RSP, STORAGE_CLASS_READ },
+	{ MSG_ID_PROP_SERVICE_READ_RSP, STORAGE_CLASS_READ },
+};
+
+/* Deferred request */
+struct storage_request {
+	list_t list;
+	struct message *msg;
+	uint32_t date;          /* taken from the queue, in 32 kHz ticks */
+};
+
+/* Statistics of a class, times in 32 kHz ticks. The deferral is counted from
+ * the time the task takes the request from its queue: the messages carry no
+ * send date, the time spent in the queue is not measured. */
+struct storage_class_stats {
+	uint32_t requests;
+	uint32_t max_pending;
+	uint32_t defer_total;
+	uint32_t defer_max;
+	uint32_t service_total;
+	uint32_t service_max;
+};
+
+static list_head_t pending[STORAGE_CLASS_COUNT];
+static uint32_t pending_count[STORAGE_CLASS_COUNT];
+static uint32_t pending_total;
+static struct storage_class_stats class_stats[STORAGE_CLASS_COUNT];
+
+static void dispatch_run(xloop_job_t *job);
+static xloop_job_t dispatch_job = {
+	.run = dispatch_run,
+};
+static bool dispatch_posted;
+
+/* Class of a request, STORAGE_BARRIER if it is not a storage request */
+static uint8_t request_class(struct message *msg)
+{
+	unsigned int i;
+
+	if (MESSAGE_SRC(msg) == MESSAGE_DST(msg))
+		return STORAGE_BARRIER;
+	for (i = 0; i < sizeof(request_classes) / sizeof(request_classes[0]);
+	     i++)
+		if (MESSAGE_ID(msg) == (request_classes[i].rsp_id & ~0x40))
+			return request_classes[i].class;
+	return STORAGE_BARRIER;
+}
+
+static bool is_from_port(list_t *element, void *param)
+{
+	return MESSAGE_SRC(((struct storage_request *)element)->msg) ==
+	       *(uint16_t *)param;
+}
+
+/* Class of the deferred requests of a port, STORAGE_CLASS_READ if none */
+static uint8_t port_class(uint16_t port_id)
+{
+	uint8_t class;
+
+	for (class = STORAGE_CLASS_WRITE; class < STORAGE_CLASS_COUNT; class++)
+		if (list_find_first(&pending[class], is_from_port, &port_id))
+			return class;
+	return STORAGE_CLASS_READ;
+}
+
+static void run_request(struct message *msg, uint8_t class, uint32_t date)
+{
+	struct storage_class_stats *stats = &class_stats[class];
+	uint32_t start = get_uptime_32k();
+	uint32_t end;
+
+	/* The message is freed by its handler */
+	port_process_message(msg);
+	end = get_uptime_32k();
+
+	stats->requests++;
+	stats->defer_total += start - date;
+	stats->defer_max = MAX(stats->defer_max, start - date);
+	stats->service_total += end - start;
+	stats->service_max = MAX(stats->service_max, end - start);
+}
+
+/* Handle the first deferred request of the highest priority, return false
+ * if there is none */
+static bool dispatch_one(void)
+{
+	struct storage_request *req;
+	uint8_t class;
+
+	for (class = STORAGE_CLASS_WRITE; class < STORAGE_CLASS_COUNT;
+	     class++) {
+		req = (struct storage_request *)list_get(&pending[class]);
+		if (req) {
+			pending_count[class]--;
+			pending_total--;
+			run_request(req->msg, class, req->date);
+			bfree(req);
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Post the dispatch job if requests are deferred. When the queue is full, it
+ * is posted again after the next message */
+static void schedule_dispatch(void)
+{
+	OS_ERR_TYPE err;
+
+	if (dispatch_posted || pending_total == 0)
+		return;
+	xloop_try_post_job(&loop, &dispatch_job, &err);
+	dispatch_posted = (err == E_OS_OK);
+}
+
+/* Handle the deferred requests one at a time, so that the reads received in
+ * the meantime go first */
+static void dispatch_run(xloop_job_t *job)
+{
+	dispatch_posted = false;
+	dispatch_one();
+	schedule_dispatch();
+}
+
+static void storage_process_message(struct message *msg)
+{
+	uint32_t now = get_uptime_32k();
+	uint8_t class = request_class(msg);
+	struct storage_request *req;
+	OS_ERR_TYPE err;
+	uint8_t port;
+
+	if (class == STORAGE_BARRIER) {
+		while (dispatch_one())
+			;
+		/* The message is freed by its handler */
+		port_process_message(msg);
+		return;
+	}
+
+	port = port_class(MESSAGE_SRC(msg));
+	if (port != STORAGE_CLASS_READ)
+		class = port;
+	if (class == STORAGE_CLASS_READ) {
+		run_request(msg, class, now);
+		schedule_dispatch();
+		return;
+	}
+
+	if (pending_total >= STORAGE_MAX_PENDING)
+		dispatch_one();
+
+	req = balloc(sizeof(*req), &err);
+	if (err != E_OS_OK) {
+		/* Keep the order of the requests */
+		while (dispatch_one())
+			;
+		run_request(msg, class, now);
+		return;
+	}
+	req->msg = msg;
+	req->date = now;
+	list_add(&pending[class], &req->list);
+	pending_count[class]++;
+	pending_total++;
+	class_stats[class].max_pending = MAX(class_stats[class].max_pending,
+					     pending_count[class]);
+	schedule_dispatch();
+}
+
 /* Storage initialisation */
 void init_storage(void)
 {
@@ -67,9 +300,80 @@ void init_storage(void)
 
 void storage_task(void)
 {
-	cfw_loop(storage_queue);
+	int i;
+
+	/* The storage services post jobs to this queue, so it is run by an
+	 * xloop rather than cfw_loop() */
+	xloop_init_from_queue(&loop, storage_queue);
+	for (i = 0; i < STORAGE_CLASS_COUNT; i++)
+		list_init(&pending[i]);
+	xloop_set_message_handler(&loop, storage_process_message);
 #ifdef CONFIG_SYSTEM_EVENTS
 	system_event_set_xloop(&loop);
 #endif
 	xloop_run(&loop);
 }
+
+#ifdef CONFIG_TCMD_STORAGE_TASK
+
+#include <stdio.h>
+#include <string.h>
+#include "infra/tcmd/handler.h"
+
+#define TICKS_TO_US(ticks) ((uint32_t)((uint64_t)(ticks) * 1000000 / 32768))
+
+/*
+ * Test command to display the scheduling statistics of the storage requests:
+ * storage sched [reset]
+ *
+ * For each class: number of requests, maximum number of deferred requests,
+ * average and maximum deferral by the task, not counting the time spent in
+ * its queue, and service time in us.
+ *
+ * @param[in]   argc        Number of arguments in the Test Command (including group and name)
+ * @param[in]   argv        Table of null-terminated buffers containing the arguments
+ * @param[in]   ctx         The context to pass back to responses
+ */
+void storage_sched_tcmd(int argc, char *argv[], struct tcmd_handler_ctx *ctx)
+{
+	static const char *const names[] = { "read", "write", "erase" };
+	struct storage_class_stats stats[STORAGE_CLASS_COUNT];
+	char buf[80];
+	unsigned int key;
+	int i;
+
+	if (argc == 3 && !strcmp(argv[2], "reset")) {
+		key = irq_lock();
+		memset(class_stats, 0, sizeof(class_stats));
+		irq_unlock(key);
+		TCMD_RSP_FINAL(ctx, NULL);
+		return;
+	} else if (argc != 2) {
+		TCMD_RSP_ERROR(ctx, TCMD_ERROR_MSG_INV_ARG);
+		return;
+	}
+
+	/* The statistics are updated by the storage task */
+	key = irq_lock();
+	memcpy(stats, class_stats, sizeof(stats));
+	irq_unlock(key);
+
+	for (i = 0; i < STORAGE_CLASS_COUNT; i++) {
+		uint32_t n = stats[i].requests ? stats[i].requests : 1;
+
+		snprintf(buf, sizeof(buf),
+			 "%s: %u req, %u pending max, deferred %u/%u us, "
+			 "service %u/%u us", names[i], stats[i].requests,
+			 stats[i].max_pending,
+			 TICKS_TO_US(stats[i].defer_total / n),
+			 TICKS_TO_US(stats[i].defer_max),
+			 TICKS_TO_US(stats[i].service_total / n),
+			 TICKS_TO_US(stats[i].service_max));
+		TCMD_RSP_PROVISIONAL(ctx, buf);
+	}
+	TCMD_RSP_FINAL(ctx, NULL);
+}
+
+DECLARE_TEST_COMMAND_ENG(storage, sched, storage_sched_tcmd);
+
+#endif
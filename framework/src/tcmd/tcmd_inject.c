@@ -152,7 +152,7 @@ void cfw_poll_message(int argc, char *argv[], struct tcmd_handler_ctx *ctx)
 
 	queue_get_message(queue, &m, OS_NO_WAIT, &err);
 	if (err == E_OS_OK) {
-		msg = (struct cfw_message *)m;
+		msg = (struct cfw_message *)message_deref(m);
 		int i;
 		for (i = 0; (CFW_MESSAGE_LEN(msg) / MSG_SPLIT_SIZE &&
 			     i < CFW_MESSAGE_LEN(msg) / MSG_SPLIT_SIZE); i++) {
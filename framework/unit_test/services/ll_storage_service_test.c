@@ -28,6 +28,8 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <string.h>
+
 #include "cfw/cfw.h"
 #include "machine.h"
 #include "storage.h"
@@ -40,6 +42,8 @@
 #define WRITE_REQ                                       1
 
 #define TST_DATA_LEN         29
+/* Several chunks and a partial word */
+#define TST_STREAM_LEN       1001
 #define TST_BLOCK_LEN        1
 #define TST_BLOCK_START      0
 #define DATA_LEN_4B          ((TST_BLOCK_LEN * \
@@ -59,6 +63,9 @@ static bool blk_erase = false;
 static bool part_erase = false;
 static bool spi_test = false;
 static bool failed_resp = false;
+static uint32_t stream_done = 0;
+static uint32_t stream_chunks = 0;
+static bool stream_end = false;
 
 #ifdef DEBUG
 static void print_buffer(uint32_t *data, uint32_t len)
@@ -203,6 +210,23 @@ void handle_msg(struct cfw_message *msg, void *data)
 				"LL Write Partition : MSG_ID_LL_STORAGE_SERVICE_WRITE_RSP FAILED\n");
 		}
 		break;
+	case MSG_ID_LL_STORAGE_SERVICE_READ_CHUNK_RSP:
+	case MSG_ID_LL_STORAGE_SERVICE_WRITE_CHUNK_RSP:
+		if ((((ll_storage_service_chunk_rsp_msg_t *)msg)->status ==
+		     DRV_RC_OK) &&
+		    (((ll_storage_service_chunk_rsp_msg_t *)msg)->offset ==
+		     stream_done)) {
+			stream_done +=
+				((ll_storage_service_chunk_rsp_msg_t *)msg)->
+				size;
+			stream_chunks++;
+		} else {
+			failed_resp = true;
+			cu_print("LL Stream : chunk response FAILED\n");
+		}
+		if (((ll_storage_service_chunk_rsp_msg_t *)msg)->last)
+			stream_end = true;
+		break;
 	default:
 		cu_print("default cfw handler\n");
 		break;
@@ -341,6 +365,68 @@ static void service_flash_test()
 	failed_resp = false;
 	part_erase = false;
 
+	// Test streamed write/read, by chunks
+	uint8_t *stream_write = balloc(TST_STREAM_LEN, NULL);
+	uint8_t *stream_read = balloc(TST_STREAM_LEN, NULL);
+
+	for (i = 0; i < TST_STREAM_LEN; i++)
+		stream_write[i] = i;
+	memset(stream_read, 0, TST_STREAM_LEN);
+
+	stream_done = 0;
+	stream_chunks = 0;
+	stream_end = false;
+	ll_storage_service_write_stream(ll_storage_service_conn,
+					factory_reset_non_persistent, 0,
+					stream_write, TST_STREAM_LEN, NULL);
+	SRV_WAIT((stream_end != true), 0xFFFF);
+	CU_ASSERT("Storage Stream Write failure",
+		  (failed_resp != true) && (stream_done == TST_STREAM_LEN));
+	cu_print("LL Stream Write: %d bytes in %d chunks\n", stream_done,
+		 stream_chunks);
+	failed_resp = false;
+
+	stream_done = 0;
+	stream_chunks = 0;
+	stream_end = false;
+	ll_storage_service_read_stream(ll_storage_service_conn,
+				       factory_reset_non_persistent, 0,
+				       stream_read, TST_STREAM_LEN, NULL);
+	SRV_WAIT((stream_end != true), 0xFFFF);
+	CU_ASSERT("Storage Stream Read failure",
+		  (failed_resp != true) && (stream_done == TST_STREAM_LEN));
+	CU_ASSERT("Incorrect stream read values",
+		  memcmp(stream_write, stream_read, TST_STREAM_LEN) == 0);
+	failed_resp = false;
+
+	// Stream outside partition's boundaries
+	offset = ((spi_test) ?
+		  (SPI_SYSTEM_EVENT_NB_BLOCKS * SERIAL_FLASH_BLOCK_SIZE) :
+		  (FACTORY_RESET_NON_PERSISTENT_NB_BLOCKS *
+		   EMBEDDED_FLASH_BLOCK_SIZE))
+		 - sizeof(uint32_t);
+	stream_end = false;
+	ll_storage_service_read_stream(ll_storage_service_conn,
+				       factory_reset_non_persistent, offset,
+				       stream_read, TST_STREAM_LEN, NULL);
+	SRV_WAIT((stream_end != true), 0xFFFF);
+	CU_ASSERT("Storage Stream outside partition's boundaries success",
+		  failed_resp == true);
+	failed_resp = false;
+
+	bfree(stream_write);
+	bfree(stream_read);
+
+	// Erase
+	part_erase = false;
+	ll_storage_service_erase_partition(ll_storage_service_conn,
+					   factory_reset_non_persistent,
+					   NULL);
+	SRV_WAIT((part_erase != true) && (failed_resp != true), 0xFFFF);
+	CU_ASSERT("Storage Partition Erase failure", part_erase == true);
+	failed_resp = false;
+	part_erase = false;
+
 	// Test read/write on last partition's block
 	offset = ((spi_test) ?
 		  (SPI_SYSTEM_EVENT_NB_BLOCKS * SERIAL_FLASH_BLOCK_SIZE) :
@@ -30,11 +30,12 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <string.h>
 
 #include "cir_storage.h"
 #include "cir_storage_backend.h"
 
-#define BASE_PTR(storage,index) index*storage->block_size + sizeof(block_info_t)
+#define BASE_PTR(storage,index) index*storage->block_size + INFO_SIZE(storage)
 #define READ_PTR(storage)       storage->rp.offset
 #define WRITE_PTR(storage)      storage->wp.offset
 #define READ_BLOCK(storage)     storage->rp.index
@@ -47,6 +48,7 @@
 typedef struct _block_header {
 	uint32_t magic:16; /** A magic word */
 	uint32_t size:16;  /** The size of each stored element */
+	uint32_t seq;      /** Sequence number, incremented at each block switch */
 } block_header_t;
 
 /**
@@ -64,7 +66,20 @@ typedef struct _block_info {
 	block_status_t status;
 } block_info_t;
 
-#define CIR_STORAGE_FLASH_MAGIC 0xABCD
+#define CIR_STORAGE_FLASH_MAGIC 0xABCE
+
+/**
+ * Legacy blocks have a header without sequence number, which shifts the
+ * elements. A legacy storage keeps its layout until all its elements are
+ * read, it is then formatted again by the next push.
+ */
+#define CIR_STORAGE_LEGACY_MAGIC 0xABCD
+#define LEGACY_HEADER_SIZE       sizeof(uint32_t)
+
+/* Size of the block header and info in the layout of the storage */
+#define HEADER_SIZE(storage) \
+	((storage)->legacy ? LEGACY_HEADER_SIZE : sizeof(block_header_t))
+#define INFO_SIZE(storage)   (HEADER_SIZE(storage) + sizeof(block_status_t))
 
 #define BLOCK_UNUSED  0xFFFFFFFF
 #define BLOCK_CURRENT 0xAAAAAAAA
@@ -81,15 +96,37 @@ typedef struct _elt_status {
 #define ELT_WRITTEN   0xBBBBBBBB
 #define ELT_READ      0x00000000
 
-static int32_t write_header(cir_storage_flash_t *storage, uint32_t index) {
+#define ELT_SPACE(storage) (sizeof(elt_status_t) + storage->parent.elt_size)
+
+#ifndef CIR_STORAGE_BATCH_SIZE
+/**
+ * Size of the stack buffer used to transfer a run of contiguous elements,
+ * with their status, in a single flash access.
+ */
+#define CIR_STORAGE_BATCH_SIZE 128
+#endif
+
+static int32_t write_header(cir_storage_flash_t *storage, uint32_t index,
+			    uint32_t seq) {
 
 	block_header_t header = {
-		.magic = CIR_STORAGE_FLASH_MAGIC
+		.magic = storage->legacy ? CIR_STORAGE_LEGACY_MAGIC
+					 : CIR_STORAGE_FLASH_MAGIC
 	};
 	header.size = storage->parent.elt_size;
+	header.seq = seq;
+	/* The legacy header stops before the sequence number. The sequence
+	 * number is written first, a block with a valid magic has it whole. */
+	if (!storage->legacy
+	    && (storage->write(storage,
+			       index*storage->block_size + LEGACY_HEADER_SIZE,
+			       sizeof(header.seq),
+			       (uint8_t *)&header.seq) != 0)) {
+		return -1;
+	}
 	return storage->write(storage,
 			      index*storage->block_size,
-	                      sizeof(header),
+	                      LEGACY_HEADER_SIZE,
 	                      (uint8_t *)&header);
 }
 
@@ -99,85 +136,326 @@ static int32_t write_status(cir_storage_flash_t *storage,
                             uint32_t offset) {
 
 	return storage->write(storage,
-			      index*storage->block_size + sizeof(block_header_t) + offset,
+			      index*storage->block_size + HEADER_SIZE(storage) + offset,
 	                      sizeof(status),
 	                      (uint8_t *)&status);
 };
 
-int32_t cir_storage_flash_init(cir_storage_flash_t *storage)
+static cir_storage_err_t advance_write_ptr(cir_storage_flash_t *storage);
+static cir_storage_err_t advance_read_ptr(cir_storage_flash_t *storage);
+static uint32_t stored_count(cir_storage_flash_t *storage);
+
+/* Number of elements that fit in a block */
+static uint32_t elts_per_block(cir_storage_flash_t *storage)
 {
-	block_info_t info;
-	if (storage->parent.buffer_size%storage->block_size ||
-		(storage->parent.elt_size + sizeof(uint32_t)
-			> storage->block_size - sizeof(block_info_t))) {
-		return -1;
-	}
+	return (storage->last_offset - INFO_SIZE(storage)) / ELT_SPACE(storage) + 1;
+}
+
+/* Set the block layout of the storage, legacy or with sequence numbers */
+static void set_layout(cir_storage_flash_t *storage, uint32_t legacy)
+{
+	uint32_t elt_space = ELT_SPACE(storage);
+	uint32_t block_space;
 
+	storage->legacy = legacy;
 	/* Doing this calculation only once will save some flash space */
-	uint32_t elt_space = storage->parent.elt_size + sizeof(elt_status_t);
-	uint32_t block_space = storage->block_size - sizeof(block_info_t);
+	block_space = storage->block_size - INFO_SIZE(storage);
 	storage->last_offset =
-		sizeof(block_info_t) + elt_space*(block_space/elt_space-1);
+		INFO_SIZE(storage) + elt_space*(block_space/elt_space-1);
+}
+
+/* Index of the block n blocks after index, wrapping at the end of the storage */
+static uint32_t next_block(cir_storage_flash_t *storage, uint32_t index,
+			   uint32_t n)
+{
+	uint32_t block_count = storage->block_last - storage->block_first + 1;
+
+	return storage->block_first
+		+ (index - storage->block_first + n) % block_count;
+}
+
+/* Read the info of a block, valid is set if the block belongs to the storage */
+static int32_t read_info(cir_storage_flash_t *storage, uint32_t index,
+			 block_info_t *info, bool *valid)
+{
+	if (storage->read(storage, index*storage->block_size, sizeof(*info),
+			  (uint8_t *)info) != 0) {
+		return -1;
+	}
+	*valid = ((uint32_t) info->header.magic == CIR_STORAGE_FLASH_MAGIC)
+		&& (info->header.size == storage->parent.elt_size);
+	return 0;
+}
+
+/*
+ * Binary search of the first element of a block which status is empty (write
+ * pointer) or not read (read pointer): statuses only go from empty to written
+ * to read, in the element order. Returns elts_per_block() if there is none.
+ */
+static int32_t search_elt(cir_storage_flash_t *storage, uint32_t index,
+			  bool find_empty, uint32_t *elt)
+{
+	uint32_t lo = 0;
+	uint32_t hi = elts_per_block(storage);
+
+	while (lo < hi) {
+		uint32_t mid = (lo + hi) / 2;
+		uint32_t elt_status;
+
+		if (storage->read(storage,
+				  BASE_PTR(storage,index) + mid*ELT_SPACE(storage),
+				  sizeof(elt_status),
+				  (uint8_t *)&elt_status) != 0) {
+			return -1;
+		}
+		if (find_empty ? (elt_status == ELT_EMPTY) : (elt_status != ELT_READ)) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
+		}
+	}
+	*elt = lo;
+	return 0;
+}
+
+/*
+ * Retrieve the write and read pointers of an existing storage.
+ *
+ * Starting from the first block, the blocks written since the storage was
+ * created or last wrapped have consecutive sequence numbers, the write block
+ * having the highest one: it is found by a binary search. Once wrapped, the
+ * blocks after it hold the oldest elements. In sequence order, the read
+ * status of the blocks goes from used to current (the read block) to unused,
+ * which gives a second binary search. The pointers are then searched within
+ * their block.
+ *
+ * The status of the blocks is repaired if a power loss occurred while the
+ * pointers were switching block, including the write pointer wrapping to
+ * the first block once it is erased.
+ *
+ * Returns 1 if no storage exists, -1 on flash error.
+ */
+static int32_t mount(cir_storage_flash_t *storage)
+{
+	uint32_t block_count = storage->block_last - storage->block_first + 1;
+	uint32_t per_block = elts_per_block(storage);
+	block_info_t first, info;
+	uint32_t lo, hi, oldest, len, start, i;
+	uint32_t write_status_word, read_status_word;
+	uint32_t wp_elt, rp_elt;
+	block_pointer_t rp;
+	bool valid;
+
+	if (read_info(storage, storage->block_first, &first, &valid) != 0) {
+		return -1;
+	}
+	start = 0;
+	if (!valid) {
+		/* The power may have been lost when the write pointer wrapped,
+		 * the first block being erased: the sequence starts with the
+		 * next block */
+		if ((block_count > 1)
+		    && (read_info(storage, storage->block_first + 1, &first, &valid) != 0)) {
+			return -1;
+		}
+		if (!valid) {
+			/* Not an existing circular buffer */
+			return 1;
+		}
+		first.header.seq--;
+		start = 1;
+	}
+
+	/* Write block: last one of the run of sequence numbers */
+	lo = start;
+	hi = block_count;
+	while (hi - lo > 1) {
+		uint32_t mid = (lo + hi) / 2;
+
+		if (read_info(storage, storage->block_first + mid, &info, &valid) != 0) {
+			return -1;
+		}
+		if (valid && (info.header.seq == first.header.seq + mid)) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+	WRITE_BLOCK(storage) = storage->block_first + lo;
+	storage->seq = first.header.seq + lo;
+	if (read_info(storage, WRITE_BLOCK(storage), &info, &valid) != 0) {
+		return -1;
+	}
+	write_status_word = info.status.write;
+	if (start && ((lo != block_count - 1) || (write_status_word != BLOCK_USED))) {
+		/* Not a wrap in progress, but blocks of a previous storage */
+		return 1;
+	}
+
+	/* Oldest block: the one after the write block once wrapped, or the next
+	 * one if a power loss occurred after erasing it */
+	oldest = storage->block_first + start;
+	len = lo + 1 - start;
+	for (i = 1; (i <= 2) && (lo + i < block_count); i++) {
+		if (read_info(storage, WRITE_BLOCK(storage) + i, &info, &valid) != 0) {
+			return -1;
+		}
+		if (valid && (info.header.seq == storage->seq - block_count + i)) {
+			oldest = WRITE_BLOCK(storage) + i;
+			len = block_count - i + 1;
+			break;
+		}
+	}
+
+	/* Read block: first one, in sequence order, not used by the reader */
+	lo = 0;
+	hi = len - 1;
+	while (lo < hi) {
+		uint32_t mid = (lo + hi) / 2;
+
+		if (read_info(storage, next_block(storage, oldest, mid), &info, &valid) != 0) {
+			return -1;
+		}
+		if (info.status.read != BLOCK_USED) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
+		}
+	}
+	READ_BLOCK(storage) = next_block(storage, oldest, lo);
+	if (read_info(storage, READ_BLOCK(storage), &info, &valid) != 0) {
+		return -1;
+	}
+	read_status_word = info.status.read;
 
+	if ((search_elt(storage, WRITE_BLOCK(storage), true, &wp_elt) != 0)
+	    || (search_elt(storage, READ_BLOCK(storage), false, &rp_elt) != 0)) {
+		return -1;
+	}
+	WRITE_PTR(storage) = BASE_PTR(storage,WRITE_BLOCK(storage))
+		+ (wp_elt < per_block ? wp_elt : per_block - 1)*ELT_SPACE(storage);
+	READ_PTR(storage) = BASE_PTR(storage,READ_BLOCK(storage))
+		+ (rp_elt < per_block ? rp_elt : per_block - 1)*ELT_SPACE(storage);
+
+	/* Mark the blocks of the pointers as current if the power was lost
+	 * before it was done. A block is only marked used once full, its status
+	 * is otherwise unused or a partly written current status. */
+	if ((wp_elt < per_block) && (write_status_word != BLOCK_CURRENT)
+	    && (write_status(storage, WRITE_BLOCK(storage), BLOCK_CURRENT, WRITE_STATUS_OFFSET) != 0)) {
+		return -1;
+	}
+	if ((rp_elt < per_block) && (read_status_word != BLOCK_CURRENT)
+	    && (write_status(storage, READ_BLOCK(storage), BLOCK_CURRENT, READ_STATUS_OFFSET) != 0)) {
+		return -1;
+	}
+
+	/* Complete the switch to the next block of a pointer which block is
+	 * full. The write pointer goes first, it may push the read pointer. */
+	rp = storage->rp;
+	if ((wp_elt == per_block)
+	    && (advance_write_ptr(storage) != CBUFFER_STORAGE_SUCCESS)) {
+		return -1;
+	}
+	if ((rp_elt == per_block) && (storage->rp.index == rp.index)
+	    && (storage->rp.offset == rp.offset)
+	    && (advance_read_ptr(storage) != CBUFFER_STORAGE_SUCCESS)) {
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Retrieve the write and read pointers of a storage of the legacy layout, by
+ * a sequential scan of the blocks marked current and of their elements.
+ *
+ * Returns 1 if no legacy storage exists or a pointer is not found, -1 on
+ * flash error.
+ */
+static int32_t mount_legacy(cir_storage_flash_t *storage)
+{
+	uint32_t block_index = storage->block_first;
+	block_status_t status;
+	uint32_t header;
+
+	set_layout(storage, 1);
 	WRITE_PTR(storage) = 0;
 	READ_PTR(storage) = 0;
 
-	/* Retrieve write and read pointers */
-	uint32_t block_index = storage->block_first;
 	while ((block_index <=  storage->block_last)
 		&& ((READ_PTR(storage) == 0) || (WRITE_PTR(storage) == 0))) {
 
 		uint32_t block_offset = block_index*storage->block_size;
-		if (storage->read(storage,
-				  block_offset,
-				  sizeof(info),
-				  (uint8_t *)&info) != 0) {
+		if ((storage->read(storage, block_offset, sizeof(header),
+				   (uint8_t *)&header) != 0)
+		    || (storage->read(storage, block_offset + LEGACY_HEADER_SIZE,
+				      sizeof(status), (uint8_t *)&status) != 0)) {
 			return -1;
 		}
 		/* Check header first */
-		if (((uint32_t) info.header.magic == CIR_STORAGE_FLASH_MAGIC)
-			&& (info.header.size == storage->parent.elt_size)) {
-			bool has_wp = (info.status.write == BLOCK_CURRENT);
-			bool has_rp = (info.status.read == BLOCK_CURRENT);
-			if (has_wp || has_rp) {
-				/* Look for pointers in this block */
-				uint32_t elt_offset = block_offset + sizeof(block_info_t);
-				while ((elt_offset < (block_offset + storage->block_size))
-					&& ((has_wp && (WRITE_PTR(storage) == 0))
-				     || (has_rp && (READ_PTR(storage) == 0)))) {
-				    uint32_t elt_status;
-				    if (storage->read(storage,
-						      elt_offset,
-				                      sizeof(elt_status),
-				                      (uint8_t *)&elt_status) != 0) {
-				        return -1;
-				    }
-					if ((has_wp && (WRITE_PTR(storage) == 0))
-					 && (elt_status == ELT_EMPTY)) {
-						/* The first empty element is the write pointer */
-						WRITE_PTR(storage) = elt_offset;
-						WRITE_BLOCK(storage) = block_index;
-					}
-					if ((has_rp && (READ_PTR(storage) == 0))
-					 && (elt_status != ELT_READ)) {
-						/* The first non-read element is the read pointer */
-						READ_PTR(storage) = elt_offset;
-						READ_BLOCK(storage) = block_index;
-					}
-					elt_offset += sizeof(elt_status) + storage->parent.elt_size;
-				}
-			}
-		} else {
+		if (((header & 0xFFFF) != CIR_STORAGE_LEGACY_MAGIC)
+			|| ((header >> 16) != storage->parent.elt_size)) {
 			/* Not an existing circular buffer */
 			break;
 		}
+		bool has_wp = (status.write == BLOCK_CURRENT);
+		bool has_rp = (status.read == BLOCK_CURRENT);
+		/* Look for pointers in this block */
+		uint32_t elt_offset = BASE_PTR(storage,block_index);
+		while ((elt_offset <= block_offset + storage->last_offset)
+			&& ((has_wp && (WRITE_PTR(storage) == 0))
+			 || (has_rp && (READ_PTR(storage) == 0)))) {
+			uint32_t elt_status;
+			if (storage->read(storage, elt_offset, sizeof(elt_status),
+					  (uint8_t *)&elt_status) != 0) {
+				return -1;
+			}
+			if ((has_wp && (WRITE_PTR(storage) == 0))
+			 && (elt_status == ELT_EMPTY)) {
+				/* The first empty element is the write pointer */
+				WRITE_PTR(storage) = elt_offset;
+				WRITE_BLOCK(storage) = block_index;
+			}
+			if ((has_rp && (READ_PTR(storage) == 0))
+			 && (elt_status != ELT_READ)) {
+				/* The first non-read element is the read pointer */
+				READ_PTR(storage) = elt_offset;
+				READ_BLOCK(storage) = block_index;
+			}
+			elt_offset += ELT_SPACE(storage);
+		}
 		block_index++;
 	}
 	if ((READ_PTR(storage) != 0) && (WRITE_PTR(storage) != 0)) {
-		/* Existing storage detected */
 		return 0;
 	}
-	/* Storage first init */
+	set_layout(storage, 0);
+	return 1;
+}
+
+/* Start an empty storage of the current layout */
+static int32_t format(cir_storage_flash_t *storage)
+{
+	block_info_t info;
+	uint32_t block_count = storage->block_last - storage->block_first + 1;
+	uint32_t block_index;
+	uint32_t seq = 0;
+	bool valid;
+
+	set_layout(storage, 0);
+
+	/* Start a storage span after the sequence numbers of any block left by
+	 * a previous storage, so that none of them is taken as part of the new
+	 * one */
+	for (block_index = storage->block_first;
+	     block_index <= storage->block_last; block_index++) {
+		if (read_info(storage, block_index, &info, &valid) != 0) {
+			return -1;
+		}
+		if (valid && (info.header.seq + 1 > seq)) {
+			seq = info.header.seq + 1;
+		}
+	}
+	storage->seq = (seq > 0) ? seq - 1 + block_count : 0;
 
 	/* Erase the first block */
 	if (storage->erase(storage, storage->block_first, 1) != 0) {
@@ -185,7 +463,7 @@ int32_t cir_storage_flash_init(cir_storage_flash_t *storage)
 	}
 
 	/* Store our header first */
-	if (write_header(storage, storage->block_first) != 0) {
+	if (write_header(storage, storage->block_first, storage->seq) != 0) {
 		return -1;
 	}
 
@@ -210,26 +488,39 @@ int32_t cir_storage_flash_init(cir_storage_flash_t *storage)
 	return 0;
 }
 
-cir_storage_err_t cir_storage_push(cir_storage_t *self, uint8_t *buf)
+int32_t cir_storage_flash_init(cir_storage_flash_t *storage)
 {
-	cir_storage_flash_t *storage = (cir_storage_flash_t *)self;
-	cir_storage_err_t ret = CBUFFER_STORAGE_SUCCESS;
+	int32_t ret;
 
-	storage->lock(storage);
-	elt_status_t elt_status = { ELT_WRITTEN };
+	if (storage->parent.buffer_size%storage->block_size ||
+		(storage->parent.elt_size + sizeof(uint32_t)
+			> storage->block_size - sizeof(block_info_t))) {
+		return -1;
+	}
 
-	/* Update the status of the next element */
-	if (storage->write(storage, WRITE_PTR(storage), sizeof(elt_status), (uint8_t *)&elt_status) != 0) {
-		ret = CBUFFER_STORAGE_ERROR;
-		goto exit;
+	set_layout(storage, 0);
+
+	/* Retrieve write and read pointers */
+	ret = mount(storage);
+	if (ret <= 0) {
+		return ret;
 	}
 
-	/* Write the element */
-	if (storage->write(storage, WRITE_PTR(storage) + sizeof(elt_status), self->elt_size, buf) != 0) {
-		ret = CBUFFER_STORAGE_ERROR;
-		goto exit;
+	/* Storage written before the sequence numbers, kept until drained */
+	ret = mount_legacy(storage);
+	if (ret <= 0) {
+		return ret;
 	}
 
+	/* Storage first init */
+	return format(storage);
+}
+
+/* Must be called with the storage mutex locked */
+static cir_storage_err_t advance_write_ptr(cir_storage_flash_t *storage)
+{
+	cir_storage_err_t ret = CBUFFER_STORAGE_SUCCESS;
+
 	/* Increase and adjust write pointer */
 	if (WRITE_PTR(storage)%storage->block_size == storage->last_offset) {
 		/* Mark current block as non-current for write pointer */
@@ -248,7 +539,8 @@ cir_storage_err_t cir_storage_push(cir_storage_t *self, uint8_t *buf)
 			goto exit;
 		}
 		/* Write new header to block */
-		if (write_header(storage, WRITE_BLOCK(storage)) !=0) {
+		storage->seq++;
+		if (write_header(storage, WRITE_BLOCK(storage), storage->seq) !=0) {
 			ret = CBUFFER_STORAGE_ERROR;
 			goto exit;
 		}
@@ -275,26 +567,133 @@ cir_storage_err_t cir_storage_push(cir_storage_t *self, uint8_t *buf)
 			}
 		}
 	} else {
-		WRITE_PTR(storage) += sizeof(elt_status) + storage->parent.elt_size;
+		WRITE_PTR(storage) += ELT_SPACE(storage);
 	}
 
 exit:
-	storage->unlock(storage);
 	return ret;
 }
 
-/* Must be called with the storage mutex locked */
-static cir_storage_err_t clear_one_element(cir_storage_flash_t * storage)
+/* Number of elements of a run starting at ptr, up to the end of the block */
+static uint32_t block_run_length(cir_storage_flash_t *storage, uint32_t ptr,
+				 uint32_t elt_count)
+{
+	uint32_t n = (storage->last_offset - ptr%storage->block_size)
+		/ ELT_SPACE(storage) + 1;
+
+	return n > elt_count ? elt_count : n;
+}
+
+/*
+ * Number of elements of a run starting at ptr that can be transferred in a
+ * single flash access: the run stops at the end of the block and must fit in
+ * the batch buffer. Elements too large for the batch buffer are written one
+ * by one.
+ */
+static uint32_t run_length(cir_storage_flash_t *storage, uint32_t ptr,
+			   uint32_t elt_count)
 {
+	uint32_t n = block_run_length(storage, ptr, elt_count);
+
+	if (n > CIR_STORAGE_BATCH_SIZE / ELT_SPACE(storage)) {
+		n = CIR_STORAGE_BATCH_SIZE / ELT_SPACE(storage);
+	}
+	return n > 0 ? n : 1;
+}
+
+/*
+ * Number of elements of a run starting at ptr to read at once. Elements too
+ * large for the batch buffer are read straight into the caller buffer, up to
+ * the end of the block.
+ */
+static uint32_t read_run_length(cir_storage_flash_t *storage, uint32_t ptr,
+				uint32_t elt_count)
+{
+	if (ELT_SPACE(storage) > CIR_STORAGE_BATCH_SIZE) {
+		return block_run_length(storage, ptr, elt_count);
+	}
+	return run_length(storage, ptr, elt_count);
+}
+
+/* Must be called with the storage mutex locked, n given by run_length() */
+static cir_storage_err_t write_run(cir_storage_flash_t *storage, uint8_t *buf,
+				   uint32_t n)
+{
+	uint8_t batch[CIR_STORAGE_BATCH_SIZE];
+	uint32_t elt_size = storage->parent.elt_size;
+	uint32_t elt_space = ELT_SPACE(storage);
+	elt_status_t elt_status = { ELT_WRITTEN };
+	uint32_t i;
+
+	if (elt_space > sizeof(batch)) {
+		/* Update the status of the next element */
+		if (storage->write(storage, WRITE_PTR(storage), sizeof(elt_status), (uint8_t *)&elt_status) != 0) {
+			return CBUFFER_STORAGE_ERROR;
+		}
+		/* Write the element */
+		if (storage->write(storage, WRITE_PTR(storage) + sizeof(elt_status), elt_size, buf) != 0) {
+			return CBUFFER_STORAGE_ERROR;
+		}
+		return advance_write_ptr(storage);
+	}
+
+	/* Interleave the elements with their status, as stored in flash */
+	for (i = 0; i < n; i++) {
+		memcpy(&batch[i*elt_space], &elt_status, sizeof(elt_status));
+		memcpy(&batch[i*elt_space + sizeof(elt_status)], &buf[i*elt_size], elt_size);
+	}
+	if (storage->write(storage, WRITE_PTR(storage), n*elt_space, batch) != 0) {
+		return CBUFFER_STORAGE_ERROR;
+	}
+
+	/* The run does not cross a block, only the last element may switch */
+	WRITE_PTR(storage) += (n - 1)*elt_space;
+	return advance_write_ptr(storage);
+}
+
+cir_storage_err_t cir_storage_push(cir_storage_t *self, uint8_t *buf)
+{
+	uint32_t count;
+
+	return cir_storage_push_n(self, buf, 1, &count);
+}
+
+cir_storage_err_t cir_storage_push_n(cir_storage_t *self, uint8_t *buf,
+				     uint32_t elt_count, uint32_t *pushed)
+{
+	cir_storage_flash_t *storage = (cir_storage_flash_t *)self;
 	cir_storage_err_t ret = CBUFFER_STORAGE_SUCCESS;
 
-	elt_status_t elt_status = { ELT_READ };
+	*pushed = 0;
+	storage->lock(storage);
 
-	/* Mark the element as read */
-	if (storage->write(storage, READ_PTR(storage),sizeof(elt_status), (uint8_t *)&elt_status) != 0) {
+	/* A drained legacy storage is migrated to the current layout */
+	if (storage->legacy && (stored_count(storage) == 0)
+	    && (format(storage) != 0)) {
 		ret = CBUFFER_STORAGE_ERROR;
-		goto exit;
 	}
+
+	while ((ret == CBUFFER_STORAGE_SUCCESS) && (elt_count > 0)) {
+		uint32_t n = run_length(storage, WRITE_PTR(storage), elt_count);
+
+		ret = write_run(storage, buf, n);
+		if (ret != CBUFFER_STORAGE_SUCCESS) {
+			break;
+		}
+		buf += n*self->elt_size;
+		elt_count -= n;
+		*pushed += n;
+	}
+
+	storage->unlock(storage);
+	return ret;
+}
+
+/* Must be called with the storage mutex locked */
+static cir_storage_err_t advance_read_ptr(cir_storage_flash_t *storage)
+{
+	cir_storage_err_t ret = CBUFFER_STORAGE_SUCCESS;
+
 	if (READ_PTR(storage)%storage->block_size == storage->last_offset) {
 		/* Mark current block as not current for read pointer */
 		if (write_status(storage, READ_BLOCK(storage), BLOCK_USED, READ_STATUS_OFFSET) != 0) {
@@ -312,64 +711,216 @@ static cir_storage_err_t clear_one_element(cir_storage_flash_t * storage)
 		READ_PTR(storage) = BASE_PTR(storage,READ_BLOCK(storage));
 	} else {
 		/* Advance the read pointer of one element */
-		READ_PTR(storage) += sizeof(elt_status) + storage->parent.elt_size;
+		READ_PTR(storage) += ELT_SPACE(storage);
 	}
 
 exit:
 	return ret;
 }
 
-/* Must be called with the storage mutex locked */
-static cir_storage_err_t read_one_element(cir_storage_flash_t *storage, uint8_t *buf)
+/* Must be called with the storage mutex locked, n given by read_run_length() */
+static cir_storage_err_t clear_run(cir_storage_flash_t *storage, uint32_t n)
 {
-	cir_storage_err_t ret = CBUFFER_STORAGE_SUCCESS;
+	uint8_t batch[CIR_STORAGE_BATCH_SIZE];
+	uint32_t elt_space = ELT_SPACE(storage);
+	elt_status_t elt_status = { ELT_READ };
+	uint32_t i;
+
+	if ((n - 1)*elt_space + sizeof(elt_status) > sizeof(batch)) {
+		/* Mark the elements as read one by one */
+		for (i = 0; i < n; i++) {
+			if (storage->write(storage, READ_PTR(storage) + i*elt_space,
+					   sizeof(elt_status), (uint8_t *)&elt_status) != 0) {
+				return CBUFFER_STORAGE_ERROR;
+			}
+		}
+	} else if (n == 1) {
+		/* Mark the element as read */
+		if (storage->write(storage, READ_PTR(storage),sizeof(elt_status), (uint8_t *)&elt_status) != 0) {
+			return CBUFFER_STORAGE_ERROR;
+		}
+	} else {
+		/* Mark the whole run as read at once: the payloads of read
+		 * elements are not used anymore and can be zeroed as well. */
+		memset(batch, 0, sizeof(batch));
+		if (storage->write(storage, READ_PTR(storage),
+				   (n - 1)*elt_space + sizeof(elt_status), batch) != 0) {
+			return CBUFFER_STORAGE_ERROR;
+		}
+	}
 
-	/* nothing to read */
-	if (READ_PTR(storage) == WRITE_PTR(storage)) {
-		ret = CBUFFER_STORAGE_EMPTY_ERROR;
-		goto exit;
+	/* The run does not cross a block, only the last element may switch */
+	READ_PTR(storage) += (n - 1)*elt_space;
+	return advance_read_ptr(storage);
+}
+
+/* Must be called with the storage mutex locked, n given by read_run_length() */
+static cir_storage_err_t read_run(cir_storage_flash_t *storage, uint32_t ptr,
+				  uint8_t *buf, uint32_t n)
+{
+	uint8_t batch[CIR_STORAGE_BATCH_SIZE];
+	uint32_t elt_size = storage->parent.elt_size;
+	uint32_t elt_space = ELT_SPACE(storage);
+	uint32_t i;
+
+	if (n == 1) {
+		if (storage->read(storage, ptr + sizeof(elt_status_t), elt_size, buf) != 0) {
+			return CBUFFER_STORAGE_ERROR;
+		}
+		return CBUFFER_STORAGE_SUCCESS;
 	}
 
-	if (storage->read(storage, READ_PTR(storage) + sizeof(elt_status_t),
-		              storage->parent.elt_size, buf) != 0) {
-		ret = CBUFFER_STORAGE_ERROR;
-		goto exit;
+	if (elt_space > sizeof(batch)) {
+		/* Read the payloads straight into buf, with the status words
+		 * between them, then pack them. buf holds n elements, so the
+		 * first m elements fit with their m - 1 status words. */
+		while (n > 0) {
+			uint32_t m = (n*elt_size + sizeof(elt_status_t)) / elt_space;
+
+			if (storage->read(storage, ptr + sizeof(elt_status_t),
+					  m*elt_space - sizeof(elt_status_t), buf) != 0) {
+				return CBUFFER_STORAGE_ERROR;
+			}
+			for (i = 1; i < m; i++) {
+				memmove(&buf[i*elt_size], &buf[i*elt_space], elt_size);
+			}
+			ptr += m*elt_space;
+			buf += m*elt_size;
+			n -= m;
+		}
+		return CBUFFER_STORAGE_SUCCESS;
 	}
 
-exit:
-	return ret;
+	if (storage->read(storage, ptr, n*elt_space, batch) != 0) {
+		return CBUFFER_STORAGE_ERROR;
+	}
+	for (i = 0; i < n; i++) {
+		memcpy(&buf[i*elt_size], &batch[i*elt_space + sizeof(elt_status_t)], elt_size);
+	}
+	return CBUFFER_STORAGE_SUCCESS;
+}
+
+/* Rank of the element pointed by p from the start of the storage */
+static uint32_t elt_rank(cir_storage_flash_t *storage, block_pointer_t *p)
+{
+	return (p->index - storage->block_first) * elts_per_block(storage)
+		+ (p->offset%storage->block_size - INFO_SIZE(storage)) / ELT_SPACE(storage);
+}
+
+/* Must be called with the storage mutex locked */
+static uint32_t stored_count(cir_storage_flash_t *storage)
+{
+	uint32_t total = (storage->block_last - storage->block_first + 1)
+		* elts_per_block(storage);
+
+	return (elt_rank(storage, &storage->wp) + total
+		- elt_rank(storage, &storage->rp)) % total;
+}
+
+/* Move a pointer n elements forward, the pointer must stay on stored elements */
+static void skip_elements(cir_storage_flash_t *storage, block_pointer_t *p,
+			  uint32_t n)
+{
+	uint32_t per_block = elts_per_block(storage);
+	uint32_t idx = (p->offset%storage->block_size - INFO_SIZE(storage))
+		/ ELT_SPACE(storage) + n;
+
+	p->index = next_block(storage, p->index, idx / per_block);
+	p->offset = BASE_PTR(storage,p->index) + (idx % per_block)*ELT_SPACE(storage);
 }
 
 cir_storage_err_t cir_storage_pop(cir_storage_t *self, uint8_t *buf)
+{
+	uint32_t count;
+
+	return cir_storage_pop_n(self, buf, 1, &count);
+}
+
+cir_storage_err_t cir_storage_pop_n(cir_storage_t *self, uint8_t *buf,
+				    uint32_t elt_count, uint32_t *popped)
 {
 	cir_storage_flash_t *storage = (cir_storage_flash_t *)self;
 	cir_storage_err_t ret = CBUFFER_STORAGE_SUCCESS;
+	uint32_t stored;
 
+	*popped = 0;
 	storage->lock(storage);
 
-	ret = read_one_element(storage, buf);
-	if (ret != CBUFFER_STORAGE_SUCCESS) {
+	stored = stored_count(storage);
+	if (stored == 0) {
+		ret = CBUFFER_STORAGE_EMPTY_ERROR;
 		goto exit;
 	}
+	if (elt_count > stored) {
+		elt_count = stored;
+	}
 
-	/* Clear data */
-	ret = clear_one_element(storage);
+	while ((ret == CBUFFER_STORAGE_SUCCESS) && (elt_count > 0)) {
+		uint32_t n = read_run_length(storage, READ_PTR(storage), elt_count);
+
+		ret = read_run(storage, READ_PTR(storage), buf, n);
+		if (ret != CBUFFER_STORAGE_SUCCESS) {
+			goto exit;
+		}
+		/* Clear data */
+		ret = clear_run(storage, n);
+		if (ret != CBUFFER_STORAGE_SUCCESS) {
+			goto exit;
+		}
+		buf += n*self->elt_size;
+		elt_count -= n;
+		*popped += n;
+	}
 
 exit:
 	storage->unlock(storage);
 	return ret;
 }
 
-
 cir_storage_err_t cir_storage_peek(cir_storage_t * self, uint8_t *buf)
+{
+	uint32_t count;
+
+	return cir_storage_peek_at(self, 0, buf, 1, &count);
+}
+
+cir_storage_err_t cir_storage_peek_at(cir_storage_t *self, uint32_t offset,
+				      uint8_t *buf, uint32_t elt_count,
+				      uint32_t *peeked)
 {
 	cir_storage_flash_t *storage = (cir_storage_flash_t *)self;
 	cir_storage_err_t ret = CBUFFER_STORAGE_SUCCESS;
+	block_pointer_t p;
+	uint32_t stored;
 
+	*peeked = 0;
 	storage->lock(storage);
 
-	ret = read_one_element(storage, buf);
+	stored = stored_count(storage);
+	if (offset >= stored) {
+		ret = CBUFFER_STORAGE_EMPTY_ERROR;
+		goto exit;
+	}
+	if (elt_count > stored - offset) {
+		elt_count = stored - offset;
+	}
+
+	p = storage->rp;
+	skip_elements(storage, &p, offset);
+	while (elt_count > 0) {
+		uint32_t n = read_run_length(storage, p.offset, elt_count);
 
+		ret = read_run(storage, p.offset, buf, n);
+		if (ret != CBUFFER_STORAGE_SUCCESS) {
+			goto exit;
+		}
+		skip_elements(storage, &p, n);
+		buf += n*self->elt_size;
+		elt_count -= n;
+		*peeked += n;
+	}
+
+exit:
 	storage->unlock(storage);
 	return ret;
 }
@@ -378,16 +929,31 @@ cir_storage_err_t cir_storage_clear(cir_storage_t * self, uint32_t elt_count)
 {
 	cir_storage_flash_t *storage = (cir_storage_flash_t *)self;
 	cir_storage_err_t ret = CBUFFER_STORAGE_SUCCESS;
-	int n = elt_count;
+	uint32_t stored;
 
 	storage->lock(storage);
 
-	while ((ret == CBUFFER_STORAGE_SUCCESS)
-		&& (READ_PTR(storage) != WRITE_PTR(storage))
-		&& ((elt_count == 0) || (n > 0))) {
-		ret = clear_one_element(storage);
-		n--;
+	stored = stored_count(storage);
+	if ((elt_count == 0) || (elt_count > stored)) {
+		elt_count = stored;
+	}
+	while ((ret == CBUFFER_STORAGE_SUCCESS) && (elt_count > 0)) {
+		uint32_t n = run_length(storage, READ_PTR(storage), elt_count);
+
+		ret = clear_run(storage, n);
+		elt_count -= n;
 	}
 	storage->unlock(storage);
 	return ret;
 }
+
+uint32_t cir_storage_get_count(cir_storage_t *self)
+{
+	cir_storage_flash_t *storage = (cir_storage_flash_t *)self;
+	uint32_t stored;
+
+	storage->lock(storage);
+	stored = stored_count(storage);
+	storage->unlock(storage);
+	return stored;
+}
@@ -43,6 +43,7 @@
  *
  * It exposes two APIs:
  * * a client API to push, pop, peek and clear elements from an existing storage, identified by its storage handle,
+ *   one element at a time or by runs of elements,
  * * a backend API used to initialize a storage.
  *   in order to initialize a circular buffer, cir_storage_flash_init() function
  *   should be called with a proper implementation of cir_storage_flash_t
@@ -81,6 +82,24 @@ typedef struct _cir_storage_t {
  */
 cir_storage_err_t cir_storage_push(cir_storage_t *self, uint8_t *buf);
 
+/**
+ * Push several elements in the circular buffer.
+ *
+ * Contiguous elements are written, with their status, in as few flash
+ * accesses as the block layout allows.
+ * @param self the pointer on the circular buffer.
+ * @param buf pointer to the elements to push, stored back to back.
+ * @param elt_count number of elements to push.
+ * @param pushed number of elements actually pushed, lower than elt_count on
+ *               error.
+ * @return cbuffer_storage_err_t error code.
+ *  CBUFFER_STORAGE_ERROR: Writing step failed, elements from the failing
+ *                         run are not pushed.
+ *  CBUFFER_STORAGE_SUCCESS: circular buffer push succeed.
+ */
+cir_storage_err_t cir_storage_push_n(cir_storage_t *self, uint8_t *buf,
+				     uint32_t elt_count, uint32_t *pushed);
+
 /**
  * Pop the oldest element from the circular buffer
  * Popped element is removed from the circular buffer.
@@ -94,6 +113,23 @@ cir_storage_err_t cir_storage_push(cir_storage_t *self, uint8_t *buf);
  */
 cir_storage_err_t cir_storage_pop(cir_storage_t *self, uint8_t *buf);
 
+/**
+ * Pop the oldest elements from the circular buffer.
+ * Popped elements are removed from the circular buffer.
+ * @param self the pointer on the circular buffer.
+ * @param buf pointer to the buffer to fill, of elt_count elements.
+ * @param elt_count maximum number of elements to pop.
+ * @param popped number of elements actually popped, lower than elt_count if
+ *               the circular buffer holds less elements.
+ * @return cbuffer_storage_err_t error code.
+ *  CBUFFER_STORAGE_EMPTY_ERROR: circular buffer is empty. Pop is not possible.
+ *  CBUFFER_STORAGE_ERROR: Reading or clearing step failed, only the
+ *                         popped elements are removed.
+ *  CBUFFER_STORAGE_SUCCESS: circular buffer pop succeed.
+ */
+cir_storage_err_t cir_storage_pop_n(cir_storage_t *self, uint8_t *buf,
+				    uint32_t elt_count, uint32_t *popped);
+
 /**
  * Read bytes from the circular buffer.
  * @param self the pointer on the circular buffer.
@@ -104,6 +140,23 @@ cir_storage_err_t cir_storage_pop(cir_storage_t *self, uint8_t *buf);
  */
 cir_storage_err_t cir_storage_peek(cir_storage_t *self, uint8_t *buf);
 
+/**
+ * Read elements from the circular buffer without removing them.
+ * @param self the pointer on the circular buffer.
+ * @param offset rank of the first element to read, 0 being the oldest.
+ * @param buf pointer to the buffer to fill, of elt_count elements.
+ * @param elt_count maximum number of elements to read.
+ * @param peeked number of elements actually read, lower than elt_count if
+ *               the circular buffer holds less elements after offset.
+ * @return cbuffer_storage_err_t error code.
+ *  CBUFFER_STORAGE_EMPTY_ERROR: no element is stored at offset.
+ *  CBUFFER_STORAGE_ERROR: Reading step failed.
+ *  CBUFFER_STORAGE_SUCCESS: circular buffer peek succeed.
+ */
+cir_storage_err_t cir_storage_peek_at(cir_storage_t *self, uint32_t offset,
+				      uint8_t *buf, uint32_t elt_count,
+				      uint32_t *peeked);
+
 /**
  * Clear data stored in the circular buffer.
  * @param self the pointer on the circular buffer.
@@ -114,6 +167,13 @@ cir_storage_err_t cir_storage_peek(cir_storage_t *self, uint8_t *buf);
  */
 cir_storage_err_t cir_storage_clear(cir_storage_t *self, uint32_t elt_count);
 
+/**
+ * Get the number of elements stored in the circular buffer.
+ * @param self the pointer on the circular buffer.
+ * @return number of elements that can be popped.
+ */
+uint32_t cir_storage_get_count(cir_storage_t *self);
+
 /** @} */
 
 #endif /* __CIR_STORAGE_H */
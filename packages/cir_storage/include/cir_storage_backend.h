@@ -53,7 +53,7 @@ typedef struct _cir_storage_flash_t cir_storage_flash_t;
 
 /**
  * Circular storage information.
- * This structure shall be filled by the backend (except wp and rp)
+ * This structure shall be filled by the backend (except wp, rp, seq and legacy)
  * and passed to the @ref cir_storage_flash_init "generic init function".
  */
 typedef struct _cir_storage_flash_t {
@@ -64,6 +64,8 @@ typedef struct _cir_storage_flash_t {
 	uint32_t last_offset; /*!< Last element offset in a block */
 	block_pointer_t wp;   /*!< Write Pointer */
 	block_pointer_t rp;   /*!< Read Pointer */
+	uint32_t seq;         /*!< Sequence number of the write block */
+	uint32_t legacy;      /*!< Set while the blocks keep the legacy layout */
 	int32_t (*read)(cir_storage_flash_t *, uint32_t, uint32_t, uint8_t *);  /*!< Read function */
 	int32_t (*write)(cir_storage_flash_t *, uint32_t, uint32_t, uint8_t *); /*!< Write function */
 	int32_t (*erase)(cir_storage_flash_t *, uint32_t, uint32_t);          /*!< Erase function */
@@ -0,0 +1,170 @@
+#!/usr/bin/env python
+
+# Copyright (c) 2016, Intel Corporation. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice,
+# this list of conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+# this list of conditions and the following disclaimer in the documentation
+# and/or other materials provided with the distribution.
+#
+# 3. Neither the name of the copyright holder nor the names of its contributors
+# may be used to endorse or promote products derived from this software without
+# specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+# LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+# SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+# CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+
+"""
+Format the binary log messages output in hexadecimal when
+CONFIG_LOG_CBUFFER_BINARY_HOST_DECODE is set, see bsp/src/infra/log_binary.c.
+
+A record is the address of the format string followed by the raw arguments:
+4 bytes per int, long and pointer, 8 bytes per long long and double, and the
+NULL-terminated copy of the strings. The format strings are read from the ELF
+file of the core which logged the message.
+"""
+
+from __future__ import print_function
+
+import argparse
+import re
+import struct
+import sys
+
+parser = argparse.ArgumentParser(description="Decode binary log messages")
+parser.add_argument('firmware_path', help='directory containing ELF binaries')
+parser.add_argument('log_file', nargs='?', help='log output, default stdin')
+args = parser.parse_args()
+
+# Log core name, as in the log_cores file, to ELF file
+ELF_FILES = {'QRK': 'quark.elf', 'ARC': 'arc.elf', '': 'quark.elf'}
+
+CONV = re.compile(r'%([-+ #0]*)(\*|\d+)?(?:\.(\*|\d*))?(hh|h|ll|l|j|z|t|L)?'
+                  r'([diouxXcspeEfFgGaAn%])')
+
+
+class Elf(object):
+    """Read the content of the allocated sections of a 32 bits ELF file"""
+
+    def __init__(self, path):
+        self.data = open(path, 'rb').read()
+        self.sections = []
+        if self.data[:4] != b'\x7fELF':
+            raise ValueError(path + ' is not an ELF file')
+        shoff, = struct.unpack_from('<I', self.data, 0x20)
+        shentsize, shnum = struct.unpack_from('<HH', self.data, 0x2e)
+        for i in range(shnum):
+            (sh_type, flags, addr, offset,
+             size) = struct.unpack_from('<IIIII', self.data,
+                                        shoff + i * shentsize + 4)
+            # SHT_PROGBITS sections loaded in memory
+            if sh_type == 1 and flags & 0x2:
+                self.sections.append((addr, offset, size))
+
+    def string(self, address):
+        for addr, offset, size in self.sections:
+            if addr <= address < addr + size:
+                start = offset + address - addr
+                end = self.data.index(b'\0', start)
+                return self.data[start:end].decode('ascii', 'replace')
+        return None
+
+
+elves = {}
+
+
+def get_elf(core):
+    if core not in elves:
+        name = ELF_FILES.get(core, 'quark.elf')
+        elves[core] = Elf(args.firmware_path + '/' + name)
+    return elves[core]
+
+
+def decode(elf, record):
+    """Format a record, truncated at the first missing argument"""
+    address, = struct.unpack_from('<I', record, 0)
+    fmt = elf.string(address)
+    if fmt is None:
+        return None
+    pos = [4]
+
+    def get(code):
+        size = struct.calcsize(code)
+        if pos[0] + size > len(record):
+            raise IndexError
+        val, = struct.unpack_from(code, record, pos[0])
+        pos[0] += size
+        return val
+
+    out = []
+    last = 0
+    try:
+        for m in CONV.finditer(fmt):
+            out.append(fmt[last:m.start()])
+            last = m.end()
+            flags, width, precision, length, conv = m.groups()
+            if conv == '%':
+                out.append('%')
+                continue
+            if width == '*':
+                width = str(get('<i'))
+            if precision == '*':
+                precision = str(get('<i'))
+            spec = '%' + flags + (width or '')
+            if precision is not None:
+                spec += '.' + precision
+            if conv in 'dic':
+                val = get('<q' if length in ('ll', 'j') else '<i')
+            elif conv in 'ouxX':
+                val = get('<Q' if length in ('ll', 'j') else '<I')
+            elif conv == 'p':
+                # The '#' flag must come before the width
+                spec, conv, val = '%#' + spec[1:], 'x', get('<I')
+            elif conv in 'eEfFgGaA':
+                val = get('<d')
+            elif conv == 'n':
+                continue
+            else:
+                end = record.index(b'\0', pos[0])
+                val = record[pos[0]:end].decode('ascii', 'replace')
+                pos[0] = end + 1
+            if conv == 'c':
+                spec, val = spec + 's', chr(val & 0xff)
+            elif conv in 'aA':
+                spec, val = spec + 's', float.hex(val)
+            else:
+                spec += {'i': 'd', 'u': 'd', 'F': 'f'}.get(conv, conv)
+            out.append(spec % val)
+        out.append(fmt[last:])
+    except (IndexError, ValueError):
+        pass
+    return ''.join(out)
+
+
+# A log line is: "timestamp|core|module|level| message"
+LINE = re.compile(r'^(\s*\d+\|([^|]*)\|[^|]*\|[^|]*\| )#([0-9a-f]+)\s*$')
+
+log = open(args.log_file) if args.log_file else sys.stdin
+for line in log:
+    m = LINE.match(line)
+    if m and len(m.group(3)) % 2 == 0 and len(m.group(3)) >= 8:
+        record = bytearray.fromhex(m.group(3))
+        text = decode(get_elf(m.group(2).strip()), bytes(record))
+        if text is not None:
+            line = m.group(1) + text + '\n'
+    sys.stdout.write(line)
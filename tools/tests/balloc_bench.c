@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2016, Intel Corporation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ *****************************************************************************
+ * Host benchmark of the balloc block lookup, i.e. the code executed with
+ * interrupts locked. Compares the legacy linear bit scan with the
+ * block_bitmap lookup on full and near-full pools.
+ *
+ * Compile with:
+ * gcc -O2 -I../../bsp/include balloc_bench.c -o balloc_bench
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+
+#include "util/block_bitmap.h"
+
+#define MAX_BLOCKS 2048
+#define LOOPS 2000
+
+static uint32_t track[BLOCK_BITMAP_TRACK_WORDS(MAX_BLOCKS)];
+static uint32_t full[BLOCK_BITMAP_FULL_WORDS(MAX_BLOCKS)];
+
+/* Block lookup of balloc before the block_bitmap was introduced */
+static int32_t legacy_alloc(uint32_t *track, uint16_t count)
+{
+	uint16_t block;
+
+	for (block = 0; block < count; block++) {
+		if ((track[block / 32] & BLOCK_BITMAP_MASK(block)) == 0) {
+			track[block / 32] |= BLOCK_BITMAP_MASK(block);
+			return block;
+		}
+	}
+	return -1;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Fill the pool, leaving only the last block free if near_full is set */
+static void fill_pool(uint16_t count, int near_full)
+{
+	uint16_t i;
+
+	memset(track, 0, sizeof(track));
+	memset(full, 0, sizeof(full));
+	for (i = 0; i < count; i++)
+		assert(block_bitmap_alloc(track, full, count) == i);
+	if (near_full)
+		block_bitmap_free(track, full, count - 1);
+}
+
+static void bench(uint16_t count, int near_full)
+{
+	uint64_t t, legacy_max = 0, bitmap_max = 0;
+	uint64_t legacy_sum = 0, bitmap_sum = 0;
+	int32_t expected = near_full ? count - 1 : -1;
+	int32_t block;
+	int i;
+
+	for (i = 0; i < LOOPS; i++) {
+		fill_pool(count, near_full);
+		t = now_ns();
+		block = legacy_alloc(track, count);
+		t = now_ns() - t;
+		assert(block == expected);
+		legacy_sum += t;
+		if (t > legacy_max)
+			legacy_max = t;
+
+		fill_pool(count, near_full);
+		t = now_ns();
+		block = block_bitmap_alloc(track, full, count);
+		t = now_ns() - t;
+		assert(block == expected);
+		bitmap_sum += t;
+		if (t > bitmap_max)
+			bitmap_max = t;
+	}
+
+	printf("%5d blocks %-9s | legacy avg %6llu max %6llu ns"
+	       " | bitmap avg %6llu max %6llu ns\n",
+	       count, near_full ? "near-full" : "full",
+	       (unsigned long long)(legacy_sum / LOOPS),
+	       (unsigned long long)legacy_max,
+	       (unsigned long long)(bitmap_sum / LOOPS),
+	       (unsigned long long)bitmap_max);
+}
+
+int main(int argc, char **argv)
+{
+	static const uint16_t counts[] = { 8, 32, 64, 256, 1024, MAX_BLOCKS };
+	unsigned int i;
+
+	for (i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+		bench(counts[i], 0);
+		bench(counts[i], 1);
+	}
+	return 0;
+}
@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2016, Intel Corporation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ *****************************************************************************
+ * Host benchmark of the event fan-out of cfw_send_event(). Compares the
+ * legacy delivery, one clone of the event per client, with the delivery of
+ * references to a single shared copy (message_share()), at 1 to 8 clients.
+ * Allocations are counted by wrapping balloc().
+ *
+ * The shared copy always saves allocations and copies, but the clones are
+ * faster below 8 clients on the host, where malloc() is cheap: the events
+ * are only shared from EVT_SHARE_MIN_CLIENTS clients (cfw_events.c).
+ *
+ * Compile with:
+ * gcc -O2 -pthread -DCONFIG_OS_LINUX -I../../bsp/include -Izephyr \
+ *     cfw_event_bench.c \
+ *     ../../bsp/src/infra/message_shared.c ../../bsp/src/os/linux/os_linux.c \
+ *     ../../bsp/src/util/timer_wheel.c -Wl,--wrap=balloc -o cfw_event_bench
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <assert.h>
+
+#include "os/os.h"
+#include "infra/message.h"
+
+#define EVENTS 100000
+#define MAX_CLIENTS 8
+
+static uint32_t alloc_count;
+static uint32_t alloc_bytes;
+
+void *__real_balloc(uint32_t size, OS_ERR_TYPE *err);
+
+void *__wrap_balloc(uint32_t size, OS_ERR_TYPE *err)
+{
+	alloc_count++;
+	alloc_bytes += size;
+	return __real_balloc(size, err);
+}
+
+void log_printk(uint8_t level, const char *module, const char *format, ...)
+{
+	va_list args;
+
+	va_start(args, format);
+	vfprintf(stderr, format, args);
+	va_end(args);
+	fputc('\n', stderr);
+}
+
+/* Messages received by the clients, freed after the fan-out */
+static struct message *received[MAX_CLIENTS];
+static uint32_t copied_bytes;
+
+static struct message *clone_message(struct message *msg)
+{
+	struct message *m = balloc(MESSAGE_LEN(msg), NULL);
+
+	memcpy(m, msg, MESSAGE_LEN(msg));
+	copied_bytes += MESSAGE_LEN(msg);
+	return m;
+}
+
+/* cfw_send_event() before the events were shared */
+static void fan_out_clone(struct message *msg, int clients)
+{
+	int i;
+
+	for (i = 0; i < clients; i++) {
+		received[i] = clone_message(msg);
+		MESSAGE_DST(received[i]) = i + 1;
+	}
+	for (i = 0; i < clients; i++)
+		bfree(received[i]);
+}
+
+/* cfw_send_event() with a shared copy, cloned for a single client */
+static void fan_out_shared(struct message *msg, int clients)
+{
+	struct message_ref *refs;
+	int i;
+
+	if (clients == 1) {
+		fan_out_clone(msg, clients);
+		return;
+	}
+	refs = message_share(msg, clients, NULL);
+	copied_bytes += MESSAGE_LEN(msg) + clients * sizeof(struct message);
+	for (i = 0; i < clients; i++) {
+		MESSAGE_DST(&refs[i].m) = i + 1;
+		received[i] = message_deref(&refs[i].m);
+		assert(received[i]->id == msg->id);
+	}
+	for (i = 0; i < clients; i++)
+		message_release(received[i]);
+}
+
+static void bench(void (*fan_out)(struct message *, int), const char *name,
+		  uint16_t len, int clients)
+{
+	static uint8_t buf[256];
+	struct message *msg = (struct message *)buf;
+	uint64_t t;
+	int i;
+
+	memset(buf, 0, sizeof(buf));
+	MESSAGE_ID(msg) = 0x1234;
+	MESSAGE_LEN(msg) = len;
+	alloc_count = alloc_bytes = copied_bytes = 0;
+
+	t = get_time_us();
+	for (i = 0; i < EVENTS; i++)
+		fan_out(msg, clients);
+	t = get_time_us() - t;
+
+	printf("%-6s %3d bytes, %d client(s): %5.2f allocs %5u bytes allocated"
+	       " %5u bytes copied %6llu ns per event\n", name, len, clients,
+	       (double)alloc_count / EVENTS, alloc_bytes / EVENTS,
+	       copied_bytes / EVENTS,
+	       (unsigned long long)(t * 1000 / EVENTS));
+}
+
+int main(int argc, char **argv)
+{
+	static const int clients[] = { 1, 2, 4, 6, MAX_CLIENTS };
+	static const uint16_t sizes[] = { 32, 128 };
+	unsigned int i, j;
+
+	os_init();
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		for (j = 0; j < sizeof(clients) / sizeof(clients[0]); j++) {
+			bench(fan_out_clone, "clone", sizes[i], clients[j]);
+			bench(fan_out_shared, "shared", sizes[i], clients[j]);
+		}
+	}
+	return 0;
+}
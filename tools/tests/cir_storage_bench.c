@@ -0,0 +1,282 @@
+/*
+ * Copyright (c) 2016, Intel Corporation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ *****************************************************************************
+ * Host benchmark of the circular storage library on the NOR flash simulator.
+ *
+ * For several element and block sizes, measures the push and pop throughput
+ * one element at a time and by runs of elements, the flash transactions and
+ * write amplification (bytes programmed per payload byte) of each, the
+ * erases of a steady push/pop load, and the time and flash reads taken by
+ * cir_storage_flash_init() to recover the pointers of a half-full storage.
+ * Finally checks the peek at an offset of a wrapped storage, and that a
+ * file-backed storage survives a remount.
+ *
+ * Host timings only cover the library and the simulator; on the target the
+ * transaction counts dominate, each one being a SPI command.
+ *
+ * Compile with:
+ * gcc -O2 -I../../packages/cir_storage/include cir_storage_bench.c \
+ *     cir_storage_nor_sim.c ../../packages/cir_storage/cir_storage.c \
+ *     -o cir_storage_bench
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cir_storage_nor_sim.h"
+
+#define BLOCK_COUNT 16
+#define RUN 32
+#define MAX_ELT_SIZE 128
+
+static uint8_t buf[RUN * MAX_ELT_SIZE];
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void fill(uint8_t *p, uint32_t elt_size, uint32_t first, uint32_t n)
+{
+	uint32_t i;
+
+	for (i = 0; i < n; i++)
+		memset(&p[i * elt_size], (uint8_t)(first + i), elt_size);
+}
+
+static void check(uint8_t *p, uint32_t elt_size, uint32_t first, uint32_t n)
+{
+	uint32_t i;
+
+	for (i = 0; i < n; i++)
+		assert(p[i * elt_size] == (uint8_t)(first + i) &&
+		       p[(i + 1) * elt_size - 1] == (uint8_t)(first + i));
+}
+
+static void print_stats(const char *name, struct nor_sim *sim, uint64_t ns,
+			uint32_t count, uint32_t elt_size, int payload_written)
+{
+	printf("  %-10s %7.0f ns/elt  %5.2f reads/elt  %5.2f writes/elt",
+	       name, (double)ns / count, (double)sim->stats.reads / count,
+	       (double)sim->stats.writes / count);
+	if (payload_written)
+		printf("  amplification %4.2f",
+		       (double)sim->stats.bytes_written /
+		       ((uint64_t)count * elt_size));
+	printf("\n");
+}
+
+/* Push then pop count elements, by runs of run elements */
+static void bench_transfer(struct nor_sim *sim, uint32_t count, uint32_t run)
+{
+	cir_storage_t *storage = &sim->storage.parent;
+	uint32_t elt_size = storage->elt_size;
+	uint32_t i, n, popped, pushed;
+	uint64_t t;
+
+	nor_sim_reset_stats(sim);
+	t = now_ns();
+	for (i = 0; i < count; i += n) {
+		n = count - i < run ? count - i : run;
+		fill(buf, elt_size, i, n);
+		if (run == 1)
+			assert(cir_storage_push(storage, buf) == 0);
+		else
+			assert(cir_storage_push_n(storage, buf, n,
+						  &pushed) == 0);
+	}
+	t = now_ns() - t;
+	print_stats(run == 1 ? "push" : "push_n", sim, t, count, elt_size, 1);
+
+	nor_sim_reset_stats(sim);
+	t = now_ns();
+	for (i = 0; i < count; i += n) {
+		n = count - i < run ? count - i : run;
+		if (run == 1)
+			assert(cir_storage_pop(storage, buf) == 0);
+		else
+			assert(cir_storage_pop_n(storage, buf, n,
+						 &popped) == 0 && popped == n);
+		check(buf, elt_size, i, n);
+	}
+	t = now_ns() - t;
+	print_stats(run == 1 ? "pop" : "pop_n", sim, t, count, elt_size, 0);
+	assert(sim->stats.violations == 0);
+}
+
+static void bench(uint32_t elt_size, uint32_t block_size)
+{
+	struct nor_sim sim;
+	uint32_t per_block = (block_size - 16) / (elt_size + 4);
+	/* stay clear of the block erased ahead of the write pointer */
+	uint32_t count = (BLOCK_COUNT - 2) * per_block;
+	block_pointer_t wp, rp;
+	uint32_t i, popped, pushed;
+	uint64_t t;
+
+	assert(nor_sim_init_ram(&sim, elt_size, block_size, BLOCK_COUNT) == 0);
+	assert(nor_sim_mount(&sim) == 0);
+	printf("elt %3u bytes, block %5u bytes, %u elements\n", elt_size,
+	       block_size, count);
+
+	bench_transfer(&sim, count, 1);
+	bench_transfer(&sim, count, RUN);
+
+	/* Steady load, several rounds over the whole storage */
+	nor_sim_reset_stats(&sim);
+	for (i = 0; i < 4 * count; i += RUN) {
+		assert(cir_storage_push_n(&sim.storage.parent, buf, RUN,
+					  &pushed) == 0);
+		assert(cir_storage_pop_n(&sim.storage.parent, buf, RUN,
+					 &popped) == 0);
+	}
+	printf("  steady     %5.2f erases/MB of payload\n",
+	       (double)sim.stats.erases * 1024 * 1024 /
+	       ((uint64_t)i * elt_size));
+
+	/* Recovery of a half-full storage, pointers in the middle blocks */
+	for (i = 0; i < count / 2; i += RUN)
+		assert(cir_storage_push_n(&sim.storage.parent, buf, RUN,
+					  &pushed) == 0);
+	for (i = 0; i < count / 4; i += RUN)
+		assert(cir_storage_pop_n(&sim.storage.parent, buf, RUN,
+					 &popped) == 0);
+	wp = sim.storage.wp;
+	rp = sim.storage.rp;
+	nor_sim_reset_stats(&sim);
+	t = now_ns();
+	assert(nor_sim_mount(&sim) == 0);
+	t = now_ns() - t;
+	assert(sim.storage.wp.offset == wp.offset &&
+	       sim.storage.rp.offset == rp.offset);
+	printf("  mount      %7.1f us  %5u reads  %7llu bytes read\n",
+	       (double)t / 1000, sim.stats.reads,
+	       (unsigned long long)sim.stats.bytes_read);
+
+	nor_sim_close(&sim);
+}
+
+/* Peek at offsets across blocks, the elements stay stored */
+static void check_peek_at(void)
+{
+	struct nor_sim sim;
+	cir_storage_t *storage = &sim.storage.parent;
+	uint32_t per_block = (4096 - 16) / (32 + 4);
+	uint32_t count = 3 * per_block;
+	uint32_t i, n, first, offset, peeked, popped, pushed;
+
+	assert(nor_sim_init_ram(&sim, 32, 4096, BLOCK_COUNT) == 0);
+	assert(nor_sim_mount(&sim) == 0);
+	assert(cir_storage_get_count(storage) == 0);
+	assert(cir_storage_peek_at(storage, 0, buf, 1, &peeked) ==
+	       CBUFFER_STORAGE_EMPTY_ERROR && peeked == 0);
+
+	/* Wrap the storage, then leave count elements from first */
+	for (i = 0; i < (BLOCK_COUNT - 2) * per_block; i += n) {
+		n = RUN;
+		fill(buf, 32, i, n);
+		assert(cir_storage_push_n(storage, buf, n, &pushed) == 0);
+		assert(cir_storage_pop_n(storage, buf, n, &popped) == 0);
+	}
+	first = i;
+	for (i = first; i < first + count; i += n) {
+		n = first + count - i < RUN ? first + count - i : RUN;
+		fill(buf, 32, i, n);
+		assert(cir_storage_push_n(storage, buf, n, &pushed) == 0);
+	}
+	assert(cir_storage_get_count(storage) == count);
+
+	for (offset = 0; offset < count; offset += 7) {
+		assert(cir_storage_peek_at(storage, offset, buf, RUN,
+					   &peeked) == 0);
+		n = count - offset < RUN ? count - offset : RUN;
+		assert(peeked == n);
+		check(buf, 32, first + offset, n);
+	}
+	assert(cir_storage_peek_at(storage, count, buf, 1, &peeked) ==
+	       CBUFFER_STORAGE_EMPTY_ERROR && peeked == 0);
+
+	/* Nothing was consumed */
+	assert(cir_storage_get_count(storage) == count);
+	assert(cir_storage_pop_n(storage, buf, RUN, &popped) == 0 &&
+	       popped == RUN);
+	check(buf, 32, first, RUN);
+	assert(cir_storage_get_count(storage) == count - RUN);
+	nor_sim_close(&sim);
+	printf("peek at offset ok\n");
+}
+
+/* A storage mapped on a file keeps its elements across processes */
+static void check_file(void)
+{
+	char path[] = "/tmp/cir_storage_bench_XXXXXX";
+	struct nor_sim sim;
+	uint32_t popped, pushed;
+	int fd = mkstemp(path);
+
+	assert(fd >= 0);
+	close(fd);
+	assert(nor_sim_init_file(&sim, path, 16, 4096, BLOCK_COUNT) == 0);
+	assert(nor_sim_mount(&sim) == 0);
+	fill(buf, 16, 0, RUN);
+	assert(cir_storage_push_n(&sim.storage.parent, buf, RUN, &pushed) == 0);
+	assert(pushed == RUN);
+	nor_sim_close(&sim);
+
+	assert(nor_sim_init_file(&sim, path, 16, 4096, BLOCK_COUNT) == 0);
+	assert(nor_sim_mount(&sim) == 0);
+	assert(cir_storage_pop_n(&sim.storage.parent, buf, RUN + 1,
+				 &popped) == 0 && popped == RUN);
+	check(buf, 16, 0, RUN);
+	nor_sim_close(&sim);
+	unlink(path);
+	printf("file backed storage remount ok\n");
+}
+
+int main(int argc, char **argv)
+{
+	static const uint32_t elt_sizes[] = { 8, 32, MAX_ELT_SIZE };
+	static const uint32_t block_sizes[] = { 4096, 65536 };
+	unsigned int i, j;
+
+	for (i = 0; i < sizeof(block_sizes) / sizeof(block_sizes[0]); i++)
+		for (j = 0; j < sizeof(elt_sizes) / sizeof(elt_sizes[0]); j++)
+			bench(elt_sizes[j], block_sizes[i]);
+	check_peek_at();
+	check_file();
+	return 0;
+}
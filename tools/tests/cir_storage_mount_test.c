@@ -0,0 +1,415 @@
+/*
+ * Copyright (c) 2016, Intel Corporation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ *****************************************************************************
+ * Host test of the circular storage mount after power losses, on the NOR
+ * flash simulator.
+ *
+ * Random runs of push_n/pop_n are interrupted by a power loss at a random
+ * flash access. The pointers found by cir_storage_flash_init() are then
+ * compared with the ones of a reference sequential scan of all the blocks
+ * and elements, the algorithm used before the binary search mount, which
+ * here also skips the blocks left by a previous storage. When the
+ * reference scan cannot find both pointers (power lost while a pointer was
+ * switching block), the mount must still recover a usable storage. In all
+ * cases the remaining elements must be the ones acknowledged before the
+ * power loss, in order: only the interrupted push_n or pop_n may have
+ * pushed part of its run, the last element of which may be torn, dropped
+ * the oldest block or popped part of its run. Finally, a storage of the
+ * legacy block layout, without sequence numbers, must be mounted and
+ * migrated once drained.
+ *
+ * Compile with:
+ * gcc -O2 -I../../packages/cir_storage/include cir_storage_mount_test.c \
+ *     cir_storage_nor_sim.c ../../packages/cir_storage/cir_storage.c \
+ *     -o cir_storage_mount_test
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdbool.h>
+
+#include "cir_storage_nor_sim.h"
+
+#define RUNS 20000
+#define BLOCK_SIZE 512
+#define BLOCK_COUNT 6
+#define MAX_RUN 12
+#define MAX_ELT_SIZE 60
+
+/* Flash layout, see cir_storage.c */
+#define INFO_SIZE 16
+#define SEQ 4
+#define WRITE_STATUS 8
+#define READ_STATUS 12
+#define MAGIC 0xABCE
+#define LEGACY_MAGIC 0xABCD
+#define LEGACY_INFO_SIZE 12
+#define LEGACY_WRITE_STATUS 4
+#define LEGACY_READ_STATUS 8
+#define BLOCK_CURRENT 0xAAAAAAAA
+#define BLOCK_USED 0x00000000
+#define ELT_EMPTY 0xFFFFFFFF
+#define ELT_READ 0x00000000
+
+static uint32_t word(struct nor_sim *sim, uint32_t address, uint32_t *reads)
+{
+	uint32_t w;
+
+	memcpy(&w, &sim->mem[address], sizeof(w));
+	(*reads)++;
+	return w;
+}
+
+/* Sequential scan of the blocks and elements, returns true if both
+ * pointers are found */
+static bool reference_scan(struct nor_sim *sim, block_pointer_t *wp,
+			   block_pointer_t *rp, uint32_t *reads)
+{
+	cir_storage_flash_t *storage = &sim->storage;
+	uint32_t elt_space = storage->parent.elt_size + 4;
+	uint32_t block_count = storage->block_last - storage->block_first + 1;
+	uint32_t first_seq = word(sim, storage->block_first * storage->block_size
+				  + SEQ, reads);
+	uint32_t block;
+
+	wp->offset = 0;
+	rp->offset = 0;
+	for (block = storage->block_first;
+	     block <= storage->block_last && (wp->offset == 0 || rp->offset == 0);
+	     block++) {
+		uint32_t base = block * storage->block_size;
+		uint32_t header = word(sim, base, reads);
+		bool has_wp, has_rp;
+		uint32_t offset;
+
+		int32_t seq = word(sim, base + SEQ, reads) - first_seq;
+
+		if ((header & 0xFFFF) != MAGIC ||
+		    (header >> 16) != storage->parent.elt_size)
+			break;
+		/* Block of a previous storage */
+		if (seq <= -(int32_t)block_count || seq >= (int32_t)block_count)
+			continue;
+		has_wp = word(sim, base + WRITE_STATUS, reads) == BLOCK_CURRENT;
+		has_rp = word(sim, base + READ_STATUS, reads) == BLOCK_CURRENT;
+		for (offset = base + INFO_SIZE;
+		     offset + elt_space <= base + storage->block_size &&
+		     ((has_wp && wp->offset == 0) || (has_rp && rp->offset == 0));
+		     offset += elt_space) {
+			uint32_t status = word(sim, offset, reads);
+
+			if (has_wp && wp->offset == 0 && status == ELT_EMPTY) {
+				wp->offset = offset;
+				wp->index = block;
+			}
+			if (has_rp && rp->offset == 0 && status != ELT_READ) {
+				rp->offset = offset;
+				rp->index = block;
+			}
+		}
+	}
+	return wp->offset != 0 && rp->offset != 0;
+}
+
+/* Elements acknowledged before the power loss: ids first to next - 1, and
+ * the ones the interrupted operation was pushing or popping */
+struct acked {
+	uint32_t first;
+	uint32_t next;
+	uint32_t push_left;
+	uint32_t pop_left;
+};
+
+/* Pop all the elements, they must be the acknowledged ones in order. The
+ * interrupted operation may have popped the first ones, pushed more of its
+ * own, of which the last one may be torn, or erased the oldest block. */
+static void check_content(struct nor_sim *sim, uint8_t *buf,
+			  struct acked *acked)
+{
+	uint32_t elt_size = sim->storage.parent.elt_size;
+	uint32_t per_block = (BLOCK_SIZE - INFO_SIZE) / (elt_size + 4);
+	uint32_t first = acked->first, next = acked->next;
+	uint32_t popped, i, id, lo = 0, hi = 0, count = 0;
+	bool torn = false;
+
+	while (cir_storage_pop_n(&sim->storage.parent, buf, MAX_RUN,
+				 &popped) == CBUFFER_STORAGE_SUCCESS) {
+		for (i = 0; i < popped; i++) {
+			memcpy(&id, &buf[i * elt_size], sizeof(id));
+			assert(!torn);
+			if (count == 0 ? (id < first ||
+					  id >= next + acked->push_left) :
+			    (id != hi)) {
+				/* Only the last pushed element may be torn */
+				assert(acked->push_left > 0);
+				torn = true;
+				id = count == 0 ? next : hi;
+				assert(id >= next);
+			}
+			if (count == 0)
+				lo = id;
+			hi = id + 1;
+			count++;
+		}
+	}
+
+	if (count == 0) {
+		assert(next - first <= acked->pop_left);
+		return;
+	}
+	assert(lo >= first);
+	if (acked->push_left > 0)
+		/* Whole blocks may have been dropped to make room, the
+		 * storage keeps at least the last BLOCK_COUNT - 2 of them */
+		assert(lo <= first ||
+		       lo <= next - (BLOCK_COUNT - 2) * per_block);
+	else
+		assert(lo <= first + acked->pop_left);
+	assert(hi >= next && hi <= next + acked->push_left);
+}
+
+/* Flash of a storage of the legacy layout, holding the elements 0 to
+ * total - 1 from start_block, the first read ones being read */
+static void write_legacy(struct nor_sim *sim, uint32_t start_block,
+			 uint32_t total, uint32_t read)
+{
+	cir_storage_flash_t *storage = &sim->storage;
+	uint32_t elt_size = storage->parent.elt_size;
+	uint32_t elt_space = elt_size + 4;
+	uint32_t per_block = (storage->block_size - LEGACY_INFO_SIZE) /
+			     elt_space;
+	uint32_t block_count = storage->block_last - storage->block_first + 1;
+	uint32_t header = LEGACY_MAGIC | (elt_size << 16);
+	uint32_t j, k, base, status;
+
+	/* Blocks of elements read before, all statuses cleared */
+	memset(sim->mem, 0, sim->size);
+	for (j = 0; j < block_count; j++)
+		memcpy(&sim->mem[(storage->block_first + j) *
+				 storage->block_size], &header, sizeof(header));
+
+	/* Blocks of the elements, erased by the switch of the write pointer */
+	for (j = 0; j <= total / per_block; j++) {
+		base = (storage->block_first + (start_block + j) % block_count) *
+		       storage->block_size;
+		memset(&sim->mem[base], 0xFF, storage->block_size);
+		memcpy(&sim->mem[base], &header, sizeof(header));
+		status = j < total / per_block ? BLOCK_USED : BLOCK_CURRENT;
+		memcpy(&sim->mem[base + LEGACY_WRITE_STATUS], &status,
+		       sizeof(status));
+		if (j <= read / per_block) {
+			status = j < read / per_block ? BLOCK_USED :
+				 BLOCK_CURRENT;
+			memcpy(&sim->mem[base + LEGACY_READ_STATUS], &status,
+			       sizeof(status));
+		}
+	}
+
+	for (k = 0; k < total; k++) {
+		base = (storage->block_first +
+			(start_block + k / per_block) % block_count) *
+		       storage->block_size + LEGACY_INFO_SIZE +
+		       (k % per_block) * elt_space;
+		status = k < read ? ELT_READ : 0xBBBBBBBB;
+		memcpy(&sim->mem[base], &status, sizeof(status));
+		memset(&sim->mem[base + 4], 0, elt_size);
+		memcpy(&sim->mem[base + 4], &k, sizeof(k));
+	}
+}
+
+/* A storage of the legacy layout is mounted, used, and migrated once its
+ * elements are read */
+static void check_legacy(uint8_t *buf)
+{
+	uint32_t elt_size = 20;
+	uint32_t per_block = (BLOCK_SIZE - LEGACY_INFO_SIZE) / (elt_size + 4);
+	uint32_t total = 2 * per_block + 5, read = per_block + 3;
+	uint32_t popped, pushed, peeked, header, i, id, next;
+	cir_storage_t *storage;
+	struct nor_sim sim;
+
+	assert(nor_sim_init_ram(&sim, elt_size, BLOCK_SIZE, BLOCK_COUNT) == 0);
+	storage = &sim.storage.parent;
+	write_legacy(&sim, BLOCK_COUNT - 2, total, read);
+	assert(nor_sim_mount(&sim) == 0);
+	assert(sim.storage.legacy);
+	assert(cir_storage_get_count(storage) == total - read);
+
+	/* Pushes switch blocks in the legacy layout, and survive a remount */
+	for (i = 0; i < per_block + 1; i++) {
+		next = total + i;
+		memcpy(&buf[i % MAX_RUN * elt_size], &next, sizeof(next));
+		if (i % MAX_RUN == MAX_RUN - 1 || i == per_block)
+			assert(cir_storage_push_n(storage, buf, i % MAX_RUN + 1,
+						  &pushed) == 0);
+	}
+	next = total + per_block + 1;
+	assert(nor_sim_mount(&sim) == 0);
+	assert(sim.storage.legacy);
+	assert(cir_storage_get_count(storage) == next - read);
+	assert(cir_storage_peek_at(storage, per_block, buf, 1, &peeked) == 0);
+	memcpy(&id, buf, sizeof(id));
+	assert(peeked == 1 && id == read + per_block);
+
+	for (i = read; i < next; i += popped) {
+		assert(cir_storage_pop_n(storage, buf, MAX_RUN, &popped) == 0);
+		for (id = 0; id < popped; id++)
+			assert(!memcmp(&buf[id * elt_size], &(uint32_t){ i + id },
+				       sizeof(uint32_t)));
+	}
+	assert(cir_storage_get_count(storage) == 0);
+
+	/* The first push on the drained storage migrates it */
+	for (i = 0; i < MAX_RUN; i++)
+		memcpy(&buf[i * elt_size], &i, sizeof(i));
+	assert(cir_storage_push_n(storage, buf, MAX_RUN, &pushed) == 0);
+	assert(!sim.storage.legacy);
+	memcpy(&header, &sim.mem[sim.storage.block_first * BLOCK_SIZE],
+	       sizeof(header));
+	assert((header & 0xFFFF) == MAGIC);
+	assert(nor_sim_mount(&sim) == 0);
+	assert(!sim.storage.legacy);
+	assert(cir_storage_pop_n(storage, buf, MAX_RUN + 1, &popped) == 0 &&
+	       popped == MAX_RUN);
+	for (i = 0; i < MAX_RUN; i++)
+		assert(!memcmp(&buf[i * elt_size], &i, sizeof(i)));
+	assert(sim.stats.violations == 0);
+	nor_sim_close(&sim);
+	printf("legacy storage mounted and migrated\n");
+}
+
+int main(int argc, char **argv)
+{
+	static const uint32_t elt_sizes[] = { 8, 20, MAX_ELT_SIZE };
+	uint8_t buf[MAX_RUN * MAX_ELT_SIZE];
+	uint32_t matched = 0, recovered = 0;
+	uint64_t ref_reads = 0, mount_reads = 0;
+	int run;
+
+	srand(1);
+	for (run = 0; run < RUNS; run++) {
+		uint32_t elt_size = elt_sizes[run % 3];
+		uint32_t reads = 0, popped, pushed, id, i, n;
+		struct acked acked;
+		block_pointer_t wp, rp;
+		struct nor_sim sim;
+		bool ok;
+
+		assert(nor_sim_init_ram(&sim, elt_size, BLOCK_SIZE,
+					BLOCK_COUNT) == 0);
+		/* Leave blocks of a previous storage behind */
+		if (run % 4 == 0) {
+			assert(nor_sim_mount(&sim) == 0);
+			for (i = 0; i < 100; i++)
+				cir_storage_push(&sim.storage.parent, buf);
+			assert(sim.storage.erase(&sim.storage, 0, 1) == 0);
+		}
+		assert(nor_sim_mount(&sim) == 0);
+
+		/* Random load until the power loss */
+		memset(&acked, 0, sizeof(acked));
+		nor_sim_cut_after(&sim, rand() % 600);
+		do {
+			n = rand() % MAX_RUN + 1;
+			acked.push_left = acked.pop_left = 0;
+			if (rand() % 3) {
+				for (i = 0; i < n; i++) {
+					id = acked.next + i;
+					memcpy(&buf[i * elt_size], &id,
+					       sizeof(id));
+				}
+				ok = cir_storage_push_n(&sim.storage.parent,
+							buf, n, &pushed) == 0;
+				acked.next += pushed;
+				if (!ok)
+					acked.push_left = n - pushed;
+			} else {
+				ok = cir_storage_pop_n(&sim.storage.parent,
+						       buf, n, &popped) != CBUFFER_STORAGE_ERROR;
+				for (i = 0; i < popped; i++) {
+					memcpy(&id, &buf[i * elt_size],
+					       sizeof(id));
+					assert(id == acked.first + i);
+				}
+				acked.first += popped;
+				if (!ok)
+					acked.pop_left = n - popped;
+			}
+			/* Pushing on a full storage drops the oldest block */
+			if (ok)
+				acked.first = acked.next -
+					cir_storage_get_count(
+						&sim.storage.parent);
+		} while (ok);
+		nor_sim_cut_after(&sim, -1);
+
+		ok = reference_scan(&sim, &wp, &rp, &reads);
+		ref_reads += reads;
+		nor_sim_reset_stats(&sim);
+		assert(nor_sim_mount(&sim) == 0);
+		mount_reads += sim.stats.reads;
+		assert(sim.stats.violations == 0);
+		if (ok) {
+			assert(sim.storage.wp.index == wp.index &&
+			       sim.storage.wp.offset == wp.offset);
+			assert(sim.storage.rp.index == rp.index &&
+			       sim.storage.rp.offset == rp.offset);
+			matched++;
+		} else {
+			recovered++;
+		}
+
+		check_content(&sim, buf, &acked);
+
+		/* The storage is consistent again */
+		for (i = 0; i < 3 * MAX_RUN; i++)
+			memcpy(&buf[(i % MAX_RUN) * elt_size], &i, sizeof(i));
+		assert(cir_storage_push_n(&sim.storage.parent, buf,
+					  MAX_RUN, &pushed) == 0);
+		assert(nor_sim_mount(&sim) == 0);
+		assert(reference_scan(&sim, &wp, &rp, &reads));
+		assert(sim.storage.wp.offset == wp.offset &&
+		       sim.storage.rp.offset == rp.offset);
+		assert(cir_storage_pop_n(&sim.storage.parent, buf, MAX_RUN,
+					 &popped) == 0 && popped == MAX_RUN);
+		assert(sim.stats.violations == 0);
+		nor_sim_close(&sim);
+	}
+
+	printf("%d power losses: %u same pointers as the sequential scan,"
+	       " %u recovered where it fails\n", RUNS, matched, recovered);
+	printf("mount reads: sequential scan %.1f, binary search %.1f\n",
+	       (double)ref_reads / RUNS, (double)mount_reads / RUNS);
+
+	check_legacy(buf);
+	return 0;
+}
@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) 2016, Intel Corporation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ *****************************************************************************
+ * Host NOR flash simulator backend of the circular storage library, see
+ * cir_storage_nor_sim.h.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "cir_storage_nor_sim.h"
+
+static int32_t nor_sim_read(cir_storage_flash_t *storage, uint32_t address,
+			    uint32_t data_size, uint8_t *data)
+{
+	struct nor_sim *sim = (struct nor_sim *)storage;
+
+	if (address + data_size > sim->size || sim->cut == 0)
+		return -1;
+	memcpy(data, &sim->mem[address], data_size);
+	sim->stats.reads++;
+	sim->stats.bytes_read += data_size;
+	return 0;
+}
+
+static int32_t nor_sim_write(cir_storage_flash_t *storage, uint32_t address,
+			     uint32_t data_size, uint8_t *data)
+{
+	struct nor_sim *sim = (struct nor_sim *)storage;
+	uint32_t i;
+
+	if (address + data_size > sim->size || sim->cut == 0)
+		return -1;
+	if (sim->cut > 0 && --sim->cut == 0)
+		/* Power lost while programming */
+		data_size = rand() % (data_size + 1);
+	/* Programming can only clear bits */
+	for (i = 0; i < data_size; i++) {
+		if ((sim->mem[address + i] & data[i]) != data[i]) {
+			sim->stats.violations++;
+			return -1;
+		}
+	}
+	memcpy(&sim->mem[address], data, data_size);
+	sim->stats.writes++;
+	sim->stats.bytes_written += data_size;
+	return sim->cut == 0 ? -1 : 0;
+}
+
+static int32_t nor_sim_erase(cir_storage_flash_t *storage, uint32_t first_block,
+			     uint32_t block_count)
+{
+	struct nor_sim *sim = (struct nor_sim *)storage;
+	uint32_t block_size = storage->block_size;
+
+	if ((first_block + block_count) * block_size > sim->size || sim->cut == 0)
+		return -1;
+	if (sim->cut > 0 && --sim->cut == 0 && rand() % 2)
+		/* Power lost before erasing */
+		return -1;
+	memset(&sim->mem[first_block * block_size], 0xFF,
+	       block_count * block_size);
+	sim->stats.erases += block_count;
+	return sim->cut == 0 ? -1 : 0;
+}
+
+/* Single threaded host: no locking */
+static void nor_sim_lock(cir_storage_flash_t *storage)
+{
+}
+
+static void nor_sim_unlock(cir_storage_flash_t *storage)
+{
+}
+
+static void nor_sim_setup(struct nor_sim *sim, uint32_t elt_size,
+			  uint32_t block_size, uint32_t block_count)
+{
+	memset(&sim->storage, 0, sizeof(sim->storage));
+	sim->storage.parent.buffer_size = block_count * block_size;
+	sim->storage.parent.elt_size = elt_size;
+	sim->storage.block_first = 0;
+	sim->storage.block_last = block_count - 1;
+	sim->storage.block_size = block_size;
+	sim->storage.read = nor_sim_read;
+	sim->storage.write = nor_sim_write;
+	sim->storage.erase = nor_sim_erase;
+	sim->storage.lock = nor_sim_lock;
+	sim->storage.unlock = nor_sim_unlock;
+	sim->size = block_count * block_size;
+	sim->cut = -1;
+	nor_sim_reset_stats(sim);
+}
+
+int nor_sim_init_ram(struct nor_sim *sim, uint32_t elt_size,
+		     uint32_t block_size, uint32_t block_count)
+{
+	nor_sim_setup(sim, elt_size, block_size, block_count);
+	sim->fd = -1;
+	sim->mem = malloc(sim->size);
+	if (sim->mem == NULL)
+		return -1;
+	memset(sim->mem, 0xFF, sim->size);
+	return 0;
+}
+
+int nor_sim_init_file(struct nor_sim *sim, const char *path,
+		      uint32_t elt_size, uint32_t block_size,
+		      uint32_t block_count)
+{
+	struct stat st;
+	void *mem;
+
+	nor_sim_setup(sim, elt_size, block_size, block_count);
+	sim->fd = open(path, O_RDWR | O_CREAT, 0644);
+	if (sim->fd < 0)
+		return -1;
+	if (fstat(sim->fd, &st) < 0 || ftruncate(sim->fd, sim->size) < 0)
+		goto err;
+	mem = mmap(NULL, sim->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		   sim->fd, 0);
+	if (mem == MAP_FAILED)
+		goto err;
+	sim->mem = mem;
+	/* A new or grown file is erased flash */
+	if (st.st_size < sim->size)
+		memset(&sim->mem[st.st_size], 0xFF, sim->size - st.st_size);
+	return 0;
+
+err:
+	close(sim->fd);
+	sim->fd = -1;
+	return -1;
+}
+
+int32_t nor_sim_mount(struct nor_sim *sim)
+{
+	return cir_storage_flash_init(&sim->storage);
+}
+
+void nor_sim_cut_after(struct nor_sim *sim, int32_t ops)
+{
+	sim->cut = ops < 0 ? -1 : ops + 1;
+}
+
+void nor_sim_reset_stats(struct nor_sim *sim)
+{
+	memset(&sim->stats, 0, sizeof(sim->stats));
+}
+
+void nor_sim_close(struct nor_sim *sim)
+{
+	if (sim->fd < 0) {
+		free(sim->mem);
+	} else {
+		munmap(sim->mem, sim->size);
+		close(sim->fd);
+	}
+	sim->mem = NULL;
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2016, Intel Corporation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ *****************************************************************************
+ * Host NOR flash simulator backend of the circular storage library.
+ *
+ * The flash is a RAM array, or a file mapped in memory so that the storage
+ * survives the process. Like a NOR flash, a write may only clear bits and
+ * bits are set back by whole block erases: a write setting a bit is refused
+ * and counted as a violation. Flash accesses are counted to compute the
+ * write amplification and the number of transactions of each operation.
+ *
+ * A power loss can be scheduled after a number of writes and erases: the
+ * interrupted write only programs a random part of its first bytes, the
+ * interrupted erase is done or not, and every access then fails until the
+ * power is restored.
+ */
+
+#ifndef __CIR_STORAGE_NOR_SIM_H
+#define __CIR_STORAGE_NOR_SIM_H
+
+#include <stdint.h>
+
+#include "cir_storage.h"
+#include "cir_storage_backend.h"
+
+/** Flash access counters */
+struct nor_sim_stats {
+	uint32_t reads;         /* read transactions */
+	uint32_t writes;        /* write transactions */
+	uint32_t erases;        /* erased blocks */
+	uint64_t bytes_read;
+	uint64_t bytes_written;
+	uint32_t violations;    /* writes refused for setting a bit */
+};
+
+/** Simulated flash, the storage must stay the first member */
+struct nor_sim {
+	cir_storage_flash_t storage;
+	uint8_t *mem;
+	uint32_t size;
+	int fd;                 /* mapped file, -1 for a RAM flash */
+	int32_t cut;            /* writes and erases before power loss, -1 never */
+	struct nor_sim_stats stats;
+};
+
+/**
+ * Set up a RAM flash of block_count blocks, erased.
+ *
+ * @return 0 on success, -1 on allocation failure
+ */
+int nor_sim_init_ram(struct nor_sim *sim, uint32_t elt_size,
+		     uint32_t block_size, uint32_t block_count);
+
+/**
+ * Set up a flash mapped on a file, created erased if it does not exist.
+ *
+ * @return 0 on success, -1 if the file cannot be created or mapped
+ */
+int nor_sim_init_file(struct nor_sim *sim, const char *path,
+		      uint32_t elt_size, uint32_t block_size,
+		      uint32_t block_count);
+
+/**
+ * Mount the circular storage on the simulated flash, i.e. call
+ * cir_storage_flash_init().
+ *
+ * @return value of cir_storage_flash_init()
+ */
+int32_t nor_sim_mount(struct nor_sim *sim);
+
+/**
+ * Schedule a power loss.
+ *
+ * @param sim simulated flash
+ * @param ops number of writes and erases completed before the power loss,
+ *            -1 to restore the power
+ */
+void nor_sim_cut_after(struct nor_sim *sim, int32_t ops);
+
+/** Reset the access counters */
+void nor_sim_reset_stats(struct nor_sim *sim);
+
+/** Release the flash, the file of a mapped flash is kept */
+void nor_sim_close(struct nor_sim *sim);
+
+#endif /* __CIR_STORAGE_NOR_SIM_H */
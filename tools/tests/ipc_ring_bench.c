@@ -0,0 +1,563 @@
+/*
+ * Copyright (c) 2016, Intel Corporation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ *****************************************************************************
+ * Host benchmark of the inter-core messages of Quark SE, with the two cores
+ * run as threads. Each core has a simulated mailbox: a synchronous request
+ * wakes up the interrupt thread of the remote core and waits for its
+ * acknowledge, and an ipc port thread runs the requests posted by
+ * ipc_async_send_message() and ipc_async_free_message().
+ *
+ * A producer on the first core sends messages to a consumer on the second
+ * core, which frees them: the frees go back to the first core, which owns
+ * the memory. The number of messages in flight is bounded, as by a memory
+ * pool. A mailbox round-trip is given a fixed duration. The messages are
+ * sent by bursts, then one at a time at a low rate, and are sent:
+ * - by one mailbox request per message and per free;
+ * - through the shared memory rings, with one doorbell request per batch,
+ *   following the protocol of bsp/src/machine/soc/intel/quark_se/common/ipc.c;
+ * - through the rings, the frees waiting for a batch of FREE_BATCH frees, a
+ *   message to the other core or the free timer before ringing the doorbell.
+ *
+ * The consumer checks the order of the messages, and measures the latency
+ * from their sending. The rings rely on the ordering of the memory accesses
+ * of x86.
+ *
+ * Compile with:
+ * gcc -O2 -pthread -I../../bsp/include ipc_ring_bench.c \
+ *     ../../bsp/src/util/spsc_ring.c -o ipc_ring_bench
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "util/spsc_ring.h"
+
+#define MESSAGES 50000
+#define MAX_IN_FLIGHT 64
+#define BURST 8
+#define RING_SIZE 16
+#define FREE_BATCH 8
+#define FREE_DELAY_US 1000
+#define SPARSE_MESSAGES 5000
+#define SPARSE_PERIOD_US 200
+#define FIFO_SIZE 1024
+/* Duration of a mailbox round-trip, the sending core waits for the interrupt
+ * of the other core */
+#define MBX_LATENCY_US 20
+
+/* Mailbox requests */
+enum { REQ_MESSAGE = 1, REQ_FREE, REQ_RING };
+/* Messages of the ipc port */
+enum { PORT_SEND = 1, PORT_FREE, PORT_DOORBELL };
+
+struct msg {
+	uint32_t seq;
+	uint64_t date;
+};
+
+struct fifo_item {
+	int id;
+	void *ptr;
+};
+
+struct fifo {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct fifo_item items[FIFO_SIZE];
+	uint32_t head;
+	uint32_t tail;
+	bool closed;
+};
+
+struct core {
+	struct core *remote;
+	bool use_ring;
+	uint32_t free_batch;
+
+	/* Mailbox of the requests to this core */
+	pthread_mutex_t mbx_lock;
+	pthread_cond_t mbx_cond;
+	int mbx_request;
+	void *mbx_ptr;
+	bool mbx_busy;
+	bool mbx_ack;
+	bool stop;
+
+	/* Rings to this core */
+	struct spsc_ring messages;
+	struct spsc_ring frees;
+	void *message_slots[RING_SIZE];
+	void *free_slots[RING_SIZE];
+
+	/* Sender state, irq_lock stands for irq_lock() */
+	pthread_mutex_t irq_lock;
+	bool doorbell_pending;
+	uint32_t pending_sends;
+
+	struct fifo port_queue;
+	struct fifo app_queue;
+	pthread_t isr_thread;
+	pthread_t port_thread;
+
+	/* Statistics */
+	uint64_t requests;
+	uint64_t doorbells;
+	uint64_t received;
+	uint64_t rx_frees;
+	uint64_t rx_doorbells;
+	uint32_t max_batch;
+};
+
+static struct core cores[2];
+
+static uint32_t messages;
+static bool sparse;
+static volatile bool timer_stop;
+
+/* Messages in flight, owned by the first core */
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_cond = PTHREAD_COND_INITIALIZER;
+static uint32_t in_flight;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void fifo_init(struct fifo *f)
+{
+	pthread_mutex_init(&f->lock, NULL);
+	pthread_cond_init(&f->cond, NULL);
+	f->head = f->tail = 0;
+	f->closed = false;
+}
+
+static void fifo_push(struct fifo *f, int id, void *ptr)
+{
+	pthread_mutex_lock(&f->lock);
+	assert(f->head - f->tail < FIFO_SIZE);
+	f->items[f->head % FIFO_SIZE].id = id;
+	f->items[f->head % FIFO_SIZE].ptr = ptr;
+	f->head++;
+	pthread_cond_signal(&f->cond);
+	pthread_mutex_unlock(&f->lock);
+}
+
+/* Returns false once the fifo is closed and empty */
+static bool fifo_pop(struct fifo *f, struct fifo_item *item)
+{
+	pthread_mutex_lock(&f->lock);
+	while (f->head == f->tail && !f->closed)
+		pthread_cond_wait(&f->cond, &f->lock);
+	if (f->head == f->tail) {
+		pthread_mutex_unlock(&f->lock);
+		return false;
+	}
+	*item = f->items[f->tail % FIFO_SIZE];
+	f->tail++;
+	pthread_mutex_unlock(&f->lock);
+	return true;
+}
+
+static void fifo_close(struct fifo *f)
+{
+	pthread_mutex_lock(&f->lock);
+	f->closed = true;
+	pthread_cond_broadcast(&f->cond);
+	pthread_mutex_unlock(&f->lock);
+}
+
+/* ipc_request_sync_int(): post a request to the mailbox of the remote core
+ * and wait for its acknowledge */
+static void mbx_request(struct core *core, int request, void *ptr)
+{
+	struct core *remote = core->remote;
+
+	struct timespec latency = { 0, MBX_LATENCY_US * 1000 };
+
+	core->requests++;
+	nanosleep(&latency, NULL);
+	pthread_mutex_lock(&remote->mbx_lock);
+	assert(!remote->mbx_busy);
+	remote->mbx_request = request;
+	remote->mbx_ptr = ptr;
+	remote->mbx_ack = false;
+	remote->mbx_busy = true;
+	pthread_cond_broadcast(&remote->mbx_cond);
+	while (!remote->mbx_ack)
+		pthread_cond_wait(&remote->mbx_cond, &remote->mbx_lock);
+	remote->mbx_busy = false;
+	pthread_mutex_unlock(&remote->mbx_lock);
+}
+
+static void message_free(struct msg *m)
+{
+	free(m);
+	pthread_mutex_lock(&pool_lock);
+	in_flight--;
+	pthread_cond_signal(&pool_cond);
+	pthread_mutex_unlock(&pool_lock);
+}
+
+/* ipc_ring_receive() */
+static void ring_receive(struct core *core)
+{
+	uint32_t count = 0;
+	void *m;
+
+	while ((m = spsc_ring_pop(&core->frees))) {
+		message_free(m);
+		count++;
+	}
+	core->rx_frees += count;
+	while ((m = spsc_ring_pop(&core->messages))) {
+		fifo_push(&core->app_queue, 0, m);
+		count++;
+	}
+	core->received += count;
+	core->rx_doorbells++;
+	if (count > core->max_batch)
+		core->max_batch = count;
+}
+
+/* Mailbox interrupt of a core */
+static void *isr_thread(void *param)
+{
+	struct core *core = param;
+	int request;
+	void *ptr;
+
+	for (;;) {
+		pthread_mutex_lock(&core->mbx_lock);
+		while (!(core->mbx_busy && !core->mbx_ack) && !core->stop)
+			pthread_cond_wait(&core->mbx_cond, &core->mbx_lock);
+		if (core->stop) {
+			pthread_mutex_unlock(&core->mbx_lock);
+			return NULL;
+		}
+		request = core->mbx_request;
+		ptr = core->mbx_ptr;
+		pthread_mutex_unlock(&core->mbx_lock);
+
+		switch (request) {
+		case REQ_MESSAGE:
+			fifo_push(&core->app_queue, 0, ptr);
+			break;
+		case REQ_FREE:
+			message_free(ptr);
+			break;
+		case REQ_RING:
+			ring_receive(core);
+			break;
+		}
+
+		pthread_mutex_lock(&core->mbx_lock);
+		core->mbx_ack = true;
+		pthread_cond_broadcast(&core->mbx_cond);
+		pthread_mutex_unlock(&core->mbx_lock);
+	}
+}
+
+/* ring_send_overflow() */
+static void ring_send_overflow(struct core *core, void *m)
+{
+	bool pushed = false, notify = false;
+
+	if (core->use_ring) {
+		pushed = spsc_ring_push(&core->remote->messages, m);
+		if (!pushed) {
+			core->doorbells++;
+			mbx_request(core, REQ_RING, NULL);
+			pushed = spsc_ring_push(&core->remote->messages, m);
+		}
+	}
+	if (!pushed)
+		mbx_request(core, REQ_MESSAGE, m);
+
+	pthread_mutex_lock(&core->irq_lock);
+	core->pending_sends--;
+	if (pushed) {
+		notify = !core->doorbell_pending;
+		core->doorbell_pending = true;
+	}
+	pthread_mutex_unlock(&core->irq_lock);
+	if (notify)
+		fifo_push(&core->port_queue, PORT_DOORBELL, NULL);
+}
+
+/* handle_ipc_request_port() */
+static void *port_thread(void *param)
+{
+	struct core *core = param;
+	struct fifo_item item;
+
+	while (fifo_pop(&core->port_queue, &item)) {
+		switch (item.id) {
+		case PORT_SEND:
+			ring_send_overflow(core, item.ptr);
+			break;
+		case PORT_FREE:
+			mbx_request(core, REQ_FREE, item.ptr);
+			break;
+		case PORT_DOORBELL:
+			pthread_mutex_lock(&core->irq_lock);
+			core->doorbell_pending = false;
+			pthread_mutex_unlock(&core->irq_lock);
+			core->doorbells++;
+			mbx_request(core, REQ_RING, NULL);
+			break;
+		}
+	}
+	return NULL;
+}
+
+/* ring_push_locked() */
+static bool ring_push_locked(struct core *core, struct spsc_ring *ring,
+			     void *ptr, bool *notify)
+{
+	if (!spsc_ring_push(ring, ptr))
+		return false;
+	*notify = !core->doorbell_pending;
+	core->doorbell_pending = true;
+	return true;
+}
+
+/* ipc_async_send_message() */
+static void async_send(struct core *core, struct msg *m)
+{
+	bool pushed = false, notify = false;
+
+	pthread_mutex_lock(&core->irq_lock);
+	if (core->use_ring && !core->pending_sends)
+		pushed = ring_push_locked(core, &core->remote->messages, m,
+					  &notify);
+	if (!pushed)
+		core->pending_sends++;
+	pthread_mutex_unlock(&core->irq_lock);
+
+	if (!pushed)
+		fifo_push(&core->port_queue, PORT_SEND, m);
+	else if (notify)
+		fifo_push(&core->port_queue, PORT_DOORBELL, NULL);
+}
+
+/* ipc_async_free_message() */
+static void async_free(struct core *core, struct msg *m)
+{
+	bool pushed = false, notify = false;
+
+	pthread_mutex_lock(&core->irq_lock);
+	if (core->use_ring)
+		pushed = spsc_ring_push(&core->remote->frees, m);
+	if (pushed && !core->doorbell_pending &&
+	    spsc_ring_count(&core->remote->frees) >= core->free_batch)
+		notify = core->doorbell_pending = true;
+	pthread_mutex_unlock(&core->irq_lock);
+
+	if (!pushed)
+		fifo_push(&core->port_queue, PORT_FREE, m);
+	else if (notify)
+		fifo_push(&core->port_queue, PORT_DOORBELL, NULL);
+}
+
+/* free_timer_expired() */
+static void free_flush(struct core *core)
+{
+	bool notify = false;
+
+	pthread_mutex_lock(&core->irq_lock);
+	if (spsc_ring_count(&core->remote->frees) && !core->doorbell_pending)
+		notify = core->doorbell_pending = true;
+	pthread_mutex_unlock(&core->irq_lock);
+
+	if (notify)
+		fifo_push(&core->port_queue, PORT_DOORBELL, NULL);
+}
+
+/* Free timer of the consumer core, expiring every FREE_DELAY_US */
+static void *timer_thread(void *param)
+{
+	struct timespec delay = { 0, FREE_DELAY_US * 1000 };
+
+	while (!timer_stop) {
+		nanosleep(&delay, NULL);
+		free_flush(&cores[1]);
+	}
+	return NULL;
+}
+
+static void *producer_thread(void *param)
+{
+	struct timespec period = { 0, SPARSE_PERIOD_US * 1000 };
+	uint32_t burst = sparse ? 1 : BURST;
+	struct core *core = param;
+	struct msg *m;
+	uint32_t i;
+
+	for (i = 0; i < messages; i++) {
+		/* Bursts of messages, as a sensor sending a batch of samples,
+		 * or single messages at a low rate */
+		if (sparse)
+			nanosleep(&period, NULL);
+		if (i % burst == 0) {
+			pthread_mutex_lock(&pool_lock);
+			while (in_flight > MAX_IN_FLIGHT - burst)
+				pthread_cond_wait(&pool_cond, &pool_lock);
+			in_flight += burst;
+			pthread_mutex_unlock(&pool_lock);
+		}
+
+		m = malloc(sizeof(*m));
+		assert(m);
+		m->seq = i;
+		m->date = now_ns();
+		async_send(core, m);
+	}
+	return NULL;
+}
+
+static void run(const char *name, bool use_ring, uint32_t free_batch)
+{
+	pthread_t timer;
+	uint64_t start, latency_total = 0, latency_max = 0, latency, elapsed;
+	struct fifo_item item;
+	pthread_t producer;
+	uint64_t requests;
+	uint32_t i;
+	int c;
+
+	for (c = 0; c < 2; c++) {
+		struct core *core = &cores[c];
+
+		core->remote = &cores[1 - c];
+		core->use_ring = use_ring;
+		core->free_batch = free_batch;
+		pthread_mutex_init(&core->mbx_lock, NULL);
+		pthread_cond_init(&core->mbx_cond, NULL);
+		pthread_mutex_init(&core->irq_lock, NULL);
+		core->mbx_busy = core->mbx_ack = core->stop = false;
+		core->doorbell_pending = false;
+		core->pending_sends = 0;
+		core->requests = core->doorbells = core->received = 0;
+		core->rx_frees = core->rx_doorbells = 0;
+		core->max_batch = 0;
+		spsc_ring_init(&core->messages, core->message_slots, RING_SIZE);
+		spsc_ring_init(&core->frees, core->free_slots, RING_SIZE);
+		fifo_init(&core->port_queue);
+		fifo_init(&core->app_queue);
+		pthread_create(&core->isr_thread, NULL, isr_thread, core);
+		pthread_create(&core->port_thread, NULL, port_thread, core);
+	}
+
+	/* The second core consumes the messages of the first one */
+	timer_stop = false;
+	pthread_create(&timer, NULL, timer_thread, NULL);
+	start = now_ns();
+	pthread_create(&producer, NULL, producer_thread, &cores[0]);
+	for (i = 0; i < messages; i++) {
+		struct msg *m;
+
+		assert(fifo_pop(&cores[1].app_queue, &item));
+		m = item.ptr;
+		assert(m->seq == i);
+		latency = now_ns() - m->date;
+		latency_total += latency;
+		if (latency > latency_max)
+			latency_max = latency;
+		async_free(&cores[1], m);
+	}
+	pthread_join(producer, NULL);
+	pthread_mutex_lock(&pool_lock);
+	while (in_flight)
+		pthread_cond_wait(&pool_cond, &pool_lock);
+	pthread_mutex_unlock(&pool_lock);
+	elapsed = now_ns() - start;
+	timer_stop = true;
+	pthread_join(timer, NULL);
+
+	/* Doorbells may still be pending, the interrupts are stopped last */
+	for (c = 0; c < 2; c++) {
+		fifo_close(&cores[c].port_queue);
+		pthread_join(cores[c].port_thread, NULL);
+	}
+	for (c = 0; c < 2; c++) {
+		struct core *core = &cores[c];
+
+		pthread_mutex_lock(&core->mbx_lock);
+		core->stop = true;
+		pthread_cond_broadcast(&core->mbx_cond);
+		pthread_mutex_unlock(&core->mbx_lock);
+		pthread_join(core->isr_thread, NULL);
+	}
+	assert(spsc_ring_count(&cores[1].messages) == 0);
+	assert(spsc_ring_count(&cores[0].frees) == 0);
+
+	requests = cores[0].requests + cores[1].requests;
+	printf("%s: %.0f messages/s, latency avg %.1f us max %.1f us,"
+	       " %.2f mailbox requests per message\n", name,
+	       messages * 1e9 / elapsed, latency_total / 1e3 / messages,
+	       latency_max / 1e3, (double)requests / messages);
+	if (use_ring)
+		printf("    %lu doorbells, %.1f messages and frees per doorbell,"
+		       " max %u\n", cores[0].doorbells + cores[1].doorbells,
+		       (double)(cores[0].received + cores[1].received) /
+		       (cores[0].doorbells + cores[1].doorbells),
+		       cores[0].max_batch > cores[1].max_batch ?
+		       cores[0].max_batch : cores[1].max_batch);
+	if (use_ring)
+		printf("    %.1f frees per doorbell of the consumer core\n",
+		       (double)cores[0].rx_frees / cores[0].rx_doorbells);
+}
+
+int main(int argc, char **argv)
+{
+	printf("Bursts of %d messages\n", BURST);
+	messages = MESSAGES;
+	sparse = false;
+	run("mailbox request per message", false, 1);
+	run("shared memory rings", true, 1);
+	run("shared memory rings, batched frees", true, FREE_BATCH);
+
+	printf("A message every %d us\n", SPARSE_PERIOD_US);
+	messages = SPARSE_MESSAGES;
+	sparse = true;
+	run("mailbox request per message", false, 1);
+	run("shared memory rings", true, 1);
+	run("shared memory rings, batched frees", true, FREE_BATCH);
+	return 0;
+}
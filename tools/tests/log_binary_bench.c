@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) 2016, Intel Corporation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ *****************************************************************************
+ * Host benchmark of the binary log messages of the cbuffer log, see
+ * bsp/src/infra/log_binary.c.
+ *
+ * Typical log messages are either formatted by the caller, as vsnprintf()
+ * in log_write_msg(), or encoded by log_binary_pack(), the formatting being
+ * deferred to log_binary_format() in the logger task. The text formatted by
+ * both must be the same, including when it is truncated. The time spent by
+ * the caller and the size of the message in the cbuffer are compared.
+ *
+ * Compile with:
+ * gcc -O2 -I../../bsp/src/infra log_binary_bench.c \
+ *     ../../bsp/src/infra/log_binary.c -o log_binary_bench
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdarg.h>
+#include <assert.h>
+#include <time.h>
+
+#include "log_binary.h"
+
+#define LOG_MAX_MSG_LEN 80
+#define ITERATIONS 200000
+
+/* Size of the header of a message in the cbuffer, see log_message_t */
+#define HEADER_LEN 13
+
+/* Size of the header of a binary message, see struct log_binary_header */
+#define BINARY_HEADER_LEN 8
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* What the caller does, with each encoding */
+static int text_write(char *buf, const char *format, ...)
+{
+	va_list args;
+	int len;
+
+	va_start(args, format);
+	len = vsnprintf(buf, LOG_MAX_MSG_LEN, format, args);
+	va_end(args);
+	if (len >= LOG_MAX_MSG_LEN)
+		len = LOG_MAX_MSG_LEN - 1;
+	return len;
+}
+
+static int binary_write(uint8_t *buf, const char *format, ...)
+{
+	va_list args;
+	int len;
+
+	va_start(args, format);
+	len = log_binary_pack(buf, LOG_MAX_MSG_LEN, format, args);
+	va_end(args);
+	return len;
+}
+
+/* The messages, called with the same arguments by both encodings */
+#define MESSAGES(write, buf, i) \
+	write(buf, "Error locking ipc %d", (int)i); \
+	write(buf, "cfw: send msg %x to port %d, id %d", (unsigned)i * 7, \
+	      (int)i & 15, 0x1234); \
+	write(buf, "%s: block %u erased in %u ms", "ll_storage", (unsigned)i, \
+	      12u); \
+	write(buf, "Battery level %3d%%, %4d mV, temp %d", (int)i % 101, \
+	      3700 + (int)i % 500, -5); \
+	write(buf, "adv started, addr %02x:%02x:%02x:%02x:%02x:%02x", 0xc1, \
+	      0x22, 0x43, 0x54, 0x65, (int)i & 0xff); \
+	write(buf, "%-8s|%*d|%.3s|%lu|%lld|%c|%p", "pad", 6, (int)i, "abcdef", \
+	      (unsigned long)i, (long long)i << 33, 'x', (void *)buf); \
+	write(buf, "%.2f%% done, %s", 12.5 + i, \
+	      "a string long enough to truncate the message of the binary log " \
+	      "as well as the text one");
+
+#define MESSAGE_COUNT 7
+
+static int check_i;
+static uint8_t check_record[LOG_MAX_MSG_LEN];
+
+/* Format the binary record, compare with the text */
+static int check_write(char *buf, const char *format, ...)
+{
+	char text[LOG_MAX_MSG_LEN];
+	char decoded[LOG_MAX_MSG_LEN];
+	va_list args;
+	int len, text_len, decoded_len;
+
+	va_start(args, format);
+	text_len = vsnprintf(text, sizeof(text), format, args);
+	va_end(args);
+	if (text_len >= LOG_MAX_MSG_LEN)
+		text_len = LOG_MAX_MSG_LEN - 1;
+	va_start(args, format);
+	len = log_binary_pack(check_record, sizeof(check_record), format, args);
+	va_end(args);
+
+	decoded_len = log_binary_format(decoded, sizeof(decoded), check_record,
+					len);
+	/* The binary record may truncate before the text */
+	if (decoded_len > text_len || strncmp(text, decoded, decoded_len) ||
+	    (len < (int)sizeof(check_record) && decoded_len != text_len)) {
+		printf("mismatch:\n  text   \"%s\"\n  binary \"%s\"\n", text,
+		       decoded);
+		exit(1);
+	}
+	check_i++;
+	(void)buf;
+	return len;
+}
+
+int main(int argc, char **argv)
+{
+	char text[LOG_MAX_MSG_LEN];
+	uint8_t record[LOG_MAX_MSG_LEN];
+	char decoded[LOG_MAX_MSG_LEN];
+	uint64_t text_bytes = 0, binary_bytes = 0;
+	uint64_t t_text, t_binary, t_format;
+	long i;
+
+	/* Same text */
+	for (i = 0; i < 1000; i++) {
+		MESSAGES(check_write, text, i)
+	}
+	assert(check_i == 1000 * MESSAGE_COUNT);
+
+	/* Same text, truncated records */
+	for (i = 0; i < LOG_MAX_MSG_LEN; i++) {
+		int len = binary_write(record, "%d %s %d", 1234, "str", 5678);
+		int n = log_binary_format(decoded, sizeof(decoded), record,
+					  len < i ? len : i);
+		assert(strncmp(decoded, "1234 str 5678", n) == 0);
+	}
+
+	/* Strings bounded by their precision need not be NULL-terminated */
+	for (i = 0; i < 8; i++) {
+		static const char chars[4] = { 'a', 'b', 'c', 'd' };
+		int len = binary_write(record, "%.4s|%.*s|%d", chars, (int)i % 5,
+				       chars, 42);
+		log_binary_format(decoded, sizeof(decoded), record, len);
+		snprintf(text, sizeof(text), "abcd|%.*s|42", (int)i % 5, "abcd");
+		assert(strcmp(decoded, text) == 0);
+	}
+
+	t_text = now_ns();
+	for (i = 0; i < ITERATIONS; i++) {
+		MESSAGES(text_bytes += HEADER_LEN + text_write, text, i)
+	}
+	t_text = now_ns() - t_text;
+
+	t_binary = now_ns();
+	for (i = 0; i < ITERATIONS; i++) {
+		MESSAGES(binary_bytes += BINARY_HEADER_LEN + binary_write, record,
+			 i)
+	}
+	t_binary = now_ns() - t_binary;
+
+	/* The formatting deferred to the logger task */
+	t_format = now_ns();
+	for (i = 0; i < ITERATIONS * MESSAGE_COUNT; i++) {
+		int len = binary_write(record, "cfw: send msg %x to port %d",
+				       (unsigned)i, (int)i & 15);
+		log_binary_format(decoded, sizeof(decoded), record, len);
+	}
+	t_format = now_ns() - t_format;
+
+	printf("%d messages, %d-bit pointers\n", ITERATIONS * MESSAGE_COUNT,
+	       (int)sizeof(void *) * 8);
+	printf("caller, text:   %6.1f ns/msg, %5.1f bytes/msg in the cbuffer\n",
+	       (double)t_text / (ITERATIONS * MESSAGE_COUNT),
+	       (double)text_bytes / (ITERATIONS * MESSAGE_COUNT));
+	printf("caller, binary: %6.1f ns/msg, %5.1f bytes/msg in the cbuffer\n",
+	       (double)t_binary / (ITERATIONS * MESSAGE_COUNT),
+	       (double)binary_bytes / (ITERATIONS * MESSAGE_COUNT));
+	printf("logger task, pack and format: %6.1f ns/msg\n",
+	       (double)t_format / (ITERATIONS * MESSAGE_COUNT));
+	return 0;
+}
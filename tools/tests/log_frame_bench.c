@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2016, Intel Corporation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+
+ *****************************************************************************
+ * Host simulation of the transfer of the log messages of a slave core to the
+ * log master, see bsp/src/infra/log_impl_cbuffer.c.
+ *
+ * The slave logs bursts of messages in its circular log buffer, where the
+ * oldest messages are overwritten when it is full. Its logger task sends the
+ * messages to the master either one per IPC request, or as many as the frame
+ * of the master can hold. Each request costs a fixed time: the synchronous
+ * IPC round-trip, the wake up of the master logger task and the return of
+ * the buffer or frame to the slave. The time is simulated, by steps of 1 us.
+ *
+ * Compile with:
+ * gcc -O2 log_frame_bench.c -o log_frame_bench
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#define CBUFFER_SIZE 1024
+#define FRAME_SIZE 512
+/* Header of a message, see log_message_t */
+#define HEADER_LEN 13
+/* Maximum length of a message */
+#define MAX_MSG_LEN (HEADER_LEN + 80)
+/* Time spent per IPC request, in us */
+#define REQUEST_US 60
+/* Time to copy a byte of a message to the frame or buffer, in ns */
+#define COPY_NS 20
+
+#define QUEUE_LEN 4096
+
+struct scenario {
+	const char *name;
+	int bursts;             /* number of bursts */
+	int burst_len;          /* messages per burst */
+	int period_us;          /* time between two messages of a burst */
+	int idle_us;            /* time between two bursts */
+};
+
+/* The messages in the cbuffer, by length */
+static int queue[QUEUE_LEN];
+static int head, tail, used;
+
+static void run(const struct scenario *sc, int frame_size)
+{
+	long now = 0, busy_until = 0, logged = 0, sent = 0, lost = 0;
+	long requests = 0;
+	int burst = 0, in_burst = 0;
+	long next_log = 0;
+
+	head = tail = used = 0;
+	srand(1);
+	while (burst < sc->bursts || used > 0 || now < busy_until) {
+		/* The slave logs a message */
+		if (burst < sc->bursts && now >= next_log) {
+			int len = HEADER_LEN + 20 + rand() % 40;
+
+			/* Overwrite the oldest messages */
+			while (used + len > CBUFFER_SIZE) {
+				used -= queue[tail];
+				tail = (tail + 1) % QUEUE_LEN;
+				lost++;
+			}
+			queue[head] = len;
+			head = (head + 1) % QUEUE_LEN;
+			used += len;
+			logged++;
+			next_log = now + sc->period_us;
+			if (++in_burst == sc->burst_len) {
+				in_burst = 0;
+				burst++;
+				next_log = now + sc->idle_us;
+			}
+		}
+
+		/* The logger task sends a request once the previous is done */
+		if (now >= busy_until && used > 0) {
+			int len = 0;
+			/* A frame is filled while a message of maximum length
+			 * fits */
+			do {
+				len += queue[tail];
+				used -= queue[tail];
+				tail = (tail + 1) % QUEUE_LEN;
+				sent++;
+			} while (used > 0 && len + MAX_MSG_LEN <= frame_size);
+			requests++;
+			busy_until = now + REQUEST_US + len * COPY_NS / 1000;
+		}
+		now++;
+	}
+
+	printf("%-22s %-10s %6ld logged %6ld lost %6ld requests %7.1f ms\n",
+	       sc->name, frame_size > MAX_MSG_LEN ? "frames" : "per msg",
+	       logged, lost, requests, now / 1000.0);
+	if (sent + lost != logged)
+		exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	static const struct scenario scenarios[] = {
+		{ "sensor bursts, 5us", 50, 100, 5, 20000 },
+		{ "sensor bursts, 20us", 50, 100, 20, 20000 },
+		{ "sensor bursts, 100us", 50, 100, 100, 20000 },
+		{ "steady, 1 per ms", 1, 2000, 1000, 0 },
+	};
+	unsigned int i;
+
+	for (i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+		run(&scenarios[i], MAX_MSG_LEN);
+		run(&scenarios[i], FRAME_SIZE - 6);
+	}
+	return 0;
+}
@@ -0,0 +1,291 @@
+/*
+ * Copyright (c) 2016, Intel Corporation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+
+ *****************************************************************************
+ * Host stress test of the lock-free log ring, see bsp/src/util/mpsc_ring.c.
+ *
+ * Producer threads write records of random length, made of their id, a
+ * counter and a pattern derived from both, as fast as they can, while a
+ * consumer thread reads them. The threads are preempted at any point by the
+ * host scheduler, and the copies of the ring yield the processor at random,
+ * so that writers are lapped in the middle of a record and records are
+ * overwritten while the consumer copies them. The consumer checks that:
+ * - no record read is torn, i.e. its pattern is intact;
+ * - the records of a producer are read in order;
+ * - the records read and the records reported lost add up to the records
+ *   written, modulo 65536 as the lost count of each read;
+ * - once the producers stop, it reads up to the head of the ring: no record
+ *   dropped by its writer blocks it.
+ * The same is checked first without threads, a record being dropped after
+ * a partial claim while an interrupt laps the ring.
+ *
+ * Compile with:
+ * gcc -O2 -pthread -Izephyr -I../../bsp/include mpsc_ring_stress.c \
+ *     ../../bsp/src/util/mpsc_ring.c -Wl,--wrap=memcpy -o mpsc_ring_stress
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "util/mpsc_ring.h"
+
+#define PRODUCERS 4
+#define WRITES 500000
+#define MAX_LEN 93
+#define HEADER_LEN 9
+
+struct config {
+	uint32_t count;
+	uint16_t slot_size;
+};
+
+static struct mpsc_ring ring;
+static uint32_t buf[4096];
+static volatile int producers_done;
+static long written, dropped;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread unsigned int yield_seed = 1;
+static __thread int interrupt_pending;
+
+static void interrupt(void);
+
+void *__real_memcpy(void *dst, const void *src, size_t n);
+
+/* Preempt the copies at random, or by the pending interrupt */
+void *__wrap_memcpy(void *dst, const void *src, size_t n)
+{
+	if (interrupt_pending) {
+		interrupt_pending = 0;
+		interrupt();
+	}
+	if (rand_r(&yield_seed) % 32 == 0)
+		sched_yield();
+	return __real_memcpy(dst, src, n);
+}
+
+static uint8_t pattern(uint8_t id, uint32_t counter, int i)
+{
+	return (uint8_t)(id * 31 + counter * 7 + i * 13);
+}
+
+/* Record: id, counter, length, then the pattern */
+static int make_record(uint8_t *rec, uint8_t id, uint32_t counter, int len)
+{
+	int i;
+
+	rec[0] = id;
+	memcpy(&rec[1], &counter, sizeof(counter));
+	memcpy(&rec[5], &len, sizeof(uint32_t));
+	for (i = HEADER_LEN; i < len; i++)
+		rec[i] = pattern(id, counter, i);
+	return len;
+}
+
+static void *producer(void *arg)
+{
+	uint8_t id = (uint8_t)(long)arg;
+	uint8_t rec[MAX_LEN];
+	unsigned int seed = id;
+
+	yield_seed = id + 1;
+	long drops = 0;
+	uint32_t counter;
+
+	for (counter = 0; counter < WRITES; counter++) {
+		int len = make_record(rec, id, counter,
+				      HEADER_LEN + rand_r(&seed) %
+				      (MAX_LEN - HEADER_LEN + 1));
+		if (mpsc_ring_write(&ring, rec, len) != 0)
+			drops++;
+		if (rand_r(&seed) % 64 == 0)
+			sched_yield();
+	}
+	pthread_mutex_lock(&stats_lock);
+	written += WRITES;
+	dropped += drops;
+	pthread_mutex_unlock(&stats_lock);
+	return NULL;
+}
+
+/* Lap the ring of 8 slots of 32 bytes, written from position 1 while the
+ * record at position 0 is copied. The record at positions 7 and 8 claims
+ * slot 7, then finds slot 0 still written and is dropped. */
+static void interrupt(void)
+{
+	uint8_t rec[MAX_LEN];
+	uint32_t counter;
+
+	for (counter = 1; counter <= 8; counter++) {
+		int len = make_record(rec, 1, counter,
+				      counter == 7 ? 30 : HEADER_LEN);
+		if ((mpsc_ring_write(&ring, rec, len) != 0) != (counter == 7)) {
+			printf("interrupt: record %u not written as expected\n",
+			       counter);
+			exit(1);
+		}
+	}
+}
+
+/* The records dropped by the interrupt must not block the consumer, which
+ * reads up to the last one */
+static int check_lapped_writer(void)
+{
+	uint8_t rec[MAX_LEN];
+	uint32_t counter = 0, head;
+	uint16_t lost;
+
+	mpsc_ring_init(&ring, (uint8_t *)buf, 8, 32);
+	interrupt_pending = 1;
+	mpsc_ring_write(&ring, rec, make_record(rec, 0, 0, HEADER_LEN));
+	while (mpsc_ring_read(&ring, rec, sizeof(rec), &lost) > 0)
+		memcpy(&counter, &rec[1], sizeof(counter));
+	head = atomic_get(&ring.head) & ((1 << MPSC_RING_POS_BITS) - 1);
+	if (ring.tail != head || counter != 8) {
+		printf("lapped writer: consumer blocked at %u, head at %u, "
+		       "last record %u\n", ring.tail, head, counter);
+		return 1;
+	}
+	return 0;
+}
+
+struct result {
+	long read;
+	long lost;
+};
+
+static void check_record(const uint8_t *rec, int len, int64_t *last)
+{
+	uint32_t counter, rec_len;
+	int i;
+
+	memcpy(&counter, &rec[1], sizeof(counter));
+	memcpy(&rec_len, &rec[5], sizeof(rec_len));
+	if (len < HEADER_LEN || rec[0] >= PRODUCERS || rec_len != (uint32_t)len) {
+		printf("torn record header: len %d id %u len %u\n", len, rec[0],
+		       rec_len);
+		exit(1);
+	}
+	for (i = HEADER_LEN; i < len; i++) {
+		if (rec[i] != pattern(rec[0], counter, i)) {
+			printf("torn record: producer %u counter %u byte %d\n",
+			       rec[0], counter, i);
+			exit(1);
+		}
+	}
+	if ((int64_t)counter <= last[rec[0]]) {
+		printf("producer %u: counter %u after %lld\n", rec[0], counter,
+		       (long long)last[rec[0]]);
+		exit(1);
+	}
+	last[rec[0]] = counter;
+}
+
+static void *consumer(void *arg)
+{
+	struct result *res = arg;
+	int64_t last[PRODUCERS];
+	uint8_t rec[MAX_LEN];
+	int i;
+	uint16_t lost;
+
+	for (i = 0; i < PRODUCERS; i++)
+		last[i] = -1;
+	while (1) {
+		/* The ring does not change after the producers stop */
+		int done = producers_done;
+		int len = mpsc_ring_read(&ring, rec, sizeof(rec), &lost);
+		if (len > 0) {
+			res->read++;
+			res->lost += lost;
+			check_record(rec, len, last);
+			continue;
+		}
+		if (done)
+			break;
+		sched_yield();
+	}
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	static const struct config configs[] = {
+		{ 8, 32 }, { 32, 32 }, { 64, 64 }, { 256, 16 },
+	};
+	unsigned int c;
+	long i;
+
+	if (check_lapped_writer())
+		return 1;
+	for (c = 0; c < sizeof(configs) / sizeof(configs[0]); c++) {
+		pthread_t threads[PRODUCERS], cons;
+		struct result res = { 0, 0 };
+		uint32_t head;
+		uint16_t unread;
+
+		mpsc_ring_init(&ring, (uint8_t *)buf, configs[c].count,
+			       configs[c].slot_size);
+		producers_done = 0;
+		written = dropped = 0;
+		pthread_create(&cons, NULL, consumer, &res);
+		for (i = 0; i < PRODUCERS; i++)
+			pthread_create(&threads[i], NULL, producer, (void *)i);
+		for (i = 0; i < PRODUCERS; i++)
+			pthread_join(threads[i], NULL);
+		producers_done = 1;
+		pthread_join(cons, NULL);
+
+		printf("%3u slots of %3u bytes: %ld written, %ld read, %ld lost "
+		       "(%ld dropped by writers)\n", configs[c].count,
+		       configs[c].slot_size, written, res.read, res.lost,
+		       dropped);
+		/* All the committed records are read */
+		head = atomic_get(&ring.head);
+		if (ring.tail != (head & ((1 << MPSC_RING_POS_BITS) - 1))) {
+			printf("consumer blocked at %u, head at %u\n", ring.tail,
+			       head & ((1 << MPSC_RING_POS_BITS) - 1));
+			return 1;
+		}
+		/* All the records are read or reported lost, but the ones
+		 * dropped after the last one read */
+		unread = (uint16_t)((head >> MPSC_RING_POS_BITS) -
+				    ring.next_record);
+		if ((written - res.read - res.lost - unread) % 65536 != 0) {
+			printf("%ld records not accounted for\n",
+			       written - res.read - res.lost - unread);
+			return 1;
+		}
+	}
+	return 0;
+}
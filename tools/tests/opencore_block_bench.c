@@ -0,0 +1,218 @@
+/*
+ * Copyright (c) 2016, Intel Corporation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ *****************************************************************************
+ * Host replay benchmark of the block exec of the raw data feed. Replays raw
+ * data nodes of random sizes of an accelerometer into the raw data feed
+ * with the direct feed loop of FeedSensDataDirectly(): once frame by frame
+ * through exec, the reports being committed by CommitReadyReports() after
+ * each frame, once with sensor_rawdata_prepare_exec_block(), which copies
+ * runs of frames and commits each report as soon as it is full. As in
+ * opencore_algo_engine.c, the block call is only used for nodes giving more
+ * than one frame, and takes the frames one by one when a report holds a
+ * single frame. Both runs must commit the same reports; the cost is reported
+ * per raw frame.
+ *
+ * Compile with:
+ * gcc -O2 opencore_block_bench.c -o opencore_block_bench
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+
+#define MAX_NODE_FRAMES 25
+#define ROUNDS 200000
+/* RAW_SENSOR_DATA_COUNT of opencore_rawdata.c */
+#define REPORT_FRAMES 5
+
+struct accel_frame {
+	int16_t ax;
+	int16_t ay;
+	int16_t az;
+};
+
+/* Exposed raw data sensor, with the report buffer */
+struct exposed {
+	uint8_t rpt_data_buf[REPORT_FRAMES * sizeof(struct accel_frame)];
+	int rpt_data_buf_len;
+	int data_frame_count;
+	int ready_flag;
+	/* host side of OpencoreCommitSensData() */
+	uint32_t checksum;
+	uint32_t reports;
+};
+
+static void commit(struct exposed *exposed)
+{
+	int i;
+
+	for (i = 0; i < exposed->rpt_data_buf_len; i++)
+		exposed->checksum = exposed->checksum * 31 +
+				    exposed->rpt_data_buf[i];
+	exposed->reports++;
+	exposed->ready_flag = 0;
+}
+
+/* sensor_rawdata_prepare_exec(), without the calibration process */
+static int exec(struct exposed *exposed, const uint8_t *data, int frame_size)
+{
+	memcpy(exposed->rpt_data_buf + exposed->data_frame_count * frame_size,
+	       data, frame_size);
+	exposed->data_frame_count++;
+	if (exposed->data_frame_count * frame_size ==
+	    exposed->rpt_data_buf_len) {
+		exposed->data_frame_count = 0;
+		exposed->ready_flag = 1;
+		return 1;
+	}
+	return 0;
+}
+
+/* sensor_rawdata_prepare_exec_block(), without the calibration process */
+static int exec_block(struct exposed *exposed, const uint8_t *data,
+		      int count, int stride, int frame_size)
+{
+	int frames = exposed->rpt_data_buf_len / frame_size;
+	int n, k, run;
+	uint8_t *dst;
+
+	for (n = 0; n < count;) {
+		/* nothing to batch with one frame per report */
+		if (frames == 1) {
+			if (exec(exposed, data, frame_size))
+				commit(exposed);
+			data += stride;
+			n++;
+			continue;
+		}
+		run = frames - exposed->data_frame_count;
+		if (run > count - n)
+			run = count - n;
+		dst = exposed->rpt_data_buf +
+		      exposed->data_frame_count * frame_size;
+		if (stride == frame_size) {
+			memcpy(dst, data, run * frame_size);
+		} else {
+			for (k = 0; k < run; k++)
+				memcpy(dst + k * frame_size, data + k * stride,
+				       frame_size);
+		}
+		data += run * stride;
+		n += run;
+		exposed->data_frame_count += run;
+		if (exposed->data_frame_count == frames) {
+			exposed->data_frame_count = 0;
+			commit(exposed);
+		}
+	}
+	return 0;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Replay ROUNDS raw data nodes, return ns per raw frame */
+static double replay(struct exposed *exposed, int gap, int report_frames,
+		     int use_block)
+{
+	static struct accel_frame raw[MAX_NODE_FRAMES];
+	int frame_size = sizeof(struct accel_frame);
+	int raw_data_offset = 0;
+	uint64_t t, frames = 0;
+	const uint8_t *buffer;
+	int r, j, n, count, node_frames;
+
+	memset(exposed, 0, sizeof(*exposed));
+	exposed->rpt_data_buf_len = report_frames * frame_size;
+	srand(gap * 100 + report_frames);
+
+	t = now_ns();
+	for (r = 0; r < ROUNDS; r++) {
+		node_frames = rand() % MAX_NODE_FRAMES + 1;
+		for (j = 0; j < node_frames; j++) {
+			raw[j].ax = r + j;
+			raw[j].ay = r * 3 - j;
+			raw[j].az = r ^ j;
+		}
+		frames += node_frames;
+
+		/* FeedSensDataDirectly() */
+		buffer = (const uint8_t *)raw + raw_data_offset * frame_size;
+		count = 0;
+		if (raw_data_offset < node_frames)
+			count = (node_frames - raw_data_offset + gap - 1) / gap;
+		if (count > 1 && use_block) {
+			exec_block(exposed, buffer, count, gap * frame_size,
+				   frame_size);
+		} else {
+			for (n = 0; n < count; n++, buffer += gap * frame_size)
+				if (exec(exposed, buffer, frame_size))
+					commit(exposed);
+		}
+		raw_data_offset += gap * count - node_frames;
+	}
+	t = now_ns() - t;
+	return (double)t / frames;
+}
+
+static void bench(int gap, int report_frames)
+{
+	struct exposed frame, block;
+	double frame_ns, block_ns;
+
+	frame_ns = replay(&frame, gap, report_frames, 0);
+	block_ns = replay(&block, gap, report_frames, 1);
+
+	/* the same reports must have been committed */
+	assert(frame.reports == block.reports);
+	assert(frame.checksum == block.checksum);
+	assert(frame.data_frame_count == block.data_frame_count);
+
+	printf("gap %d, %d frames/report | %7u reports | exec %5.1f ns/frame"
+	       " | exec_block %5.1f ns/frame\n",
+	       gap, report_frames, frame.reports, frame_ns, block_ns);
+}
+
+int main(int argc, char **argv)
+{
+	bench(1, 1);
+	bench(1, REPORT_FRAMES);
+	bench(2, REPORT_FRAMES);
+	bench(4, 3);
+	return 0;
+}
@@ -0,0 +1,464 @@
+/*
+ * Copyright (c) 2016, Intel Corporation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ *****************************************************************************
+ * Host replay benchmark of the open core feed matcher. Replays the raw data
+ * nodes of several physical sensors into a synchronized feed, once with the
+ * legacy arithmetic of FeedSensDataAfterMatch() / HandleMatchBufferData()
+ * (LCMs and float divisions computed on every call), once with the
+ * resampling plan compiled by RefleshSensorCore(). Both runs must feed the
+ * algorithm with the same samples; the cost is reported per raw sample.
+ *
+ * The host has an FPU: on the ARC core, where each float operation is a
+ * library call, the legacy figures are worse.
+ *
+ * Compile with:
+ * gcc -O2 opencore_resample_bench.c -o opencore_resample_bench
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+
+#define MAX_DEMANDS 4
+#define MATCH_REPO 64
+#define NODE_FRAMES 20
+#define ROUNDS 20000
+#define IGNORE (1 << 1)
+
+struct demand {
+	int freq;       /* Hz */
+	uint8_t flag;
+	uint16_t phy_freq;      /* ODR of the physical sensor, Hz x 10 */
+	int match_buffer[MATCH_REPO];
+	uint16_t match_data_count;
+	uint16_t put_idx;
+	uint16_t get_idx;
+	int16_t raw_data_offset;
+	/* resampling plan */
+	uint16_t si;
+	uint16_t gap;
+	uint16_t target_count;
+	uint16_t match_count;
+	uint8_t scale;
+};
+
+struct feed {
+	struct demand demand[MAX_DEMANDS];
+	int demand_length;
+	uint16_t vernier_length;
+	/* algorithm side */
+	uint32_t checksum;
+	uint32_t exec_count;
+};
+
+/* Helpers of opencore_method.c */
+static uint16_t GetCommonDivisor(uint16_t next_freq, uint16_t prev_multiple)
+{
+	uint16_t temp;
+
+	if (next_freq < prev_multiple) {
+		temp = next_freq;
+		next_freq = prev_multiple;
+		prev_multiple = temp;
+	}
+	temp = next_freq % prev_multiple;
+	while (temp != 0) {
+		next_freq = prev_multiple;
+		prev_multiple = temp;
+		temp = next_freq % prev_multiple;
+	}
+	return prev_multiple;
+}
+
+static uint16_t GetCommonMultiple(uint16_t next_freq, uint16_t prev_multiple)
+{
+	return next_freq * prev_multiple / GetCommonDivisor(next_freq,
+							    prev_multiple);
+}
+
+static int ValueRound(float value)
+{
+	int rslt = value;
+	int temp = ((int)(value * 10)) % 10;
+
+	if (temp >= 5)
+		rslt++;
+	return rslt;
+}
+
+static uint16_t IntDivRound(uint32_t num, uint32_t den)
+{
+	return (2 * num + den) / (2 * den);
+}
+
+static void exec(struct feed *feed, int **ptr)
+{
+	int i;
+
+	for (i = 0; i < feed->demand_length; i++)
+		if (ptr[i] != NULL)
+			feed->checksum = feed->checksum * 31 + *ptr[i] * (i + 1);
+	feed->exec_count++;
+}
+
+static void copy_to_delay_buf(struct demand *demand, const int *buffer,
+			      int gap, int count)
+{
+	int idx = gap * count + demand->raw_data_offset;
+
+	demand->match_buffer[demand->put_idx] = buffer[idx];
+	demand->put_idx++;
+	demand->match_data_count++;
+	if (demand->put_idx == MATCH_REPO)
+		demand->put_idx = 0;
+	if (demand->put_idx == demand->get_idx) {
+		demand->get_idx++;
+		if (demand->get_idx == MATCH_REPO)
+			demand->get_idx = 0;
+		demand->match_data_count--;
+	}
+}
+
+static int *take_sample(struct demand *demand)
+{
+	int *ptr = &demand->match_buffer[demand->get_idx];
+
+	demand->get_idx++;
+	demand->match_data_count--;
+	if (demand->get_idx >= MATCH_REPO)
+		demand->get_idx = 0;
+	return ptr;
+}
+
+/* HandleMatchBufferData() before the resampling plans */
+static void legacy_handle_match(struct feed *feed)
+{
+	struct demand *demand = feed->demand;
+	int demand_length = feed->demand_length;
+	uint8_t data_match_not_ready_flag = 0;
+	uint16_t cm_time_consume = 1;
+	uint8_t match_times = 0;
+	int i, v;
+
+	for (i = 0; i < demand_length; i++) {
+		if (demand[i].freq == 0 || (demand[i].flag & IGNORE) != 0)
+			continue;
+		cm_time_consume = GetCommonMultiple(cm_time_consume,
+			ValueRound((float)1000 / demand[i].freq));
+	}
+	for (i = 0; i < demand_length; i++) {
+		if (demand[i].freq == 0 || (demand[i].flag & IGNORE) != 0)
+			continue;
+		if (demand[i].match_data_count < cm_time_consume /
+		    ValueRound((float)1000 / demand[i].freq)) {
+			data_match_not_ready_flag++;
+		} else {
+			int temp = demand[i].match_data_count / (cm_time_consume /
+				ValueRound((float)1000 / demand[i].freq));
+			if (match_times == 0 || temp < match_times)
+				match_times = temp;
+		}
+	}
+	if (data_match_not_ready_flag != 0)
+		return;
+
+	int vernier_length = 0;
+	uint16_t cm_multi_freq = 1;
+	int8_t scale[MAX_DEMANDS] = { 0 };
+
+	for (i = 0; i < demand_length; i++) {
+		if (demand[i].freq == 0)
+			continue;
+		cm_multi_freq = GetCommonMultiple(cm_multi_freq, demand[i].freq);
+	}
+	for (i = 0; i < demand_length; i++) {
+		int count;
+		if (demand[i].freq == 0)
+			continue;
+		scale[i] = cm_multi_freq / demand[i].freq;
+		count = match_times * (cm_time_consume /
+			ValueRound((float)1000 / demand[i].freq));
+		if (vernier_length == 0 || vernier_length < count * scale[i])
+			vernier_length = count * scale[i];
+	}
+	for (v = 0; v < vernier_length; v++) {
+		int *ptr[MAX_DEMANDS] = { NULL };
+		int act = 0;
+		for (i = 0; i < demand_length; i++) {
+			if (demand[i].freq == 0 || scale[i] == 0)
+				continue;
+			if (v % scale[i] == 0 &&
+			    demand[i].get_idx != demand[i].put_idx) {
+				ptr[i] = take_sample(&demand[i]);
+				act++;
+			}
+		}
+		if (act != 0)
+			exec(feed, ptr);
+	}
+}
+
+/* FeedSensDataAfterMatch(SYNC) before the resampling plans */
+static void legacy_feed(struct feed *feed, const int *buffer[])
+{
+	struct demand *demand = feed->demand;
+	uint32_t cm_time_consume = 1;
+	int count[MAX_DEMANDS] = { 0 };
+	int done[MAX_DEMANDS] = { 0 };
+	int i;
+
+	for (i = 0; i < feed->demand_length; i++)
+		cm_time_consume = GetCommonMultiple(cm_time_consume,
+			ValueRound((float)1000 / demand[i].freq));
+	while (1) {
+		int defect = 0;
+		for (i = 0; i < feed->demand_length; i++) {
+			if (done[i]) {
+				defect++;
+				continue;
+			}
+			int gap = ValueRound((float)demand[i].phy_freq /
+					     (demand[i].freq * 10));
+			int target_count = cm_time_consume /
+				ValueRound((float)1000 / demand[i].freq);
+			for (; gap * count[i] + demand[i].raw_data_offset <
+			     NODE_FRAMES &&
+			     demand[i].match_data_count < target_count;
+			     count[i]++)
+				copy_to_delay_buf(&demand[i], buffer[i], gap,
+						  count[i]);
+			if (gap * count[i] + demand[i].raw_data_offset >=
+			    NODE_FRAMES) {
+				demand[i].raw_data_offset = gap - (NODE_FRAMES -
+					(gap * (count[i] - 1) +
+					 demand[i].raw_data_offset));
+				done[i] = 1;
+			}
+		}
+		if (defect > 0)
+			break;
+		legacy_handle_match(feed);
+	}
+}
+
+/* CompileFeedPlan() */
+static void compile_plan(struct feed *feed)
+{
+	struct demand *demand = feed->demand;
+	uint32_t cm_time_consume = 1;
+	uint16_t match_cm_time_consume = 1;
+	uint16_t cm_multi_freq = 1;
+	int i;
+
+	for (i = 0; i < feed->demand_length; i++) {
+		demand[i].si = IntDivRound(1000, demand[i].freq);
+		cm_time_consume = GetCommonMultiple(cm_time_consume,
+						    demand[i].si);
+		if ((demand[i].flag & IGNORE) == 0)
+			match_cm_time_consume = GetCommonMultiple(
+				match_cm_time_consume, demand[i].si);
+		cm_multi_freq = GetCommonMultiple(cm_multi_freq, demand[i].freq);
+	}
+	feed->vernier_length = 0;
+	for (i = 0; i < feed->demand_length; i++) {
+		demand[i].gap = IntDivRound(demand[i].phy_freq,
+					    demand[i].freq * 10);
+		demand[i].target_count = cm_time_consume / demand[i].si;
+		demand[i].match_count = match_cm_time_consume / demand[i].si;
+		demand[i].scale = cm_multi_freq / demand[i].freq;
+		if (feed->vernier_length <
+		    demand[i].match_count * demand[i].scale)
+			feed->vernier_length =
+				demand[i].match_count * demand[i].scale;
+	}
+}
+
+/* HandleMatchBufferData() with the resampling plan */
+static void plan_handle_match(struct feed *feed)
+{
+	struct demand *demand = feed->demand;
+	int demand_length = feed->demand_length;
+	uint8_t match_times = 0;
+	uint8_t tick[MAX_DEMANDS] = { 0 };
+	int i, v;
+
+	for (i = 0; i < demand_length; i++) {
+		if ((demand[i].flag & IGNORE) != 0)
+			continue;
+		if (demand[i].match_data_count < demand[i].match_count)
+			return;
+		int temp = demand[i].match_data_count / demand[i].match_count;
+		if (match_times == 0 || temp < match_times)
+			match_times = temp;
+	}
+
+	int vernier_length = match_times * feed->vernier_length;
+
+	for (v = 0; v < vernier_length; v++) {
+		int *ptr[MAX_DEMANDS] = { NULL };
+		int act = 0;
+		for (i = 0; i < demand_length; i++) {
+			if (demand[i].scale == 0)
+				continue;
+			if (tick[i] == 0) {
+				tick[i] = demand[i].scale;
+				if (demand[i].get_idx != demand[i].put_idx) {
+					ptr[i] = take_sample(&demand[i]);
+					act++;
+				}
+			}
+			tick[i]--;
+		}
+		if (act != 0)
+			exec(feed, ptr);
+	}
+}
+
+/* FeedSensDataAfterMatch(SYNC) with the resampling plan */
+static void plan_feed(struct feed *feed, const int *buffer[])
+{
+	struct demand *demand = feed->demand;
+	int count[MAX_DEMANDS] = { 0 };
+	int done[MAX_DEMANDS] = { 0 };
+	int i;
+
+	while (1) {
+		int defect = 0;
+		for (i = 0; i < feed->demand_length; i++) {
+			if (done[i]) {
+				defect++;
+				continue;
+			}
+			int gap = demand[i].gap;
+			int target_count = demand[i].target_count;
+			for (; gap * count[i] + demand[i].raw_data_offset <
+			     NODE_FRAMES &&
+			     demand[i].match_data_count < target_count;
+			     count[i]++)
+				copy_to_delay_buf(&demand[i], buffer[i], gap,
+						  count[i]);
+			if (gap * count[i] + demand[i].raw_data_offset >=
+			    NODE_FRAMES) {
+				demand[i].raw_data_offset = gap - (NODE_FRAMES -
+					(gap * (count[i] - 1) +
+					 demand[i].raw_data_offset));
+				done[i] = 1;
+			}
+		}
+		if (defect > 0)
+			break;
+		plan_handle_match(feed);
+	}
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void setup(struct feed *feed, const int *freqs, const int *phy_freqs,
+		  int demand_length)
+{
+	int i;
+
+	memset(feed, 0, sizeof(*feed));
+	feed->demand_length = demand_length;
+	for (i = 0; i < demand_length; i++) {
+		feed->demand[i].freq = freqs[i];
+		feed->demand[i].phy_freq = phy_freqs[i];
+	}
+}
+
+/* Replay ROUNDS raw data nodes of every demand, return ns per raw sample */
+static double replay(struct feed *feed, int use_plan)
+{
+	static int raw[MAX_DEMANDS][NODE_FRAMES];
+	const int *buffer[MAX_DEMANDS];
+	uint64_t t;
+	int r, i, j;
+
+	for (i = 0; i < feed->demand_length; i++)
+		buffer[i] = raw[i];
+	if (use_plan)
+		compile_plan(feed);
+
+	t = now_ns();
+	for (r = 0; r < ROUNDS; r++) {
+		for (i = 0; i < feed->demand_length; i++)
+			for (j = 0; j < NODE_FRAMES; j++)
+				raw[i][j] = r * NODE_FRAMES + j + i * 1000;
+		if (use_plan)
+			plan_feed(feed, buffer);
+		else
+			legacy_feed(feed, buffer);
+	}
+	t = now_ns() - t;
+	return (double)t / ((double)ROUNDS * NODE_FRAMES * feed->demand_length);
+}
+
+static void bench(const char *name, const int *freqs, const int *phy_freqs,
+		  int demand_length)
+{
+	struct feed legacy, plan;
+	double legacy_ns, plan_ns;
+
+	setup(&legacy, freqs, phy_freqs, demand_length);
+	setup(&plan, freqs, phy_freqs, demand_length);
+	legacy_ns = replay(&legacy, 0);
+	plan_ns = replay(&plan, 1);
+
+	/* the algorithm must have been fed the same samples */
+	assert(legacy.exec_count == plan.exec_count);
+	assert(legacy.checksum == plan.checksum);
+
+	printf("%-24s | %7u exec | legacy %6.1f ns/sample"
+	       " | plan %6.1f ns/sample\n",
+	       name, legacy.exec_count, legacy_ns, plan_ns);
+}
+
+int main(int argc, char **argv)
+{
+	static const int ag_freqs[] = { 100, 50 };
+	static const int ag_phy[] = { 2000, 1000 };
+	static const int agm_freqs[] = { 100, 50, 25 };
+	static const int agm_phy[] = { 1000, 1000, 250 };
+	static const int mix_freqs[] = { 50, 20, 10, 5 };
+	static const int mix_phy[] = { 1000, 1000, 200, 100 };
+
+	bench("accel 100 + gyro 50", ag_freqs, ag_phy, 2);
+	bench("accel/gyro/mag", agm_freqs, agm_phy, 3);
+	bench("4 demands 50/20/10/5", mix_freqs, mix_phy, 4);
+	return 0;
+}
@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) 2016, Intel Corporation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ *****************************************************************************
+ * Host benchmark of the message passing of the Linux OS abstraction layer.
+ * Measures the throughput of producer tasks sending to a consumer task
+ * through a bounded queue, and the round trip latency of a ping-pong between
+ * two tasks.
+ *
+ * Compile with:
+ * gcc -O2 -pthread -I../../bsp/include os_linux_queue_bench.c \
+ *     ../../bsp/src/os/linux/os_linux.c ../../bsp/src/util/timer_wheel.c \
+ *     -o os_linux_queue_bench
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <assert.h>
+
+#include "os/os.h"
+#include "os/os_linux.h"
+
+#define QUEUE_SIZE 64
+#define MESSAGES 1000000
+#define MAX_PRODUCERS 8
+#define ROUND_TRIPS 100000
+
+static T_QUEUE queue;
+static T_QUEUE reply;
+
+void log_printk(uint8_t level, const char *module, const char *format, ...)
+{
+	va_list args;
+
+	va_start(args, format);
+	vfprintf(stderr, format, args);
+	va_end(args);
+	fputc('\n', stderr);
+}
+
+static void send_blocking(T_QUEUE q, void *msg)
+{
+	OS_ERR_TYPE err;
+
+	/* Like the framework, retry when the queue is full */
+	for (;;) {
+		queue_send_message(q, msg, &err);
+		if (err != E_OS_ERR_OVERFLOW)
+			break;
+		local_task_sleep_ms(0);
+	}
+	assert(err == E_OS_OK);
+}
+
+static void producer(void *param)
+{
+	uintptr_t count = (uintptr_t)param;
+	uintptr_t i;
+
+	for (i = 1; i <= count; i++)
+		send_blocking(queue, (void *)i);
+}
+
+static void consumer(void *param)
+{
+	uintptr_t count = (uintptr_t)param;
+	T_QUEUE_MESSAGE msg;
+	OS_ERR_TYPE err;
+
+	while (count--) {
+		queue_get_message(queue, &msg, OS_WAIT_FOREVER, &err);
+		assert(err == E_OS_OK && msg != NULL);
+	}
+}
+
+static void ponger(void *param)
+{
+	T_QUEUE_MESSAGE msg;
+	OS_ERR_TYPE err;
+	int i;
+
+	for (i = 0; i < ROUND_TRIPS; i++) {
+		queue_get_message(queue, &msg, OS_WAIT_FOREVER, &err);
+		assert(err == E_OS_OK);
+		send_blocking(reply, msg);
+	}
+}
+
+static void bench_throughput(int producers)
+{
+	T_TASK tasks[MAX_PRODUCERS + 1];
+	uintptr_t per_producer = MESSAGES / producers;
+	uint64_t t;
+	int i;
+
+	t = get_time_us();
+	tasks[0] = task_create(consumer, (void *)(per_producer * producers),
+			       NULL);
+	for (i = 1; i <= producers; i++)
+		tasks[i] = task_create(producer, (void *)per_producer, NULL);
+	for (i = 0; i <= producers; i++)
+		task_join(tasks[i]);
+	t = get_time_us() - t;
+
+	printf("%d producer(s) -> 1 consumer: %8llu msg/s\n", producers,
+	       (unsigned long long)(per_producer * producers * 1000000ULL /
+				    (t ? t : 1)));
+}
+
+static void bench_round_trip(void)
+{
+	T_QUEUE_MESSAGE msg;
+	OS_ERR_TYPE err;
+	T_TASK task;
+	uint64_t t;
+	int i;
+
+	task = task_create(ponger, NULL, NULL);
+	t = get_time_us();
+	for (i = 0; i < ROUND_TRIPS; i++) {
+		send_blocking(queue, (void *)1);
+		queue_get_message(reply, &msg, OS_WAIT_FOREVER, &err);
+		assert(err == E_OS_OK);
+	}
+	t = get_time_us() - t;
+	task_join(task);
+
+	printf("ping-pong round trip:      %8llu ns\n",
+	       (unsigned long long)(t * 1000 / ROUND_TRIPS));
+}
+
+static void check_timeouts(void)
+{
+	T_QUEUE_MESSAGE msg;
+	OS_ERR_TYPE err;
+	uint32_t t;
+
+	queue_get_message(queue, &msg, OS_NO_WAIT, &err);
+	assert(err == E_OS_ERR_EMPTY);
+
+	t = get_time_ms();
+	queue_get_message(queue, &msg, 20, &err);
+	assert(err == E_OS_ERR_TIMEOUT);
+	assert(get_time_ms() - t >= 20);
+}
+
+int main(int argc, char **argv)
+{
+	static const int producers[] = { 1, 2, 4, MAX_PRODUCERS };
+	unsigned int i;
+
+	os_init();
+	queue = queue_create(QUEUE_SIZE);
+	reply = queue_create(QUEUE_SIZE);
+	assert(queue != NULL && reply != NULL);
+
+	check_timeouts();
+	for (i = 0; i < sizeof(producers) / sizeof(producers[0]); i++)
+		bench_throughput(producers[i]);
+	bench_round_trip();
+
+	queue_delete(queue);
+	queue_delete(reply);
+	return 0;
+}
@@ -0,0 +1,395 @@
+/*
+ * Copyright (c) 2016, Intel Corporation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+
+ *****************************************************************************
+ * Host test of the SPI flash driver on a bus-level simulator of a Macronix
+ * MX25U1635E. The serial bus access requests are decoded as flash commands
+ * on a RAM array: the simulator counts the bus transactions and bytes, keeps
+ * the write-in-progress bit set for a few status reads after a page program
+ * and flags any command the flash would ignore (command in deep power-down,
+ * page program without write enable or while busy).
+ *
+ * Reads and writes of 64 KB in small calls are measured with and without a
+ * spi_flash_session_begin()/spi_flash_session_end() pair around the batch,
+ * and the flash content is checked against a reference copy. A scan of
+ * small headers, as done by the storages to find their free space, is
+ * measured as well.
+ *
+ * Add -DCONFIG_SPI_FLASH_FAST_READ to the command line to read with the
+ * fast read command, and -DCONFIG_SPI_FLASH_CACHE
+ * -DCONFIG_SPI_FLASH_CACHE_LINES=8 -DCONFIG_SPI_FLASH_CACHE_LINE_SIZE=64 to
+ * read through the cache, which is then checked after writes and erases.
+ *
+ * Compile with:
+ * gcc -O2 -pthread -DCONFIG_OS_LINUX -DCONFIG_SPI_FLASH_MX25U1635E \
+ *     -I../../bsp/include -I../../bsp/src/drivers/mtd spi_flash_sim_test.c \
+ *     ../../bsp/src/drivers/mtd/spi_flash.c \
+ *     ../../bsp/src/drivers/mtd/spi_flash_mx25.c \
+ *     ../../bsp/src/util/flash_cache.c \
+ *     ../../bsp/src/os/linux/os_linux.c ../../bsp/src/util/timer_wheel.c \
+ *     -o spi_flash_sim_test
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "os/os.h"
+#include "infra/pm.h"
+#include "drivers/spi_flash.h"
+#include "drivers/serial_bus_access.h"
+#include "spi_flash_internal.h"
+#include "spi_flash_mx25.h"
+
+#define SIM_SIZE 0x200000
+#define SIM_RDID 0x003525c2
+#define PROGRAM_POLLS 3
+#define TEST_LEN 0x10000
+
+extern const struct spi_flash_driver spi_flash_mx25u1635e_driver;
+
+static struct {
+	uint8_t mem[SIM_SIZE];
+	bool deep_powerdown;
+	bool wel;
+	int busy_polls;
+	uint32_t transactions;
+	uint32_t bytes;
+	uint32_t violations;
+} sim;
+
+static uint8_t reference[SIM_SIZE];
+static int wakelocks;
+
+static uint32_t sim_address(const uint8_t *tx)
+{
+	return (tx[1] << 16) | (tx[2] << 8) | tx[3];
+}
+
+static void sim_command(struct sba_request *req)
+{
+	const uint8_t *tx = req->tx_buff;
+	uint32_t address, i;
+
+	if (sim.deep_powerdown && tx[0] != FLASH_CMD_RDP) {
+		sim.violations++;
+		return;
+	}
+	if (sim.busy_polls && tx[0] != FLASH_CMD_RDSR &&
+	    tx[0] != FLASH_CMD_RDSCUR) {
+		sim.violations++;
+		return;
+	}
+
+	switch (tx[0]) {
+	case FLASH_CMD_RDP:
+		sim.deep_powerdown = false;
+		break;
+	case FLASH_CMD_DP:
+		sim.deep_powerdown = true;
+		break;
+	case FLASH_CMD_RDID:
+		req->rx_buff[0] = SIM_RDID & 0xff;
+		req->rx_buff[1] = (SIM_RDID >> 8) & 0xff;
+		req->rx_buff[2] = SIM_RDID >> 16;
+		break;
+	case FLASH_CMD_RDSR:
+		req->rx_buff[0] = (sim.busy_polls ? FLASH_WIP_BIT : 0) |
+				  (sim.wel ? FLASH_WEL_BIT : 0);
+		if (sim.busy_polls)
+			sim.busy_polls--;
+		break;
+	case FLASH_CMD_RDSCUR:
+		req->rx_buff[0] = 0;
+		break;
+	case FLASH_CMD_WREN:
+		sim.wel = true;
+		break;
+	case FLASH_CMD_PP:
+		if (!sim.wel) {
+			sim.violations++;
+			break;
+		}
+		/* The address wraps within the page */
+		address = sim_address(tx);
+		for (i = 0; i < req->tx_len - 4; i++)
+			sim.mem[(address & ~(FLASH_PAGE_SIZE - 1)) |
+				((address + i) & (FLASH_PAGE_SIZE - 1))] &= tx[4 + i];
+		sim.wel = false;
+		sim.busy_polls = PROGRAM_POLLS;
+		break;
+	case FLASH_CMD_SE:
+		if (!sim.wel) {
+			sim.violations++;
+			break;
+		}
+		address = sim_address(tx) & ~(FLASH_SECTOR_SIZE - 1);
+		memset(&sim.mem[address], 0xff, FLASH_SECTOR_SIZE);
+		sim.wel = false;
+		sim.busy_polls = PROGRAM_POLLS;
+		break;
+	case FLASH_CMD_READ:
+	case FLASH_CMD_FASTREAD:
+		address = sim_address(tx);
+		if (req->tx_len != (tx[0] == FLASH_CMD_READ ? 4 : 5)) {
+			sim.violations++;
+			break;
+		}
+		for (i = 0; i < req->rx_len; i++)
+			req->rx_buff[i] = sim.mem[(address + i) % SIM_SIZE];
+		break;
+	default:
+		sim.violations++;
+	}
+}
+
+DRIVER_API_RC sba_exec_dev_request(struct sba_device *dev,
+				   struct sba_request *req)
+{
+	sim.transactions++;
+	sim.bytes += req->tx_len + req->rx_len;
+	sim_command(req);
+	req->status = DRV_RC_OK;
+	req->callback(req);
+	return DRV_RC_OK;
+}
+
+void pm_wakelock_init(struct pm_wakelock *wl)
+{
+}
+
+int pm_wakelock_acquire(struct pm_wakelock *wl)
+{
+	wakelocks++;
+	return 0;
+}
+
+int pm_wakelock_release(struct pm_wakelock *wl)
+{
+	wakelocks--;
+	return 0;
+}
+
+void log_printk(uint8_t level, const char *module_short_name,
+		const char *format, ...)
+{
+	va_list args;
+
+	va_start(args, format);
+	vfprintf(stderr, format, args);
+	va_end(args);
+	fputc('\n', stderr);
+}
+
+static struct sba_device flash = {
+	.dev.driver = (struct driver *)&spi_flash_mx25u1635e_driver,
+};
+
+static void reset_stats(void)
+{
+	sim.transactions = 0;
+	sim.bytes = 0;
+}
+
+static void report(const char *name, bool session)
+{
+	printf("%-24s %-11s %7.1f transactions/KB %8.1f bytes/KB\n", name,
+	       session ? "session" : "no session",
+	       sim.transactions * 1024.0 / TEST_LEN,
+	       sim.bytes * 1024.0 / TEST_LEN);
+}
+
+/* Write TEST_LEN bytes at address in calls of at most chunk bytes */
+static void write_test(uint32_t address, uint32_t chunk, bool session)
+{
+	uint32_t done, len;
+	unsigned int retlen;
+	char name[32];
+
+	for (done = 0; done < TEST_LEN; done++)
+		reference[address + done] = rand();
+	reset_stats();
+	if (session)
+		assert(spi_flash_session_begin(&flash.dev) == DRV_RC_OK);
+	for (done = 0; done < TEST_LEN; done += len) {
+		len = TEST_LEN - done < chunk ? TEST_LEN - done : chunk;
+		assert(spi_flash_write_byte(&flash.dev, address + done, len,
+					    &retlen,
+					    &reference[address + done]) ==
+		       DRV_RC_OK);
+		assert(retlen == len);
+		assert(sim.deep_powerdown == !session);
+	}
+	if (session)
+		assert(spi_flash_session_end(&flash.dev) == DRV_RC_OK);
+	assert(sim.deep_powerdown);
+	snprintf(name, sizeof(name), "write by %u bytes", chunk);
+	report(name, session);
+}
+
+/* Read TEST_LEN bytes at address in calls of chunk bytes and check them */
+static void read_test(uint32_t address, uint32_t chunk, bool session)
+{
+	static uint8_t buf[TEST_LEN];
+	unsigned int retlen;
+	uint32_t done;
+	char name[32];
+
+	memset(buf, 0, sizeof(buf));
+	reset_stats();
+	if (session)
+		assert(spi_flash_session_begin(&flash.dev) == DRV_RC_OK);
+	for (done = 0; done < TEST_LEN; done += chunk) {
+		assert(spi_flash_read_byte(&flash.dev, address + done, chunk,
+					   &retlen, &buf[done]) == DRV_RC_OK);
+		assert(retlen == chunk);
+	}
+	if (session)
+		assert(spi_flash_session_end(&flash.dev) == DRV_RC_OK);
+	assert(sim.deep_powerdown);
+	assert(memcmp(buf, &reference[address], TEST_LEN) == 0);
+	snprintf(name, sizeof(name), "read by %u bytes", chunk);
+	report(name, session);
+}
+
+/* Read the 8 bytes header of entries of 24 bytes, 4 times over 16 KB */
+static void scan_test(uint32_t address)
+{
+	uint8_t header[8];
+	unsigned int retlen;
+	uint32_t offset;
+	int pass;
+
+	reset_stats();
+	for (pass = 0; pass < 4; pass++) {
+		for (offset = 0; offset + sizeof(header) <= 0x4000;
+		     offset += 24) {
+			assert(spi_flash_read_byte(&flash.dev, address + offset,
+						   sizeof(header), &retlen,
+						   header) == DRV_RC_OK);
+			assert(memcmp(header, &reference[address + offset],
+				      sizeof(header)) == 0);
+		}
+	}
+	printf("%-24s %-11s %7u transactions %13u bytes\n",
+	       "scan of 8 bytes headers", "4 passes", sim.transactions,
+	       sim.bytes);
+}
+
+#ifdef CONFIG_SPI_FLASH_CACHE
+/* The cached lines must follow the writes and erases */
+static void cache_test(void)
+{
+	struct flash_cache_stats stats;
+	uint8_t buf[16], data[16];
+	unsigned int retlen;
+
+	memset(data, 0x5a, sizeof(data));
+	/* Cache the line, then program it */
+	assert(spi_flash_sector_erase(&flash.dev, 8, 1) == DRV_RC_OK);
+	assert(spi_flash_read_byte(&flash.dev, 8 * FLASH_SECTOR_SIZE,
+				   sizeof(buf), &retlen, buf) == DRV_RC_OK);
+	assert(buf[0] == 0xff);
+	assert(spi_flash_write_byte(&flash.dev, 8 * FLASH_SECTOR_SIZE + 4,
+				    sizeof(data), &retlen, data) == DRV_RC_OK);
+	assert(spi_flash_read_byte(&flash.dev, 8 * FLASH_SECTOR_SIZE,
+				   sizeof(buf), &retlen, buf) == DRV_RC_OK);
+	assert(buf[3] == 0xff && buf[4] == 0x5a && buf[15] == 0x5a);
+	/* And erase it again */
+	assert(spi_flash_sector_erase(&flash.dev, 8, 1) == DRV_RC_OK);
+	assert(spi_flash_read_byte(&flash.dev, 8 * FLASH_SECTOR_SIZE,
+				   sizeof(buf), &retlen, buf) == DRV_RC_OK);
+	assert(buf[4] == 0xff);
+
+	assert(spi_flash_get_cache_stats(&flash.dev, &stats) == DRV_RC_OK);
+	printf("cache: %u hits, %u misses, %u bypasses, %u bytes saved, "
+	       "%u bytes filled, %d net bytes saved, %u invalidations\n",
+	       stats.hits, stats.misses, stats.bypasses, stats.bytes_saved,
+	       stats.bytes_filled, stats.net_bytes_saved, stats.invalidations);
+}
+#endif
+
+int main(int argc, char **argv)
+{
+	unsigned int retlen;
+	uint8_t byte;
+	uint32_t rdid;
+
+	os_init();
+	memset(sim.mem, 0xff, sizeof(sim.mem));
+	memset(reference, 0xff, sizeof(reference));
+	sim.deep_powerdown = true;
+
+	assert(spi_flash_init(&flash.dev) == 0);
+	assert(spi_flash_get_rdid(&flash.dev, &rdid) == DRV_RC_OK);
+	assert(rdid == SIM_RDID);
+	/* Unbalanced session end */
+	assert(spi_flash_session_end(&flash.dev) == DRV_RC_INVALID_OPERATION);
+
+	write_test(0, 256, false);
+	write_test(TEST_LEN, 256, true);
+	/* Unaligned writes cross the pages */
+	write_test(2 * TEST_LEN, 100, false);
+	write_test(3 * TEST_LEN, 100, true);
+
+	read_test(0, 32, false);
+	read_test(0, 32, true);
+	read_test(2 * TEST_LEN, 256, false);
+	read_test(2 * TEST_LEN, 256, true);
+	read_test(3 * TEST_LEN, 4096, false);
+	read_test(3 * TEST_LEN, 4096, true);
+
+	scan_test(0);
+#ifdef CONFIG_SPI_FLASH_CACHE
+	cache_test();
+#endif
+
+	/* Nested sessions and erase within a session */
+	assert(spi_flash_session_begin(&flash.dev) == DRV_RC_OK);
+	assert(spi_flash_session_begin(&flash.dev) == DRV_RC_OK);
+	assert(spi_flash_sector_erase(&flash.dev, 0, 1) == DRV_RC_OK);
+	assert(spi_flash_session_end(&flash.dev) == DRV_RC_OK);
+	assert(!sim.deep_powerdown);
+	assert(spi_flash_read_byte(&flash.dev, FLASH_SECTOR_SIZE - 1, 1,
+				   &retlen, &byte) == DRV_RC_OK);
+	assert(byte == 0xff);
+	assert(spi_flash_read_byte(&flash.dev, FLASH_SECTOR_SIZE, 1,
+				   &retlen, &byte) == DRV_RC_OK);
+	assert(byte == reference[FLASH_SECTOR_SIZE]);
+	assert(spi_flash_session_end(&flash.dev) == DRV_RC_OK);
+	assert(sim.deep_powerdown);
+
+	assert(sim.violations == 0);
+	assert(wakelocks == 0);
+	printf("flash content and power states checked, no ignored command\n");
+	return 0;
+}